@@ -23,7 +23,9 @@
 #include "revision.h"
 #include "object-store-ll.h"
 #include "setup.h"
+#include "strmap.h"
 #include "thread-utils.h"
+#include "trace2.h"
 #include "tree-walk.h"
 #include "object-name.h"
 
@@ -504,6 +506,157 @@ static void drop_attr_stack(struct attr_stack **stack)
 	}
 }
 
+/*
+ * Results of fill() are remembered per attr_check, so that paths which
+ * are bound to match the same patterns are only resolved once.  When
+ * no pattern containing a slash can apply to a path, its attributes
+ * depend only on its basename (e.g. every "Makefile" or "*.c" in
+ * directories without their own .gitattributes), which is what makes
+ * the cache worthwhile.  The cache is only valid for the set of
+ * non-empty frames on the stack it was filled from, and is emptied
+ * whenever prepare_attr_stack() adds or drops one of them.
+ */
+#define ATTR_CACHE_MAX_ENTRIES 65536
+
+struct attr_cache {
+	struct strmap results;
+	int prepared;
+	/*
+	 * Set when a pattern with a slash in it can apply to any path,
+	 * e.g. one starting with a wildcard in the top-level
+	 * .gitattributes, so that no path can be looked up by its
+	 * basename.
+	 */
+	int disabled;
+	/*
+	 * Literal leading part of every pattern with a slash in it,
+	 * including the directory of the .gitattributes file it came
+	 * from; paths outside of all of them use the basename as key.
+	 */
+	char **prefixes;
+	size_t prefixes_nr, prefixes_alloc;
+};
+
+struct attr_cache_entry {
+	int nr;
+	const char *values[FLEX_ARRAY];
+};
+
+static void attr_cache_clear(struct attr_cache *cache)
+{
+	size_t i;
+
+	if (!cache)
+		return;
+	strmap_clear(&cache->results, 1);
+	strmap_init(&cache->results);
+	for (i = 0; i < cache->prefixes_nr; i++)
+		free(cache->prefixes[i]);
+	cache->prefixes_nr = 0;
+	cache->prepared = 0;
+	cache->disabled = 0;
+}
+
+static void attr_cache_free(struct attr_cache *cache)
+{
+	if (!cache)
+		return;
+	attr_cache_clear(cache);
+	strmap_clear(&cache->results, 1);
+	free(cache->prefixes);
+	free(cache);
+}
+
+static void attr_cache_prepare(struct attr_cache *cache,
+			       const struct attr_stack *stack)
+{
+	struct strbuf sb = STRBUF_INIT;
+
+	for (; stack; stack = stack->prev) {
+		unsigned i;
+
+		for (i = 0; i < stack->num_matches; i++) {
+			const struct match_attr *a = stack->attrs[i];
+			const char *pattern;
+			int prefix;
+
+			if (a->is_macro || (a->u.pat.flags & PATTERN_FLAG_NODIR))
+				continue;
+			pattern = a->u.pat.pattern;
+			prefix = a->u.pat.nowildcardlen;
+			if (*pattern == '/') {
+				pattern++;
+				prefix--;
+			}
+			strbuf_reset(&sb);
+			if (stack->originlen)
+				strbuf_addf(&sb, "%s/", stack->origin);
+			strbuf_add(&sb, pattern, prefix);
+			if (!sb.len)
+				cache->disabled = 1;
+			ALLOC_GROW(cache->prefixes, cache->prefixes_nr + 1,
+				   cache->prefixes_alloc);
+			cache->prefixes[cache->prefixes_nr++] = strbuf_detach(&sb, NULL);
+		}
+	}
+	cache->prepared = 1;
+}
+
+/*
+ * Return the key 'path' is cached under, which is its basename, or NULL
+ * if a pattern with a slash may match it. A path that is not shared
+ * with its siblings gains nothing from the cache, so it is not cached.
+ */
+static const char *attr_cache_key(struct attr_cache *cache,
+				  const struct attr_stack *stack,
+				  const char *path, int basename_offset)
+{
+	size_t i;
+
+	if (!cache->prepared)
+		attr_cache_prepare(cache, stack);
+	if (cache->disabled)
+		return NULL;
+
+	for (i = 0; i < cache->prefixes_nr; i++) {
+		const char *prefix = cache->prefixes[i];
+		if (!fspathncmp(path, prefix, strlen(prefix)))
+			return NULL;
+	}
+	return path + basename_offset;
+}
+
+static int attr_cache_lookup(struct attr_check *check, const char *key)
+{
+	struct attr_cache_entry *e = strmap_get(&check->cache->results, key);
+	int i;
+
+	if (!e || e->nr != check->all_attrs_nr)
+		return 0;
+	for (i = 0; i < e->nr; i++)
+		check->all_attrs[i].value = e->values[i];
+	return 1;
+}
+
+static void attr_cache_store(struct attr_check *check, const char *key)
+{
+	struct attr_cache *cache = check->cache;
+	struct attr_cache_entry *e;
+	int i;
+
+	if (strmap_get_size(&cache->results) >= ATTR_CACHE_MAX_ENTRIES) {
+		strmap_clear(&cache->results, 1);
+		strmap_init(&cache->results);
+	}
+
+	e = xmalloc(st_add(sizeof(*e),
+			   st_mult(sizeof(*e->values), check->all_attrs_nr)));
+	e->nr = check->all_attrs_nr;
+	for (i = 0; i < e->nr; i++)
+		e->values[i] = check->all_attrs[i].value;
+	free(strmap_put(&cache->results, key, e));
+}
+
 /* List of all attr_check structs; access should be surrounded by mutex */
 static struct check_vector {
 	size_t nr;
@@ -566,6 +719,7 @@ static void drop_all_attr_stacks(void)
 
 	for (i = 0; i < check_vector.nr; i++) {
 		drop_attr_stack(&check_vector.checks[i]->stack);
+		attr_cache_clear(check_vector.checks[i]->cache);
 	}
 
 	vector_unlock();
@@ -657,6 +811,8 @@ void attr_check_clear(struct attr_check *check)
 	check->all_attrs_nr = 0;
 
 	drop_attr_stack(&check->stack);
+	attr_cache_free(check->cache);
+	check->cache = NULL;
 }
 
 void attr_check_free(struct attr_check *check)
@@ -981,13 +1137,18 @@ static void bootstrap_attr_stack(struct index_state *istate,
 	push_stack(stack, e, NULL, 0);
 }
 
-static void prepare_attr_stack(struct index_state *istate,
-			       const struct object_id *tree_oid,
-			       const char *path, int dirlen,
-			       struct attr_stack **stack)
+/*
+ * Returns non-zero when a frame with attributes in it was pushed onto or
+ * popped off the stack.
+ */
+static int prepare_attr_stack(struct index_state *istate,
+			      const struct object_id *tree_oid,
+			      const char *path, int dirlen,
+			      struct attr_stack **stack)
 {
 	struct attr_stack *info;
 	struct strbuf pathbuf = STRBUF_INIT;
+	int changed = 0;
 
 	/*
 	 * At the bottom of the attribute stack is the built-in
@@ -1029,6 +1190,8 @@ static void prepare_attr_stack(struct index_state *istate,
 			break;
 
 		*stack = elem->prev;
+		if (elem->num_matches)
+			changed = 1;
 		attr_stack_free(elem);
 	}
 
@@ -1066,6 +1229,8 @@ static void prepare_attr_stack(struct index_state *istate,
 
 		origin = xstrdup(pathbuf.buf);
 		push_stack(stack, next, origin, len);
+		if (next && next->num_matches)
+			changed = 1;
 	}
 
 	/*
@@ -1074,6 +1239,7 @@ static void prepare_attr_stack(struct index_state *istate,
 	push_stack(stack, info, NULL, 0);
 
 	strbuf_release(&pathbuf);
+	return changed;
 }
 
 static int path_matches(const char *pathname, int pathlen,
@@ -1185,6 +1351,7 @@ static void collect_some_attrs(struct index_state *istate,
 	int pathlen, rem, dirlen;
 	const char *cp, *last_slash = NULL;
 	int basename_offset;
+	const char *key;
 
 	for (cp = path; *cp; cp++) {
 		if (*cp == '/' && cp[1])
@@ -1199,12 +1366,27 @@ static void collect_some_attrs(struct index_state *istate,
 		dirlen = 0;
 	}
 
-	prepare_attr_stack(istate, tree_oid, path, dirlen, &check->stack);
+	if (!check->cache) {
+		CALLOC_ARRAY(check->cache, 1);
+		strmap_init(&check->cache->results);
+	}
+	if (prepare_attr_stack(istate, tree_oid, path, dirlen, &check->stack))
+		attr_cache_clear(check->cache);
 	all_attrs_init(&g_attr_hashmap, check);
+
+	key = attr_cache_key(check->cache, check->stack, path, basename_offset);
+	if (key && attr_cache_lookup(check, key)) {
+		trace2_counter_add(TRACE2_COUNTER_ID_ATTR_CACHE_HITS, 1);
+		return;
+	}
+	trace2_counter_add(TRACE2_COUNTER_ID_ATTR_CACHE_MISSES, 1);
+
 	determine_macros(check->all_attrs, check->stack);
 
 	rem = check->all_attrs_nr;
 	fill(path, pathlen, basename_offset, check->stack, check->all_attrs, rem);
+	if (key)
+		attr_cache_store(check, key);
 }
 
 static const char *default_attr_source_tree_object_name;
@@ -133,6 +133,7 @@ struct git_attr;
 /* opaque structures used internally for attribute collection */
 struct all_attrs_item;
 struct attr_stack;
+struct attr_cache;
 
 /*
  * The textual object name for the tree-ish used by git_check_attr()
@@ -187,6 +188,7 @@ struct attr_check {
 	int all_attrs_nr;
 	struct all_attrs_item *all_attrs;
 	struct attr_stack *stack;
+	struct attr_cache *cache;
 };
 
 struct attr_check *attr_check_alloc(void);
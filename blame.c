@@ -3,6 +3,9 @@
 #include "git-compat-util.h"
 #include "refs.h"
 #include "object-store-ll.h"
+#include "oid-array.h"
+#include "oidset.h"
+#include "promisor-remote.h"
 #include "cache-tree.h"
 #include "mergesort.h"
 #include "commit.h"
@@ -2576,6 +2579,60 @@ static void pass_blame(struct blame_scoreboard *sb, struct blame_origin *origin,
 		free(sg_origin);
 }
 
+#define BLAME_PREFETCH_AHEAD 32
+
+/*
+ * In a partial clone, passing blame to the parents of a commit needs
+ * their version of the file, which is fetched from the promisor remote
+ * one round trip at a time. Guess which versions will be needed next
+ * by following the first parents of the suspect, and fetch them in the
+ * background in batches of at least half the window, unless we are
+ * approaching the end of the history. "seen" remembers the commits
+ * that were already taken care of.
+ */
+static void prefetch_blame_ahead(struct blame_scoreboard *sb,
+				 struct blame_origin *suspect,
+				 struct oidset *seen)
+{
+	struct commit *ahead[BLAME_PREFETCH_AHEAD];
+	struct oid_array to_fetch = OID_ARRAY_INIT;
+	struct commit *commit;
+	int count = 0, nr = 0;
+
+	for (commit = suspect->commit;
+	     commit && count < BLAME_PREFETCH_AHEAD;
+	     commit = commit->parents ? commit->parents->item : NULL) {
+		if (commit->object.flags & UNINTERESTING ||
+		    repo_parse_commit(sb->repo, commit))
+			break;
+		count++;
+		if (!oidset_contains(seen, &commit->object.oid))
+			ahead[nr++] = commit;
+	}
+	if (!nr || (nr < BLAME_PREFETCH_AHEAD / 2 &&
+		    count == BLAME_PREFETCH_AHEAD))
+		return;
+
+	for (int i = 0; i < nr; i++) {
+		struct tree *tree = repo_get_commit_tree(sb->repo, ahead[i]);
+		struct object_id blob_oid;
+		unsigned short mode;
+
+		oidset_insert(seen, &ahead[i]->object.oid);
+		/* the fake commit of the working tree has no tree */
+		if (tree &&
+		    !get_tree_entry(sb->repo, &tree->object.oid,
+				    suspect->path, &blob_oid, &mode) &&
+		    S_ISREG(mode) &&
+		    oid_object_info_extended(sb->repo, &blob_oid, NULL,
+					     OBJECT_INFO_FOR_PREFETCH))
+			oid_array_append(&to_fetch, &blob_oid);
+	}
+
+	promisor_remote_prefetch(sb->repo, to_fetch.oid, to_fetch.nr);
+	oid_array_clear(&to_fetch);
+}
+
 /*
  * The main loop -- while we have blobs with lines whose true origin
  * is still unknown, pick one blob, and allow its lines to pass blames
@@ -2584,6 +2641,8 @@ void assign_blame(struct blame_scoreboard *sb, int opt)
 {
 	struct rev_info *revs = sb->revs;
 	struct commit *commit = prio_queue_get(&sb->commits);
+	struct oidset prefetched = OIDSET_INIT;
+	int prefetch = !sb->reverse && repo_has_promisor_remote(sb->repo);
 
 	while (commit) {
 		struct blame_entry *ent;
@@ -2608,9 +2667,11 @@ void assign_blame(struct blame_scoreboard *sb, int opt)
 		repo_parse_commit(the_repository, commit);
 		if (sb->reverse ||
 		    (!(commit->object.flags & UNINTERESTING) &&
-		     !(revs->max_age != -1 && commit->date < revs->max_age)))
+		     !(revs->max_age != -1 && commit->date < revs->max_age))) {
+			if (prefetch)
+				prefetch_blame_ahead(sb, suspect, &prefetched);
 			pass_blame(sb, suspect, opt);
-		else {
+		} else {
 			commit->object.flags |= UNINTERESTING;
 			if (commit->object.parsed)
 				mark_parents_uninteresting(sb->revs, commit);
@@ -2642,6 +2703,8 @@ void assign_blame(struct blame_scoreboard *sb, int opt)
 		if (sb->debug) /* sanity */
 			sanity_check_refcnt(sb);
 	}
+
+	oidset_clear(&prefetched);
 }
 
 /*
@@ -15,13 +15,16 @@
 #include "parse-options.h"
 #include "userdiff.h"
 #include "streaming.h"
+#include "strvec.h"
 #include "oid-array.h"
+#include "oidmap.h"
 #include "packfile.h"
 #include "object-file.h"
 #include "object-name.h"
 #include "object-store-ll.h"
 #include "replace-object.h"
 #include "promisor-remote.h"
+#include "remote.h"
 #include "mailmap.h"
 #include "write-or-die.h"
 
@@ -307,6 +310,13 @@ struct expand_data {
 	 * optimized out.
 	 */
 	unsigned skip_object_info : 1;
+
+	/*
+	 * This flag will be true if the requested batch format only needs
+	 * information that a promisor remote can tell us about objects
+	 * that are missing locally, see lookup_promisor_object_info().
+	 */
+	unsigned promisor_object_info : 1;
 };
 
 static int is_atom(const char *atom, const char *s, int slen)
@@ -452,6 +462,80 @@ static void print_default_format(struct strbuf *scratch, struct expand_data *dat
 		    (uintmax_t)data->size, opt->output_delim);
 }
 
+/*
+ * In a partial clone, "--batch-check" asks the promisor remote about the
+ * objects that are missing locally instead of fetching them. The answers
+ * are kept here, so that they can be requested in batches.
+ */
+struct promisor_info_entry {
+	struct oidmap_entry entry;
+	struct remote_object_info info;
+};
+
+static struct oidmap promisor_info = OIDMAP_INIT;
+static int promisor_info_unsupported;
+
+/*
+ * Asks the promisor remote about those of the given objects that are
+ * missing locally and that we do not know about yet.
+ */
+static void query_promisor_object_info(const struct object_id *oids, int nr)
+{
+	struct oid_array to_ask = OID_ARRAY_INIT;
+	struct remote_object_info *infos;
+
+	for (int i = 0; i < nr; i++) {
+		if (oidmap_get(&promisor_info, &oids[i]) ||
+		    !oid_object_info_extended(the_repository, &oids[i], NULL,
+					      OBJECT_INFO_FOR_PREFETCH))
+			continue;
+		oid_array_append(&to_ask, &oids[i]);
+	}
+	if (!to_ask.nr || promisor_info_unsupported)
+		goto out;
+
+	CALLOC_ARRAY(infos, to_ask.nr);
+	if (promisor_remote_get_object_info(the_repository, to_ask.oid,
+					    to_ask.nr, infos) < 0) {
+		promisor_info_unsupported = 1;
+	} else {
+		for (size_t i = 0; i < to_ask.nr; i++) {
+			struct promisor_info_entry *e = xcalloc(1, sizeof(*e));
+
+			oidcpy(&e->entry.oid, &to_ask.oid[i]);
+			e->info = infos[i];
+			oidmap_put(&promisor_info, e);
+		}
+	}
+	free(infos);
+out:
+	oid_array_clear(&to_ask);
+}
+
+/*
+ * Fills in the requested information about an object that is missing
+ * locally from what the promisor remote told us. Returns a negative value
+ * if it could not tell, in which case the object has to be fetched.
+ */
+static int lookup_promisor_object_info(struct expand_data *data)
+{
+	struct promisor_info_entry *e;
+
+	query_promisor_object_info(&data->oid, 1);
+	e = oidmap_get(&promisor_info, &data->oid);
+	if (!e || !e->info.found ||
+	    (data->info.disk_sizep && e->info.disk_size < 0))
+		return -1;
+
+	if (data->info.typep)
+		*data->info.typep = e->info.type;
+	if (data->info.sizep)
+		*data->info.sizep = e->info.size;
+	if (data->info.disk_sizep)
+		*data->info.disk_sizep = e->info.disk_size;
+	return 0;
+}
+
 /*
  * If "pack" is non-NULL, then "offset" is the byte offset within the pack from
  * which the object may be accessed (though note that we may also rely on
@@ -470,13 +554,26 @@ static void batch_object_write(const char *obj_name,
 		if (use_mailmap)
 			data->info.typep = &data->type;
 
-		if (pack)
+		if (pack) {
 			ret = packed_object_info(the_repository, pack, offset,
 						 &data->info);
-		else
+		} else if (data->promisor_object_info &&
+			   opt->batch_mode == BATCH_MODE_INFO) {
+			ret = oid_object_info_extended(the_repository,
+						       &data->oid, &data->info,
+						       OBJECT_INFO_LOOKUP_REPLACE |
+						       OBJECT_INFO_SKIP_FETCH_OBJECT);
+			if (ret < 0 && !lookup_promisor_object_info(data))
+				ret = 0;
+			else if (ret < 0)
+				ret = oid_object_info_extended(the_repository,
+							       &data->oid, &data->info,
+							       OBJECT_INFO_LOOKUP_REPLACE);
+		} else {
 			ret = oid_object_info_extended(the_repository,
 						       &data->oid, &data->info,
 						       OBJECT_INFO_LOOKUP_REPLACE);
+		}
 		if (ret < 0) {
 			printf("%s missing%c",
 			       obj_name ? obj_name : oid_to_hex(&data->oid), opt->output_delim);
@@ -516,15 +613,52 @@ static void batch_object_write(const char *obj_name,
 	}
 }
 
+static int batch_get_oid_flags(struct batch_options *opt)
+{
+	return GET_OID_HASH_ANY |
+		(opt->follow_symlinks ? GET_OID_FOLLOW_SYMLINKS : 0);
+}
+
+/*
+ * Resolves the given object names (splitting off the rest of the line
+ * if "split" is set) and asks the promisor remote about the missing
+ * objects among them at once, instead of one at a time when they are
+ * printed.
+ */
+static void query_promisor_object_names(struct batch_options *opt,
+					const char **names, size_t nr,
+					int split)
+{
+	struct oid_array oids = OID_ARRAY_INIT;
+	struct strbuf name = STRBUF_INIT;
+
+	for (size_t i = 0; i < nr; i++) {
+		struct object_context ctx = {0};
+		struct object_id oid;
+
+		strbuf_reset(&name);
+		strbuf_addstr(&name, names[i]);
+		if (split)
+			strbuf_setlen(&name, strcspn(name.buf, " \t"));
+		if (get_oid_with_context(the_repository, name.buf,
+					 batch_get_oid_flags(opt),
+					 &oid, &ctx) == FOUND && ctx.mode)
+			oid_array_append(&oids, &oid);
+		object_context_release(&ctx);
+	}
+	query_promisor_object_info(oids.oid, oids.nr);
+
+	strbuf_release(&name);
+	oid_array_clear(&oids);
+}
+
 static void batch_one_object(const char *obj_name,
 			     struct strbuf *scratch,
 			     struct batch_options *opt,
 			     struct expand_data *data)
 {
 	struct object_context ctx = {0};
-	int flags =
-		GET_OID_HASH_ANY |
-		(opt->follow_symlinks ? GET_OID_FOLLOW_SYMLINKS : 0);
+	int flags = batch_get_oid_flags(opt);
 	enum get_oid_result result;
 
 	result = get_oid_with_context(the_repository, obj_name,
@@ -678,6 +812,18 @@ static void dispatch_calls(struct batch_options *opt,
 	if (!opt->buffer_output)
 		die(_("flush is only for --buffer mode"));
 
+	if (data->promisor_object_info) {
+		const char **names;
+		size_t names_nr = 0;
+
+		ALLOC_ARRAY(names, nr);
+		for (i = 0; i < nr; i++)
+			if (cmd[i].fn == parse_cmd_info)
+				names[names_nr++] = cmd[i].line;
+		query_promisor_object_names(opt, names, names_nr, 0);
+		free(names);
+	}
+
 	for (i = 0; i < nr; i++)
 		cmd[i].fn(opt, cmd[i].line, output, data);
 
@@ -773,6 +919,60 @@ static void batch_objects_command(struct batch_options *opt,
 
 #define DEFAULT_FORMAT "%(objectname) %(objecttype) %(objectsize)"
 
+static void batch_one_line(char *line, struct strbuf *output,
+			   struct batch_options *opt,
+			   struct expand_data *data)
+{
+	if (data->split_on_whitespace) {
+		/*
+		 * Split at first whitespace, tying off the beginning
+		 * of the string and saving the remainder (or NULL) in
+		 * data.rest.
+		 */
+		char *p = strpbrk(line, " \t");
+		if (p) {
+			while (*p && strchr(" \t", *p))
+				*p++ = '\0';
+		}
+		data->rest = p;
+	}
+
+	batch_one_object(line, output, opt, data);
+}
+
+/*
+ * The number of input lines that are read ahead with --buffer to ask the
+ * promisor remote about the missing objects among them at once.
+ */
+#define PROMISOR_INFO_BATCH 4096
+
+static void batch_lines_with_promisor_info(struct batch_options *opt,
+					   struct strbuf *output,
+					   struct expand_data *data)
+{
+	struct strbuf input = STRBUF_INIT;
+	struct strvec lines = STRVEC_INIT;
+	int eof = 0;
+
+	while (!eof) {
+		while (lines.nr < PROMISOR_INFO_BATCH &&
+		       !(eof = strbuf_getdelim_strip_crlf(&input, stdin,
+							  opt->input_delim) == EOF))
+			strvec_push(&lines, input.buf);
+
+		query_promisor_object_names(opt, lines.v, lines.nr,
+					    data->split_on_whitespace);
+		for (size_t i = 0; i < lines.nr; i++) {
+			strbuf_reset(&input);
+			strbuf_addstr(&input, lines.v[i]);
+			batch_one_line(input.buf, output, opt, data);
+		}
+		strvec_clear(&lines);
+	}
+
+	strbuf_release(&input);
+}
+
 static int batch_objects(struct batch_options *opt)
 {
 	struct strbuf input = STRBUF_INIT;
@@ -856,32 +1056,33 @@ static int batch_objects(struct batch_options *opt)
 	save_warning = warn_on_object_refname_ambiguity;
 	warn_on_object_refname_ambiguity = 0;
 
+	/*
+	 * In a partial clone, ask the promisor remote about missing objects
+	 * instead of fetching them, unless we need more than their types
+	 * and sizes. With --buffer, ask about many objects at once.
+	 */
+	if (!data.info.delta_base_oid &&
+	    repo_has_promisor_remote(the_repository))
+		data.promisor_object_info = 1;
+
 	if (opt->batch_mode == BATCH_MODE_QUEUE_AND_DISPATCH) {
 		batch_objects_command(opt, &output, &data);
 		goto cleanup;
 	}
 
-	while (strbuf_getdelim_strip_crlf(&input, stdin, opt->input_delim) != EOF) {
-		if (data.split_on_whitespace) {
-			/*
-			 * Split at first whitespace, tying off the beginning
-			 * of the string and saving the remainder (or NULL) in
-			 * data.rest.
-			 */
-			char *p = strpbrk(input.buf, " \t");
-			if (p) {
-				while (*p && strchr(" \t", *p))
-					*p++ = '\0';
-			}
-			data.rest = p;
-		}
-
-		batch_one_object(input.buf, &output, opt, &data);
+	if (opt->buffer_output && data.promisor_object_info &&
+	    opt->batch_mode == BATCH_MODE_INFO) {
+		batch_lines_with_promisor_info(opt, &output, &data);
+		goto cleanup;
 	}
 
+	while (strbuf_getdelim_strip_crlf(&input, stdin, opt->input_delim) != EOF)
+		batch_one_line(input.buf, &output, opt, &data);
+
  cleanup:
 	strbuf_release(&input);
 	strbuf_release(&output);
+	oidmap_free(&promisor_info, 1);
 	warn_on_object_refname_ambiguity = save_warning;
 	return retval;
 }
@@ -1156,6 +1156,7 @@ static int store_updated_refs(struct display_state *display_state,
 		struct check_connected_options opt = CHECK_CONNECTED_INIT;
 
 		opt.exclude_hidden_refs_section = "fetch";
+		opt.use_bitmaps = 1;
 		rm = ref_map;
 		if (check_connected(iterate_ref_map, &rm, &opt)) {
 			rc = error(_("%s did not send all necessary objects"),
@@ -1334,6 +1335,7 @@ static int check_exist_and_connected(struct ref *ref_map)
 
 	opt.quiet = 1;
 	opt.exclude_hidden_refs_section = "fetch";
+	opt.use_bitmaps = 1;
 	return check_connected(iterate_ref_map, &rm, &opt);
 }
 
@@ -24,13 +24,17 @@
 #include "strvec.h"
 #include "commit.h"
 #include "commit-graph.h"
+#include "commit-reach.h"
 #include "packfile.h"
 #include "object-file.h"
 #include "object-store-ll.h"
+#include "oidset.h"
 #include "pack.h"
 #include "pack-objects.h"
 #include "path.h"
 #include "blob.h"
+#include "bundle.h"
+#include "bundle-uri.h"
 #include "tree.h"
 #include "promisor-remote.h"
 #include "refs.h"
@@ -1336,6 +1340,442 @@ static int maintenance_task_incremental_repack(struct maintenance_run_opts *opts
 	return 0;
 }
 
+struct generated_bundle {
+	char *path;
+	uint64_t token;
+	off_t size;
+};
+
+static int compare_generated_bundles(const void *va, const void *vb)
+{
+	const struct generated_bundle *a = va, *b = vb;
+
+	if (a->token < b->token)
+		return -1;
+	return a->token > b->token;
+}
+
+struct generated_bundles {
+	struct generated_bundle *items;
+	size_t nr, alloc;
+};
+
+static int collect_generated_bundle(struct remote_bundle_info *info, void *data)
+{
+	struct generated_bundles *bundles = data;
+	struct generated_bundle *b;
+	struct stat st;
+
+	if (!info->uri || stat(info->uri, &st))
+		return -1;
+
+	ALLOC_GROW(bundles->items, bundles->nr + 1, bundles->alloc);
+	b = &bundles->items[bundles->nr++];
+	b->path = xstrdup(info->uri);
+	b->token = info->creationToken;
+	b->size = st.st_size;
+	return 0;
+}
+
+static void clear_generated_bundles(struct generated_bundles *bundles)
+{
+	for (size_t i = 0; i < bundles->nr; i++)
+		free(bundles->items[i].path);
+	free(bundles->items);
+	bundles->items = NULL;
+	bundles->nr = bundles->alloc = 0;
+}
+
+/*
+ * Read the bundles listed in 'list_path', ordered by creationToken. If the
+ * list cannot be used, e.g. because one of its bundles has gone missing,
+ * start over with an empty list.
+ */
+static void read_generated_bundles(const char *list_path,
+				   struct generated_bundles *bundles)
+{
+	struct bundle_list list;
+
+	if (access(list_path, F_OK))
+		return;
+
+	init_bundle_list(&list);
+	if (bundle_uri_parse_config_format(list_path, list_path, &list) ||
+	    list.heuristic != BUNDLE_HEURISTIC_CREATIONTOKEN ||
+	    for_all_bundles_in_list(&list, collect_generated_bundle, bundles)) {
+		warning(_("ignoring unusable bundle list '%s'"), list_path);
+		clear_generated_bundles(bundles);
+	}
+	clear_bundle_list(&list);
+
+	QSORT(bundles->items, bundles->nr, compare_generated_bundles);
+}
+
+/*
+ * Add the tips of the bundle at 'path' to 'tips'. Returns 1 if the bundle
+ * carries a ref that is now hidden, -1 if it cannot be read and 0
+ * otherwise.
+ */
+static int add_bundle_tips(struct oidset *tips, const char *path,
+			   const struct strvec *hidden)
+{
+	struct bundle_header header = BUNDLE_HEADER_INIT;
+	struct string_list_item *item;
+	int fd = read_bundle_header(path, &header);
+	int ret = 0;
+
+	if (fd < 0)
+		return -1;
+	close(fd);
+
+	for_each_string_list_item(item, &header.references) {
+		oidset_insert(tips, item->util);
+		if (ref_is_hidden(item->string, item->string, hidden))
+			ret = 1;
+	}
+	bundle_header_release(&header);
+	return ret;
+}
+
+struct bundle_refs {
+	/* The full names of the refs to bundle, with their oids as util. */
+	struct string_list names;
+	struct strvec hidden;
+};
+
+#define BUNDLE_REFS_INIT { \
+	.names = STRING_LIST_INIT_DUP, \
+	.hidden = STRVEC_INIT, \
+}
+
+static void bundle_refs_release(struct bundle_refs *refs)
+{
+	string_list_clear(&refs->names, 1);
+	strvec_clear(&refs->hidden);
+}
+
+static int collect_hidden_refs(const char *var, const char *value,
+			       const struct config_context *ctx UNUSED,
+			       void *data)
+{
+	return parse_hide_refs_config(var, value, "uploadpack", data);
+}
+
+static int collect_bundle_ref(const char *refname,
+			      const char *referent UNUSED,
+			      const struct object_id *oid,
+			      int flags UNUSED, void *data)
+{
+	struct bundle_refs *refs = data;
+
+	if (!ref_is_hidden(refname, refname, &refs->hidden))
+		string_list_append(&refs->names, refname)->util = oiddup(oid);
+	return 0;
+}
+
+/*
+ * Collect the branches and tags to bundle. The bundles are served to the
+ * same clients as upload-pack, so leave out the refs it hides by
+ * "uploadpack.hideRefs" or "transfer.hideRefs".
+ */
+static void collect_bundle_refs(struct repository *r, struct bundle_refs *refs)
+{
+	struct ref_store *refs_store = get_main_ref_store(r);
+
+	repo_config(r, collect_hidden_refs, &refs->hidden);
+	refs_for_each_fullref_in(refs_store, "refs/heads/", NULL,
+				 collect_bundle_ref, refs);
+	refs_for_each_fullref_in(refs_store, "refs/tags/", NULL,
+				 collect_bundle_ref, refs);
+}
+
+/*
+ * Check whether any of 'refs' has history that is not bundled yet.
+ * Refs that merely point into the bundled history, e.g. a new branch
+ * created from an old commit, do not need a new bundle (and "git bundle
+ * create" would refuse to write an empty one).
+ */
+static int has_unbundled_history(struct repository *r, struct bundle_refs *refs,
+				 struct oidset *tips)
+{
+	struct commit **tip_commits = NULL;
+	size_t nr = 0, alloc = 0;
+	struct oidset_iter iter;
+	struct string_list_item *item;
+	const struct object_id *oid;
+	int ret = 0;
+
+	oidset_iter_init(tips, &iter);
+	while ((oid = oidset_iter_next(&iter))) {
+		struct commit *c = lookup_commit_reference_gently(r, oid, 1);
+
+		if (!c)
+			continue;
+		ALLOC_GROW(tip_commits, nr + 1, alloc);
+		tip_commits[nr++] = c;
+	}
+
+	for_each_string_list_item(item, &refs->names) {
+		oid = item->util;
+		if (oidset_contains(tips, oid))
+			continue;
+		if (oid_object_info(r, oid, NULL) != OBJ_COMMIT ||
+		    repo_in_merge_bases_many(r, lookup_commit(r, oid),
+					     nr, tip_commits, 0) <= 0) {
+			ret = 1;
+			break;
+		}
+	}
+
+	free(tip_commits);
+	return ret;
+}
+
+/*
+ * Write a bundle of 'refs' to 'path', excluding what is reachable from
+ * 'exclude'. "git bundle create" uses the reachability bitmaps and reuses
+ * pack data verbatim where it can.
+ *
+ * Tips of older bundles may have been pruned after a forced update;
+ * they cannot be excluded and are skipped, so that the new bundle
+ * carries whatever history it needs on its own.
+ */
+static int write_generated_bundle(const char *path, struct bundle_refs *refs,
+				  struct oidset *exclude,
+				  struct maintenance_run_opts *opts)
+{
+	struct child_process child = CHILD_PROCESS_INIT;
+	struct string_list_item *item;
+	struct oidset_iter iter;
+	const struct object_id *oid;
+	FILE *in;
+
+	child.git_cmd = 1;
+	child.in = -1;
+	strvec_pushl(&child.args, "bundle", "create", NULL);
+	if (opts->quiet)
+		strvec_push(&child.args, "--quiet");
+	strvec_pushl(&child.args, path, "--stdin", NULL);
+
+	if (start_command(&child))
+		return error(_("failed to start 'git bundle create'"));
+
+	in = xfdopen(child.in, "w");
+	for_each_string_list_item(item, &refs->names)
+		fprintf(in, "%s\n", item->string);
+	oidset_iter_init(exclude, &iter);
+	while ((oid = oidset_iter_next(&iter)))
+		if (repo_has_object_file(the_repository, oid))
+			fprintf(in, "^%s\n", oid_to_hex(oid));
+	fclose(in);
+
+	if (finish_command(&child))
+		return error(_("failed to create bundle '%s'"), path);
+	return 0;
+}
+
+/*
+ * Bundles are named after their contents. They are served as immutable,
+ * so a list that starts over must never reuse the name of an older,
+ * different bundle that clients may have cached.
+ */
+static int hash_generated_bundle(const char *path, struct object_id *oid)
+{
+	git_hash_ctx ctx;
+	char buf[65536];
+	ssize_t len;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return error_errno(_("unable to open '%s'"), path);
+
+	the_hash_algo->init_fn(&ctx);
+	while ((len = xread(fd, buf, sizeof(buf))) > 0)
+		the_hash_algo->update_fn(&ctx, buf, len);
+	close(fd);
+	if (len < 0)
+		return error_errno(_("unable to read '%s'"), path);
+	the_hash_algo->final_oid_fn(oid, &ctx);
+	return 0;
+}
+
+static int write_generated_bundle_list(const char *list_path,
+				       struct generated_bundles *bundles)
+{
+	struct lock_file lk = LOCK_INIT;
+	struct strbuf buf = STRBUF_INIT;
+
+	if (hold_lock_file_for_update(&lk, list_path, 0) < 0)
+		return error_errno(_("unable to lock '%s'"), list_path);
+
+	strbuf_addstr(&buf, "[bundle]\n"
+			    "\tversion = 1\n"
+			    "\tmode = all\n"
+			    "\theuristic = creationToken\n");
+	for (size_t i = 0; i < bundles->nr; i++) {
+		struct generated_bundle *b = &bundles->items[i];
+
+		strbuf_addf(&buf, "[bundle \"%"PRIu64"\"]\n"
+				  "\turi = %s\n"
+				  "\tcreationToken = %"PRIu64"\n",
+			    b->token, find_last_dir_sep(b->path) + 1, b->token);
+	}
+
+	if (write_in_full(get_lock_file_fd(&lk), buf.buf, buf.len) < 0) {
+		strbuf_release(&buf);
+		rollback_lock_file(&lk);
+		return error_errno(_("unable to write '%s'"), list_path);
+	}
+	strbuf_release(&buf);
+
+	if (commit_lock_file(&lk))
+		return error_errno(_("unable to write '%s'"), list_path);
+	return 0;
+}
+
+static int maintenance_task_bundles(struct maintenance_run_opts *opts,
+				    struct gc_config *cfg UNUSED)
+{
+	struct repository *r = the_repository;
+	struct generated_bundles bundles = { 0 };
+	struct bundle_refs refs = BUNDLE_REFS_INIT;
+	struct oidset tips = OIDSET_INIT;
+	struct strbuf dir = STRBUF_INIT, list_path = STRBUF_INIT;
+	struct strbuf new_path = STRBUF_INIT;
+	struct generated_bundle *b;
+	struct object_id oid;
+	int factor = 2, rebundle = 0;
+	size_t keep, nr_old;
+	off_t total;
+	uint64_t token;
+	struct stat st;
+	int result = 0;
+
+	git_config_get_int("maintenance.bundles.geometricfactor", &factor);
+	if (factor < 2) {
+		error(_("maintenance.bundles.geometricFactor must be at least 2"));
+		return 1;
+	}
+
+	strbuf_addf(&dir, "%s/%s", r->objects->odb->path, GENERATED_BUNDLES_DIR);
+	strbuf_addf(&list_path, "%s/%s", dir.buf, GENERATED_BUNDLE_LIST);
+	if (safe_create_leading_directories(list_path.buf)) {
+		result = error_errno(_("unable to create directory '%s'"), dir.buf);
+		goto cleanup;
+	}
+
+	collect_bundle_refs(r, &refs);
+	read_generated_bundles(list_path.buf, &bundles);
+	for (size_t i = 0; i < bundles.nr; i++) {
+		int ret = add_bundle_tips(&tips, bundles.items[i].path,
+					  &refs.hidden);
+
+		if (ret < 0) {
+			warning(_("ignoring unusable bundle list '%s'"),
+				list_path.buf);
+			clear_generated_bundles(&bundles);
+			oidset_clear(&tips);
+			break;
+		}
+		if (ret > 0)
+			rebundle = 1;
+	}
+
+	/*
+	 * If refs that were bundled have been hidden since, replace all
+	 * bundles by a new one without them. If there is nothing left to
+	 * bundle, remove the list and the bundles.
+	 */
+	if (rebundle)
+		oidset_clear(&tips);
+
+	if (!has_unbundled_history(r, &refs, &tips)) {
+		if (rebundle) {
+			unlink_or_warn(list_path.buf);
+			for (size_t i = 0; i < bundles.nr; i++)
+				unlink_or_warn(bundles.items[i].path);
+		}
+		goto cleanup;
+	}
+
+	strbuf_addf(&new_path, "%s/new.bundle", dir.buf);
+	if (write_generated_bundle(new_path.buf, &refs, &tips, opts) ||
+	    stat(new_path.buf, &st)) {
+		result = 1;
+		goto cleanup;
+	}
+
+	/*
+	 * Keep the bundles geometrically sized: every bundle must be at
+	 * least 'factor' times as large as all newer ones together.
+	 * Otherwise, roll the newer ones up into a single bundle.
+	 */
+	keep = rebundle ? 0 : bundles.nr;
+	total = st.st_size;
+	while (keep && bundles.items[keep - 1].size < factor * total)
+		total += bundles.items[--keep].size;
+
+	if (!rebundle && keep < bundles.nr) {
+		oidset_clear(&tips);
+		for (size_t i = 0; i < keep; i++) {
+			if (add_bundle_tips(&tips, bundles.items[i].path,
+					    &refs.hidden) < 0) {
+				result = error(_("unable to read bundle '%s'"),
+					       bundles.items[i].path);
+				goto cleanup;
+			}
+		}
+		if (write_generated_bundle(new_path.buf, &refs, &tips, opts)) {
+			result = 1;
+			goto cleanup;
+		}
+	}
+
+	if (hash_generated_bundle(new_path.buf, &oid)) {
+		result = 1;
+		goto cleanup;
+	}
+
+	token = bundles.nr ? bundles.items[bundles.nr - 1].token + 1 : 1;
+	if (token < (uint64_t)time(NULL))
+		token = time(NULL);
+
+	ALLOC_GROW(bundles.items, bundles.nr + 1, bundles.alloc);
+	b = &bundles.items[bundles.nr++];
+	b->path = xstrfmt("%s/bundle-%s.bundle", dir.buf, oid_to_hex(&oid));
+	b->token = token;
+	if (rename(new_path.buf, b->path)) {
+		result = error_errno(_("unable to rename '%s' to '%s'"),
+				     new_path.buf, b->path);
+		goto cleanup;
+	}
+
+	/*
+	 * Swap the new bundle in for the rolled up ones, write the list,
+	 * and only then delete the bundles that it no longer mentions.
+	 */
+	SWAP(bundles.items[keep], bundles.items[bundles.nr - 1]);
+	nr_old = bundles.nr;
+	bundles.nr = keep + 1;
+	if (write_generated_bundle_list(list_path.buf, &bundles))
+		result = 1;
+	bundles.nr = nr_old;
+	for (size_t i = keep + 1; !result && i < bundles.nr; i++)
+		if (strcmp(bundles.items[i].path, bundles.items[keep].path))
+			unlink_or_warn(bundles.items[i].path);
+
+cleanup:
+	if (new_path.len)
+		unlink(new_path.buf);
+	clear_generated_bundles(&bundles);
+	bundle_refs_release(&refs);
+	oidset_clear(&tips);
+	strbuf_release(&new_path);
+	strbuf_release(&list_path);
+	strbuf_release(&dir);
+	return result;
+}
+
 typedef int maintenance_task_fn(struct maintenance_run_opts *opts,
 				struct gc_config *cfg);
 
@@ -1365,6 +1805,7 @@ enum maintenance_task_label {
 	TASK_GC,
 	TASK_COMMIT_GRAPH,
 	TASK_PACK_REFS,
+	TASK_BUNDLES,
 
 	/* Leave as final value */
 	TASK__COUNT
@@ -1401,6 +1842,10 @@ static struct maintenance_task tasks[] = {
 		maintenance_task_pack_refs,
 		pack_refs_condition,
 	},
+	[TASK_BUNDLES] = {
+		"bundles",
+		maintenance_task_bundles,
+	},
 };
 
 static int compare_tasks_by_selection(const void *a_, const void *b_)
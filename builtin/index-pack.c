@@ -29,6 +29,7 @@
 #include "run-command.h"
 #include "setup.h"
 #include "strvec.h"
+#include "trace2.h"
 
 static const char index_pack_usage[] =
 "git index-pack [-v] [-o <index-file>] [--keep | --keep=<msg>] [--[no-]rev-index] [--verify] [--strict[=<msg-id>=<severity>...]] [--fsck-objects[=<msg-id>=<severity>...]] (<pack-file> | --stdin [--fix-thin] [<pack-file>])";
@@ -39,8 +40,18 @@ struct object_entry {
 	unsigned char hdr_size;
 	signed char type;
 	signed char real_type;
+	/*
+	 * For OFS_DELTA objects that are resolved while the pack is still
+	 * being received, `early` is one of the EARLY_* values and
+	 * `early_base` is the index of the base object in `objects`.
+	 */
+	unsigned char early;
+	int early_base;
 };
 
+#define EARLY_QUEUED 1
+#define EARLY_RESOLVED 2
+
 struct object_stat {
 	unsigned delta_depth;
 	int base_object_no;
@@ -70,41 +81,57 @@ struct base_data {
 	struct list_head list;
 	void *data;
 	unsigned long size;
+	/*
+	 * The thread on whose stacks this struct lives. Its mutex guards
+	 * all of the fields above.
+	 */
+	struct thread_local_data *owner;
 };
 
 /*
- * Stack of struct base_data that have unprocessed children.
- * threaded_second_pass() uses this as a source of work (the other being the
- * objects array).
- *
- * Guarded by work_mutex.
- */
-static LIST_HEAD(work_head);
-
-/*
- * Stack of struct base_data that have children, all of whom have been
- * processed or are being processed, and at least one child is being processed.
- * These struct base_data must be kept around until the last child is
- * processed.
- *
- * Guarded by work_mutex.
+ * Each thread resolves deltas depth-first from its own stacks and only
+ * falls back to the objects array and to stealing work from other threads
+ * when they run dry, so that threads rarely contend for the same lock.
  */
-static LIST_HEAD(done_head);
-
-/*
- * All threads share one delta base cache.
- *
- * base_cache_used is guarded by work_mutex, and base_cache_limit is read-only
- * in a thread.
- */
-static size_t base_cache_used;
-static size_t base_cache_limit;
-
 struct thread_local_data {
 	pthread_t thread;
 	int pack_fd;
+
+	/*
+	 * Stack of struct base_data that have unprocessed children. The
+	 * owning thread takes work from the top, other threads steal from
+	 * the bottom, where the bases closest to the root of their delta
+	 * tree (and thus with the most work below them) are.
+	 */
+	struct list_head work_head;
+
+	/*
+	 * Stack of struct base_data that have children, all of whom have
+	 * been processed or are being processed, and at least one child is
+	 * being processed. These struct base_data must be kept around until
+	 * the last child is processed.
+	 */
+	struct list_head done_head;
+
+	/*
+	 * Every thread has its own delta base cache, holding the data of
+	 * the struct base_data on its stacks and bounded by base_cache_limit.
+	 */
+	size_t base_cache_used;
+
+	/* Guards the stacks above and the struct base_data on them. */
+	pthread_mutex_t mutex;
+
+	/* Range of the objects array that this thread takes bases from. */
+	int dispatch_next, dispatch_end;
+
+	/* Resolved deltas that have not been added to nr_resolved_deltas. */
+	int nr_resolved;
 };
 
+/* base_cache_limit is read-only in a thread. */
+static size_t base_cache_limit;
+
 /* Remember to update object flag allocation in object.h */
 #define FLAG_LINK (1u<<20)
 #define FLAG_CHECKED (1u<<21)
@@ -123,12 +150,16 @@ static struct object_entry *objects;
 static struct object_stat *obj_stat;
 static struct ofs_delta_entry *ofs_deltas;
 static struct ref_delta_entry *ref_deltas;
-static struct thread_local_data nothread_data;
+static struct thread_local_data nothread_data = {
+	.work_head = LIST_HEAD_INIT(nothread_data.work_head),
+	.done_head = LIST_HEAD_INIT(nothread_data.done_head),
+};
 static int nr_objects;
 static int nr_ofs_deltas;
 static int nr_ref_deltas;
 static int ref_deltas_alloc;
 static int nr_resolved_deltas;
+static int nr_early_deltas;
 static int nr_threads;
 
 static int from_stdin;
@@ -143,6 +174,15 @@ static int check_self_contained_and_connected;
 
 static struct progress *progress;
 
+/*
+ * OFS_DELTA objects whose base has been (or is about to be) resolved in the
+ * first pass. They are resolved in pack order while we would otherwise sit
+ * idle waiting for more input, see resolve_early_deltas().
+ */
+static int *early_queue;
+static int early_queue_nr, early_queue_alloc, early_queue_pos;
+static int force_early_deltas;
+
 /* We always read in 4kB chunks. */
 static unsigned char input_buffer[4096];
 static unsigned int input_offset, input_len;
@@ -162,9 +202,19 @@ static struct oidset local_links = OIDSET_INIT;
 static int record_local_links;
 
 static struct thread_local_data *thread_data;
-static int nr_dispatched;
 static int threads_active;
 
+/*
+ * nr_dispatched, nr_idle and work_generation are guarded by work_mutex.
+ * Threads that found no work wait on work_cond until work_generation
+ * changes, which happens whenever the stack of a thread goes from empty
+ * to non-empty, or until all threads are idle.
+ */
+static int nr_dispatched;
+static int nr_idle;
+static unsigned int work_generation;
+static pthread_cond_t work_cond;
+
 static pthread_mutex_t read_mutex;
 #define read_lock()		lock_mutex(&read_mutex)
 #define read_unlock()		unlock_mutex(&read_mutex)
@@ -204,13 +254,18 @@ static void init_thread(void)
 	init_recursive_mutex(&read_mutex);
 	pthread_mutex_init(&counter_mutex, NULL);
 	pthread_mutex_init(&work_mutex, NULL);
+	pthread_cond_init(&work_cond, NULL);
 	if (show_stat)
 		pthread_mutex_init(&deepest_delta_mutex, NULL);
 	pthread_key_create(&key, NULL);
 	CALLOC_ARRAY(thread_data, nr_threads);
 	for (i = 0; i < nr_threads; i++) {
 		thread_data[i].pack_fd = xopen(curr_pack, O_RDONLY);
+		INIT_LIST_HEAD(&thread_data[i].work_head);
+		INIT_LIST_HEAD(&thread_data[i].done_head);
+		pthread_mutex_init(&thread_data[i].mutex, NULL);
 	}
+	nr_idle = 0;
 
 	threads_active = 1;
 }
@@ -224,10 +279,13 @@ static void cleanup_thread(void)
 	pthread_mutex_destroy(&read_mutex);
 	pthread_mutex_destroy(&counter_mutex);
 	pthread_mutex_destroy(&work_mutex);
+	pthread_cond_destroy(&work_cond);
 	if (show_stat)
 		pthread_mutex_destroy(&deepest_delta_mutex);
-	for (i = 0; i < nr_threads; i++)
+	for (i = 0; i < nr_threads; i++) {
 		close(thread_data[i].pack_fd);
+		pthread_mutex_destroy(&thread_data[i].mutex);
+	}
 	pthread_key_delete(key);
 	free(thread_data);
 }
@@ -292,6 +350,8 @@ static unsigned check_objects(void)
 }
 
 
+static void resolve_early_deltas(void);
+
 /* Discard current buffer used content. */
 static void flush(void)
 {
@@ -319,8 +379,11 @@ static void *fill(int min)
 		    min);
 	flush();
 	do {
-		ssize_t ret = xread(input_fd, input_buffer + input_len,
-				sizeof(input_buffer) - input_len);
+		ssize_t ret;
+
+		resolve_early_deltas();
+		ret = xread(input_fd, input_buffer + input_len,
+			    sizeof(input_buffer) - input_len);
 		if (ret <= 0) {
 			if (!ret)
 				die(_("early EOF"));
@@ -424,35 +487,35 @@ static void free_base_data(struct base_data *c)
 {
 	if (c->data) {
 		FREE_AND_NULL(c->data);
-		base_cache_used -= c->size;
+		c->owner->base_cache_used -= c->size;
 	}
 }
 
-static void prune_base_data(struct base_data *retain)
+static void prune_base_data(struct thread_local_data *t)
 {
 	struct list_head *pos;
 
-	if (base_cache_used <= base_cache_limit)
+	if (t->base_cache_used <= base_cache_limit)
 		return;
 
-	list_for_each_prev(pos, &done_head) {
+	list_for_each_prev(pos, &t->done_head) {
 		struct base_data *b = list_entry(pos, struct base_data, list);
-		if (b->retain_data || b == retain)
+		if (b->retain_data)
 			continue;
 		if (b->data) {
 			free_base_data(b);
-			if (base_cache_used <= base_cache_limit)
+			if (t->base_cache_used <= base_cache_limit)
 				return;
 		}
 	}
 
-	list_for_each_prev(pos, &work_head) {
+	list_for_each_prev(pos, &t->work_head) {
 		struct base_data *b = list_entry(pos, struct base_data, list);
-		if (b->retain_data || b == retain)
+		if (b->retain_data)
 			continue;
 		if (b->data) {
 			free_base_data(b);
-			if (base_cache_used <= base_cache_limit)
+			if (t->base_cache_used <= base_cache_limit)
 				return;
 		}
 	}
@@ -463,6 +526,27 @@ static int is_delta_type(enum object_type type)
 	return (type == OBJ_REF_DELTA || type == OBJ_OFS_DELTA);
 }
 
+/*
+ * Small non-delta objects are not hashed while they are inflated in the
+ * first pass; parse_pack_objects() names them in batches instead, which
+ * lets the hash implementation work on several of them at once.
+ */
+#define HASH_BATCH_NR 16
+#define HASH_BATCH_MAX_SIZE (64 * 1024)
+
+struct hash_batch {
+	struct hash_object_request req[HASH_BATCH_NR];
+	struct object_entry *obj[HASH_BATCH_NR];
+	int nr;
+};
+
+static int hash_in_batch(const struct object_entry *obj)
+{
+	return !is_delta_type(obj->type) &&
+		obj->size < HASH_BATCH_MAX_SIZE &&
+		!(obj->type == OBJ_BLOB && obj->size > big_file_threshold);
+}
+
 static void *unpack_entry_data(off_t offset, unsigned long size,
 			       enum object_type type, struct object_id *oid)
 {
@@ -574,7 +658,8 @@ static void *unpack_raw_entry(struct object_entry *obj,
 	}
 	obj->hdr_size = consumed_bytes - obj->idx.offset;
 
-	data = unpack_entry_data(obj->idx.offset, obj->size, obj->type, oid);
+	data = unpack_entry_data(obj->idx.offset, obj->size, obj->type,
+				 hash_in_batch(obj) ? NULL : oid);
 	obj->idx.crc32 = input_crc32;
 	return data;
 }
@@ -658,7 +743,7 @@ static int compare_ofs_delta_bases(off_t offset1, off_t offset2,
 
 static int find_ofs_delta(const off_t offset)
 {
-	int first = 0, last = nr_ofs_deltas;
+	int first = 0, last = nr_ofs_deltas - nr_early_deltas;
 
 	while (first < last) {
 		int next = first + (last - first) / 2;
@@ -684,7 +769,7 @@ static void find_ofs_delta_children(off_t offset,
 {
 	int first = find_ofs_delta(offset);
 	int last = first;
-	int end = nr_ofs_deltas - 1;
+	int end = nr_ofs_deltas - nr_early_deltas - 1;
 
 	if (first < 0) {
 		*first_index = 0;
@@ -949,54 +1034,129 @@ static void sha1_object(const void *data, struct object_entry *obj_entry,
 	free(new_data);
 }
 
+/*
+ * Return the contents of an object that serves as the root of a delta tree
+ * in the second pass. This is either a non-delta object, or a delta that
+ * has already been resolved in the first pass, in which case we have to
+ * reconstruct it from its base.
+ */
+static void *get_root_data(struct object_entry *obj, unsigned long *size)
+{
+	void *base, *raw, *data;
+	unsigned long base_size;
+
+	if (obj->early != EARLY_RESOLVED) {
+		*size = obj->size;
+		return get_data_from_pack(obj);
+	}
+
+	base = get_root_data(&objects[obj->early_base], &base_size);
+	raw = get_data_from_pack(obj);
+	data = patch_delta(base, base_size, raw, obj->size, size);
+	free(base);
+	free(raw);
+	if (!data)
+		bad_object(obj->idx.offset, _("failed to apply delta"));
+	return data;
+}
+
+static void release_base_data(struct base_data *c)
+{
+	lock_mutex(&c->owner->mutex);
+	c->retain_data--;
+	unlock_mutex(&c->owner->mutex);
+}
+
 /*
  * Ensure that this node has been reconstructed and return its contents.
+ * The caller must have incremented retain_data of the node.
  *
  * In the typical and best case, this node would already be reconstructed
  * (through the invocation to resolve_delta() in threaded_second_pass()) and it
  * would not be pruned. However, if pruning of this node was necessary due to
  * reaching delta_base_cache_limit, this function will find the closest
  * ancestor with reconstructed data that has not been pruned (or if there is
- * none, the ultimate base object), and reconstruct each node in the delta
- * chain in order to generate the reconstructed data for this node.
+ * none, the ultimate base object), and reconstruct each node on the path
+ * back down to this one. Every ancestor on that path is retained while we
+ * do so, so that it is not pruned before its child has been rebuilt.
+ *
+ * Nodes may live on the stacks of other threads, so this function must not
+ * be called with any mutex held. It only ever holds the mutex of one node's
+ * owner at a time, and not while reconstructing data.
  */
 static void *get_base_data(struct base_data *c)
 {
-	if (!c->data) {
-		struct object_entry *obj = c->obj;
-		struct base_data **delta = NULL;
-		int delta_nr = 0, delta_alloc = 0;
+	struct base_data **delta = NULL;
+	int delta_nr = 0, delta_alloc = 0;
+	struct base_data *b, *top;
+	void *data;
 
-		while (is_delta_type(c->obj->type) && !c->data) {
-			ALLOC_GROW(delta, delta_nr + 1, delta_alloc);
-			delta[delta_nr++] = c;
-			c = c->base;
-		}
-		if (!delta_nr) {
-			c->data = get_data_from_pack(obj);
-			c->size = obj->size;
-			base_cache_used += c->size;
-			prune_base_data(c);
-		}
-		for (; delta_nr > 0; delta_nr--) {
+	for (b = c; ; b = b->base) {
+		lock_mutex(&b->owner->mutex);
+		if (b != c)
+			b->retain_data++;
+		data = b->data;
+		unlock_mutex(&b->owner->mutex);
+		if (data)
+			break;
+		ALLOC_GROW(delta, delta_nr + 1, delta_alloc);
+		delta[delta_nr++] = b;
+		if (!b->base)
+			break;
+	}
+	if (!delta_nr)
+		return data;
+	top = b;
+
+	for (; delta_nr > 0; delta_nr--) {
+		struct thread_local_data *owner;
+		struct object_entry *obj;
+		unsigned long size;
+
+		b = delta[delta_nr - 1];
+		owner = b->owner;
+		obj = b->obj;
+		if (b->base) {
 			void *base, *raw;
-			c = delta[delta_nr - 1];
-			obj = c->obj;
-			base = get_base_data(c->base);
+			unsigned long base_size;
+
+			lock_mutex(&b->base->owner->mutex);
+			base = b->base->data;
+			base_size = b->base->size;
+			unlock_mutex(&b->base->owner->mutex);
+
 			raw = get_data_from_pack(obj);
-			c->data = patch_delta(
-				base, c->base->size,
-				raw, obj->size,
-				&c->size);
+			data = patch_delta(base, base_size, raw, obj->size, &size);
 			free(raw);
-			if (!c->data)
+			if (!data)
 				bad_object(obj->idx.offset, _("failed to apply delta"));
-			base_cache_used += c->size;
-			prune_base_data(c);
+		} else {
+			data = get_root_data(obj, &size);
+		}
+
+		lock_mutex(&owner->mutex);
+		if (b->data) {
+			/* Another thread has beaten us to it. */
+			free(data);
+		} else {
+			b->data = data;
+			b->size = size;
+			owner->base_cache_used += b->size;
+			prune_base_data(owner);
 		}
-		free(delta);
+		unlock_mutex(&owner->mutex);
 	}
-	return c->data;
+	free(delta);
+
+	for (b = c; b != top; ) {
+		b = b->base;
+		release_base_data(b);
+	}
+
+	lock_mutex(&c->owner->mutex);
+	data = c->data;
+	unlock_mutex(&c->owner->mutex);
+	return data;
 }
 
 static struct base_data *make_base(struct object_entry *obj,
@@ -1047,11 +1207,200 @@ static struct base_data *resolve_delta(struct object_entry *delta_obj,
 	result->data = result_data;
 	result->size = result_size;
 
-	counter_lock();
+	return result;
+}
+
+/*
+ * A small direct-mapped cache of objects reconstructed in the first pass,
+ * so that chains of deltas that arrive one after another do not have to be
+ * inflated over and over again. Its size is bounded by base_cache_limit.
+ */
+#define EARLY_CACHE_SLOTS 1024
+
+static struct early_cache_entry {
+	struct object_entry *obj;
+	void *data;
+	unsigned long size;
+} early_cache[EARLY_CACHE_SLOTS];
+static int early_cache_evict_pos;
+static size_t early_cache_used;
+
+static void early_cache_free(struct early_cache_entry *e)
+{
+	if (e->data) {
+		FREE_AND_NULL(e->data);
+		early_cache_used -= e->size;
+	}
+	e->obj = NULL;
+}
+
+/*
+ * Hand `data` over to the cache and return it. The returned pointer stays
+ * valid until the next call to this function.
+ */
+static void *early_cache_put(struct object_entry *obj, void *data,
+			     unsigned long size)
+{
+	struct early_cache_entry *e = &early_cache[(obj - objects) % EARLY_CACHE_SLOTS];
+
+	early_cache_free(e);
+	e->obj = obj;
+	e->data = data;
+	e->size = size;
+	early_cache_used += size;
+
+	while (early_cache_used > base_cache_limit) {
+		struct early_cache_entry *victim =
+			&early_cache[early_cache_evict_pos];
+		early_cache_evict_pos = (early_cache_evict_pos + 1) % EARLY_CACHE_SLOTS;
+		if (victim != e)
+			early_cache_free(victim);
+		else if (early_cache_used - e->size <= base_cache_limit)
+			break;
+	}
+	return data;
+}
+
+static void *early_data(struct object_entry *obj, unsigned long *size)
+{
+	struct early_cache_entry *e = &early_cache[(obj - objects) % EARLY_CACHE_SLOTS];
+	void *base, *raw, *data;
+	unsigned long base_size;
+
+	if (e->obj == obj && e->data) {
+		*size = e->size;
+		return e->data;
+	}
+
+	if (!is_delta_type(obj->type)) {
+		*size = obj->size;
+		return early_cache_put(obj, get_data_from_pack(obj), obj->size);
+	}
+
+	base = early_data(&objects[obj->early_base], &base_size);
+	raw = get_data_from_pack(obj);
+	data = patch_delta(base, base_size, raw, obj->size, size);
+	free(raw);
+	if (!data)
+		bad_object(obj->idx.offset, _("failed to apply delta"));
+	return early_cache_put(obj, data, *size);
+}
+
+static void resolve_early_delta(struct object_entry *obj)
+{
+	struct object_entry *base = &objects[obj->early_base];
+	void *base_data, *delta_data, *result;
+	unsigned long base_size, result_size;
+
+	if (show_stat) {
+		int i = obj - objects;
+		int j = base - objects;
+		obj_stat[i].delta_depth = obj_stat[j].delta_depth + 1;
+		if (deepest_delta < obj_stat[i].delta_depth)
+			deepest_delta = obj_stat[i].delta_depth;
+		obj_stat[i].base_object_no = j;
+	}
+
+	base_data = early_data(base, &base_size);
+	delta_data = get_data_from_pack(obj);
+	result = patch_delta(base_data, base_size, delta_data, obj->size,
+			     &result_size);
+	free(delta_data);
+	if (!result)
+		bad_object(obj->idx.offset, _("failed to apply delta"));
+
+	obj->real_type = base->real_type;
+	hash_object_file(the_hash_algo, result, result_size, obj->real_type,
+			 &obj->idx.oid);
+	sha1_object(result, NULL, result_size, obj->real_type, &obj->idx.oid);
+	early_cache_put(obj, result, result_size);
+
+	obj->early = EARLY_RESOLVED;
+	nr_early_deltas++;
 	nr_resolved_deltas++;
-	counter_unlock();
+}
 
-	return result;
+/*
+ * Resolve queued deltas while no more input is available, so that we use
+ * the time spent waiting for the network instead of resolving all deltas
+ * only once the whole pack has been received.
+ */
+static void resolve_early_deltas(void)
+{
+	while (early_queue_pos < early_queue_nr) {
+		if (!force_early_deltas) {
+			struct pollfd pfd = { .fd = input_fd, .events = POLLIN };
+			if (poll(&pfd, 1, 0))
+				return;
+		}
+
+		/* Make sure that the bases we need have been written out. */
+		flush();
+		resolve_early_delta(&objects[early_queue[early_queue_pos++]]);
+	}
+}
+
+static int find_object_at_offset(off_t offset, int nr)
+{
+	int first = 0, last = nr;
+
+	while (first < last) {
+		int next = first + (last - first) / 2;
+		if (objects[next].idx.offset == offset)
+			return next;
+		if (objects[next].idx.offset > offset)
+			last = next;
+		else
+			first = next + 1;
+	}
+	return -1;
+}
+
+/*
+ * Queue the OFS_DELTA object `i` for early resolution in case its base is
+ * available by the time we get to it.
+ */
+static void queue_early_delta(int i, off_t base_offset)
+{
+	int base = find_object_at_offset(base_offset, i);
+
+	if (base < 0)
+		return;
+	if (is_delta_type(objects[base].type) ? !objects[base].early :
+	    objects[base].real_type == OBJ_BAD)
+		return;
+
+	objects[i].early = EARLY_QUEUED;
+	objects[i].early_base = base;
+	ALLOC_GROW(early_queue, early_queue_nr + 1, early_queue_alloc);
+	early_queue[early_queue_nr++] = i;
+}
+
+/*
+ * Hand all deltas that have not been resolved in the first pass over to
+ * the second one.
+ */
+static void finish_early_deltas(void)
+{
+	int i, j;
+
+	for (i = early_queue_pos; i < early_queue_nr; i++)
+		objects[early_queue[i]].early = 0;
+	FREE_AND_NULL(early_queue);
+	early_queue_nr = early_queue_alloc = early_queue_pos = 0;
+
+	for (i = 0; i < EARLY_CACHE_SLOTS; i++)
+		early_cache_free(&early_cache[i]);
+
+	trace2_data_intmax("index-pack", the_repository, "early-deltas",
+			   nr_early_deltas);
+	if (!nr_early_deltas)
+		return;
+	for (i = j = 0; i < nr_ofs_deltas; i++) {
+		if (objects[ofs_deltas[i].obj_no].early == EARLY_RESOLVED)
+			continue;
+		ofs_deltas[j++] = ofs_deltas[i];
+	}
 }
 
 static int compare_ofs_delta_entry(const void *a, const void *b)
@@ -1072,85 +1421,249 @@ static int compare_ref_delta_entry(const void *a, const void *b)
 	return oidcmp(&delta_a->oid, &delta_b->oid);
 }
 
+/*
+ * Take the next child of `parent`, which must be on the work stack of `t`,
+ * and retain the data of `parent` for it. Called with the mutex of `t` held.
+ */
+static struct object_entry *take_child(struct thread_local_data *t,
+				       struct base_data *parent)
+{
+	struct object_entry *child_obj;
+
+	if (parent->ref_first <= parent->ref_last) {
+		int offset = ref_deltas[parent->ref_first++].obj_no;
+		child_obj = objects + offset;
+		if (child_obj->real_type != OBJ_REF_DELTA)
+			die("REF_DELTA at offset %"PRIuMAX" already resolved (duplicate base %s?)",
+			    (uintmax_t) child_obj->idx.offset,
+			    oid_to_hex(&parent->obj->idx.oid));
+		child_obj->real_type = parent->obj->real_type;
+	} else {
+		child_obj = objects +
+			ofs_deltas[parent->ofs_first++].obj_no;
+		assert(child_obj->real_type == OBJ_OFS_DELTA);
+		child_obj->real_type = parent->obj->real_type;
+	}
+
+	if (parent->ref_first > parent->ref_last &&
+	    parent->ofs_first > parent->ofs_last) {
+		/*
+		 * This parent has run out of children, so move it to
+		 * done_head.
+		 */
+		list_del(&parent->list);
+		list_add(&parent->list, &t->done_head);
+	}
+
+	parent->retain_data++;
+	return child_obj;
+}
+
+/*
+ * Take the next object that is not a delta from the objects array. Threads
+ * claim chunks of the array at a time, which get smaller as we approach its
+ * end so that the work stays balanced.
+ */
+#define DISPATCH_CHUNK_MAX 256
+
+static struct object_entry *dispatch_object(struct thread_local_data *t,
+					    unsigned int *generation)
+{
+	int nr_workers = threads_active ? nr_threads : 1;
+
+	for (;;) {
+		int chunk;
+
+		while (t->dispatch_next < t->dispatch_end) {
+			struct object_entry *obj = &objects[t->dispatch_next++];
+			if (!is_delta_type(obj->type) ||
+			    obj->early == EARLY_RESOLVED)
+				return obj;
+		}
+
+		work_lock();
+		if (nr_dispatched >= nr_objects) {
+			*generation = work_generation;
+			work_unlock();
+			return NULL;
+		}
+		chunk = (nr_objects - nr_dispatched) / (2 * nr_workers);
+		if (chunk < 1)
+			chunk = 1;
+		else if (chunk > DISPATCH_CHUNK_MAX)
+			chunk = DISPATCH_CHUNK_MAX;
+		t->dispatch_next = nr_dispatched;
+		nr_dispatched += chunk;
+		t->dispatch_end = nr_dispatched;
+		work_unlock();
+	}
+}
+
+/*
+ * Steal a child from the bottom of the work stack of another thread,
+ * starting with our neighbours.
+ */
+static struct object_entry *steal_child(struct thread_local_data *self,
+					struct base_data **parent)
+{
+	int i;
+
+	if (!threads_active)
+		return NULL;
+
+	for (i = 1; i < nr_threads; i++) {
+		struct thread_local_data *victim =
+			&thread_data[(self - thread_data + i) % nr_threads];
+		struct object_entry *child_obj = NULL;
+
+		lock_mutex(&victim->mutex);
+		if (!list_empty(&victim->work_head)) {
+			*parent = list_entry(victim->work_head.prev,
+					     struct base_data, list);
+			child_obj = take_child(victim, *parent);
+		}
+		unlock_mutex(&victim->mutex);
+
+		if (child_obj)
+			return child_obj;
+	}
+	return NULL;
+}
+
+/*
+ * Wake up the threads waiting for work, if any. A base usually has more
+ * than one child to steal, so let all of them have a go at it.
+ */
+static void announce_work(void)
+{
+	if (!threads_active)
+		return;
+
+	work_lock();
+	work_generation++;
+	if (nr_idle)
+		pthread_cond_broadcast(&work_cond);
+	work_unlock();
+}
+
+/*
+ * Wait until there may be new work to steal. Returns 0 if all threads are
+ * out of work, which means that all deltas we can resolve are resolved.
+ */
+static int wait_for_work(unsigned int generation)
+{
+	int ret = 1;
+
+	if (!threads_active)
+		return 0;
+
+	work_lock();
+	if (generation != work_generation)
+		; /* new work has shown up since we last looked */
+	else if (++nr_idle == nr_threads)
+		pthread_cond_broadcast(&work_cond);
+	else {
+		while (generation == work_generation && nr_idle < nr_threads)
+			pthread_cond_wait(&work_cond, &work_mutex);
+		if (nr_idle < nr_threads)
+			nr_idle--;
+	}
+	if (nr_idle == nr_threads)
+		ret = 0;
+	work_unlock();
+	return ret;
+}
+
+static void flush_resolved(struct thread_local_data *t)
+{
+	counter_lock();
+	nr_resolved_deltas += t->nr_resolved;
+	t->nr_resolved = 0;
+	display_progress(progress, nr_resolved_deltas);
+	counter_unlock();
+}
+
+/*
+ * Drop the reference to `parent` taken by take_child(). If the child has
+ * been fully processed, free `parent` and its ancestors once all of their
+ * children are.
+ */
+static void release_parent(struct base_data *parent, int child_done)
+{
+	struct base_data *p = parent;
+
+	while (p) {
+		struct thread_local_data *owner = p->owner;
+		struct base_data *next_p;
+
+		lock_mutex(&owner->mutex);
+		if (p == parent)
+			p->retain_data--;
+		if (!child_done || --p->children_remaining) {
+			unlock_mutex(&owner->mutex);
+			break;
+		}
+
+		next_p = p->base;
+		free_base_data(p);
+		list_del(&p->list);
+		unlock_mutex(&owner->mutex);
+		free(p);
+
+		p = next_p;
+	}
+}
+
+#define RESOLVED_BATCH 32
+
 static void *threaded_second_pass(void *data)
 {
+	struct thread_local_data *self;
+
 	if (data)
 		set_thread_data(data);
+	self = get_thread_data();
+
 	for (;;) {
 		struct base_data *parent = NULL;
-		struct object_entry *child_obj;
+		struct object_entry *child_obj = NULL;
 		struct base_data *child;
+		unsigned int generation = 0;
 
-		counter_lock();
-		display_progress(progress, nr_resolved_deltas);
-		counter_unlock();
-
-		work_lock();
-		if (list_empty(&work_head)) {
-			/*
-			 * Take an object from the object array.
-			 */
-			while (nr_dispatched < nr_objects &&
-			       is_delta_type(objects[nr_dispatched].type))
-				nr_dispatched++;
-			if (nr_dispatched >= nr_objects) {
-				work_unlock();
-				break;
-			}
-			child_obj = &objects[nr_dispatched++];
-		} else {
-			/*
-			 * Peek at the top of the stack, and take a child from
-			 * it.
-			 */
-			parent = list_first_entry(&work_head, struct base_data,
-						  list);
-
-			if (parent->ref_first <= parent->ref_last) {
-				int offset = ref_deltas[parent->ref_first++].obj_no;
-				child_obj = objects + offset;
-				if (child_obj->real_type != OBJ_REF_DELTA)
-					die("REF_DELTA at offset %"PRIuMAX" already resolved (duplicate base %s?)",
-					    (uintmax_t) child_obj->idx.offset,
-					    oid_to_hex(&parent->obj->idx.oid));
-				child_obj->real_type = parent->obj->real_type;
-			} else {
-				child_obj = objects +
-					ofs_deltas[parent->ofs_first++].obj_no;
-				assert(child_obj->real_type == OBJ_OFS_DELTA);
-				child_obj->real_type = parent->obj->real_type;
-			}
-
-			if (parent->ref_first > parent->ref_last &&
-			    parent->ofs_first > parent->ofs_last) {
-				/*
-				 * This parent has run out of children, so move
-				 * it to done_head.
-				 */
-				list_del(&parent->list);
-				list_add(&parent->list, &done_head);
-			}
+		/*
+		 * Peek at the top of our own stack, and take a child from
+		 * it. Its data is likely to be still hot in the cache.
+		 */
+		lock_mutex(&self->mutex);
+		if (!list_empty(&self->work_head)) {
+			parent = list_first_entry(&self->work_head,
+						  struct base_data, list);
+			child_obj = take_child(self, parent);
+		}
+		unlock_mutex(&self->mutex);
 
-			/*
-			 * Ensure that the parent has data, since we will need
-			 * it later.
-			 *
-			 * NEEDSWORK: If parent data needs to be reloaded, this
-			 * prolongs the time that the current thread spends in
-			 * the mutex. A mitigating factor is that parent data
-			 * needs to be reloaded only if the delta base cache
-			 * limit is exceeded, so in the typical case, this does
-			 * not happen.
-			 */
-			get_base_data(parent);
-			parent->retain_data++;
+		/*
+		 * Otherwise, take an object from the object array, or steal
+		 * work from other threads once that is exhausted.
+		 */
+		if (!child_obj)
+			child_obj = dispatch_object(self, &generation);
+		if (!child_obj)
+			child_obj = steal_child(self, &parent);
+		if (!child_obj) {
+			flush_resolved(self);
+			if (wait_for_work(generation))
+				continue;
+			break;
 		}
-		work_unlock();
 
 		if (parent) {
+			get_base_data(parent);
 			child = resolve_delta(child_obj, parent);
 			if (!child->children_remaining)
 				FREE_AND_NULL(child->data);
+			if (++self->nr_resolved >= RESOLVED_BATCH)
+				flush_resolved(self);
 		} else {
 			child = make_base(child_obj, NULL);
 			if (child->children_remaining) {
@@ -1159,54 +1672,65 @@ static void *threaded_second_pass(void *data)
 				 * we will need this data in the future.
 				 * Inflate now so that future iterations will
 				 * have access to this object's data while
-				 * outside the work mutex.
+				 * outside the mutex.
 				 */
-				child->data = get_data_from_pack(child_obj);
-				child->size = child_obj->size;
+				child->data = get_root_data(child_obj,
+							    &child->size);
 			}
 		}
 
-		work_lock();
-		if (parent)
-			parent->retain_data--;
 		if (child->data) {
 			/*
 			 * This child has its own children, so add it to
-			 * work_head.
+			 * our work_head.
 			 */
-			list_add(&child->list, &work_head);
-			base_cache_used += child->size;
-			prune_base_data(NULL);
-			free_base_data(child);
+			int was_empty;
+
+			/*
+			 * Once the child is on our stack, other threads may
+			 * steal its children and free the parent before we
+			 * get to it again, so let go of the parent first.
+			 */
+			if (parent)
+				release_parent(parent, 0);
+
+			child->owner = self;
+			lock_mutex(&self->mutex);
+			was_empty = list_empty(&self->work_head);
+			list_add(&child->list, &self->work_head);
+			self->base_cache_used += child->size;
+			prune_base_data(self);
+			unlock_mutex(&self->mutex);
+
+			if (was_empty)
+				announce_work();
 		} else {
 			/*
 			 * This child does not have its own children. It may be
 			 * the last descendant of its ancestors; free those
 			 * that we can.
 			 */
-			struct base_data *p = parent;
-
-			while (p) {
-				struct base_data *next_p;
-
-				p->children_remaining--;
-				if (p->children_remaining)
-					break;
-
-				next_p = p->base;
-				free_base_data(p);
-				list_del(&p->list);
-				free(p);
-
-				p = next_p;
-			}
+			release_parent(parent, 1);
 			FREE_AND_NULL(child);
 		}
-		work_unlock();
 	}
 	return NULL;
 }
 
+static void flush_hash_batch(struct hash_batch *batch)
+{
+	hash_object_file_many(the_hash_algo, batch->req, batch->nr);
+	for (int i = 0; i < batch->nr; i++) {
+		struct object_entry *obj = batch->obj[i];
+		void *data = (void *)batch->req[i].buf;
+
+		oidcpy(&obj->idx.oid, &batch->req[i].oid);
+		sha1_object(data, NULL, obj->size, obj->type, &obj->idx.oid);
+		free(data);
+	}
+	batch->nr = 0;
+}
+
 /*
  * First pass:
  * - find locations of all objects;
@@ -1218,6 +1742,7 @@ static void parse_pack_objects(unsigned char *hash)
 	int i, nr_delays = 0;
 	struct ofs_delta_entry *ofs_delta = ofs_deltas;
 	struct object_id ref_delta_oid;
+	struct hash_batch batch = { .nr = 0 };
 	struct stat st;
 	git_hash_ctx tmp_ctx;
 
@@ -1226,6 +1751,7 @@ static void parse_pack_objects(unsigned char *hash)
 				progress_title ? progress_title :
 				from_stdin ? _("Receiving objects") : _("Indexing objects"),
 				nr_objects);
+	base_cache_limit = delta_base_cache_limit;
 	for (i = 0; i < nr_objects; i++) {
 		struct object_entry *obj = &objects[i];
 		void *data = unpack_raw_entry(obj, &ofs_delta->offset,
@@ -1235,6 +1761,8 @@ static void parse_pack_objects(unsigned char *hash)
 		if (obj->type == OBJ_OFS_DELTA) {
 			nr_ofs_deltas++;
 			ofs_delta->obj_no = i;
+			if (from_stdin)
+				queue_early_delta(i, ofs_delta->offset);
 			ofs_delta++;
 		} else if (obj->type == OBJ_REF_DELTA) {
 			ALLOC_GROW(ref_deltas, nr_ref_deltas + 1, ref_deltas_alloc);
@@ -1245,12 +1773,26 @@ static void parse_pack_objects(unsigned char *hash)
 			/* large blobs, check later */
 			obj->real_type = OBJ_BAD;
 			nr_delays++;
+		} else if (hash_in_batch(obj)) {
+			batch.req[batch.nr].buf = data;
+			batch.req[batch.nr].len = obj->size;
+			batch.req[batch.nr].type = obj->type;
+			batch.obj[batch.nr] = obj;
+			data = NULL;
+			if (++batch.nr == HASH_BATCH_NR)
+				flush_hash_batch(&batch);
 		} else
 			sha1_object(data, NULL, obj->size, obj->type,
 				    &obj->idx.oid);
 		free(data);
 		display_progress(progress, i+1);
+		if (force_early_deltas) {
+			/* Resolve everything that we can right away. */
+			objects[i + 1].idx.offset = consumed_bytes;
+			resolve_early_deltas();
+		}
 	}
+	flush_hash_batch(&batch);
 	objects[i].idx.offset = consumed_bytes;
 	stop_progress(&progress);
 
@@ -1281,6 +1823,8 @@ static void parse_pack_objects(unsigned char *hash)
 	}
 	if (nr_delays)
 		die(_("confusion beyond insanity in parse_pack_objects()"));
+
+	finish_early_deltas();
 }
 
 /*
@@ -1299,15 +1843,17 @@ static void resolve_deltas(void)
 		return;
 
 	/* Sort deltas by base SHA1/offset for fast searching */
-	QSORT(ofs_deltas, nr_ofs_deltas, compare_ofs_delta_entry);
+	QSORT(ofs_deltas, nr_ofs_deltas - nr_early_deltas,
+	      compare_ofs_delta_entry);
 	QSORT(ref_deltas, nr_ref_deltas, compare_ref_delta_entry);
 
 	if (verbose || show_resolving_progress)
 		progress = start_progress(_("Resolving deltas"),
 					  nr_ref_deltas + nr_ofs_deltas);
+	display_progress(progress, nr_resolved_deltas);
 
 	nr_dispatched = 0;
-	base_cache_limit = delta_base_cache_limit * nr_threads;
+	base_cache_limit = delta_base_cache_limit;
 	if (nr_threads > 1 || getenv("GIT_FORCE_THREADS")) {
 		init_thread();
 		work_lock();
@@ -1423,6 +1969,7 @@ static struct object_entry *append_obj_to_pack(struct hashfile *f,
 	obj[0].hdr_size = n;
 	obj[0].type = type;
 	obj[0].real_type = type;
+	obj[0].early = 0;
 	obj[1].idx.offset = obj[0].idx.offset + n;
 	obj[1].idx.offset += write_compressed(f, buf, size);
 	obj[0].idx.crc32 = crc32_end(f);
@@ -1656,6 +2203,13 @@ static int git_index_pack_config(const char *k, const char *v,
 		else
 			opts->flags &= ~WRITE_REV;
 	}
+	if (!strcmp(k, "core.checksumthread")) {
+		if (git_config_bool(k, v))
+			opts->flags |= WRITE_CHECKSUM_THREAD;
+		else
+			opts->flags &= ~WRITE_CHECKSUM_THREAD;
+		return 0;
+	}
 	return git_default_config(k, v, ctx, cb);
 }
 
@@ -1857,10 +2411,16 @@ int cmd_index_pack(int argc,
 
 	disable_replace_refs();
 	fsck_options.walk = mark_link;
+	force_early_deltas = git_env_bool("GIT_TEST_INDEX_PACK_EARLY_DELTAS", 0);
 
 	reset_pack_idx_option(&opts);
 	opts.flags |= WRITE_REV;
 	git_config(git_index_pack_config, &opts);
+	if (git_env_bool(GIT_TEST_CHECKSUM_THREAD,
+			 opts.flags & WRITE_CHECKSUM_THREAD))
+		opts.flags |= WRITE_CHECKSUM_THREAD;
+	else
+		opts.flags &= ~WRITE_CHECKSUM_THREAD;
 	if (prefix && chdir(prefix))
 		die(_("Cannot come back to cwd"));
 
@@ -2009,21 +2569,23 @@ int cmd_index_pack(int argc,
 	if (HAVE_THREADS && !nr_threads) {
 		nr_threads = online_cpus();
 		/*
-		 * Experiments show that going above 20 threads doesn't help,
-		 * no matter how many cores you have. Below that, we tend to
-		 * max at half the number of online_cpus(), presumably because
-		 * half of those are hyperthreads rather than full cores. We'll
-		 * never reduce the level below "3", though, to match a
-		 * historical value that nobody complained about.
+		 * We tend to max at half the number of online_cpus(),
+		 * presumably because half of those are hyperthreads rather
+		 * than full cores. We'll never reduce the level below "3",
+		 * though, to match a historical value that nobody complained
+		 * about.
+		 *
+		 * There used to be a hard cap of 20 threads, as all threads
+		 * took their work from one shared stack. Now that every
+		 * thread works on its own stack and only steals from others
+		 * when it runs dry, we keep scaling with the number of cores.
 		 */
 		if (nr_threads < 4)
 			; /* too few cores to consider capping */
 		else if (nr_threads < 6)
 			nr_threads = 3; /* historic cap */
-		else if (nr_threads < 40)
-			nr_threads /= 2;
 		else
-			nr_threads = 20; /* hard cap */
+			nr_threads /= 2;
 	}
 
 	curr_pack = open_pack_file(pack_name);
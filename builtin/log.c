@@ -24,6 +24,7 @@
 #include "log-tree.h"
 #include "builtin.h"
 #include "oid-array.h"
+#include "oidset.h"
 #include "tag.h"
 #include "reflog-walk.h"
 #include "patch-ids.h"
@@ -503,6 +504,7 @@ static void finish_early_output(struct rev_info *rev)
 static int cmd_log_walk_no_free(struct rev_info *rev)
 {
 	struct commit *commit;
+	struct oidset prefetched = OIDSET_INIT;
 	int saved_nrl = 0;
 	int saved_dcctc = 0;
 	int result;
@@ -522,6 +524,7 @@ static int cmd_log_walk_no_free(struct rev_info *rev)
 	 * retain that state information if replacing rev->diffopt in this loop
 	 */
 	while ((commit = get_revision(rev)) != NULL) {
+		log_tree_prefetch(rev, commit, &prefetched);
 		if (!log_tree_commit(rev, commit) && rev->max_count >= 0)
 			/*
 			 * We decremented max_count in get_revision,
@@ -545,6 +548,7 @@ static int cmd_log_walk_no_free(struct rev_info *rev)
 	}
 	rev->diffopt.degraded_cc_to_c = saved_dcctc;
 	rev->diffopt.needed_rename_limit = saved_nrl;
+	oidset_clear(&prefetched);
 
 	result = diff_result_code(rev);
 	if (rev->diffopt.output_format & DIFF_FORMAT_CHECKDIFF &&
@@ -1274,6 +1274,7 @@ static void write_pack_file(void)
 			f = hashfd_throughput(1, "<stdout>", progress_state);
 		else
 			f = create_tmp_packfile(&pack_tmp_name);
+		f->want_thread = !!(pack_idx_opts.flags & WRITE_CHECKSUM_THREAD);
 
 		offset = write_pack_header(f, nr_remaining);
 
@@ -3311,6 +3312,13 @@ static int git_pack_config(const char *k, const char *v,
 			pack_idx_opts.flags &= ~WRITE_REV;
 		return 0;
 	}
+	if (!strcmp(k, "core.checksumthread")) {
+		if (git_config_bool(k, v))
+			pack_idx_opts.flags |= WRITE_CHECKSUM_THREAD;
+		else
+			pack_idx_opts.flags &= ~WRITE_CHECKSUM_THREAD;
+		return 0;
+	}
 	if (!strcmp(k, "uploadpack.blobpackfileuri")) {
 		struct configured_exclusion *ex;
 		const char *oid_end, *pack_end;
@@ -4452,6 +4460,11 @@ int cmd_pack_objects(int argc,
 	git_config(git_pack_config, NULL);
 	if (git_env_bool(GIT_TEST_NO_WRITE_REV_INDEX, 0))
 		pack_idx_opts.flags &= ~WRITE_REV;
+	if (git_env_bool(GIT_TEST_CHECKSUM_THREAD,
+			 pack_idx_opts.flags & WRITE_CHECKSUM_THREAD))
+		pack_idx_opts.flags |= WRITE_CHECKSUM_THREAD;
+	else
+		pack_idx_opts.flags &= ~WRITE_CHECKSUM_THREAD;
 
 	progress = isatty(2);
 	argc = parse_options(argc, argv, prefix, pack_objects_options,
@@ -1946,6 +1946,7 @@ static void execute_commands(struct command *commands,
 	opt.progress = err_fd && !quiet;
 	opt.env = tmp_objdir_env(tmp_objdir);
 	opt.exclude_hidden_refs_section = "receive";
+	opt.use_bitmaps = 1;
 
 	if (check_connected(iterate_receive_command_list, &data, &opt))
 		set_connectivity_errors(commands, si);
@@ -16,9 +16,12 @@
 #include "progress.h"
 #include "decorate.h"
 #include "fsck.h"
+#include "thread-utils.h"
+#include "trace2.h"
 
 static int dry_run, quiet, recover, has_errors, strict;
-static const char unpack_usage[] = "git unpack-objects [-n] [-q] [-r] [--strict]";
+static int nr_threads;
+static const char unpack_usage[] = "git unpack-objects [-n] [-q] [-r] [--strict] [--threads=<n>]";
 
 /* We always read in 4kB chunks. */
 static unsigned char buffer[4096];
@@ -183,6 +186,8 @@ struct obj_info {
 	off_t offset;
 	struct object_id oid;
 	struct object *obj;
+	/* Set while the object waits for a writer thread. */
+	struct loose_write *pending;
 };
 
 /* Remember to update object flag allocation in object.h */
@@ -192,6 +197,186 @@ struct obj_info {
 static struct obj_info *obj_list;
 static unsigned nr_objects;
 
+/*
+ * With more than one thread, the main thread still inflates the objects,
+ * resolves the deltas and computes the object ids, but hands the objects
+ * off to writer threads to be compressed and written as loose objects.
+ * The objects stay in memory until they are written, so that deltas
+ * against them do not have to wait for them or read them back.
+ */
+struct loose_write {
+	struct object_id oid;
+	enum object_type type;
+	void *buf;
+	unsigned long size;
+	unsigned nr;
+	struct loose_write *next;
+};
+
+/*
+ * Upper bound for the size of the objects waiting to be written, above
+ * which the main thread waits for the writers.
+ */
+#define MAX_PENDING_WRITE_BYTES (64 * 1024 * 1024)
+
+static pthread_t *writers;
+static int writers_active;
+static int writers_exit;
+static pthread_mutex_t write_mutex;
+/* Signalled when objects are queued, or the writers should exit. */
+static pthread_cond_t write_cond;
+/* Signalled when an object was written. */
+static pthread_cond_t written_cond;
+static struct loose_write *write_head, **write_tail = &write_head;
+static unsigned long pending_write_bytes;
+static unsigned pending_write_nr;
+
+static void *writer_thread(void *data UNUSED)
+{
+	trace2_thread_start("unpack-write");
+	pthread_mutex_lock(&write_mutex);
+	for (;;) {
+		struct loose_write *w;
+
+		while (!write_head && !writers_exit)
+			pthread_cond_wait(&write_cond, &write_mutex);
+		if (!write_head)
+			break;
+		w = write_head;
+		write_head = w->next;
+		if (!write_head)
+			write_tail = &write_head;
+		pthread_mutex_unlock(&write_mutex);
+
+		if (write_loose_object_file(w->buf, w->size, w->type,
+					    &w->oid) < 0)
+			die("failed to write object %s", oid_to_hex(&w->oid));
+
+		pthread_mutex_lock(&write_mutex);
+		obj_list[w->nr].pending = NULL;
+		pending_write_bytes -= w->size;
+		pending_write_nr--;
+		free(w->buf);
+		free(w);
+		pthread_cond_signal(&written_cond);
+	}
+	pthread_mutex_unlock(&write_mutex);
+	trace2_thread_exit();
+	return NULL;
+}
+
+static void start_writers(void)
+{
+	int i;
+
+	if (dry_run || nr_threads <= 1 || nr_objects <= 1 ||
+	    the_repository->compat_hash_algo)
+		return;
+
+	pthread_mutex_init(&write_mutex, NULL);
+	pthread_cond_init(&write_cond, NULL);
+	pthread_cond_init(&written_cond, NULL);
+	CALLOC_ARRAY(writers, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int ret = pthread_create(&writers[i], NULL, writer_thread, NULL);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+	writers_active = 1;
+}
+
+static void wait_for_writers(void)
+{
+	pthread_mutex_lock(&write_mutex);
+	while (pending_write_nr)
+		pthread_cond_wait(&written_cond, &write_mutex);
+	pthread_mutex_unlock(&write_mutex);
+}
+
+static void stop_writers(void)
+{
+	int i;
+
+	if (!writers_active)
+		return;
+
+	pthread_mutex_lock(&write_mutex);
+	writers_exit = 1;
+	pthread_cond_broadcast(&write_cond);
+	pthread_mutex_unlock(&write_mutex);
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(writers[i], NULL);
+	FREE_AND_NULL(writers);
+	writers_active = 0;
+
+	pthread_cond_destroy(&written_cond);
+	pthread_cond_destroy(&write_cond);
+	pthread_mutex_destroy(&write_mutex);
+}
+
+/* Hands the nr-th object off to the writers, which free "buf". */
+static void queue_loose_write(unsigned nr, enum object_type type,
+			      void *buf, unsigned long size)
+{
+	struct loose_write *w = xcalloc(1, sizeof(*w));
+
+	oidcpy(&w->oid, &obj_list[nr].oid);
+	w->type = type;
+	w->buf = buf;
+	w->size = size;
+	w->nr = nr;
+
+	pthread_mutex_lock(&write_mutex);
+	while (pending_write_bytes &&
+	       pending_write_bytes + size > MAX_PENDING_WRITE_BYTES)
+		pthread_cond_wait(&written_cond, &write_mutex);
+	*write_tail = w;
+	write_tail = &w->next;
+	obj_list[nr].pending = w;
+	pending_write_bytes += size;
+	pending_write_nr++;
+	pthread_cond_signal(&write_cond);
+	pthread_mutex_unlock(&write_mutex);
+}
+
+/*
+ * Returns a copy of the contents of the nr-th object if it still waits
+ * to be written, or NULL.
+ */
+static void *copy_pending_object(unsigned nr, enum object_type *type,
+				 unsigned long *size)
+{
+	void *buf = NULL;
+
+	if (!writers_active)
+		return NULL;
+
+	pthread_mutex_lock(&write_mutex);
+	if (obj_list[nr].pending) {
+		struct loose_write *w = obj_list[nr].pending;
+
+		buf = xmemdupz(w->buf, w->size);
+		*type = w->type;
+		*size = w->size;
+	}
+	pthread_mutex_unlock(&write_mutex);
+	return buf;
+}
+
+/*
+ * Like repo_has_object_file(), but also finds the objects that are
+ * still waiting for a writer thread.
+ */
+static int has_object_file(const struct object_id *oid)
+{
+	if (repo_has_object_file(the_repository, oid))
+		return 1;
+	if (!writers_active)
+		return 0;
+	wait_for_writers();
+	return repo_has_object_file(the_repository, oid);
+}
+
 /*
  * Called only from check_object() after it verified this object
  * is Ok.
@@ -259,6 +444,27 @@ static void write_rest(void)
 static void added_object(unsigned nr, enum object_type type,
 			 void *data, unsigned long size);
 
+/*
+ * Write out the nr-th object as a loose object, and resolve the deltas
+ * against it. Takes ownership of "buf".
+ */
+static void write_and_resolve(unsigned nr, enum object_type type,
+			      void *buf, unsigned long size)
+{
+	if (writers_active &&
+	    prepare_loose_object_file(buf, size, type, &obj_list[nr].oid)) {
+		added_object(nr, type, buf, size);
+		queue_loose_write(nr, type, buf, size);
+		return;
+	}
+
+	if (!writers_active &&
+	    write_object_file(buf, size, type, &obj_list[nr].oid) < 0)
+		die("failed to write object");
+	added_object(nr, type, buf, size);
+	free(buf);
+}
+
 /*
  * Write out nr-th object from the list, now we know the contents
  * of it.  Under --strict, this buffers structured objects in-core,
@@ -268,19 +474,11 @@ static void write_object(unsigned nr, enum object_type type,
 			 void *buf, unsigned long size)
 {
 	if (!strict) {
-		if (write_object_file(buf, size, type,
-				      &obj_list[nr].oid) < 0)
-			die("failed to write object");
-		added_object(nr, type, buf, size);
-		free(buf);
+		write_and_resolve(nr, type, buf, size);
 		obj_list[nr].obj = NULL;
 	} else if (type == OBJ_BLOB) {
 		struct blob *blob;
-		if (write_object_file(buf, size, type,
-				      &obj_list[nr].oid) < 0)
-			die("failed to write object");
-		added_object(nr, type, buf, size);
-		free(buf);
+		write_and_resolve(nr, type, buf, size);
 
 		blob = lookup_blob(the_repository, &obj_list[nr].oid);
 		if (blob)
@@ -435,9 +633,10 @@ static int resolve_against_held(unsigned nr, const struct object_id *base,
 static void unpack_delta_entry(enum object_type type, unsigned long delta_size,
 			       unsigned nr)
 {
-	void *delta_data, *base;
+	void *delta_data, *base = NULL;
 	unsigned long base_size;
 	struct object_id base_oid;
+	int base_nr = -1;
 
 	if (type == OBJ_REF_DELTA) {
 		oidread(&base_oid, fill(the_hash_algo->rawsz), the_repository->hash_algo);
@@ -445,7 +644,7 @@ static void unpack_delta_entry(enum object_type type, unsigned long delta_size,
 		delta_data = get_data(delta_size);
 		if (!delta_data)
 			return;
-		if (repo_has_object_file(the_repository, &base_oid))
+		if (has_object_file(&base_oid))
 			; /* Ok we have this one */
 		else if (resolve_against_held(nr, &base_oid,
 					      delta_data, delta_size))
@@ -493,6 +692,7 @@ static void unpack_delta_entry(enum object_type type, unsigned long delta_size,
 			} else {
 				oidcpy(&base_oid, &obj_list[mid].oid);
 				base_found = !is_null_oid(&base_oid);
+				base_nr = mid;
 				break;
 			}
 		}
@@ -511,8 +711,11 @@ static void unpack_delta_entry(enum object_type type, unsigned long delta_size,
 	if (resolve_against_held(nr, &base_oid, delta_data, delta_size))
 		return;
 
-	base = repo_read_object_file(the_repository, &base_oid, &type,
-				     &base_size);
+	if (base_nr >= 0)
+		base = copy_pending_object(base_nr, &type, &base_size);
+	if (!base)
+		base = repo_read_object_file(the_repository, &base_oid, &type,
+					     &base_size);
 	if (!base) {
 		error("failed to read delta-pack base object %s",
 		      oid_to_hex(&base_oid));
@@ -591,10 +794,12 @@ static void unpack_all(void)
 		progress = start_progress(_("Unpacking objects"), nr_objects);
 	CALLOC_ARRAY(obj_list, nr_objects);
 	begin_odb_transaction();
+	start_writers();
 	for (i = 0; i < nr_objects; i++) {
 		unpack_one(i);
 		display_progress(progress, i + 1);
 	}
+	stop_writers();
 	end_odb_transaction();
 	stop_progress(&progress);
 
@@ -602,6 +807,23 @@ static void unpack_all(void)
 		die("unresolved deltas left after unpacking");
 }
 
+static int unpack_objects_config(const char *var, const char *value,
+				 const struct config_context *ctx, void *cb)
+{
+	if (!strcmp(var, "pack.threads")) {
+		nr_threads = git_config_int(var, value, ctx->kvi);
+		if (nr_threads < 0)
+			die(_("invalid number of threads specified (%d)"),
+			    nr_threads);
+		if (!HAVE_THREADS && nr_threads != 1) {
+			warning(_("no threads support, ignoring %s"), var);
+			nr_threads = 1;
+		}
+		return 0;
+	}
+	return git_default_config(var, value, ctx, cb);
+}
+
 int cmd_unpack_objects(int argc,
 		       const char **argv,
 		       const char *prefix UNUSED,
@@ -613,7 +835,7 @@ int cmd_unpack_objects(int argc,
 
 	disable_replace_refs();
 
-	git_config(git_default_config, NULL);
+	git_config(unpack_objects_config, NULL);
 
 	quiet = !isatty(2);
 
@@ -661,12 +883,34 @@ int cmd_unpack_objects(int argc,
 				max_input_size = strtoumax(arg, NULL, 10);
 				continue;
 			}
+			if (skip_prefix(arg, "--threads=", &arg)) {
+				char *end;
+				nr_threads = strtoul(arg, &end, 0);
+				if (!*arg || *end || nr_threads < 0)
+					usage(unpack_usage);
+				if (!HAVE_THREADS && nr_threads != 1) {
+					warning(_("no threads support, ignoring --threads"));
+					nr_threads = 1;
+				}
+				continue;
+			}
 			usage(unpack_usage);
 		}
 
 		/* We don't take any non-flag arguments now.. Maybe some day */
 		usage(unpack_usage);
 	}
+	if (HAVE_THREADS && !nr_threads) {
+		/*
+		 * The writers spend much of their time waiting for the
+		 * filesystem, but more of them than there are cores mostly
+		 * contend for it.
+		 */
+		nr_threads = online_cpus();
+		if (nr_threads > 8)
+			nr_threads = 8;
+	}
+
 	the_hash_algo->init_fn(&ctx);
 	unpack_all();
 	the_hash_algo->update_fn(&ctx, buffer, offset);
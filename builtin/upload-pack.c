@@ -4,9 +4,7 @@
 #include "pkt-line.h"
 #include "parse-options.h"
 #include "path.h"
-#include "protocol.h"
 #include "replace-object.h"
-#include "upload-pack.h"
 #include "serve.h"
 #include "commit.h"
 #include "environment.h"
@@ -57,28 +55,7 @@ int cmd_upload_pack(int argc,
 	if (!enter_repo(dir, strict))
 		die("'%s' does not appear to be a git repository", dir);
 
-	switch (determine_protocol_version_server()) {
-	case protocol_v2:
-		if (advertise_refs)
-			protocol_v2_advertise_capabilities();
-		else
-			protocol_v2_serve_loop(stateless_rpc);
-		break;
-	case protocol_v1:
-		/*
-		 * v1 is just the original protocol with a version string,
-		 * so just fall through after writing the version string.
-		 */
-		if (advertise_refs || !stateless_rpc)
-			packet_write_fmt(1, "version 1\n");
-
-		/* fallthrough */
-	case protocol_v0:
-		upload_pack(advertise_refs, stateless_rpc, timeout);
-		break;
-	case protocol_unknown_version:
-		BUG("unknown protocol version");
-	}
+	serve_upload_pack(advertise_refs, stateless_rpc, timeout);
 
 	return 0;
 }
@@ -4,6 +4,7 @@
 #include "bundle-uri.h"
 #include "bundle.h"
 #include "copy.h"
+#include "environment.h"
 #include "gettext.h"
 #include "refs.h"
 #include "run-command.h"
@@ -12,6 +13,8 @@
 #include "config.h"
 #include "fetch-pack.h"
 #include "remote.h"
+#include "strvec.h"
+#include "thread-utils.h"
 #include "trace2.h"
 #include "object-store-ll.h"
 
@@ -359,41 +362,20 @@ static int copy_uri_to_file(const char *filename, const char *uri)
 	return copy_file(filename, uri, 0);
 }
 
-static int unbundle_from_file(struct repository *r, const char *file)
+/*
+ * Convert all refs/heads/ from the bundle into refs/bundles/
+ * in the local repository.
+ */
+static void update_bundle_refs(struct bundle_header *header)
 {
-	int result = 0;
-	int bundle_fd;
-	struct bundle_header header = BUNDLE_HEADER_INIT;
 	struct string_list_item *refname;
 	struct strbuf bundle_ref = STRBUF_INIT;
 	size_t bundle_prefix_len;
 
-	bundle_fd = read_bundle_header(file, &header);
-	if (bundle_fd < 0) {
-		result = 1;
-		goto cleanup;
-	}
-
-	/*
-	 * Skip the reachability walk here, since we will be adding
-	 * a reachable ref pointing to the new tips, which will reach
-	 * the prerequisite commits.
-	 */
-	result = unbundle(r, &header, bundle_fd, NULL,
-			  VERIFY_BUNDLE_QUIET | (fetch_pack_fsck_objects() ? VERIFY_BUNDLE_FSCK : 0));
-	if (result) {
-		result = 1;
-		goto cleanup;
-	}
-
-	/*
-	 * Convert all refs/heads/ from the bundle into refs/bundles/
-	 * in the local repository.
-	 */
 	strbuf_addstr(&bundle_ref, "refs/bundles/");
 	bundle_prefix_len = bundle_ref.len;
 
-	for_each_string_list_item(refname, &header.references) {
+	for_each_string_list_item(refname, &header->references) {
 		struct object_id *oid = refname->util;
 		struct object_id old_oid;
 		const char *branch_name;
@@ -413,8 +395,41 @@ static int unbundle_from_file(struct repository *r, const char *file)
 				0, UPDATE_REFS_MSG_ON_ERR);
 	}
 
-cleanup:
 	strbuf_release(&bundle_ref);
+}
+
+static enum verify_bundle_flags unbundle_flags(void)
+{
+	return VERIFY_BUNDLE_QUIET |
+	       (fetch_pack_fsck_objects() ? VERIFY_BUNDLE_FSCK : 0);
+}
+
+static int unbundle_from_file(struct repository *r, const char *file)
+{
+	int result = 0;
+	int bundle_fd;
+	struct bundle_header header = BUNDLE_HEADER_INIT;
+
+	bundle_fd = read_bundle_header(file, &header);
+	if (bundle_fd < 0) {
+		result = 1;
+		goto cleanup;
+	}
+
+	/*
+	 * Skip the reachability walk here, since we will be adding
+	 * a reachable ref pointing to the new tips, which will reach
+	 * the prerequisite commits.
+	 */
+	result = unbundle(r, &header, bundle_fd, NULL, unbundle_flags());
+	if (result) {
+		result = 1;
+		goto cleanup;
+	}
+
+	update_bundle_refs(&header);
+
+cleanup:
 	bundle_header_release(&header);
 	return result;
 }
@@ -494,6 +509,598 @@ static int compare_creation_token_decreasing(const void *va, const void *vb)
 	return 0;
 }
 
+static int bundle_jobs(struct repository *r)
+{
+	int jobs = 1;
+
+	if (!HAVE_THREADS)
+		return 1;
+
+	if (!repo_config_get_int(r, "fetch.bundlejobs", &jobs)) {
+		if (jobs < 0)
+			die(_("fetch.bundleJobs cannot be negative"));
+		if (!jobs)
+			jobs = online_cpus();
+	}
+	return jobs;
+}
+
+/*
+ * With "fetch.bundleJobs" larger than one, bundles are downloaded and
+ * unbundled in parallel: a pool of threads copies the bundles to
+ * temporary files in the order in which they appear in 'items', while
+ * the main thread uses run_processes_parallel() to run "index-pack" on
+ * every downloaded bundle whose prerequisites are present.
+ *
+ * Bundles building on top of each other still have to be indexed one
+ * after the other, as their thin packs need the objects of the bundles
+ * they build on. But downloads overlap with indexing, and independent
+ * bundles are indexed at the same time.
+ */
+enum parallel_bundle_state {
+	PB_PENDING = 0,
+	PB_DOWNLOADING,
+	PB_DOWNLOADED,
+	PB_DOWNLOAD_FAILED,
+	PB_NOT_A_BUNDLE,
+	PB_WAITING,
+	PB_INDEXING,
+	PB_UNBUNDLED,
+	PB_FAILED,
+};
+
+struct parallel_bundle {
+	struct remote_bundle_info *bundle;
+	enum parallel_bundle_state state;
+	struct bundle_header header;
+	int fd;
+
+	/*
+	 * The value of 'nr_unbundled' when the prerequisites were found
+	 * missing the last time, so that we only check again once more
+	 * objects have arrived.
+	 */
+	int checked;
+
+	/* The order in which bundles finished unbundling. */
+	int seq;
+};
+
+struct parallel_bundles {
+	struct repository *r;
+	struct parallel_bundle *items;
+	size_t nr;
+
+	/*
+	 * With the creationToken heuristic, 'items' are sorted by
+	 * decreasing creationToken, and only the bundles down to the
+	 * first one that applies to the repository as it is, the 'floor',
+	 * are needed. 'scan' is the next bundle to look at while trying
+	 * to find it.
+	 */
+	unsigned minimal:1,
+		 have_floor:1;
+	size_t scan, floor;
+
+	int nr_unbundled;
+	int running;
+
+	/*
+	 * Download threads. Everything below is protected by 'mutex', as
+	 * is the 'state' of items that have not been downloaded yet.
+	 */
+	pthread_t *threads;
+	int nr_threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	size_t next_download, download_limit;
+	int downloading;
+	int nr_downloads_done;
+	int stop;
+};
+
+static void init_parallel_bundles(struct parallel_bundles *pb,
+				  struct repository *r,
+				  struct remote_bundle_info **bundles,
+				  size_t nr)
+{
+	memset(pb, 0, sizeof(*pb));
+	pb->r = r;
+	pb->nr = nr;
+	CALLOC_ARRAY(pb->items, nr);
+	for (size_t i = 0; i < nr; i++) {
+		struct parallel_bundle *item = &pb->items[i];
+
+		item->bundle = bundles[i];
+		bundle_header_init(&item->header);
+		item->fd = -1;
+		item->checked = -1;
+	}
+	pthread_mutex_init(&pb->mutex, NULL);
+	pthread_cond_init(&pb->cond, NULL);
+}
+
+static void clear_parallel_bundles(struct parallel_bundles *pb)
+{
+	for (size_t i = 0; i < pb->nr; i++) {
+		if (pb->items[i].fd >= 0)
+			close(pb->items[i].fd);
+		bundle_header_release(&pb->items[i].header);
+	}
+	free(pb->items);
+	free(pb->threads);
+	pthread_cond_destroy(&pb->cond);
+	pthread_mutex_destroy(&pb->mutex);
+}
+
+static void *download_bundles_thread(void *data)
+{
+	struct parallel_bundles *pb = data;
+
+	pthread_mutex_lock(&pb->mutex);
+	while (!pb->stop) {
+		struct parallel_bundle *item;
+		int res;
+
+		if (pb->next_download >= pb->download_limit) {
+			pthread_cond_wait(&pb->cond, &pb->mutex);
+			continue;
+		}
+
+		item = &pb->items[pb->next_download++];
+		if (item->state != PB_PENDING)
+			continue;
+		item->state = PB_DOWNLOADING;
+		pb->downloading++;
+		pthread_mutex_unlock(&pb->mutex);
+
+		res = copy_uri_to_file(item->bundle->file, item->bundle->uri);
+		if (res)
+			unlink(item->bundle->file);
+
+		pthread_mutex_lock(&pb->mutex);
+		item->state = res ? PB_DOWNLOAD_FAILED : PB_DOWNLOADED;
+		pb->downloading--;
+		pb->nr_downloads_done++;
+		pthread_cond_broadcast(&pb->cond);
+	}
+	pthread_mutex_unlock(&pb->mutex);
+	return NULL;
+}
+
+static void start_bundle_downloads(struct parallel_bundles *pb, int jobs)
+{
+	for (size_t i = 0; i < pb->nr; i++) {
+		struct remote_bundle_info *bundle = pb->items[i].bundle;
+
+		if (pb->items[i].state != PB_PENDING)
+			continue;
+		if (!bundle->file && !(bundle->file = find_temp_filename()))
+			pb->items[i].state = PB_DOWNLOAD_FAILED;
+	}
+
+	/*
+	 * Until we know which bundles are needed, only download as many
+	 * as there are threads, starting with the newest ones.
+	 */
+	if (pb->minimal && jobs < pb->nr)
+		pb->download_limit = jobs;
+	else
+		pb->download_limit = pb->nr;
+	CALLOC_ARRAY(pb->threads, jobs);
+	for (int i = 0; i < jobs; i++) {
+		int err = pthread_create(&pb->threads[i], NULL,
+					 download_bundles_thread, pb);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+		pb->nr_threads++;
+	}
+}
+
+static void set_download_limit(struct parallel_bundles *pb, size_t limit)
+{
+	pthread_mutex_lock(&pb->mutex);
+	pb->download_limit = limit;
+	pthread_cond_broadcast(&pb->cond);
+	pthread_mutex_unlock(&pb->mutex);
+}
+
+/* Keep the download threads busy with the bundles right after 'scan'. */
+static void widen_download_limit(struct parallel_bundles *pb)
+{
+	size_t limit = st_add(pb->scan, pb->nr_threads);
+
+	set_download_limit(pb, limit < pb->nr ? limit : pb->nr);
+}
+
+/*
+ * Stop the download threads. With 'wait', let them download all bundles
+ * below the download limit first.
+ */
+static void stop_bundle_downloads(struct parallel_bundles *pb, int wait)
+{
+	pthread_mutex_lock(&pb->mutex);
+	while (wait && (pb->downloading ||
+			pb->next_download < pb->download_limit))
+		pthread_cond_wait(&pb->cond, &pb->mutex);
+	pb->stop = 1;
+	pthread_cond_broadcast(&pb->cond);
+	pthread_mutex_unlock(&pb->mutex);
+
+	for (int i = 0; i < pb->nr_threads; i++)
+		pthread_join(pb->threads[i], NULL);
+	pb->nr_threads = 0;
+}
+
+static enum parallel_bundle_state bundle_state(struct parallel_bundles *pb,
+					       struct parallel_bundle *item)
+{
+	enum parallel_bundle_state state;
+
+	pthread_mutex_lock(&pb->mutex);
+	state = item->state;
+	pthread_mutex_unlock(&pb->mutex);
+	return state;
+}
+
+static int nr_downloads_done(struct parallel_bundles *pb)
+{
+	int nr;
+
+	pthread_mutex_lock(&pb->mutex);
+	nr = pb->nr_downloads_done;
+	pthread_mutex_unlock(&pb->mutex);
+	return nr;
+}
+
+static void wait_for_download(struct parallel_bundles *pb, int seen)
+{
+	pthread_mutex_lock(&pb->mutex);
+	while (pb->nr_downloads_done == seen)
+		pthread_cond_wait(&pb->cond, &pb->mutex);
+	pthread_mutex_unlock(&pb->mutex);
+}
+
+static enum parallel_bundle_state open_bundle(struct parallel_bundles *pb,
+					      struct parallel_bundle *item)
+{
+	enum parallel_bundle_state state;
+
+	/* Files that are not bundles are looked at again at the end. */
+	if (!is_bundle(item->bundle->file, 1)) {
+		state = PB_NOT_A_BUNDLE;
+	} else {
+		item->fd = read_bundle_header(item->bundle->file, &item->header);
+		state = item->fd < 0 ? PB_FAILED : PB_WAITING;
+	}
+
+	pthread_mutex_lock(&pb->mutex);
+	item->state = state;
+	pthread_mutex_unlock(&pb->mutex);
+	return state;
+}
+
+static int prerequisites_present(struct parallel_bundles *pb,
+				 struct parallel_bundle *item)
+{
+	if (item->checked == pb->nr_unbundled)
+		return 0;
+	if (!verify_bundle(pb->r, &item->header, VERIFY_BUNDLE_QUIET))
+		return 1;
+	item->checked = pb->nr_unbundled;
+	return 0;
+}
+
+/*
+ * Return a bundle that can be unbundled right now, if any. Set
+ * '*pending' if there may be more once other downloads complete.
+ */
+static struct parallel_bundle *next_ready_bundle(struct parallel_bundles *pb,
+						 int *pending)
+{
+	size_t end = pb->nr;
+
+	*pending = 0;
+
+	while (pb->minimal && !pb->have_floor && pb->scan < pb->nr) {
+		struct parallel_bundle *item = &pb->items[pb->scan];
+		enum parallel_bundle_state state = bundle_state(pb, item);
+
+		if (state == PB_PENDING || state == PB_DOWNLOADING) {
+			*pending = 1;
+			return NULL;
+		}
+		if (state == PB_DOWNLOADED)
+			state = open_bundle(pb, item);
+		if (state == PB_WAITING && prerequisites_present(pb, item)) {
+			pb->have_floor = 1;
+			pb->floor = pb->scan;
+			set_download_limit(pb, pb->floor + 1);
+			return item;
+		}
+		pb->scan++;
+		widen_download_limit(pb);
+	}
+
+	if (pb->minimal) {
+		if (!pb->have_floor)
+			return NULL;
+		end = pb->floor;
+	}
+
+	for (size_t i = 0; i < end; i++) {
+		struct parallel_bundle *item = &pb->items[i];
+		enum parallel_bundle_state state = bundle_state(pb, item);
+
+		if (state == PB_PENDING || state == PB_DOWNLOADING) {
+			*pending = 1;
+			continue;
+		}
+		if (state == PB_DOWNLOADED)
+			state = open_bundle(pb, item);
+		if (state == PB_WAITING && prerequisites_present(pb, item))
+			return item;
+	}
+	return NULL;
+}
+
+static int next_unbundle_task(struct child_process *cp,
+			      struct strbuf *out UNUSED,
+			      void *pp_cb, void **task_cb)
+{
+	struct parallel_bundles *pb = pp_cb;
+
+	for (;;) {
+		int seen = nr_downloads_done(pb);
+		struct parallel_bundle *item;
+		int pending;
+
+		item = next_ready_bundle(pb, &pending);
+		if (item) {
+			prepare_unbundle(cp, &item->header, item->fd, NULL,
+					 unbundle_flags());
+			cp->no_stdin = 0;
+			item->fd = -1;
+			item->state = PB_INDEXING;
+			pb->running++;
+			*task_cb = item;
+			return 1;
+		}
+
+		/*
+		 * We are called again whenever a running task finishes, so
+		 * only block on downloads when nothing else can happen.
+		 */
+		if (pb->running || !pending)
+			return 0;
+		wait_for_download(pb, seen);
+	}
+}
+
+static void unbundle_failed(struct parallel_bundles *pb,
+			    struct parallel_bundle *item)
+{
+	item->state = PB_FAILED;
+
+	/* Look deeper in the list for another bundle to start from. */
+	if (pb->minimal && pb->have_floor && item == &pb->items[pb->floor]) {
+		pb->have_floor = 0;
+		pb->scan = pb->floor + 1;
+		widen_download_limit(pb);
+	}
+}
+
+static int unbundle_start_failure(struct strbuf *out UNUSED,
+				  void *pp_cb, void *task_cb)
+{
+	struct parallel_bundles *pb = pp_cb;
+
+	pb->running--;
+	unbundle_failed(pb, task_cb);
+	return 0;
+}
+
+static int unbundle_task_finished(int result, struct strbuf *out UNUSED,
+				  void *pp_cb, void *task_cb)
+{
+	struct parallel_bundles *pb = pp_cb;
+	struct parallel_bundle *item = task_cb;
+
+	pb->running--;
+	if (result) {
+		unbundle_failed(pb, item);
+	} else {
+		item->state = PB_UNBUNDLED;
+		item->seq = pb->nr_unbundled++;
+	}
+	return 0;
+}
+
+static void run_parallel_unbundle(struct parallel_bundles *pb, int jobs)
+{
+	struct run_process_parallel_opts opts = {
+		.tr2_category = "bundle-uri",
+		.tr2_label = "unbundle",
+		.processes = jobs,
+		.get_next_task = next_unbundle_task,
+		.start_failure = unbundle_start_failure,
+		.task_finished = unbundle_task_finished,
+		.data = pb,
+	};
+
+	run_processes_parallel(&opts);
+}
+
+static int compare_unbundle_order(const void *va, const void *vb)
+{
+	const struct parallel_bundle * const *a = va;
+	const struct parallel_bundle * const *b = vb;
+
+	return (*a)->seq - (*b)->seq;
+}
+
+/*
+ * Download the bundles in 'bundles', sorted by decreasing creationToken,
+ * in parallel and unbundle as few of them as possible, like the serial
+ * loop in fetch_bundles_by_token() does. The refs of the bundles are
+ * updated in order of increasing creationToken once all of them have
+ * been indexed.
+ *
+ * Files that turn out not to be bundles are skipped while looking for
+ * bundles to unbundle, and handed to fetch_bundle_uri_internal() at the
+ * end, like the serial loop does: a bundle list found there is handled
+ * as such, and anything else is ignored like a failed download.
+ */
+static int fetch_bundles_by_token_in_parallel(struct repository *r,
+					      struct bundle_list *list,
+					      struct remote_bundle_info **bundles,
+					      size_t nr,
+					      uint64_t maxCreationToken,
+					      uint64_t *newMaxCreationToken,
+					      int jobs)
+{
+	struct parallel_bundles pb;
+	int result;
+
+	/* Bundles at or below the previous creationToken are not needed. */
+	while (nr && bundles[nr - 1]->creationToken <= maxCreationToken)
+		nr--;
+
+	init_parallel_bundles(&pb, r, bundles, nr);
+	pb.minimal = 1;
+	for (size_t i = 0; i < nr; i++)
+		if (bundles[i]->file)
+			pb.items[i].state = PB_DOWNLOADED;
+
+	start_bundle_downloads(&pb, jobs);
+	run_parallel_unbundle(&pb, jobs);
+	stop_bundle_downloads(&pb, 0);
+
+	result = !pb.have_floor;
+	for (size_t i = nr; i-- > 0; ) {
+		struct parallel_bundle *item = &pb.items[i];
+
+		switch (item->state) {
+		case PB_UNBUNDLED:
+			update_bundle_refs(&item->header);
+			item->bundle->unbundled = 1;
+			if (item->bundle->creationToken > *newMaxCreationToken)
+				*newMaxCreationToken = item->bundle->creationToken;
+			break;
+		case PB_DOWNLOAD_FAILED:
+			if (!pb.have_floor || i < pb.floor)
+				warning(_("failed to download bundle from URI '%s'"),
+					item->bundle->uri);
+			break;
+		case PB_NOT_A_BUNDLE:
+			/* The serial loop would never have looked at it. */
+			if (pb.have_floor && i > pb.floor)
+				break;
+			item->bundle->downloaded = 1;
+			if (fetch_bundle_uri_internal(r, item->bundle, 1, list)) {
+				/* Mark as unbundled so we do not retry. */
+				item->bundle->unbundled = 1;
+				break;
+			}
+			warning(_("file downloaded from '%s' is not a bundle"),
+				item->bundle->uri);
+			result = 1;
+			break;
+		default:
+			/* A bundle above the floor did not apply. */
+			if (pb.have_floor && i < pb.floor)
+				result = 1;
+			break;
+		}
+	}
+
+	clear_parallel_bundles(&pb);
+	return result;
+}
+
+/*
+ * Download all bundles of 'list' in parallel ahead of time, so that the
+ * serial walk over the list in download_bundle_list() finds them on disk.
+ */
+static void prefetch_bundle_list(struct repository *r,
+				 struct bundle_list *list)
+{
+	struct parallel_bundles pb;
+	int jobs = bundle_jobs(r);
+	struct bundles_for_sorting bundles = {
+		.alloc = hashmap_get_size(&list->bundles),
+	};
+
+	if (jobs <= 1 || bundles.alloc <= 1)
+		return;
+
+	ALLOC_ARRAY(bundles.items, bundles.alloc);
+	for_all_bundles_in_list(list, append_bundle, &bundles);
+
+	init_parallel_bundles(&pb, r, bundles.items, bundles.nr);
+	for (size_t i = 0; i < pb.nr; i++)
+		if (bundles.items[i]->file)
+			pb.items[i].state = PB_DOWNLOADED;
+
+	start_bundle_downloads(&pb, jobs);
+	stop_bundle_downloads(&pb, 1);
+
+	/* Failed downloads are retried, and reported, by the serial walk. */
+	for (size_t i = 0; i < pb.nr; i++)
+		if (pb.items[i].state == PB_DOWNLOADED)
+			pb.items[i].bundle->downloaded = 1;
+
+	clear_parallel_bundles(&pb);
+	free(bundles.items);
+}
+
+/*
+ * Unbundle all downloaded bundles of 'list' in parallel, respecting
+ * their prerequisites. The refs are updated in the order in which the
+ * bundles were unbundled, so that bundles building on top of others
+ * win.
+ */
+static void unbundle_all_bundles_in_parallel(struct repository *r,
+					     struct bundle_list *list,
+					     int jobs)
+{
+	struct parallel_bundles pb;
+	struct parallel_bundle **done;
+	size_t nr_done = 0;
+	struct bundles_for_sorting bundles = {
+		.alloc = hashmap_get_size(&list->bundles),
+	};
+
+	ALLOC_ARRAY(bundles.items, bundles.alloc);
+	for_all_bundles_in_list(list, append_bundle, &bundles);
+
+	init_parallel_bundles(&pb, r, bundles.items, bundles.nr);
+	for (size_t i = 0; i < pb.nr; i++) {
+		struct remote_bundle_info *bundle = bundles.items[i];
+
+		if (bundle->file && !bundle->unbundled)
+			pb.items[i].state = PB_DOWNLOADED;
+		else
+			pb.items[i].state = PB_FAILED;
+	}
+
+	run_parallel_unbundle(&pb, jobs);
+
+	ALLOC_ARRAY(done, pb.nr);
+	for (size_t i = 0; i < pb.nr; i++)
+		if (pb.items[i].state == PB_UNBUNDLED)
+			done[nr_done++] = &pb.items[i];
+	QSORT(done, nr_done, compare_unbundle_order);
+	for (size_t i = 0; i < nr_done; i++) {
+		update_bundle_refs(&done[i]->header);
+		done[i]->bundle->unbundled = 1;
+	}
+
+	free(done);
+	clear_parallel_bundles(&pb);
+	free(bundles.items);
+}
+
 static int fetch_bundles_by_token(struct repository *r,
 				  struct bundle_list *list)
 {
@@ -501,6 +1108,7 @@ static int fetch_bundles_by_token(struct repository *r,
 	int move_direction = 0;
 	const char *creationTokenStr;
 	uint64_t maxCreationToken = 0, newMaxCreationToken = 0;
+	int jobs = bundle_jobs(r);
 	struct bundle_list_context ctx = {
 		.r = r,
 		.list = list,
@@ -551,8 +1159,20 @@ static int fetch_bundles_by_token(struct repository *r,
 	 * If there are existing objects, then this process may terminate
 	 * early when all required commits from "new" bundles exist in the
 	 * repo's object store.
+	 *
+	 * With fetch.bundleJobs, the same happens with several bundles
+	 * being downloaded and unbundled at the same time. The loop below
+	 * is skipped in that case, with 'cur' set to where it would have
+	 * ended.
 	 */
-	cur = 0;
+	if (jobs > 1)
+		cur = fetch_bundles_by_token_in_parallel(r, list, bundles.items,
+							 bundles.nr,
+							 maxCreationToken,
+							 &newMaxCreationToken,
+							 jobs) ? bundles.nr : -1;
+	else
+		cur = 0;
 	while (cur >= 0 && cur < bundles.nr) {
 		struct remote_bundle_info *bundle = bundles.items[cur];
 
@@ -654,6 +1274,9 @@ static int download_bundle_list(struct repository *r,
 		.mode = local_list->mode,
 	};
 
+	if (local_list->mode == BUNDLE_MODE_ALL)
+		prefetch_bundle_list(r, local_list);
+
 	return for_all_bundles_in_list(local_list, download_bundle_to_file, &ctx);
 }
 
@@ -728,7 +1351,8 @@ static int fetch_bundle_uri_internal(struct repository *r,
 		goto cleanup;
 	}
 
-	if ((result = copy_uri_to_file(bundle->file, bundle->uri))) {
+	if (!bundle->downloaded &&
+	    (result = copy_uri_to_file(bundle->file, bundle->uri))) {
 		warning(_("failed to download bundle from URI '%s'"), bundle->uri);
 		goto cleanup;
 	}
@@ -777,6 +1401,13 @@ static int attempt_unbundle(struct remote_bundle_info *info, void *data)
 static int unbundle_all_bundles(struct repository *r,
 				struct bundle_list *list)
 {
+	int jobs = bundle_jobs(r);
+
+	if (jobs > 1) {
+		unbundle_all_bundles_in_parallel(r, list, jobs);
+		return 0;
+	}
+
 	/*
 	 * Iterate through all bundles looking for ones that can
 	 * successfully unbundle. If any succeed, then perhaps another
@@ -875,36 +1506,163 @@ int fetch_bundle_list(struct repository *r, struct bundle_list *list)
  * API for serve.c.
  */
 
+static char *generated_bundle_list(struct repository *r)
+{
+	return xstrfmt("%s/%s/%s", r->objects->odb->path,
+		       GENERATED_BUNDLES_DIR, GENERATED_BUNDLE_LIST);
+}
+
+static int has_generated_bundles(struct repository *r)
+{
+	char *path = generated_bundle_list(r);
+	int ret = !access(path, F_OK);
+
+	free(path);
+	return ret;
+}
+
 int bundle_uri_advertise(struct repository *r, struct strbuf *value UNUSED)
 {
 	static int advertise_bundle_uri = -1;
+	int ret;
 
 	if (advertise_bundle_uri != -1)
 		goto cached;
 
-	advertise_bundle_uri = 0;
-	repo_config_get_maybe_bool(r, "uploadpack.advertisebundleuris", &advertise_bundle_uri);
+	/*
+	 * Unless configured otherwise, advertise the bundles written by the
+	 * "bundles" maintenance task, if there are any.
+	 */
+	ret = repo_config_get_maybe_bool(r, "uploadpack.advertisebundleuris",
+					 &advertise_bundle_uri);
+	if (ret > 0)
+		advertise_bundle_uri = !*get_git_namespace() &&
+				       has_generated_bundles(r);
+	else if (ret < 0)
+		advertise_bundle_uri = 0;
 
 cached:
 	return advertise_bundle_uri;
 }
 
+struct bundle_uri_lines {
+	struct packet_writer *writer;
+	int nr;
+
+	/* For generated bundles, the base their URIs are relative to. */
+	const char *uri_base;
+};
+
 static int config_to_packet_line(const char *key, const char *value,
 				 const struct config_context *ctx UNUSED,
 				 void *data)
 {
-	struct packet_reader *writer = data;
+	struct bundle_uri_lines *lines = data;
 
-	if (starts_with(key, "bundle."))
-		packet_write_fmt(writer->fd, "%s=%s", key, value);
+	if (!starts_with(key, "bundle."))
+		return 0;
+
+	if (lines->uri_base && ends_with(key, ".uri"))
+		packet_writer_write(lines->writer, "%s=%s/%s", key,
+				    lines->uri_base, value);
+	else
+		packet_writer_write(lines->writer, "%s=%s", key, value);
+	lines->nr++;
 
 	return 0;
 }
 
+static int collect_hidden_refs(const char *var, const char *value,
+			       const struct config_context *ctx UNUSED,
+			       void *data)
+{
+	return parse_hide_refs_config(var, value, "uploadpack", data);
+}
+
+static int check_generated_bundle(struct remote_bundle_info *info, void *data)
+{
+	const struct strvec *hidden = data;
+	struct bundle_header header = BUNDLE_HEADER_INIT;
+	struct string_list_item *item;
+	int fd = read_bundle_header(info->uri, &header);
+	int ret = 0;
+
+	if (fd < 0)
+		return -1;
+	close(fd);
+
+	for_each_string_list_item(item, &header.references)
+		if (ref_is_hidden(item->string, item->string, hidden))
+			ret = -1;
+	bundle_header_release(&header);
+	return ret;
+}
+
+/*
+ * The "bundles" maintenance task leaves out hidden refs, but refs may
+ * have been hidden after it last ran. Check the bundles when any refs
+ * are hidden.
+ */
+static int generated_bundles_are_visible(struct repository *r,
+					 const char *path)
+{
+	struct strvec hidden = STRVEC_INIT;
+	struct bundle_list list;
+	int ret = 1;
+
+	repo_config(r, collect_hidden_refs, &hidden);
+	if (!hidden.nr)
+		return 1;
+
+	init_bundle_list(&list);
+	if (bundle_uri_parse_config_format(path, path, &list) ||
+	    for_all_bundles_in_list(&list, check_generated_bundle, &hidden))
+		ret = 0;
+	clear_bundle_list(&list);
+	strvec_clear(&hidden);
+	return ret;
+}
+
+/*
+ * Send the list of bundles written by the "bundles" maintenance task. The
+ * bundles are named relative to "uploadpack.bundleURIBase", which defaults
+ * to their location relative to the URL of the repository. Clients resolve
+ * relative URIs against the URL they fetch from, which names the working
+ * tree rather than the ".git" directory of a non-bare repository.
+ */
+static void advertise_generated_bundles(struct repository *r,
+					struct bundle_uri_lines *lines)
+{
+	char *path = generated_bundle_list(r);
+	const char *base;
+	int bare;
+
+	if (repo_config_get_string_tmp(r, "uploadpack.bundleuribase", &base)) {
+		if (!repo_config_get_bool(r, "core.bare", &bare) && !bare)
+			base = ".git/objects/" GENERATED_BUNDLES_DIR;
+		else
+			base = "objects/" GENERATED_BUNDLES_DIR;
+	}
+
+	/*
+	 * The bundles hold all branches and tags, so they cannot be served
+	 * from within a namespace.
+	 */
+	if (!*get_git_namespace() && !access(path, F_OK) &&
+	    generated_bundles_are_visible(r, path)) {
+		lines->uri_base = base;
+		git_config_from_file(config_to_packet_line, path, lines);
+	}
+	free(path);
+}
+
 int bundle_uri_command(struct repository *r,
 		       struct packet_reader *request)
 {
 	struct packet_writer writer;
+	struct bundle_uri_lines lines = {
+		.writer = &writer,
+	};
 	packet_writer_init(&writer, 1);
 
 	while (packet_reader_read(request) == PACKET_READ_NORMAL)
@@ -914,9 +1672,11 @@ int bundle_uri_command(struct repository *r,
 
 	/*
 	 * Read all "bundle.*" config lines to the client as key=value
-	 * packet lines.
+	 * packet lines. Without any, fall back to generated bundles.
 	 */
-	repo_config(r, config_to_packet_line, &writer);
+	repo_config(r, config_to_packet_line, &lines);
+	if (!lines.nr)
+		advertise_generated_bundles(r, &lines);
 
 	packet_writer_flush(&writer);
 
@@ -37,6 +37,13 @@ struct remote_bundle_info {
 	 */
 	char *file;
 
+	/**
+	 * If the bundle has been downloaded to 'file' ahead of time,
+	 * e.g. in parallel with other bundles, then this boolean is
+	 * true.
+	 */
+	unsigned downloaded:1;
+
 	/**
 	 * If the bundle has been unbundled successfully, then
 	 * this boolean is true.
@@ -110,6 +117,14 @@ int for_all_bundles_in_list(struct bundle_list *list,
 struct FILE;
 void print_bundle_list(FILE *fp, struct bundle_list *list);
 
+/*
+ * The "bundles" maintenance task writes bundles of the repository's own
+ * history into this directory below the object directory, together with
+ * a bundle list using the creationToken heuristic that describes them.
+ */
+#define GENERATED_BUNDLES_DIR "info/bundles"
+#define GENERATED_BUNDLE_LIST "bundle-list"
+
 /**
  * A bundle URI may point to a bundle list where the key=value
  * pairs are provided in config file format. This method is
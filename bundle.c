@@ -626,30 +626,37 @@ int create_bundle(struct repository *r, const char *path,
 	return ret;
 }
 
-int unbundle(struct repository *r, struct bundle_header *header,
-	     int bundle_fd, struct strvec *extra_index_pack_args,
-	     enum verify_bundle_flags flags)
+void prepare_unbundle(struct child_process *ip, struct bundle_header *header,
+		      int bundle_fd, struct strvec *extra_index_pack_args,
+		      enum verify_bundle_flags flags)
 {
-	struct child_process ip = CHILD_PROCESS_INIT;
-
-	if (verify_bundle(r, header, flags))
-		return -1;
-
-	strvec_pushl(&ip.args, "index-pack", "--fix-thin", "--stdin", NULL);
+	strvec_pushl(&ip->args, "index-pack", "--fix-thin", "--stdin", NULL);
 
 	/* If there is a filter, then we need to create the promisor pack. */
 	if (header->filter.choice)
-		strvec_push(&ip.args, "--promisor=from-bundle");
+		strvec_push(&ip->args, "--promisor=from-bundle");
 
 	if (flags & VERIFY_BUNDLE_FSCK)
-		strvec_push(&ip.args, "--fsck-objects");
+		strvec_push(&ip->args, "--fsck-objects");
 
 	if (extra_index_pack_args)
-		strvec_pushv(&ip.args, extra_index_pack_args->v);
+		strvec_pushv(&ip->args, extra_index_pack_args->v);
+
+	ip->in = bundle_fd;
+	ip->no_stdout = 1;
+	ip->git_cmd = 1;
+}
+
+int unbundle(struct repository *r, struct bundle_header *header,
+	     int bundle_fd, struct strvec *extra_index_pack_args,
+	     enum verify_bundle_flags flags)
+{
+	struct child_process ip = CHILD_PROCESS_INIT;
+
+	if (verify_bundle(r, header, flags))
+		return -1;
 
-	ip.in = bundle_fd;
-	ip.no_stdout = 1;
-	ip.git_cmd = 1;
+	prepare_unbundle(&ip, header, bundle_fd, extra_index_pack_args, flags);
 	if (run_command(&ip))
 		return error(_("index-pack died"));
 	return 0;
@@ -5,6 +5,8 @@
 #include "string-list.h"
 #include "list-objects-filter-options.h"
 
+struct child_process;
+
 struct bundle_header {
 	unsigned version;
 	struct string_list prerequisites;
@@ -55,6 +57,16 @@ int verify_bundle(struct repository *r, struct bundle_header *header,
 int unbundle(struct repository *r, struct bundle_header *header,
 	     int bundle_fd, struct strvec *extra_index_pack_args,
 	     enum verify_bundle_flags flags);
+
+/**
+ * Set up 'ip' to run the "git index-pack" that unbundle() would run on
+ * 'bundle_fd', but neither verify the bundle nor start the command. This
+ * allows callers to run several of them at once, e.g. with
+ * run_processes_parallel(). 'ip' takes ownership of 'bundle_fd'.
+ */
+void prepare_unbundle(struct child_process *ip, struct bundle_header *header,
+		      int bundle_fd, struct strvec *extra_index_pack_args,
+		      enum verify_bundle_flags flags);
 int list_bundle_refs(struct bundle_header *header,
 		int argc, const char **argv);
 
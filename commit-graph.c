@@ -2085,6 +2085,8 @@ static int write_commit_graph_file(struct write_commit_graph_context *ctx)
 					       LOCK_DIE_ON_ERROR, 0444);
 		f = hashfd(get_lock_file_fd(&lk), get_lock_file_path(&lk));
 	}
+	prepare_repo_settings(ctx->r);
+	f->want_thread = ctx->r->settings.core_checksum_thread;
 
 	cf = init_chunkfile(f);
 
@@ -0,0 +1,6 @@
+CURL_CONFIG=/usr/bin/curl-config
+NO_OPENSSL=1
+NO_GETTEXT=1
+NO_TCLTK=1
+NO_PERL=1
+NO_PYTHON=1
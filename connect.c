@@ -19,6 +19,7 @@
 #include "trace2.h"
 #include "strbuf.h"
 #include "version.h"
+#include "write-or-die.h"
 #include "protocol.h"
 #include "alias.h"
 #include "bundle-uri.h"
@@ -502,6 +503,115 @@ static void send_capabilities(int fd_out, struct packet_reader *reader)
 	}
 }
 
+static int parse_object_info_line(const char *line, const char **attrs,
+				  int attr_nr, const struct object_id *oid,
+				  struct remote_object_info *info)
+{
+	const char *p;
+	char *end;
+
+	if (!skip_prefix(line, oid_to_hex(oid), &p))
+		return -1;
+
+	info->disk_size = -1;
+	info->found = 1;
+	for (int i = 0; i < attr_nr; i++) {
+		if (*p++ != ' ')
+			return -1;
+
+		/* The values of unknown objects are left empty. */
+		if (!*p || *p == ' ') {
+			info->found = 0;
+			continue;
+		}
+
+		if (!strcmp(attrs[i], "size")) {
+			info->size = strtoul(p, &end, 10);
+		} else if (!strcmp(attrs[i], "disk-size")) {
+			info->disk_size = strtoumax(p, &end, 10);
+		} else if (!strcmp(attrs[i], "type")) {
+			end = strchrnul(p, ' ');
+			info->type = type_from_string_gently(p, end - p, 1);
+			if (info->type < 0)
+				return -1;
+		} else {
+			/* skip values we did not ask for */
+			end = strchrnul(p, ' ');
+		}
+		if (end == p)
+			return -1;
+		p = end;
+	}
+	return *p ? -1 : 0;
+}
+
+int get_remote_object_info(int fd_out, struct packet_reader *reader,
+			   const struct object_id *oids, int oid_nr,
+			   struct remote_object_info *infos,
+			   int stateless_rpc)
+{
+	struct strbuf req = STRBUF_INIT;
+	struct string_list attrs = STRING_LIST_INIT_DUP;
+	const char **attr_names = NULL;
+	int i, ret = 0;
+
+	ensure_server_supports_v2("object-info");
+	server_supports_feature("object-info", "type", 1);
+
+	/* (Re-)send capabilities */
+	send_capabilities(fd_out, reader);
+
+	/* Send command */
+	packet_buf_write(&req, "command=object-info\n");
+	packet_buf_delim(&req);
+	packet_buf_write(&req, "size\n");
+	packet_buf_write(&req, "type\n");
+	if (server_supports_feature("object-info", "disk-size", 0))
+		packet_buf_write(&req, "disk-size\n");
+	for (i = 0; i < oid_nr; i++)
+		packet_buf_write(&req, "oid %s\n", oid_to_hex(&oids[i]));
+	packet_buf_flush(&req);
+	write_or_die(fd_out, req.buf, req.len);
+	strbuf_release(&req);
+
+	/* Process response from server */
+	if (packet_reader_read(reader) != PACKET_READ_NORMAL) {
+		ret = error(_("expected attributes in object-info response"));
+		goto out;
+	}
+	string_list_split(&attrs, reader->line, ' ', -1);
+	ALLOC_ARRAY(attr_names, attrs.nr);
+	for (i = 0; i < attrs.nr; i++)
+		attr_names[i] = attrs.items[i].string;
+
+	for (i = 0; i < oid_nr; i++) {
+		memset(&infos[i], 0, sizeof(infos[i]));
+		if (packet_reader_read(reader) != PACKET_READ_NORMAL) {
+			ret = error(_("expected %d objects in object-info response"),
+				    oid_nr);
+			goto out;
+		}
+		if (parse_object_info_line(reader->line, attr_names, attrs.nr,
+					   &oids[i], &infos[i])) {
+			ret = error(_("error on object-info response line: %s"),
+				    reader->line);
+			goto out;
+		}
+	}
+
+	if (packet_reader_read(reader) != PACKET_READ_FLUSH) {
+		ret = error(_("expected flush after object-info response"));
+		goto out;
+	}
+	check_stateless_delimiter(stateless_rpc, reader,
+				  _("expected response end packet after object-info"));
+
+out:
+	free(attr_names);
+	string_list_clear(&attrs, 0);
+	return ret;
+}
+
 int get_remote_bundle_uri(int fd_out, struct packet_reader *reader,
 			  struct bundle_list *bundles, int stateless_rpc)
 {
@@ -10,6 +10,208 @@
 #include "transport.h"
 #include "packfile.h"
 #include "promisor-remote.h"
+#include "config.h"
+#include "blob.h"
+#include "commit.h"
+#include "tree.h"
+#include "tree-walk.h"
+#include "tag.h"
+#include "oid-array.h"
+#include "oidset.h"
+#include "prio-queue.h"
+#include "pack-bitmap.h"
+#include "ewah/ewok.h"
+#include "trace2.h"
+
+/*
+ * Give up on proving connectivity with bitmaps once we had to walk this
+ * many commits that are not covered by any bitmap. This protects us from
+ * walking large parts of history in repositories whose bitmaps are stale,
+ * where "rev-list --not --all" is likely to be faster.
+ */
+#define BITMAP_CHECK_MAX_COMMITS 1000
+
+struct bitmap_check {
+	struct repository *repo;
+	struct bitmap_index *bitmap_git;
+	struct bitmap *proven;
+	struct prio_queue commits;
+	struct object_array pending;
+	struct oidset seen;
+	size_t nr_commits;
+	size_t nr_objects;
+};
+
+static int bitmap_check_add(struct bitmap_check *check,
+			    const struct object_id *oid,
+			    enum object_type type)
+{
+	if (oidset_insert(&check->seen, oid))
+		return 0;
+
+	switch (type) {
+	case OBJ_COMMIT: {
+		struct commit *commit = lookup_commit(check->repo, oid);
+		struct ewah_bitmap *ewah;
+
+		if (!commit)
+			return -1;
+
+		/*
+		 * A commit with a bitmap has all of its reachable objects
+		 * in the bitmapped pack, so there is no need to walk it.
+		 */
+		ewah = bitmap_for_commit(check->bitmap_git, commit);
+		if (ewah) {
+			bitmap_or_ewah(check->proven, ewah);
+			return 0;
+		}
+
+		if (repo_parse_commit_gently(check->repo, commit, 1) < 0)
+			return -1;
+		prio_queue_put(&check->commits, commit);
+		return 0;
+	}
+	case OBJ_TAG: {
+		struct tag *tag = lookup_tag(check->repo, oid);
+
+		if (!tag || parse_tag(tag) < 0 || !tag->tagged)
+			return -1;
+		return bitmap_check_add(check, &tag->tagged->oid,
+					tag->tagged->type);
+	}
+	case OBJ_TREE: {
+		struct tree *tree = lookup_tree(check->repo, oid);
+		if (!tree)
+			return -1;
+		add_object_array(&tree->object, NULL, &check->pending);
+		return 0;
+	}
+	case OBJ_BLOB: {
+		struct blob *blob = lookup_blob(check->repo, oid);
+		if (!blob)
+			return -1;
+		add_object_array(&blob->object, NULL, &check->pending);
+		return 0;
+	}
+	default:
+		return -1;
+	}
+}
+
+static int bitmap_check_tree(struct bitmap_check *check, struct tree *tree)
+{
+	struct tree_desc desc;
+	struct name_entry entry;
+	int ret = 0;
+
+	if (parse_tree_gently(tree, 1) < 0)
+		return -1;
+
+	init_tree_desc(&desc, &tree->object.oid, tree->buffer, tree->size);
+	while (!ret && tree_entry(&desc, &entry)) {
+		if (S_ISGITLINK(entry.mode))
+			continue;
+		ret = bitmap_check_add(check, &entry.oid,
+				       S_ISDIR(entry.mode) ? OBJ_TREE : OBJ_BLOB);
+	}
+
+	free_tree_buffer(tree);
+	return ret;
+}
+
+/*
+ * Try to prove that everything reachable from `tips` exists without
+ * running rev-list. We walk from the tips until we hit commits that have
+ * a reachability bitmap, which guarantees that all objects reachable from
+ * them are present in the bitmapped pack or MIDX. Trees and blobs that
+ * are reachable from any of these commits need not be looked at either.
+ * Everything else we come across is checked for existence.
+ *
+ * Returns 0 if all objects are known to exist, and -1 if we were unable to
+ * prove so, in which case the caller should fall back to rev-list, which
+ * will also produce proper error messages.
+ */
+static int check_connected_with_bitmap(struct repository *r,
+				       const struct oid_array *tips)
+{
+	struct bitmap_check check = {
+		.repo = r,
+		.commits = { compare_commits_by_commit_date },
+		.pending = OBJECT_ARRAY_INIT,
+	};
+	struct commit *commit;
+	int ret = 0;
+
+	check.bitmap_git = prepare_bitmap_git(r);
+	if (!check.bitmap_git)
+		return -1;
+
+	trace2_region_enter("connected", "bitmap-check", r);
+
+	check.proven = bitmap_new();
+	oidset_init(&check.seen, 0);
+
+	for (size_t i = 0; !ret && i < tips->nr; i++) {
+		int type = oid_object_info(r, &tips->oid[i], NULL);
+		if (type < 0)
+			ret = -1;
+		else
+			ret = bitmap_check_add(&check, &tips->oid[i], type);
+	}
+
+	/*
+	 * Walk commits first so that we know about as many bitmaps as
+	 * possible before we start looking at trees and blobs.
+	 */
+	while (!ret && (commit = prio_queue_get(&check.commits))) {
+		struct commit_list *parent;
+
+		if (bitmap_walk_contains(check.bitmap_git, check.proven,
+					 &commit->object.oid))
+			continue;
+
+		if (++check.nr_commits > BITMAP_CHECK_MAX_COMMITS) {
+			ret = -1;
+			break;
+		}
+
+		ret = bitmap_check_add(&check, get_commit_tree_oid(commit),
+				       OBJ_TREE);
+		for (parent = commit->parents; !ret && parent; parent = parent->next)
+			ret = bitmap_check_add(&check, &parent->item->object.oid,
+					       OBJ_COMMIT);
+	}
+
+	while (!ret && check.pending.nr) {
+		struct object *obj = object_array_pop(&check.pending);
+
+		if (bitmap_walk_contains(check.bitmap_git, check.proven,
+					 &obj->oid))
+			continue;
+
+		check.nr_objects++;
+		if (obj->type == OBJ_TREE)
+			ret = bitmap_check_tree(&check, (struct tree *)obj);
+		else if (!has_object(r, &obj->oid, HAS_OBJECT_RECHECK_PACKED))
+			ret = -1;
+	}
+
+	trace2_data_intmax("connected", r, "bitmap-check/commits",
+			   check.nr_commits);
+	trace2_data_intmax("connected", r, "bitmap-check/objects",
+			   check.nr_objects);
+	trace2_data_string("connected", r, "bitmap-check/result",
+			   ret ? "fallback" : "connected");
+	trace2_region_leave("connected", "bitmap-check", r);
+
+	clear_prio_queue(&check.commits);
+	object_array_clear(&check.pending);
+	oidset_clear(&check.seen);
+	bitmap_free(check.proven);
+	free_bitmap_index(check.bitmap_git);
+	return ret;
+}
 
 /*
  * If we feed all the commits we want to verify to this command
@@ -32,7 +234,9 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 	int err = 0;
 	struct packed_git *new_pack = NULL;
 	struct transport *transport;
+	struct oid_array tips = OID_ARRAY_INIT;
 	size_t base_len;
+	int use_bitmaps = 1;
 
 	if (!opt)
 		opt = &defaults;
@@ -94,6 +298,34 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 	}
 
 no_promisor_pack_found:
+	do {
+		/*
+		 * If index-pack already checked that:
+		 * - there are no dangling pointers in the new pack
+		 * - the pack is self contained
+		 * Then if the updated ref is in the new pack, then we
+		 * are sure the ref is good and not sending it to
+		 * rev-list for verification.
+		 */
+		if (new_pack && find_pack_entry_one(oid, new_pack))
+			continue;
+
+		oid_array_append(&tips, oid);
+	} while ((oid = fn(cb_data)) != NULL);
+
+	repo_config_get_bool(the_repository, "transfer.bitmapconnectivitycheck",
+			     &use_bitmaps);
+	if (opt->use_bitmaps && use_bitmaps &&
+	    !opt->shallow_file && !opt->is_deepening_fetch &&
+	    !repo_has_promisor_remote(the_repository) &&
+	    !check_connected_with_bitmap(the_repository, &tips)) {
+		if (opt->err_fd)
+			close(opt->err_fd);
+		oid_array_clear(&tips);
+		free(new_pack);
+		return 0;
+	}
+
 	if (opt->shallow_file) {
 		strvec_push(&rev_list.args, "--shallow-file");
 		strvec_push(&rev_list.args, opt->shallow_file);
@@ -127,6 +359,7 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 		rev_list.no_stderr = opt->quiet;
 
 	if (start_command(&rev_list)) {
+		oid_array_clear(&tips);
 		free(new_pack);
 		return error(_("Could not run 'git rev-list'"));
 	}
@@ -135,21 +368,9 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 
 	rev_list_in = xfdopen(rev_list.in, "w");
 
-	do {
-		/*
-		 * If index-pack already checked that:
-		 * - there are no dangling pointers in the new pack
-		 * - the pack is self contained
-		 * Then if the updated ref is in the new pack, then we
-		 * are sure the ref is good and not sending it to
-		 * rev-list for verification.
-		 */
-		if (new_pack && find_pack_entry_one(oid, new_pack))
-			continue;
-
-		if (fprintf(rev_list_in, "%s\n", oid_to_hex(oid)) < 0)
+	for (size_t i = 0; i < tips.nr; i++)
+		if (fprintf(rev_list_in, "%s\n", oid_to_hex(&tips.oid[i])) < 0)
 			break;
-	} while ((oid = fn(cb_data)) != NULL);
 
 	if (ferror(rev_list_in) || fflush(rev_list_in)) {
 		if (errno != EPIPE && errno != EINVAL)
@@ -161,6 +382,7 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 		err = error_errno(_("failed to close rev-list's stdin"));
 
 	sigchain_pop(SIGPIPE);
+	oid_array_clear(&tips);
 	free(new_pack);
 	return finish_command(&rev_list) || err;
 }
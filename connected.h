@@ -53,6 +53,13 @@ struct check_connected_options {
 	 * already-reachable refs.
 	 */
 	const char *exclude_hidden_refs_section;
+
+	/*
+	 * If non-zero, first try to prove connectivity in-process by using
+	 * reachability bitmaps, and only spawn rev-list if that fails. This
+	 * does not show progress.
+	 */
+	unsigned use_bitmaps : 1;
 };
 
 #define CHECK_CONNECTED_INIT { 0 }
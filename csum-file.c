@@ -14,6 +14,7 @@
 #include "progress.h"
 #include "csum-file.h"
 #include "hash.h"
+#include "thread-utils.h"
 
 static void verify_buffer_or_die(struct hashfile *f,
 				 const void *buf,
@@ -44,20 +45,148 @@ static void flush(struct hashfile *f, const void *buf, unsigned int count)
 	display_throughput(f->tp, f->total);
 }
 
+/*
+ * In the pipelined mode, a helper thread hashes one buffer while the
+ * caller writes it out and fills the other one.  Only the hashing is
+ * moved off the caller's thread; writing, verification and error
+ * handling stay where they were.  f->ctx belongs to the helper thread
+ * while "pending" is set.
+ */
+struct hashfile_thread {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct hashfile *f;
+	const unsigned char *pending;
+	unsigned int pending_len;
+	unsigned char *spare;
+	int stop;
+};
+
+static void *hashfile_thread_proc(void *data)
+{
+	struct hashfile_thread *t = data;
+
+	pthread_mutex_lock(&t->mutex);
+	for (;;) {
+		const unsigned char *buf;
+
+		while (!t->pending && !t->stop)
+			pthread_cond_wait(&t->cond, &t->mutex);
+		if (!t->pending)
+			break;
+		buf = t->pending;
+		pthread_mutex_unlock(&t->mutex);
+
+		the_hash_algo->unsafe_update_fn(&t->f->ctx, buf, t->pending_len);
+
+		pthread_mutex_lock(&t->mutex);
+		t->pending = NULL;
+		pthread_cond_broadcast(&t->cond);
+	}
+	pthread_mutex_unlock(&t->mutex);
+	return NULL;
+}
+
+static void hashfile_thread_start(struct hashfile *f)
+{
+	struct hashfile_thread *t = xcalloc(1, sizeof(*t));
+
+	t->f = f;
+	pthread_mutex_init(&t->mutex, NULL);
+	pthread_cond_init(&t->cond, NULL);
+	if (pthread_create(&t->thread, NULL, hashfile_thread_proc, t)) {
+		/* hash inline as usual */
+		pthread_mutex_destroy(&t->mutex);
+		pthread_cond_destroy(&t->cond);
+		free(t);
+		f->want_thread = 0;
+		return;
+	}
+	t->spare = xmalloc(f->buffer_len);
+	f->thread = t;
+}
+
+/* Wait until f->ctx includes everything handed to the helper thread. */
+static void hashfile_thread_wait(struct hashfile *f)
+{
+	struct hashfile_thread *t = f->thread;
+
+	if (!t)
+		return;
+	pthread_mutex_lock(&t->mutex);
+	while (t->pending)
+		pthread_cond_wait(&t->cond, &t->mutex);
+	pthread_mutex_unlock(&t->mutex);
+}
+
+static void hashfile_thread_stop(struct hashfile *f)
+{
+	struct hashfile_thread *t = f->thread;
+
+	if (!t)
+		return;
+	pthread_mutex_lock(&t->mutex);
+	t->stop = 1;
+	pthread_cond_broadcast(&t->cond);
+	pthread_mutex_unlock(&t->mutex);
+	pthread_join(t->thread, NULL);
+	pthread_mutex_destroy(&t->mutex);
+	pthread_cond_destroy(&t->cond);
+	free(t->spare);
+	free(t);
+	f->thread = NULL;
+}
+
+/*
+ * Hand f->buffer to the helper thread, write it out meanwhile, and
+ * continue in the other buffer.
+ */
+static void hashflush_pipelined(struct hashfile *f, unsigned int count)
+{
+	struct hashfile_thread *t = f->thread;
+	unsigned char *buf = f->buffer;
+
+	hashfile_thread_wait(f);
+	pthread_mutex_lock(&t->mutex);
+	t->pending = buf;
+	t->pending_len = count;
+	pthread_cond_broadcast(&t->cond);
+	pthread_mutex_unlock(&t->mutex);
+
+	flush(f, buf, count);
+
+	f->buffer = t->spare;
+	t->spare = buf;
+}
+
 void hashflush(struct hashfile *f)
 {
 	unsigned offset = f->offset;
 
 	if (offset) {
-		if (!f->skip_hash)
-			the_hash_algo->unsafe_update_fn(&f->ctx, f->buffer, offset);
-		flush(f, f->buffer, offset);
+		/*
+		 * Only files that fill their buffer at least once are
+		 * worth a thread.
+		 */
+		if (f->want_thread && !f->thread && !f->skip_hash &&
+		    offset == f->buffer_len)
+			hashfile_thread_start(f);
+
+		if (f->thread) {
+			hashflush_pipelined(f, offset);
+		} else {
+			if (!f->skip_hash)
+				the_hash_algo->unsafe_update_fn(&f->ctx, f->buffer, offset);
+			flush(f, f->buffer, offset);
+		}
 		f->offset = 0;
 	}
 }
 
 void free_hashfile(struct hashfile *f)
 {
+	hashfile_thread_stop(f);
 	free(f->buffer);
 	free(f->check_buffer);
 	free(f);
@@ -69,6 +198,7 @@ int finalize_hashfile(struct hashfile *f, unsigned char *result,
 	int fd;
 
 	hashflush(f);
+	hashfile_thread_stop(f);
 
 	if (f->skip_hash)
 		hashclr(f->buffer, the_repository->hash_algo);
@@ -120,12 +250,15 @@ void hashwrite(struct hashfile *f, const void *buf, unsigned int count)
 		if (f->do_crc)
 			f->crc32 = crc32(f->crc32, buf, nr);
 
-		if (nr == f->buffer_len) {
+		if (nr == f->buffer_len &&
+		    (!f->want_thread || f->skip_hash)) {
 			/*
 			 * Flush a full batch worth of data directly
 			 * from the input, skipping the memcpy() to
 			 * the hashfile's buffer. In this block,
-			 * f->offset is necessarily zero.
+			 * f->offset is necessarily zero.  The helper
+			 * thread, if any, needs a buffer that stays
+			 * around, so it always goes through the copy.
 			 */
 			if (!f->skip_hash)
 				the_hash_algo->unsafe_update_fn(&f->ctx, buf, nr);
@@ -174,6 +307,8 @@ static struct hashfile *hashfd_internal(int fd, const char *name,
 	f->name = name;
 	f->do_crc = 0;
 	f->skip_hash = 0;
+	f->want_thread = 0;
+	f->thread = NULL;
 	the_hash_algo->unsafe_init_fn(&f->ctx);
 
 	f->buffer_len = buffer_len;
@@ -207,6 +342,7 @@ struct hashfile *hashfd_throughput(int fd, const char *name, struct progress *tp
 void hashfile_checkpoint(struct hashfile *f, struct hashfile_checkpoint *checkpoint)
 {
 	hashflush(f);
+	hashfile_thread_wait(f);
 	checkpoint->offset = f->total;
 	the_hash_algo->unsafe_clone_fn(&checkpoint->ctx, &f->ctx);
 }
@@ -215,6 +351,7 @@ int hashfile_truncate(struct hashfile *f, struct hashfile_checkpoint *checkpoint
 {
 	off_t offset = checkpoint->offset;
 
+	hashfile_thread_wait(f);
 	if (ftruncate(f->fd, offset) ||
 	    lseek(f->fd, offset, SEEK_SET) != offset)
 		return -1;
@@ -5,6 +5,7 @@
 #include "write-or-die.h"
 
 struct progress;
+struct hashfile_thread;
 
 /* A SHA1-protected file */
 struct hashfile {
@@ -27,6 +28,15 @@ struct hashfile {
 	 * instead only use it as a buffered write.
 	 */
 	int skip_hash;
+
+	/*
+	 * If non-zero, full buffers may be hashed by a helper thread
+	 * while the caller fills the next one. Off by default; callers
+	 * that write large files set it after creating the hashfile.
+	 * thread is that helper thread once it has been started.
+	 */
+	int want_thread;
+	struct hashfile_thread *thread;
 };
 
 /* Checkpoint */
@@ -38,6 +48,9 @@ struct hashfile_checkpoint {
 void hashfile_checkpoint(struct hashfile *, struct hashfile_checkpoint *);
 int hashfile_truncate(struct hashfile *, struct hashfile_checkpoint *);
 
+/* Overrides core.checksumThread */
+#define GIT_TEST_CHECKSUM_THREAD "GIT_TEST_CHECKSUM_THREAD"
+
 /* finalize_hashfile flags */
 #define CSUM_CLOSE		1
 #define CSUM_FSYNC		2
@@ -2,14 +2,22 @@
 
 #include "git-compat-util.h"
 #include "abspath.h"
+#include "commit-graph.h"
 #include "config.h"
 #include "environment.h"
+#include "exec-cmd.h"
 #include "gettext.h"
+#include "packfile.h"
 #include "path.h"
 #include "pkt-line.h"
 #include "protocol.h"
+#include "refs.h"
+#include "replace-object.h"
 #include "run-command.h"
+#include "serve.h"
 #include "setup.h"
+#include "sigchain.h"
+#include "statinfo.h"
 #include "strbuf.h"
 #include "string-list.h"
 
@@ -30,6 +38,7 @@ static int informative_errors;
 static const char daemon_usage[] =
 "git daemon [--verbose] [--syslog] [--export-all]\n"
 "           [--timeout=<n>] [--init-timeout=<n>] [--max-connections=<n>]\n"
+"           [--prefork=<n>]\n"
 "           [--strict-paths] [--base-path=<path>] [--base-path-relaxed]\n"
 "           [--user-path | --user-path=<path>]\n"
 "           [--interpolated-path=<path>]\n"
@@ -63,6 +72,9 @@ static const char *user_path;
 static unsigned int timeout;
 static unsigned int init_timeout;
 
+/* Number of pre-forked workers, or 0 to fork for every connection */
+static int prefork;
+
 struct hostinfo {
 	struct strbuf hostname;
 	struct strbuf canon_hostname;
@@ -463,9 +475,103 @@ static int run_service_command(struct child_process *cld)
 	return finish_command(cld);
 }
 
+/*
+ * A pre-forked worker loads the state of the first repository it serves
+ * upload-pack for (its packs, multi-pack-index, commit-graph and ref
+ * store). The processes it forks for later connections to the same
+ * repository inherit that state, and serve upload-pack themselves instead
+ * of spawning "git upload-pack", until its packs change.
+ */
+static char *warm_gitdir;
+static struct stat_data warm_pack_dir, warm_info_dir;
+
+/*
+ * In a process serving a connection for a worker, where to report the
+ * repository it serves to the worker, see warm_upload_pack().
+ */
+static int warm_report_fd = -1;
+
+static void stat_warm_dir(const char *name, struct stat *st)
+{
+	struct strbuf path = STRBUF_INIT;
+
+	strbuf_addf(&path, "%s/objects/%s", warm_gitdir, name);
+	if (stat(path.buf, st))
+		memset(st, 0, sizeof(*st));
+	strbuf_release(&path);
+}
+
+static int warm_dir_changed(const char *name, const struct stat_data *sd)
+{
+	struct stat st;
+
+	stat_warm_dir(name, &st);
+	/*
+	 * Packs may well be written within the same second that we loaded
+	 * the repository in, so look at sub-second modification times even
+	 * if USE_NSEC is not defined.
+	 */
+	return match_stat_data(sd, &st) ||
+		sd->sd_mtime.nsec != ST_MTIME_NSEC(st);
+}
+
+static int warm_state_changed(void)
+{
+	return warm_dir_changed("pack", &warm_pack_dir) ||
+		warm_dir_changed("info", &warm_info_dir);
+}
+
+static void set_env(const struct strvec *env)
+{
+	for (size_t i = 0; i < env->nr; i++) {
+		const char *eq = strchr(env->v[i], '=');
+		char *name = xstrndup(env->v[i], eq - env->v[i]);
+
+		xsetenv(name, eq + 1, 1);
+		free(name);
+	}
+}
+
+/*
+ * Serve upload-pack in this process if our worker has the state of the
+ * repository we are in loaded. Returns 0 if the caller has to spawn
+ * "git upload-pack" instead.
+ */
+static int warm_upload_pack(const struct strvec *env)
+{
+	struct strbuf cwd = STRBUF_INIT;
+	int warm;
+
+	if (warm_report_fd < 0 || strbuf_getcwd(&cwd) < 0)
+		return 0;
+
+	warm = warm_gitdir && !strcmp(cwd.buf, warm_gitdir) &&
+		!warm_state_changed();
+	if (!warm_gitdir)
+		write_in_full(warm_report_fd, cwd.buf, cwd.len);
+	close(warm_report_fd);
+	warm_report_fd = -1;
+	strbuf_release(&cwd);
+	if (!warm)
+		return 0;
+
+	set_env(env);
+	packet_trace_identity("upload-pack");
+	save_commit_buffer = 0;
+	xsetenv(NO_LAZY_FETCH_ENVIRONMENT, "1", 0);
+	setup_path();
+
+	serve_upload_pack(0, 0, timeout);
+	return 1;
+}
+
 static int upload_pack(const struct strvec *env)
 {
 	struct child_process cld = CHILD_PROCESS_INIT;
+
+	if (warm_upload_pack(env))
+		return 0;
+
 	strvec_pushl(&cld.args, "upload-pack", "--strict", NULL);
 	strvec_pushf(&cld.args, "--timeout=%u", timeout);
 
@@ -869,6 +975,27 @@ static void check_dead_children(void)
 			cradle = &blanket->next;
 }
 
+static void add_remote_env(struct strvec *env, struct sockaddr *addr)
+{
+	if (addr->sa_family == AF_INET) {
+		char buf[128] = "";
+		struct sockaddr_in *sin_addr = (void *) addr;
+		inet_ntop(addr->sa_family, &sin_addr->sin_addr, buf, sizeof(buf));
+		strvec_pushf(env, "REMOTE_ADDR=%s", buf);
+		strvec_pushf(env, "REMOTE_PORT=%d",
+			     ntohs(sin_addr->sin_port));
+#ifndef NO_IPV6
+	} else if (addr->sa_family == AF_INET6) {
+		char buf[128] = "";
+		struct sockaddr_in6 *sin6_addr = (void *) addr;
+		inet_ntop(AF_INET6, &sin6_addr->sin6_addr, buf, sizeof(buf));
+		strvec_pushf(env, "REMOTE_ADDR=[%s]", buf);
+		strvec_pushf(env, "REMOTE_PORT=%d",
+			     ntohs(sin6_addr->sin6_port));
+#endif
+	}
+}
+
 static struct strvec cld_argv = STRVEC_INIT;
 static void handle(int incoming, struct sockaddr *addr, socklen_t addrlen)
 {
@@ -885,23 +1012,7 @@ static void handle(int incoming, struct sockaddr *addr, socklen_t addrlen)
 		}
 	}
 
-	if (addr->sa_family == AF_INET) {
-		char buf[128] = "";
-		struct sockaddr_in *sin_addr = (void *) addr;
-		inet_ntop(addr->sa_family, &sin_addr->sin_addr, buf, sizeof(buf));
-		strvec_pushf(&cld.env, "REMOTE_ADDR=%s", buf);
-		strvec_pushf(&cld.env, "REMOTE_PORT=%d",
-			     ntohs(sin_addr->sin_port));
-#ifndef NO_IPV6
-	} else if (addr->sa_family == AF_INET6) {
-		char buf[128] = "";
-		struct sockaddr_in6 *sin6_addr = (void *) addr;
-		inet_ntop(AF_INET6, &sin6_addr->sin6_addr, buf, sizeof(buf));
-		strvec_pushf(&cld.env, "REMOTE_ADDR=[%s]", buf);
-		strvec_pushf(&cld.env, "REMOTE_PORT=%d",
-			     ntohs(sin6_addr->sin6_port));
-#endif
-	}
+	add_remote_env(&cld.env, addr);
 
 	strvec_pushv(&cld.args, cld_argv.v);
 	cld.in = incoming;
@@ -1189,6 +1300,11 @@ static struct credentials *prepare_credentials(const char *user_name UNUSED,
 	die("--user not supported on this platform");
 }
 
+static int prefork_loop(struct socketlist *socklist UNUSED)
+{
+	die("--prefork not supported on this platform");
+}
+
 #else
 
 struct credentials {
@@ -1224,6 +1340,246 @@ static struct credentials *prepare_credentials(const char *user_name,
 
 	return &c;
 }
+
+/*
+ * Load the state of the repository at `gitdir` into this worker, for the
+ * connections it serves later on to inherit, see warm_upload_pack().
+ *
+ * Refs are not read here: the files backend caches loose refs without
+ * ever checking them for changes. The ref store itself is set up though,
+ * so that for example the tables of the reftable backend, which are
+ * reloaded as needed, are opened only once.
+ */
+static void warm_repository(const char *gitdir)
+{
+	struct packed_git *p;
+	struct stat st;
+
+	if (!enter_repo(gitdir, 1))
+		return;
+	warm_gitdir = xstrdup(gitdir);
+
+	/* Take these first, so that we notice changes while we load. */
+	stat_warm_dir("pack", &st);
+	fill_stat_data(&warm_pack_dir, &st);
+	stat_warm_dir("info", &st);
+	fill_stat_data(&warm_info_dir, &st);
+
+	disable_replace_refs();
+	for (p = get_all_packs(the_repository); p; p = p->next)
+		open_pack_index(p);
+	generation_numbers_enabled(the_repository); /* loads the commit-graph */
+	get_main_ref_store(the_repository);
+
+	loginfo("Loaded '%s'", gitdir);
+}
+
+static void worker_handle(struct socketlist *socklist, int incoming,
+			  struct sockaddr *addr)
+{
+	struct strbuf gitdir = STRBUF_INIT;
+	int report[2], status;
+	pid_t pid;
+
+	if (pipe(report) < 0) {
+		logerror("unable to create pipe: %s", strerror(errno));
+		close(incoming);
+		return;
+	}
+
+	pid = fork();
+	if (!pid) {
+		struct strvec env = STRVEC_INIT;
+		size_t i;
+		int flags;
+
+		for (i = 0; i < socklist->nr; i++)
+			close(socklist->list[i]);
+		close(report[0]);
+		flags = fcntl(report[1], F_GETFD, 0);
+		if (flags >= 0)
+			fcntl(report[1], F_SETFD, flags | FD_CLOEXEC);
+		warm_report_fd = report[1];
+
+		dup2(incoming, 0);
+		dup2(incoming, 1);
+		close(incoming);
+
+		add_remote_env(&env, addr);
+		set_env(&env);
+		strvec_clear(&env);
+
+		/* Read the configuration of the requested repository. */
+		git_config_clear();
+
+		exit(execute());
+	}
+
+	close(report[1]);
+	close(incoming);
+	if (pid < 0) {
+		logerror("unable to fork");
+		close(report[0]);
+		return;
+	}
+
+	/*
+	 * The child reports the repository it serves upload-pack for right
+	 * away, so that we can load it while the first connection is still
+	 * being served.
+	 */
+	if (strbuf_read(&gitdir, report[0], 0) > 0 && !warm_gitdir)
+		warm_repository(gitdir.buf);
+	close(report[0]);
+	strbuf_release(&gitdir);
+
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+		; /* try again */
+	loginfo("[%"PRIuMAX"] Disconnected%s", (uintmax_t)pid,
+		status ? " (with error)" : "");
+}
+
+/*
+ * A worker serves one connection at a time, accepting connections from the
+ * listening sockets it shares with the other workers. It exits once the
+ * repository it has loaded changes, to be replaced by a fresh one.
+ */
+static int worker_loop(struct socketlist *socklist)
+{
+	struct pollfd *pfd;
+	size_t i;
+
+	CALLOC_ARRAY(pfd, socklist->nr);
+	for (i = 0; i < socklist->nr; i++) {
+		pfd[i].fd = socklist->list[i];
+		pfd[i].events = POLLIN;
+	}
+
+	while (!warm_gitdir || !warm_state_changed()) {
+		if (poll(pfd, socklist->nr, -1) < 0) {
+			if (errno != EINTR) {
+				logerror("Poll failed, resuming: %s",
+				      strerror(errno));
+				sleep(1);
+			}
+			continue;
+		}
+
+		for (i = 0; i < socklist->nr; i++) {
+			union {
+				struct sockaddr sa;
+				struct sockaddr_in sai;
+#ifndef NO_IPV6
+				struct sockaddr_in6 sai6;
+#endif
+			} ss;
+			socklen_t sslen = sizeof(ss);
+			int incoming, flags;
+
+			if (!(pfd[i].revents & POLLIN))
+				continue;
+
+			/*
+			 * The listening sockets are non-blocking, as another
+			 * worker may have beaten us to the connection.
+			 */
+			incoming = accept(pfd[i].fd, &ss.sa, &sslen);
+			if (incoming < 0) {
+				switch (errno) {
+				case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+				case EWOULDBLOCK:
+#endif
+				case EINTR:
+				case ECONNABORTED:
+					continue;
+				default:
+					die_errno("accept returned");
+				}
+			}
+			flags = fcntl(incoming, F_GETFL);
+			if (flags >= 0)
+				fcntl(incoming, F_SETFL, flags & ~O_NONBLOCK);
+
+			worker_handle(socklist, incoming, &ss.sa);
+		}
+	}
+
+	loginfo("Retiring, '%s' has changed", warm_gitdir);
+	free(pfd);
+	return 0;
+}
+
+static pid_t *workers;
+
+static void kill_workers_on_signal(int signo)
+{
+	int i;
+
+	for (i = 0; i < prefork; i++)
+		if (workers[i] > 0)
+			kill(workers[i], SIGTERM);
+	sigchain_pop(signo);
+	raise(signo);
+}
+
+static pid_t spawn_worker(struct socketlist *socklist)
+{
+	pid_t pid = fork();
+
+	if (!pid) {
+		sigchain_pop_common();
+		exit(worker_loop(socklist));
+	}
+	if (pid < 0)
+		logerror("unable to fork worker: %s", strerror(errno));
+	return pid;
+}
+
+/*
+ * Instead of forking for every connection, keep "prefork" workers around
+ * that serve connections one at a time, and replace those that exit. As
+ * there are never more connections served than workers, this honors
+ * --max-connections; connections beyond that wait in the listen backlog.
+ */
+static int prefork_loop(struct socketlist *socklist)
+{
+	size_t i;
+
+	for (i = 0; i < socklist->nr; i++) {
+		int flags = fcntl(socklist->list[i], F_GETFL);
+		if (flags < 0 ||
+		    fcntl(socklist->list[i], F_SETFL, flags | O_NONBLOCK) < 0)
+			die_errno("unable to make listening socket non-blocking");
+	}
+
+	CALLOC_ARRAY(workers, prefork);
+	sigchain_push_common(kill_workers_on_signal);
+
+	for (;;) {
+		int status, n;
+		pid_t pid;
+
+		for (n = 0; n < prefork; n++)
+			if (workers[n] <= 0)
+				workers[n] = spawn_worker(socklist);
+
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			if (errno != EINTR)
+				sleep(1); /* we could not spawn any worker */
+			continue;
+		}
+
+		for (n = 0; n < prefork; n++)
+			if (workers[n] == pid)
+				workers[n] = 0;
+		if (status) {
+			logerror("[%"PRIuMAX"] Worker died", (uintmax_t)pid);
+			sleep(1); /* do not spin if workers keep dying */
+		}
+	}
+}
 #endif
 
 static int serve(struct string_list *listen_addr, int listen_port,
@@ -1240,6 +1596,8 @@ static int serve(struct string_list *listen_addr, int listen_port,
 
 	loginfo("Ready to rumble");
 
+	if (prefork)
+		return prefork_loop(&socklist);
 	return service_loop(&socklist);
 }
 
@@ -1325,6 +1683,11 @@ int cmd_main(int argc, const char **argv)
 				max_connections = 0;  /* unlimited */
 			continue;
 		}
+		if (skip_prefix(arg, "--prefork=", &v)) {
+			if (strtol_i(v, 10, &prefork) || prefork < 0)
+				die(_("invalid prefork '%s', expecting a non-negative integer"), v);
+			continue;
+		}
 		if (!strcmp(arg, "--strict-paths")) {
 			strict_paths = 1;
 			continue;
@@ -1421,6 +1784,13 @@ int cmd_main(int argc, const char **argv)
 	if (inetd_mode && (detach || group_name || user_name))
 		die("--detach, --user and --group are incompatible with --inetd");
 
+	if (inetd_mode && prefork)
+		die("--prefork is incompatible with --inetd");
+
+	if (prefork && max_connections && prefork > max_connections)
+		die("--prefork=%d exceeds --max-connections=%d",
+		    prefork, max_connections);
+
 	if (inetd_mode && (listen_port || (listen_addr.nr > 0)))
 		die("--listen= and --port= are incompatible with --inetd");
 	else if (listen_port == 0)
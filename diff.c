@@ -7039,7 +7039,7 @@ void init_diffstat_widths(struct diff_options *options)
 	options->stat_graph_width = -1;  /* respect diff.statGraphWidth config */
 }
 
-void diffcore_std(struct diff_options *options)
+int diff_needs_blob_data(const struct diff_options *options)
 {
 	int output_formats_to_prefetch = DIFF_FORMAT_DIFFSTAT |
 		DIFF_FORMAT_NUMSTAT |
@@ -7047,6 +7047,12 @@ void diffcore_std(struct diff_options *options)
 		DIFF_FORMAT_SHORTSTAT |
 		DIFF_FORMAT_DIRSTAT;
 
+	return options->output_format & output_formats_to_prefetch ||
+	       options->pickaxe_opts & DIFF_PICKAXE_KINDS_MASK;
+}
+
+void diffcore_std(struct diff_options *options)
+{
 	/*
 	 * Check if the user requested a blob-data-requiring diff output and/or
 	 * break-rewrite detection (which requires blob data). If yes, prefetch
@@ -7056,8 +7062,7 @@ void diffcore_std(struct diff_options *options)
 	 * decides that it needs inexact rename detection.
 	 */
 	if (options->repo == the_repository && repo_has_promisor_remote(the_repository) &&
-	    (options->output_format & output_formats_to_prefetch ||
-	     options->pickaxe_opts & DIFF_PICKAXE_KINDS_MASK))
+	    diff_needs_blob_data(options))
 		diff_queued_diff_prefetch(options->repo);
 
 	/* NOTE please keep the following in sync with diff_tree_combined() */
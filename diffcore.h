@@ -75,6 +75,13 @@ void fill_filespec(struct diff_filespec *, const struct object_id *,
  */
 void diff_queued_diff_prefetch(void *repository);
 
+/*
+ * Returns whether the diff output or pickaxe asked for by "options" needs
+ * the contents of the blobs of the queued pairs, i.e. whether those are
+ * worth prefetching in a partial clone.
+ */
+int diff_needs_blob_data(const struct diff_options *options);
+
 struct diff_populate_filespec_options {
 	unsigned check_size_only : 1;
 	unsigned check_binary : 1;
@@ -32,6 +32,8 @@
 #include "sparse-index.h"
 #include "submodule-config.h"
 #include "symlinks.h"
+#include "strmap.h"
+#include "thread-utils.h"
 #include "trace2.h"
 #include "tree.h"
 #include "hex.h"
@@ -58,8 +60,12 @@ enum path_treatment {
 /*
  * Support data structure for our opendir/readdir/closedir wrappers
  */
+struct dir_listing;
+
 struct cached_dir {
 	DIR *fdir;
+	struct dir_listing *listing;
+	int listing_pos;
 	struct untracked_cache_dir *untracked;
 	int nr_files;
 	int nr_dirs;
@@ -927,6 +933,8 @@ int hashmap_contains_parent(struct hashmap *map,
 	return 0;
 }
 
+static void free_pattern_index(struct pattern_index *index);
+
 void add_pattern(const char *string, const char *base,
 		 int baselen, struct pattern_list *pl, int srcpos)
 {
@@ -946,6 +954,10 @@ void add_pattern(const char *string, const char *base,
 	ALLOC_GROW(pl->patterns, pl->nr + 1, pl->alloc);
 	pl->patterns[pl->nr++] = pattern;
 	pattern->pl = pl;
+	if (pl->index) {
+		free_pattern_index(pl->index);
+		pl->index = NULL;
+	}
 
 	add_pattern_to_hashsets(pl, pattern);
 }
@@ -980,6 +992,7 @@ void clear_pattern_list(struct pattern_list *pl)
 	free(pl->patterns);
 	clear_pattern_entry_hashmap(&pl->recursive_hashmap);
 	clear_pattern_entry_hashmap(&pl->parent_hashmap);
+	free_pattern_index(pl->index);
 
 	memset(pl, 0, sizeof(*pl));
 }
@@ -1369,6 +1382,260 @@ int match_pathname(const char *pathname, int pathlen,
 				 WM_PATHNAME) == 0;
 }
 
+/*
+ * Long pattern lists (think generated .gitignore files with thousands
+ * of entries) are compiled on first use into buckets keyed by the
+ * literal part of each pattern, so that a lookup only needs to run
+ * the full matcher on the few patterns that can possibly match.
+ * Lists shorter than this are scanned linearly as before.
+ */
+#define PATTERN_INDEX_MIN_PATTERNS 32
+
+struct pattern_bucket {
+	int nr, alloc;
+	int *idx;
+};
+
+struct pattern_index {
+	/* NODIR patterns without wildcards, keyed by the basename */
+	struct strmap basenames;
+	/* NODIR "*literal" patterns, keyed by the literal suffix */
+	struct strmap suffixes;
+	int *suffix_lens;
+	int suffix_lens_nr, suffix_lens_alloc;
+	/*
+	 * Patterns containing a slash, keyed by the leading directories
+	 * of base + pattern that precede the first wildcard.
+	 */
+	struct strmap dirs;
+	/* everything else, in list order */
+	struct pattern_bucket others;
+	/* scratch space for lookups */
+	struct strbuf key;
+	struct pattern_bucket found;
+};
+
+static void pattern_index_key(struct strbuf *key, const char *s, size_t len)
+{
+	strbuf_reset(key);
+	strbuf_add(key, s, len);
+	if (ignore_case) {
+		size_t i;
+		for (i = 0; i < key->len; i++)
+			key->buf[i] = tolower(key->buf[i]);
+	}
+}
+
+static void pattern_bucket_add(struct pattern_bucket *b, int i)
+{
+	ALLOC_GROW(b->idx, b->nr + 1, b->alloc);
+	b->idx[b->nr++] = i;
+}
+
+static void pattern_index_add(struct strmap *map, const char *key, int i)
+{
+	struct pattern_bucket *b = strmap_get(map, key);
+
+	if (!b) {
+		CALLOC_ARRAY(b, 1);
+		strmap_put(map, key, b);
+	}
+	pattern_bucket_add(b, i);
+}
+
+static struct pattern_index *build_pattern_index(struct pattern_list *pl)
+{
+	struct pattern_index *index;
+	struct strbuf key = STRBUF_INIT;
+	int i, j;
+
+	CALLOC_ARRAY(index, 1);
+	strmap_init(&index->basenames);
+	strmap_init(&index->suffixes);
+	strmap_init(&index->dirs);
+	strbuf_init(&index->key, 0);
+
+	for (i = 0; i < pl->nr; i++) {
+		struct path_pattern *pattern = pl->patterns[i];
+		const char *p = pattern->pattern;
+		int prefix = pattern->nowildcardlen;
+
+		if (pattern->flags & PATTERN_FLAG_NODIR) {
+			if (prefix == pattern->patternlen) {
+				pattern_index_key(&key, p, prefix);
+				pattern_index_add(&index->basenames, key.buf, i);
+			} else if (pattern->flags & PATTERN_FLAG_ENDSWITH) {
+				int len = pattern->patternlen - 1;
+
+				pattern_index_key(&key, p + 1, len);
+				pattern_index_add(&index->suffixes, key.buf, i);
+				for (j = 0; j < index->suffix_lens_nr; j++)
+					if (index->suffix_lens[j] == len)
+						break;
+				if (j == index->suffix_lens_nr) {
+					ALLOC_GROW(index->suffix_lens,
+						   index->suffix_lens_nr + 1,
+						   index->suffix_lens_alloc);
+					index->suffix_lens[index->suffix_lens_nr++] = len;
+				}
+			} else {
+				pattern_bucket_add(&index->others, i);
+			}
+			continue;
+		}
+
+		/*
+		 * Mirror match_pathname(): the pattern is matched against
+		 * the path below "base", and everything up to the first
+		 * wildcard has to match literally.  Only whole leading
+		 * directories are used as the key.
+		 */
+		if (*p == '/') {
+			p++;
+			prefix--;
+		}
+		strbuf_reset(&key);
+		strbuf_add(&key, pattern->base, pattern->baselen);
+		while (prefix && p[prefix - 1] != '/')
+			prefix--;
+		strbuf_add(&key, p, prefix);
+		pattern_index_key(&index->key, key.buf, key.len);
+		pattern_index_add(&index->dirs, index->key.buf, i);
+	}
+
+	strbuf_release(&key);
+	return index;
+}
+
+static void free_pattern_buckets(struct strmap *map)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	strmap_for_each_entry(map, &iter, e) {
+		struct pattern_bucket *b = e->value;
+		free(b->idx);
+	}
+	strmap_clear(map, 1);
+}
+
+static void free_pattern_index(struct pattern_index *index)
+{
+	if (!index)
+		return;
+	free_pattern_buckets(&index->basenames);
+	free_pattern_buckets(&index->suffixes);
+	free_pattern_buckets(&index->dirs);
+	free(index->suffix_lens);
+	free(index->others.idx);
+	free(index->found.idx);
+	strbuf_release(&index->key);
+	free(index);
+}
+
+static void pattern_index_collect(struct pattern_index *index,
+				  struct strmap *map,
+				  const char *s, size_t len)
+{
+	struct pattern_bucket *b;
+
+	pattern_index_key(&index->key, s, len);
+	b = strmap_get(map, index->key.buf);
+	if (!b)
+		return;
+	ALLOC_GROW(index->found.idx, index->found.nr + b->nr,
+		   index->found.alloc);
+	COPY_ARRAY(index->found.idx + index->found.nr, b->idx, b->nr);
+	index->found.nr += b->nr;
+}
+
+static int pattern_index_cmp(const void *a_, const void *b_)
+{
+	int a = *(const int *)a_;
+	int b = *(const int *)b_;
+
+	/* descending, so that the last pattern in the list comes first */
+	return a < b ? 1 : a > b ? -1 : 0;
+}
+
+static int path_pattern_matches(struct path_pattern *pattern,
+				const char *pathname, int pathlen,
+				const char *basename, int *dtype,
+				struct index_state *istate)
+{
+	const char *exclude = pattern->pattern;
+	int prefix = pattern->nowildcardlen;
+
+	if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
+		*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
+		if (*dtype != DT_DIR)
+			return 0;
+	}
+
+	if (pattern->flags & PATTERN_FLAG_NODIR)
+		return match_basename(basename,
+				      pathlen - (basename - pathname),
+				      exclude, prefix, pattern->patternlen,
+				      pattern->flags);
+
+	assert(pattern->baselen == 0 ||
+	       pattern->base[pattern->baselen - 1] == '/');
+	return match_pathname(pathname, pathlen,
+			      pattern->base,
+			      pattern->baselen ? pattern->baselen - 1 : 0,
+			      exclude, prefix, pattern->patternlen);
+}
+
+/*
+ * Same as the linear scan in last_matching_pattern_from_list(), but
+ * only looks at the patterns the index says could match, still going
+ * from the end of the list towards the beginning.
+ */
+static struct path_pattern *last_matching_pattern_from_index(const char *pathname,
+							     int pathlen,
+							     const char *basename,
+							     int *dtype,
+							     struct pattern_list *pl,
+							     struct index_state *istate)
+{
+	struct pattern_index *index = pl->index;
+	struct pattern_bucket *found = &index->found;
+	struct pattern_bucket *others = &index->others;
+	int basenamelen = pathlen - (basename - pathname);
+	int i, j, k;
+
+	found->nr = 0;
+	pattern_index_collect(index, &index->basenames, basename, basenamelen);
+	for (k = 0; k < index->suffix_lens_nr; k++) {
+		int len = index->suffix_lens[k];
+		if (len <= basenamelen)
+			pattern_index_collect(index, &index->suffixes,
+					      basename + basenamelen - len, len);
+	}
+	pattern_index_collect(index, &index->dirs, pathname, 0);
+	for (k = 0; k < pathlen; k++)
+		if (pathname[k] == '/')
+			pattern_index_collect(index, &index->dirs,
+					      pathname, k + 1);
+	QSORT(found->idx, found->nr, pattern_index_cmp);
+
+	/* merge with the unindexed patterns, highest index first */
+	i = 0;
+	j = others->nr - 1;
+	while (i < found->nr || 0 <= j) {
+		int pos;
+
+		if (0 <= j && (i == found->nr || found->idx[i] < others->idx[j]))
+			pos = others->idx[j--];
+		else
+			pos = found->idx[i++];
+		if (path_pattern_matches(pl->patterns[pos], pathname, pathlen,
+					 basename, dtype, istate))
+			return pl->patterns[pos];
+	}
+	return NULL;
+}
+
 /*
  * Scan the given exclude list in reverse to see whether pathname
  * should be ignored.  The first match (i.e. the last on the list), if
@@ -1382,45 +1649,27 @@ static struct path_pattern *last_matching_pattern_from_list(const char *pathname
 						       struct pattern_list *pl,
 						       struct index_state *istate)
 {
-	struct path_pattern *res = NULL; /* undecided */
 	int i;
 
 	if (!pl->nr)
 		return NULL;	/* undefined */
 
+	if (pl->nr >= PATTERN_INDEX_MIN_PATTERNS && !pl->use_cone_patterns) {
+		if (!pl->index)
+			pl->index = build_pattern_index(pl);
+		return last_matching_pattern_from_index(pathname, pathlen,
+							basename, dtype,
+							pl, istate);
+	}
+
 	for (i = pl->nr - 1; 0 <= i; i--) {
 		struct path_pattern *pattern = pl->patterns[i];
-		const char *exclude = pattern->pattern;
-		int prefix = pattern->nowildcardlen;
-
-		if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
-			*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
-			if (*dtype != DT_DIR)
-				continue;
-		}
-
-		if (pattern->flags & PATTERN_FLAG_NODIR) {
-			if (match_basename(basename,
-					   pathlen - (basename - pathname),
-					   exclude, prefix, pattern->patternlen,
-					   pattern->flags)) {
-				res = pattern;
-				break;
-			}
-			continue;
-		}
 
-		assert(pattern->baselen == 0 ||
-		       pattern->base[pattern->baselen - 1] == '/');
-		if (match_pathname(pathname, pathlen,
-				   pattern->base,
-				   pattern->baselen ? pattern->baselen - 1 : 0,
-				   exclude, prefix, pattern->patternlen)) {
-			res = pattern;
-			break;
-		}
+		if (path_pattern_matches(pattern, pathname, pathlen,
+					 basename, dtype, istate))
+			return pattern;
 	}
-	return res;
+	return NULL;
 }
 
 /*
@@ -2521,6 +2770,282 @@ static int valid_cached_dir(struct dir_struct *dir,
 	return untracked->valid;
 }
 
+/*
+ * Directory prefetching: the directories that contain tracked files are
+ * the ones that read_directory() is going to open in any case, so a pool
+ * of worker threads reads their listings ahead of the (single-threaded)
+ * traversal, which then consumes them instead of calling readdir()
+ * itself. Excludes are still matched, and results are still collected,
+ * on the main thread in the usual order.
+ */
+#define READDIR_PREFETCH_MAX_ENTRIES (1024 * 1024)
+
+struct dir_listing_entry {
+	int d_type;
+	char *d_name;
+};
+
+struct dir_listing {
+	int nr;
+	struct dir_listing_entry entries[FLEX_ARRAY];
+};
+
+struct readdir_prefetch {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int stop;
+
+	/* directories still to be read, with trailing slash ("" is the root) */
+	struct string_list todo;
+	size_t next;
+
+	/* directories claimed by the traversal or a worker */
+	struct strset claimed;
+	/* directories a worker is reading right now */
+	struct strset reading;
+	/* listings read ahead but not consumed yet */
+	struct strmap listings;
+	size_t cached_entries, max_entries;
+
+	int nr_threads;
+	pthread_t *threads;
+	intmax_t nr_read, nr_used;
+};
+
+static void free_dir_listing(struct dir_listing *listing)
+{
+	int i;
+
+	if (!listing)
+		return;
+	for (i = 0; i < listing->nr; i++)
+		free(listing->entries[i].d_name);
+	free(listing);
+}
+
+static struct dir_listing *read_dir_listing(const char *path)
+{
+	DIR *fdir = opendir(*path ? path : ".");
+	struct dirent *de;
+	struct dir_listing_entry *entries = NULL;
+	struct dir_listing *listing;
+	size_t nr = 0, alloc = 0;
+
+	/* let the traversal report the error, if any */
+	if (!fdir)
+		return NULL;
+	while ((de = readdir_skip_dot_and_dotdot(fdir))) {
+		ALLOC_GROW(entries, nr + 1, alloc);
+		entries[nr].d_type = DTYPE(de);
+		entries[nr].d_name = xstrdup(de->d_name);
+		nr++;
+	}
+	closedir(fdir);
+
+	listing = xmalloc(st_add(sizeof(*listing),
+				 st_mult(nr, sizeof(*entries))));
+	listing->nr = nr;
+	COPY_ARRAY(listing->entries, entries, nr);
+	free(entries);
+	return listing;
+}
+
+static void *readdir_prefetch_thread(void *data)
+{
+	struct readdir_prefetch *rp = data;
+
+	pthread_mutex_lock(&rp->mutex);
+	while (1) {
+		const char *path;
+		struct dir_listing *listing;
+
+		while (!rp->stop && rp->next < rp->todo.nr &&
+		       rp->cached_entries > rp->max_entries)
+			pthread_cond_wait(&rp->cond, &rp->mutex);
+		if (rp->stop || rp->next >= rp->todo.nr)
+			break;
+
+		path = rp->todo.items[rp->next++].string;
+		if (!strset_add(&rp->claimed, path))
+			continue;
+		strset_add(&rp->reading, path);
+		pthread_mutex_unlock(&rp->mutex);
+
+		listing = read_dir_listing(path);
+
+		pthread_mutex_lock(&rp->mutex);
+		strset_remove(&rp->reading, path);
+		if (listing) {
+			strmap_put(&rp->listings, path, listing);
+			rp->cached_entries += listing->nr;
+			rp->nr_read++;
+		}
+		/* the traversal may be waiting for this listing */
+		pthread_cond_broadcast(&rp->cond);
+	}
+	pthread_mutex_unlock(&rp->mutex);
+	return NULL;
+}
+
+static void get_readdir_threads(struct repository *r, int *nr_threads)
+{
+	char *env = getenv("GIT_TEST_READDIR_THREADS");
+
+	if (env && *env) {
+		if (strtol_i(env, 10, nr_threads))
+			die(_("invalid value for '%s': '%s'"),
+			    "GIT_TEST_READDIR_THREADS", env);
+	} else if (repo_config_get_int(r, "core.readdirthreads", nr_threads)) {
+		*nr_threads = 1;
+		return;
+	}
+	if (*nr_threads < 1)
+		*nr_threads = online_cpus();
+}
+
+static void start_readdir_prefetch(struct dir_struct *dir,
+				   struct index_state *istate,
+				   const char *path, int len,
+				   const struct pathspec *pathspec)
+{
+	struct readdir_prefetch *rp;
+	const char *last = NULL;
+	size_t last_len = 0;
+	int nr_threads, i, err;
+
+	if (!HAVE_THREADS || !istate->repo)
+		return;
+	get_readdir_threads(istate->repo, &nr_threads);
+	if (nr_threads < 2)
+		return;
+	/*
+	 * The untracked cache already avoids reading unchanged directories,
+	 * and with a pathspec we may not even visit most tracked ones.
+	 */
+	if (dir->untracked || (pathspec && pathspec->nr))
+		return;
+
+	CALLOC_ARRAY(rp, 1);
+	string_list_init_dup(&rp->todo);
+	strset_init(&rp->claimed);
+	strset_init(&rp->reading);
+	strmap_init(&rp->listings);
+	rp->max_entries = git_env_ulong("GIT_TEST_READDIR_PREFETCH_ENTRIES",
+					READDIR_PREFETCH_MAX_ENTRIES);
+
+	if (!len)
+		string_list_append(&rp->todo, "");
+	else if (path[len - 1] == '/')
+		string_list_append_nodup(&rp->todo, xstrndup(path, len));
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+		const char *slash;
+
+		if (S_ISSPARSEDIR(ce->ce_mode))
+			continue;
+		if (len && strncmp(ce->name, path, len))
+			continue;
+
+		/* add every leading directory we have not seen yet */
+		for (slash = strchr(ce->name + len, '/'); slash;
+		     slash = strchr(slash + 1, '/')) {
+			size_t dir_len = slash - ce->name + 1;
+
+			if (last && dir_len <= last_len &&
+			    !strncmp(ce->name, last, dir_len))
+				continue;
+			string_list_append_nodup(&rp->todo,
+						 xstrndup(ce->name, dir_len));
+		}
+		slash = strrchr(ce->name, '/');
+		last = ce->name;
+		last_len = slash ? slash - ce->name + 1 : 0;
+	}
+
+	if (rp->todo.nr < 2) {
+		string_list_clear(&rp->todo, 0);
+		strset_clear(&rp->claimed);
+		strset_clear(&rp->reading);
+		strmap_clear(&rp->listings, 0);
+		free(rp);
+		return;
+	}
+
+	pthread_mutex_init(&rp->mutex, NULL);
+	pthread_cond_init(&rp->cond, NULL);
+	rp->nr_threads = nr_threads;
+	CALLOC_ARRAY(rp->threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		err = pthread_create(&rp->threads[i], NULL,
+				     readdir_prefetch_thread, rp);
+		if (err)
+			die(_("unable to create readdir thread: %s"),
+			    strerror(err));
+	}
+	dir->internal.readdir_prefetch = rp;
+}
+
+static void stop_readdir_prefetch(struct dir_struct *dir,
+				  struct repository *r)
+{
+	struct readdir_prefetch *rp = dir->internal.readdir_prefetch;
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+	int i;
+
+	if (!rp)
+		return;
+
+	pthread_mutex_lock(&rp->mutex);
+	rp->stop = 1;
+	pthread_cond_broadcast(&rp->cond);
+	pthread_mutex_unlock(&rp->mutex);
+	for (i = 0; i < rp->nr_threads; i++)
+		if (pthread_join(rp->threads[i], NULL))
+			die(_("unable to join readdir thread"));
+
+	trace2_data_intmax("dir", r, "prefetch/listings-read", rp->nr_read);
+	trace2_data_intmax("dir", r, "prefetch/listings-used", rp->nr_used);
+
+	strmap_for_each_entry(&rp->listings, &iter, e)
+		free_dir_listing(e->value);
+	strmap_clear(&rp->listings, 0);
+	strset_clear(&rp->claimed);
+	strset_clear(&rp->reading);
+	string_list_clear(&rp->todo, 0);
+	pthread_mutex_destroy(&rp->mutex);
+	pthread_cond_destroy(&rp->cond);
+	free(rp->threads);
+	free(rp);
+	dir->internal.readdir_prefetch = NULL;
+}
+
+/*
+ * Take the prefetched listing of "path", if there is one, waiting for a
+ * worker that is still reading it. Otherwise make sure that no worker is
+ * going to read it, as we are about to do so.
+ */
+static struct dir_listing *take_dir_listing(struct readdir_prefetch *rp,
+					    const char *path)
+{
+	struct dir_listing *listing;
+
+	pthread_mutex_lock(&rp->mutex);
+	while (strset_contains(&rp->reading, path))
+		pthread_cond_wait(&rp->cond, &rp->mutex);
+	listing = strmap_get(&rp->listings, path);
+	if (listing) {
+		strmap_remove(&rp->listings, path, 0);
+		rp->cached_entries -= listing->nr;
+		rp->nr_used++;
+		pthread_cond_broadcast(&rp->cond);
+	} else {
+		strset_add(&rp->claimed, path);
+	}
+	pthread_mutex_unlock(&rp->mutex);
+	return listing;
+}
+
 static int open_cached_dir(struct cached_dir *cdir,
 			   struct dir_struct *dir,
 			   struct untracked_cache_dir *untracked,
@@ -2534,15 +3059,20 @@ static int open_cached_dir(struct cached_dir *cdir,
 	cdir->untracked = untracked;
 	if (valid_cached_dir(dir, untracked, istate, path, check_only))
 		return 0;
-	c_path = path->len ? path->buf : ".";
-	cdir->fdir = opendir(c_path);
-	if (!cdir->fdir)
-		warning_errno(_("could not open directory '%s'"), c_path);
+	if (dir->internal.readdir_prefetch)
+		cdir->listing = take_dir_listing(dir->internal.readdir_prefetch,
+						 path->buf);
+	if (!cdir->listing) {
+		c_path = path->len ? path->buf : ".";
+		cdir->fdir = opendir(c_path);
+		if (!cdir->fdir)
+			warning_errno(_("could not open directory '%s'"), c_path);
+	}
 	if (dir->untracked) {
 		invalidate_directory(dir->untracked, untracked);
 		dir->untracked->dir_opened++;
 	}
-	if (!cdir->fdir)
+	if (!cdir->fdir && !cdir->listing)
 		return -1;
 	return 0;
 }
@@ -2551,6 +3081,17 @@ static int read_cached_dir(struct cached_dir *cdir)
 {
 	struct dirent *de;
 
+	if (cdir->listing) {
+		if (cdir->listing_pos >= cdir->listing->nr) {
+			cdir->d_name = NULL;
+			cdir->d_type = DT_UNKNOWN;
+			return -1;
+		}
+		cdir->d_name = cdir->listing->entries[cdir->listing_pos].d_name;
+		cdir->d_type = cdir->listing->entries[cdir->listing_pos].d_type;
+		cdir->listing_pos++;
+		return 0;
+	}
 	if (cdir->fdir) {
 		de = readdir_skip_dot_and_dotdot(cdir->fdir);
 		if (!de) {
@@ -2585,6 +3126,7 @@ static void close_cached_dir(struct cached_dir *cdir)
 {
 	if (cdir->fdir)
 		closedir(cdir->fdir);
+	free_dir_listing(cdir->listing);
 	/*
 	 * We have gone through this directory and found no untracked
 	 * entries. Mark it valid.
@@ -2620,7 +3162,7 @@ static void add_path_to_appropriate_result_list(struct dir_struct *dir,
 		if (dir->flags & DIR_SHOW_IGNORED)
 			break;
 		dir_add_name(dir, istate, path->buf, path->len);
-		if (cdir->fdir)
+		if (cdir->fdir || cdir->listing)
 			add_untracked(untracked, path->buf + baselen);
 		break;
 
@@ -2726,7 +3268,7 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 
 			/* abort early if maximum state has been reached */
 			if (dir_state == path_untracked) {
-				if (cdir.fdir)
+				if (cdir.fdir || cdir.listing)
 					add_untracked(untracked, path.buf + baselen);
 				break;
 			}
@@ -3106,8 +3648,11 @@ int read_directory(struct dir_struct *dir, struct index_state *istate,
 		 * e.g. prep_exclude()
 		 */
 		dir->untracked = NULL;
-	if (!len || treat_leading_path(dir, istate, path, len, pathspec))
+	if (!len || treat_leading_path(dir, istate, path, len, pathspec)) {
+		start_readdir_prefetch(dir, istate, path, len, pathspec);
 		read_directory_recursive(dir, istate, path, len, untracked, 0, 0, pathspec);
+		stop_readdir_prefetch(dir, istate->repo);
+	}
 	QSORT(dir->entries, dir->nr, cmp_dir_entry);
 	QSORT(dir->ignored, dir->ignored_nr, cmp_dir_entry);
 
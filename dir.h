@@ -44,6 +44,7 @@ struct repository;
  */
 
 struct repository;
+struct readdir_prefetch;
 
 struct dir_entry {
 	unsigned int len;
@@ -91,6 +92,8 @@ struct pattern_entry {
  * can also be used to represent the list of --exclude values passed
  * via CLI args.
  */
+struct pattern_index;
+
 struct pattern_list {
 	int nr;
 	int alloc;
@@ -119,6 +122,12 @@ struct pattern_list {
 	 * Used to check single-level parents of blobs.
 	 */
 	struct hashmap parent_hashmap;
+
+	/*
+	 * Lookup structure for long non-cone lists, built lazily on the
+	 * first match and discarded whenever a pattern is added.
+	 */
+	struct pattern_index *index;
 };
 
 /*
@@ -354,6 +363,9 @@ struct dir_struct {
 		/* Stats about the traversal */
 		unsigned visited_paths;
 		unsigned visited_directories;
+
+		/* Directory listings read ahead by worker threads */
+		struct readdir_prefetch *readdir_prefetch;
 	} internal;
 };
 
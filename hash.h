@@ -119,6 +119,9 @@
 #ifdef platform_SHA256_Clone
 #define git_SHA256_Clone	platform_SHA256_Clone
 #endif
+#ifdef platform_SHA256_Update_Many
+#define git_SHA256_Update_Many	platform_SHA256_Update_Many
+#endif
 
 #ifdef SHA1_MAX_BLOCK_SIZE
 #include "compat/sha1-chunked.h"
@@ -245,6 +248,8 @@ typedef union git_hash_ctx git_hash_ctx;
 typedef void (*git_hash_init_fn)(git_hash_ctx *ctx);
 typedef void (*git_hash_clone_fn)(git_hash_ctx *dst, const git_hash_ctx *src);
 typedef void (*git_hash_update_fn)(git_hash_ctx *ctx, const void *in, size_t len);
+typedef void (*git_hash_update_many_fn)(git_hash_ctx **ctx, const void **in,
+					const size_t *len, size_t nr);
 typedef void (*git_hash_final_fn)(unsigned char *hash, git_hash_ctx *ctx);
 typedef void (*git_hash_final_oid_fn)(struct object_id *oid, git_hash_ctx *ctx);
 
@@ -276,6 +281,15 @@ struct git_hash_algo {
 	/* The hash update function. */
 	git_hash_update_fn update_fn;
 
+	/*
+	 * Update nr independent contexts at once, feeding len[i] bytes
+	 * from in[i] into ctx[i].  The result is the same as calling
+	 * update_fn on each context, but implementations may hash the
+	 * messages side by side in SIMD lanes, which pays off for batches
+	 * of small inputs.
+	 */
+	git_hash_update_many_fn update_many_fn;
+
 	/* The hash finalization function. */
 	git_hash_final_fn final_fn;
 
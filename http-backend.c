@@ -240,6 +240,13 @@ static void get_idx_file(struct strbuf *hdr, char *name)
 	send_local_file(hdr, "application/x-git-packed-objects-toc", name);
 }
 
+static void get_bundle_file(struct strbuf *hdr, char *name)
+{
+	select_getanyfile(hdr);
+	hdr_cache_forever(hdr);
+	send_local_file(hdr, "application/octet-stream", name);
+}
+
 static void http_config(void)
 {
 	int i, value = 0;
@@ -732,6 +739,7 @@ static struct service_cmd {
 	{"GET", "/objects/pack/pack-[0-9a-f]{64}\\.pack$", get_pack_file},
 	{"GET", "/objects/pack/pack-[0-9a-f]{40}\\.idx$", get_idx_file},
 	{"GET", "/objects/pack/pack-[0-9a-f]{64}\\.idx$", get_idx_file},
+	{"GET", "/objects/info/bundles/bundle-[0-9]+\\.bundle$", get_bundle_file},
 
 	{"POST", "/git-upload-pack$", service_rpc},
 	{"POST", "/git-upload-archive$", service_rpc},
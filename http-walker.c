@@ -9,6 +9,7 @@
 #include "transport.h"
 #include "packfile.h"
 #include "object-store-ll.h"
+#include "oidmap.h"
 
 struct alt_base {
 	char *base;
@@ -25,8 +26,8 @@ enum object_request_state {
 };
 
 struct object_request {
+	struct oidmap_entry ent;
 	struct walker *walker;
-	struct object_id oid;
 	struct alt_base *repo;
 	enum object_request_state state;
 	struct http_object_request *req;
@@ -48,7 +49,26 @@ struct walker_data {
 	struct alt_base *alt;
 };
 
-static LIST_HEAD(object_queue_head);
+/*
+ * Requests that have not been started yet, queued by priority: the
+ * objects a commit leads to are only known once we have it, so commits
+ * are fetched before trees, and trees before blobs.
+ */
+enum object_queue_id {
+	QUEUE_COMMITS,
+	QUEUE_TREES,
+	QUEUE_BLOBS,
+	NR_QUEUES
+};
+
+static struct list_head object_queues[NR_QUEUES] = {
+	LIST_HEAD_INIT(object_queues[QUEUE_COMMITS]),
+	LIST_HEAD_INIT(object_queues[QUEUE_TREES]),
+	LIST_HEAD_INIT(object_queues[QUEUE_BLOBS]),
+};
+
+/* All requests that have not been released yet, by object name. */
+static struct oidmap object_requests = OIDMAP_INIT;
 
 static void fetch_alternates(struct walker *walker, const char *base);
 
@@ -59,7 +79,7 @@ static void start_object_request(struct object_request *obj_req)
 	struct active_request_slot *slot;
 	struct http_object_request *req;
 
-	req = new_http_object_request(obj_req->repo->base, &obj_req->oid);
+	req = new_http_object_request(obj_req->repo->base, &obj_req->ent.oid);
 	if (!req) {
 		obj_req->state = ABORTED;
 		return;
@@ -85,7 +105,7 @@ static void finish_object_request(struct object_request *obj_req)
 		return;
 
 	if (obj_req->req->rename == 0)
-		walker_say(obj_req->walker, "got %s\n", oid_to_hex(&obj_req->oid));
+		walker_say(obj_req->walker, "got %s\n", oid_to_hex(&obj_req->ent.oid));
 }
 
 static void process_object_response(void *callback_data)
@@ -124,6 +144,7 @@ static void release_object_request(struct object_request *obj_req)
 	if (obj_req->req !=NULL && obj_req->req->localfile != -1)
 		error("fd leakage in release: %d", obj_req->req->localfile);
 
+	oidmap_remove(&object_requests, &obj_req->ent.oid);
 	list_del(&obj_req->node);
 	free(obj_req);
 }
@@ -131,12 +152,14 @@ static void release_object_request(struct object_request *obj_req)
 static int fill_active_slot(void *data UNUSED)
 {
 	struct object_request *obj_req;
-	struct list_head *pos, *tmp, *head = &object_queue_head;
+	struct list_head *pos, *tmp;
+	int i;
 
-	list_for_each_safe(pos, tmp, head) {
-		obj_req = list_entry(pos, struct object_request, node);
-		if (obj_req->state == WAITING) {
-			if (repo_has_object_file(the_repository, &obj_req->oid))
+	for (i = 0; i < NR_QUEUES; i++) {
+		list_for_each_safe(pos, tmp, &object_queues[i]) {
+			obj_req = list_entry(pos, struct object_request, node);
+			list_del_init(&obj_req->node);
+			if (repo_has_object_file(the_repository, &obj_req->ent.oid))
 				obj_req->state = COMPLETE;
 			else {
 				start_object_request(obj_req);
@@ -147,25 +170,54 @@ static int fill_active_slot(void *data UNUSED)
 	return 0;
 }
 
-static void prefetch(struct walker *walker, const struct object_id *oid)
+static void prefetch(struct walker *walker, const struct object_id *oid,
+		     enum object_type type)
 {
 	struct object_request *newreq;
 	struct walker_data *data = walker->data;
+	enum object_queue_id queue;
+
+	switch (type) {
+	case OBJ_TREE:
+		queue = QUEUE_TREES;
+		break;
+	case OBJ_BLOB:
+		queue = QUEUE_BLOBS;
+		break;
+	default:
+		queue = QUEUE_COMMITS;
+		break;
+	}
 
 	newreq = xmalloc(sizeof(*newreq));
 	newreq->walker = walker;
-	oidcpy(&newreq->oid, oid);
+	oidcpy(&newreq->ent.oid, oid);
 	newreq->repo = data->alt;
 	newreq->state = WAITING;
 	newreq->req = NULL;
 
 	http_is_verbose = walker->get_verbosely;
-	list_add_tail(&newreq->node, &object_queue_head);
+	list_add_tail(&newreq->node, &object_queues[queue]);
+	oidmap_put(&object_requests, newreq);
 
 	fill_active_slots();
 	step_active_slots();
 }
 
+static int fetch_ready(struct walker *walker UNUSED,
+		       const struct object_id *oid)
+{
+	struct object_request *obj_req = oidmap_get(&object_requests, oid);
+
+	return !obj_req ||
+		obj_req->state == COMPLETE || obj_req->state == ABORTED;
+}
+
+static int wait_for_requests(struct walker *walker UNUSED)
+{
+	return wait_active_slots();
+}
+
 static int is_alternate_allowed(const char *url)
 {
 	const char *protocols[] = {
@@ -482,25 +534,20 @@ static int fetch_object(struct walker *walker, const struct object_id *oid)
 {
 	char *hex = oid_to_hex(oid);
 	int ret = 0;
-	struct object_request *obj_req = NULL;
+	struct object_request *obj_req = oidmap_get(&object_requests, oid);
 	struct http_object_request *req;
-	struct list_head *pos, *head = &object_queue_head;
 
-	list_for_each(pos, head) {
-		obj_req = list_entry(pos, struct object_request, node);
-		if (oideq(&obj_req->oid, oid))
-			break;
-	}
 	if (!obj_req)
 		return error("Couldn't find request for %s in the queue", hex);
 
-	if (repo_has_object_file(the_repository, &obj_req->oid)) {
+	if (repo_has_object_file(the_repository, &obj_req->ent.oid)) {
 		if (obj_req->req)
 			abort_http_object_request(&obj_req->req);
 		abort_object_request(obj_req);
 		return 0;
 	}
 
+	fill_active_slots();
 	while (obj_req->state == WAITING)
 		step_active_slots();
 
@@ -535,7 +582,7 @@ static int fetch_object(struct walker *walker, const struct object_id *oid)
 	} else if (req->zret != Z_STREAM_END) {
 		walker->corrupt_object_found++;
 		ret = error("File %s (%s) corrupt", hex, req->url);
-	} else if (!oideq(&obj_req->oid, &req->real_oid)) {
+	} else if (!oideq(&obj_req->ent.oid, &req->real_oid)) {
 		ret = error("File %s has bad hash", hex);
 	} else if (req->rename < 0) {
 		struct strbuf buf = STRBUF_INIT;
@@ -577,6 +624,8 @@ static void cleanup(struct walker *walker)
 	struct walker_data *data = walker->data;
 	struct alt_base *alt, *alt_next;
 
+	http_allow_multiplexed_requests(0);
+
 	if (data) {
 		alt = data->alt;
 		while (alt) {
@@ -622,10 +671,13 @@ struct walker *get_http_walker(const char *url)
 	walker->fetch = fetch;
 	walker->fetch_ref = fetch_ref;
 	walker->prefetch = prefetch;
+	walker->fetch_ready = fetch_ready;
+	walker->wait = wait_for_requests;
 	walker->cleanup = cleanup;
 	walker->data = data;
 
 	add_fill_function(NULL, fill_active_slot);
+	http_allow_multiplexed_requests(1);
 
 	return walker;
 }
@@ -20,6 +20,7 @@
 #include "object-file.h"
 #include "object-store-ll.h"
 #include "tempfile.h"
+#include "trace2.h"
 
 static struct trace_key trace_curl = TRACE_KEY_INIT(CURL);
 static int trace_curl_data = 1;
@@ -32,6 +33,13 @@ ssize_t http_post_buffer = 16 * LARGE_PACKET_MAX;
 static int min_curl_sessions = 1;
 static int curl_session_count;
 static int max_requests = -1;
+static int max_multiplexed_requests = -1;
+/* Set by http_allow_multiplexed_requests(). */
+static int multiplex_requests;
+static unsigned long finished_requests;
+/* Reported to trace2 by http_cleanup(). */
+static int peak_active_requests;
+static long http_connections;
 static CURLM *curlm;
 static CURL *curl_default;
 
@@ -321,8 +329,14 @@ static void closedown_active_slot(struct active_request_slot *slot)
 
 static void finish_active_slot(struct active_request_slot *slot)
 {
+	long connects;
+
 	closedown_active_slot(slot);
 	curl_easy_getinfo(slot->curl, CURLINFO_HTTP_CODE, &slot->http_code);
+	finished_requests++;
+
+	if (!curl_easy_getinfo(slot->curl, CURLINFO_NUM_CONNECTS, &connects))
+		http_connections += connects;
 
 	if (slot->finished)
 		(*slot->finished) = 1;
@@ -436,6 +450,10 @@ static int http_options(const char *var, const char *value,
 		max_requests = git_config_int(var, value, ctx->kvi);
 		return 0;
 	}
+	if (!strcmp("http.maxmultiplexedrequests", var)) {
+		max_multiplexed_requests = git_config_int(var, value, ctx->kvi);
+		return 0;
+	}
 	if (!strcmp("http.lowspeedlimit", var)) {
 		curl_low_speed_limit = (long)git_config_int(var, value, ctx->kvi);
 		return 0;
@@ -1351,6 +1369,10 @@ void http_init(struct remote *remote, const char *url, int proactive_auth)
 	curl_session_count = 0;
 	if (max_requests < 1)
 		max_requests = DEFAULT_MAX_REQUESTS;
+	if (max_multiplexed_requests < 1)
+		max_multiplexed_requests = DEFAULT_MAX_MULTIPLEXED_REQUESTS;
+	if (max_multiplexed_requests < max_requests)
+		max_multiplexed_requests = max_requests;
 
 	set_from_env(&http_proxy_ssl_cert, "GIT_PROXY_SSL_CERT");
 	set_from_env(&http_proxy_ssl_key, "GIT_PROXY_SSL_KEY");
@@ -1392,6 +1414,14 @@ void http_cleanup(void)
 
 	curl_multi_cleanup(curlm);
 	curl_global_cleanup();
+	multiplex_requests = 0;
+
+	trace2_data_intmax("http", NULL, "peak-active-requests",
+			   peak_active_requests);
+	trace2_data_intmax("http", NULL, "connections",
+			   http_connections);
+	peak_active_requests = 0;
+	http_connections = 0;
 
 	string_list_clear(&extra_http_headers, 0);
 
@@ -1432,6 +1462,28 @@ void http_cleanup(void)
 	FREE_AND_NULL(cached_accept_language);
 }
 
+void http_allow_multiplexed_requests(int allow)
+{
+	multiplex_requests = allow;
+
+	/*
+	 * Send concurrent requests as streams over one HTTP/2 connection
+	 * where possible, instead of opening a connection for each of them.
+	 * Hosts that cannot multiplex still get no more than max_requests
+	 * connections; libcurl queues the other requests until one of
+	 * those connections is free.
+	 */
+	if (allow)
+		curl_multi_setopt(curlm, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+	curl_multi_setopt(curlm, CURLMOPT_MAX_HOST_CONNECTIONS,
+			  allow ? (long)max_requests : 0L);
+}
+
+static int max_active_requests(void)
+{
+	return multiplex_requests ? max_multiplexed_requests : max_requests;
+}
+
 struct active_request_slot *get_active_slot(void)
 {
 	struct active_request_slot *slot = active_queue_head;
@@ -1440,7 +1492,7 @@ struct active_request_slot *get_active_slot(void)
 	int num_transfers;
 
 	/* Wait for a slot to open up if the queue is full */
-	while (active_requests >= max_requests) {
+	while (active_requests >= max_active_requests()) {
 		curl_multi_perform(curlm, &num_transfers);
 		if (num_transfers < active_requests)
 			process_curl_messages();
@@ -1472,6 +1524,8 @@ struct active_request_slot *get_active_slot(void)
 	}
 
 	active_requests++;
+	if (peak_active_requests < active_requests)
+		peak_active_requests = active_requests;
 	slot->in_use = 1;
 	slot->results = NULL;
 	slot->finished = NULL;
@@ -1501,6 +1555,12 @@ struct active_request_slot *get_active_slot(void)
 	curl_easy_setopt(slot->curl, CURLOPT_HTTPGET, 1);
 	curl_easy_setopt(slot->curl, CURLOPT_FAILONERROR, 1);
 	curl_easy_setopt(slot->curl, CURLOPT_RANGE, NULL);
+	/*
+	 * When multiplexing, rather wait for a connection that is being set
+	 * up to tell whether it can carry more requests than open another
+	 * one right away.
+	 */
+	curl_easy_setopt(slot->curl, CURLOPT_PIPEWAIT, (long)multiplex_requests);
 
 	/*
 	 * Default following to off unless "ALWAYS" is configured; this gives
@@ -1566,7 +1626,7 @@ void fill_active_slots(void)
 {
 	struct active_request_slot *slot = active_queue_head;
 
-	while (active_requests < max_requests) {
+	while (active_requests < max_active_requests()) {
 		struct fill_chain *fill;
 		for (fill = fill_cfg; fill; fill = fill->next)
 			if (fill->fill(fill->data))
@@ -1601,52 +1661,74 @@ void step_active_slots(void)
 	}
 }
 
-void run_active_slot(struct active_request_slot *slot)
+/* Waits until curl has something to do for the active transfers. */
+static void wait_for_transfers(void)
 {
 	fd_set readfds;
 	fd_set writefds;
 	fd_set excfds;
 	int max_fd;
 	struct timeval select_timeout;
+	long curl_timeout;
+
+	curl_multi_timeout(curlm, &curl_timeout);
+	if (curl_timeout == 0) {
+		return;
+	} else if (curl_timeout == -1) {
+		select_timeout.tv_sec  = 0;
+		select_timeout.tv_usec = 50000;
+	} else {
+		select_timeout.tv_sec  =  curl_timeout / 1000;
+		select_timeout.tv_usec = (curl_timeout % 1000) * 1000;
+	}
+
+	max_fd = -1;
+	FD_ZERO(&readfds);
+	FD_ZERO(&writefds);
+	FD_ZERO(&excfds);
+	curl_multi_fdset(curlm, &readfds, &writefds, &excfds, &max_fd);
+
+	/*
+	 * It can happen that curl_multi_timeout returns a pathologically
+	 * long timeout when curl_multi_fdset returns no file descriptors
+	 * to read.  See commit message for more details.
+	 */
+	if (max_fd < 0 &&
+	    (select_timeout.tv_sec > 0 ||
+	     select_timeout.tv_usec > 50000)) {
+		select_timeout.tv_sec  = 0;
+		select_timeout.tv_usec = 50000;
+	}
+
+	select(max_fd+1, &readfds, &writefds, &excfds, &select_timeout);
+}
+
+int wait_active_slots(void)
+{
+	unsigned long finished = finished_requests;
+
+	fill_active_slots();
+	if (!active_requests)
+		return -1;
+
+	step_active_slots();
+	while (finished == finished_requests) {
+		wait_for_transfers();
+		step_active_slots();
+	}
+	return 0;
+}
+
+void run_active_slot(struct active_request_slot *slot)
+{
 	int finished = 0;
 
 	slot->finished = &finished;
 	while (!finished) {
 		step_active_slots();
 
-		if (slot->in_use) {
-			long curl_timeout;
-			curl_multi_timeout(curlm, &curl_timeout);
-			if (curl_timeout == 0) {
-				continue;
-			} else if (curl_timeout == -1) {
-				select_timeout.tv_sec  = 0;
-				select_timeout.tv_usec = 50000;
-			} else {
-				select_timeout.tv_sec  =  curl_timeout / 1000;
-				select_timeout.tv_usec = (curl_timeout % 1000) * 1000;
-			}
-
-			max_fd = -1;
-			FD_ZERO(&readfds);
-			FD_ZERO(&writefds);
-			FD_ZERO(&excfds);
-			curl_multi_fdset(curlm, &readfds, &writefds, &excfds, &max_fd);
-
-			/*
-			 * It can happen that curl_multi_timeout returns a pathologically
-			 * long timeout when curl_multi_fdset returns no file descriptors
-			 * to read.  See commit message for more details.
-			 */
-			if (max_fd < 0 &&
-			    (select_timeout.tv_sec > 0 ||
-			     select_timeout.tv_usec > 50000)) {
-				select_timeout.tv_sec  = 0;
-				select_timeout.tv_usec = 50000;
-			}
-
-			select(max_fd+1, &readfds, &writefds, &excfds, &select_timeout);
-		}
+		if (slot->in_use)
+			wait_for_transfers();
 	}
 
 	/*
@@ -12,6 +12,7 @@ struct packed_git;
 #include "remote.h"
 
 #define DEFAULT_MAX_REQUESTS 5
+#define DEFAULT_MAX_MULTIPLEXED_REQUESTS 64
 
 struct slot_results {
 	CURLcode curl_result;
@@ -62,6 +63,21 @@ void fill_active_slots(void);
 void add_fill_function(void *data, int (*fill)(void *));
 void step_active_slots(void);
 
+/*
+ * Waits until one of the active slots finishes, and handles it like
+ * step_active_slots() does. Returns -1 without waiting if no slot is
+ * active.
+ */
+int wait_active_slots(void);
+
+/*
+ * Lets up to http.maxMultiplexedRequests instead of http.maxRequests
+ * slots be active, for callers that issue many small requests like the
+ * dumb HTTP walker. Requests to hosts that cannot multiplex them over
+ * one connection still use at most http.maxRequests connections.
+ */
+void http_allow_multiplexed_requests(int allow);
+
 void http_init(struct remote *remote, const char *url,
 	       int proactive_auth);
 void http_cleanup(void);
@@ -9,6 +9,9 @@
 #include "hex.h"
 #include "object-name.h"
 #include "object-store-ll.h"
+#include "oid-array.h"
+#include "oidset.h"
+#include "promisor-remote.h"
 #include "repository.h"
 #include "tmp-objdir.h"
 #include "commit.h"
@@ -1201,3 +1204,94 @@ int log_tree_commit(struct rev_info *opt, struct commit *commit)
 	diff_free(&opt->diffopt);
 	return shown;
 }
+
+/*
+ * Add the commits on the first-parent chain starting at "commit" that
+ * are not in "seen" yet to "ahead", stopping once "budget" commits have
+ * been looked at.
+ */
+static void walk_ahead(struct commit *commit, struct oidset *visited,
+		       struct oidset *seen, struct commit **ahead,
+		       int *nr, int *count, int budget)
+{
+	for (; commit && *count < budget;
+	     commit = commit->parents ? commit->parents->item : NULL) {
+		if (commit->object.flags & UNINTERESTING ||
+		    repo_parse_commit(the_repository, commit) ||
+		    oidset_insert(visited, &commit->object.oid))
+			break;
+		(*count)++;
+		if (!oidset_contains(seen, &commit->object.oid))
+			ahead[(*nr)++] = commit;
+	}
+}
+
+void log_tree_prefetch(struct rev_info *opt, struct commit *commit,
+		       struct oidset *seen)
+{
+	struct commit *ahead[LOG_TREE_PREFETCH_AHEAD];
+	struct oidset visited = OIDSET_INIT;
+	struct oid_array to_fetch = OID_ARRAY_INIT;
+	struct diff_options diffopt;
+	struct commit_list *p;
+	int budget = LOG_TREE_PREFETCH_AHEAD, count = 0, nr = 0;
+
+	if (!opt->diff || opt->diffopt.flags.follow_renames ||
+	    opt->line_level_traverse || opt->diffopt.repo != the_repository ||
+	    !diff_needs_blob_data(&opt->diffopt) ||
+	    !repo_has_promisor_remote(the_repository))
+		return;
+
+	/* get_revision() has already counted "commit" */
+	if (opt->max_count >= 0 && opt->max_count + 1 < budget)
+		budget = opt->max_count + 1;
+
+	/*
+	 * Guess which commits will be shown next by following the first
+	 * parents of this commit and of the commits queued in the walk.
+	 */
+	walk_ahead(commit, &visited, seen, ahead, &nr, &count, budget);
+	for (p = opt->commits; p && count < budget; p = p->next)
+		walk_ahead(p->item, &visited, seen, ahead, &nr, &count, budget);
+	oidset_clear(&visited);
+
+	/*
+	 * Fetch in batches of at least half the window, unless we are
+	 * approaching the end of the walk.
+	 */
+	if (!nr || (nr < budget / 2 && count == budget))
+		return;
+
+	repo_diff_setup(the_repository, &diffopt);
+	diffopt.flags.recursive = 1;
+	diffopt.output_format = DIFF_FORMAT_NO_OUTPUT;
+	copy_pathspec(&diffopt.pathspec, &opt->diffopt.pathspec);
+	diff_setup_done(&diffopt);
+
+	for (int i = 0; i < nr; i++) {
+		struct commit *c = ahead[i];
+
+		oidset_insert(seen, &c->object.oid);
+		if (!c->parents) {
+			if (opt->show_root_diff)
+				diff_root_tree_oid(get_commit_tree_oid(c), "",
+						   &diffopt);
+			continue;
+		}
+		if (c->parents->next ||
+		    repo_parse_commit(the_repository, c->parents->item))
+			continue;
+		diff_tree_oid(get_commit_tree_oid(c->parents->item),
+			      get_commit_tree_oid(c), "", &diffopt);
+	}
+	for (int i = 0; i < diff_queued_diff.nr; i++) {
+		struct diff_filepair *pair = diff_queued_diff.queue[i];
+
+		diff_add_if_missing(the_repository, &to_fetch, pair->one);
+		diff_add_if_missing(the_repository, &to_fetch, pair->two);
+	}
+	diff_flush(&diffopt);
+
+	promisor_remote_prefetch(the_repository, to_fetch.oid, to_fetch.nr);
+	oid_array_clear(&to_fetch);
+}
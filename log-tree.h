@@ -1,6 +1,7 @@
 #ifndef LOG_TREE_H
 #define LOG_TREE_H
 
+struct oidset;
 struct rev_info;
 
 struct log_info {
@@ -24,6 +25,21 @@ struct decoration_options {
 int parse_decorate_color_config(const char *var, const char *slot_name, const char *value);
 int log_tree_diff_flush(struct rev_info *);
 int log_tree_commit(struct rev_info *, struct commit *);
+
+/*
+ * The number of commits that log_tree_prefetch() looks ahead.
+ */
+#define LOG_TREE_PREFETCH_AHEAD 32
+
+/*
+ * In a partial clone, showing the diff of each commit may have to fetch
+ * its blobs from the promisor remote, one round trip per commit. Call
+ * this before showing "commit" to instead fetch the blobs of the commits
+ * that are likely to be shown next in the background, in batches. "seen"
+ * remembers the commits that were already taken care of.
+ */
+void log_tree_prefetch(struct rev_info *, struct commit *commit,
+		       struct oidset *seen);
 void show_log(struct rev_info *opt);
 void format_decorations(struct strbuf *sb, const struct commit *commit,
 			int use_color, const struct decoration_options *opts);
@@ -1343,6 +1343,8 @@ static int write_midx_internal(const char *object_dir,
 		hold_lock_file_for_update(&lk, midx_name.buf, LOCK_DIE_ON_ERROR);
 		f = hashfd(get_lock_file_fd(&lk), get_lock_file_path(&lk));
 	}
+	prepare_repo_settings(the_repository);
+	f->want_thread = the_repository->settings.core_checksum_thread;
 
 	cf = init_chunkfile(f);
 
@@ -100,6 +100,13 @@ static void git_hash_sha1_update(git_hash_ctx *ctx, const void *data, size_t len
 	git_SHA1_Update(&ctx->sha1, data, len);
 }
 
+static void git_hash_sha1_update_many(git_hash_ctx **ctx, const void **data,
+				      const size_t *len, size_t nr)
+{
+	for (size_t i = 0; i < nr; i++)
+		git_SHA1_Update(&ctx[i]->sha1, data[i], len[i]);
+}
+
 static void git_hash_sha1_final(unsigned char *hash, git_hash_ctx *ctx)
 {
 	git_SHA1_Final(hash, &ctx->sha1);
@@ -155,6 +162,29 @@ static void git_hash_sha256_update(git_hash_ctx *ctx, const void *data, size_t l
 	git_SHA256_Update(&ctx->sha256, data, len);
 }
 
+static void git_hash_sha256_update_many(git_hash_ctx **ctx, const void **data,
+					const size_t *len, size_t nr)
+{
+#ifdef git_SHA256_Update_Many
+	git_SHA256_CTX *sha256[16];
+
+	while (nr) {
+		size_t n = nr < ARRAY_SIZE(sha256) ? nr : ARRAY_SIZE(sha256);
+
+		for (size_t i = 0; i < n; i++)
+			sha256[i] = &ctx[i]->sha256;
+		git_SHA256_Update_Many(sha256, data, len, n);
+		ctx += n;
+		data += n;
+		len += n;
+		nr -= n;
+	}
+#else
+	for (size_t i = 0; i < nr; i++)
+		git_SHA256_Update(&ctx[i]->sha256, data[i], len[i]);
+#endif
+}
+
 static void git_hash_sha256_final(unsigned char *hash, git_hash_ctx *ctx)
 {
 	git_SHA256_Final(hash, &ctx->sha256);
@@ -189,6 +219,14 @@ static void git_hash_unknown_update(git_hash_ctx *ctx UNUSED,
 	BUG("trying to update unknown hash");
 }
 
+static void git_hash_unknown_update_many(git_hash_ctx **ctx UNUSED,
+					 const void **data UNUSED,
+					 const size_t *len UNUSED,
+					 size_t nr UNUSED)
+{
+	BUG("trying to update unknown hash");
+}
+
 static void git_hash_unknown_final(unsigned char *hash UNUSED,
 				   git_hash_ctx *ctx UNUSED)
 {
@@ -211,6 +249,7 @@ const struct git_hash_algo hash_algos[GIT_HASH_NALGOS] = {
 		.init_fn = git_hash_unknown_init,
 		.clone_fn = git_hash_unknown_clone,
 		.update_fn = git_hash_unknown_update,
+		.update_many_fn = git_hash_unknown_update_many,
 		.final_fn = git_hash_unknown_final,
 		.final_oid_fn = git_hash_unknown_final_oid,
 		.unsafe_init_fn = git_hash_unknown_init,
@@ -231,6 +270,7 @@ const struct git_hash_algo hash_algos[GIT_HASH_NALGOS] = {
 		.init_fn = git_hash_sha1_init,
 		.clone_fn = git_hash_sha1_clone,
 		.update_fn = git_hash_sha1_update,
+		.update_many_fn = git_hash_sha1_update_many,
 		.final_fn = git_hash_sha1_final,
 		.final_oid_fn = git_hash_sha1_final_oid,
 		.unsafe_init_fn = git_hash_sha1_init_unsafe,
@@ -251,6 +291,7 @@ const struct git_hash_algo hash_algos[GIT_HASH_NALGOS] = {
 		.init_fn = git_hash_sha256_init,
 		.clone_fn = git_hash_sha256_clone,
 		.update_fn = git_hash_sha256_update,
+		.update_many_fn = git_hash_sha256_update_many,
 		.final_fn = git_hash_sha256_final,
 		.final_oid_fn = git_hash_sha256_final_oid,
 		.unsafe_init_fn = git_hash_sha256_init,
@@ -2097,6 +2138,37 @@ void hash_object_file(const struct git_hash_algo *algo, const void *buf,
 	hash_object_file_literally(algo, buf, len, type_name(type), oid);
 }
 
+void hash_object_file_many(const struct git_hash_algo *algo,
+			   struct hash_object_request *req, size_t nr)
+{
+	git_hash_ctx c[16], *ctx[ARRAY_SIZE(c)];
+	const void *data[ARRAY_SIZE(c)];
+	size_t len[ARRAY_SIZE(c)];
+
+	while (nr) {
+		size_t n = nr < ARRAY_SIZE(c) ? nr : ARRAY_SIZE(c);
+
+		for (size_t i = 0; i < n; i++) {
+			char hdr[MAX_HEADER_LEN];
+			int hdrlen = format_object_header(hdr, sizeof(hdr),
+							  req[i].type,
+							  req[i].len);
+
+			ctx[i] = &c[i];
+			algo->init_fn(ctx[i]);
+			algo->update_fn(ctx[i], hdr, hdrlen);
+			data[i] = req[i].buf;
+			len[i] = req[i].len;
+		}
+		algo->update_many_fn(ctx, data, len, n);
+		for (size_t i = 0; i < n; i++)
+			algo->final_oid_fn(&req[i].oid, ctx[i]);
+
+		req += n;
+		nr -= n;
+	}
+}
+
 /* Finalize a file on disk, and close it. */
 static void close_loose_object(int fd, const char *filename)
 {
@@ -2278,8 +2350,8 @@ static int write_loose_object(const struct object_id *oid, char *hdr,
 	git_zstream stream;
 	git_hash_ctx c;
 	struct object_id parano_oid;
-	static struct strbuf tmp_file = STRBUF_INIT;
-	static struct strbuf filename = STRBUF_INIT;
+	struct strbuf tmp_file = STRBUF_INIT;
+	struct strbuf filename = STRBUF_INIT;
 
 	if (batch_fsync_enabled(FSYNC_COMPONENT_LOOSE_OBJECT))
 		prepare_loose_object_bulk_checkin();
@@ -2289,8 +2361,10 @@ static int write_loose_object(const struct object_id *oid, char *hdr,
 	fd = start_loose_object_common(&tmp_file, filename.buf, flags,
 				       &stream, compressed, sizeof(compressed),
 				       &c, NULL, hdr, hdrlen);
-	if (fd < 0)
-		return -1;
+	if (fd < 0) {
+		ret = -1;
+		goto out;
+	}
 
 	/* Then the data itself.. */
 	stream.next_in = (void *)buf;
@@ -2324,8 +2398,12 @@ static int write_loose_object(const struct object_id *oid, char *hdr,
 			warning_errno(_("failed utime() on %s"), tmp_file.buf);
 	}
 
-	return finalize_object_file_flags(tmp_file.buf, filename.buf,
-					  FOF_SKIP_COLLISION_CHECK);
+	ret = finalize_object_file_flags(tmp_file.buf, filename.buf,
+					 FOF_SKIP_COLLISION_CHECK);
+out:
+	strbuf_release(&tmp_file);
+	strbuf_release(&filename);
+	return ret;
 }
 
 static int freshen_loose_object(const struct object_id *oid)
@@ -2497,6 +2575,37 @@ int write_object_file_flags(const void *buf, unsigned long len,
 	return 0;
 }
 
+int prepare_loose_object_file(const void *buf, unsigned long len,
+			      enum object_type type, struct object_id *oid)
+{
+	char hdr[MAX_HEADER_LEN];
+	int hdrlen = sizeof(hdr);
+
+	write_object_file_prepare(the_hash_algo, buf, len, type, oid,
+				  hdr, &hdrlen);
+	if (freshen_packed_object(oid) || freshen_loose_object(oid))
+		return 0;
+
+	/*
+	 * Set up what write_loose_object() would otherwise set up lazily,
+	 * as write_loose_object_file() may run in another thread.
+	 */
+	if (batch_fsync_enabled(FSYNC_COMPONENT_LOOSE_OBJECT))
+		prepare_loose_object_bulk_checkin();
+	get_shared_repository();
+	return 1;
+}
+
+int write_loose_object_file(const void *buf, unsigned long len,
+			    enum object_type type, const struct object_id *oid)
+{
+	char hdr[MAX_HEADER_LEN];
+	int hdrlen;
+
+	hdrlen = format_object_header(hdr, sizeof(hdr), type, len);
+	return write_loose_object(oid, hdr, hdrlen, buf, len, 0, 0);
+}
+
 int write_object_file_literally(const void *buf, unsigned long len,
 				const char *type, struct object_id *oid,
 				unsigned flags)
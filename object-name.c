@@ -2060,8 +2060,22 @@ static enum get_oid_result get_oid_with_context_1(struct repository *repo,
 		if (flags & GET_OID_RECORD_PATH)
 			oc->path = xstrdup(cp);
 
-		if (!repo->index || !repo->index->cache)
+		if (!repo->index || !repo->index->cache) {
+			/*
+			 * Avoid loading the whole index for a single lookup
+			 * if it has a path lookup table; misses still take
+			 * the slow path below so they are diagnosed as usual.
+			 */
+			unsigned int mode;
+
+			if (lookup_index_path(repo_get_index_file(repo), cp,
+					      namelen, stage, oid, &mode) > 0) {
+				oc->mode = mode;
+				free(new_path);
+				return 0;
+			}
 			repo_read_index(repo);
+		}
 		pos = index_name_pos(repo->index, cp, namelen);
 		if (pos < 0)
 			pos = -pos - 1;
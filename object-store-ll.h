@@ -268,6 +268,25 @@ void hash_object_file(const struct git_hash_algo *algo, const void *buf,
 		      unsigned long len, enum object_type type,
 		      struct object_id *oid);
 
+/*
+ * An object to be named by hash_object_file_many(): the caller fills in
+ * "buf", "len" and "type", and the object name is returned in "oid".
+ */
+struct hash_object_request {
+	const void *buf;
+	unsigned long len;
+	enum object_type type;
+	struct object_id oid;
+};
+
+/*
+ * Equivalent to calling hash_object_file() on each of the "nr" requests,
+ * but lets the hash implementation work on several objects at once,
+ * which is considerably faster for batches of small objects.
+ */
+void hash_object_file_many(const struct git_hash_algo *algo,
+			   struct hash_object_request *req, size_t nr);
+
 int write_object_file_flags(const void *buf, unsigned long len,
 			    enum object_type type, struct object_id *oid,
 			    struct object_id *comapt_oid_in, unsigned flags);
@@ -277,6 +296,26 @@ static inline int write_object_file(const void *buf, unsigned long len,
 	return write_object_file_flags(buf, len, type, oid, NULL, 0);
 }
 
+/*
+ * write_object_file() split in two steps, so that the expensive part of
+ * writing a loose object can be done by other threads.
+ *
+ * prepare_loose_object_file() computes the object id of the object, and
+ * returns 1 if the object has to be written, or 0 if it already is in
+ * the object store (in which case it is freshened). It sets up all state
+ * that write_loose_object_file() relies on, and has to be called by the
+ * thread that otherwise accesses the object store.
+ *
+ * write_loose_object_file() then compresses and writes the object. It
+ * can be called from several threads at once, while the calling thread
+ * of prepare_loose_object_file() keeps reading and writing objects. The
+ * repository must not have a compatibility hash algorithm configured.
+ */
+int prepare_loose_object_file(const void *buf, unsigned long len,
+			      enum object_type type, struct object_id *oid);
+int write_loose_object_file(const void *buf, unsigned long len,
+			    enum object_type type, const struct object_id *oid);
+
 int write_object_file_literally(const void *buf, unsigned long len,
 				const char *type, struct object_id *oid,
 				unsigned flags);
@@ -1028,6 +1028,8 @@ void bitmap_writer_finish(struct bitmap_writer *writer,
 		options |= BITMAP_OPT_PSEUDO_MERGES;
 
 	f = hashfd(fd, tmp_file.buf);
+	prepare_repo_settings(the_repository);
+	f->want_thread = the_repository->settings.core_checksum_thread;
 
 	memcpy(header.magic, BITMAP_IDX_SIGNATURE, sizeof(BITMAP_IDX_SIGNATURE));
 	header.version = htons(default_version);
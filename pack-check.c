@@ -48,6 +48,45 @@ int check_pack_crc(struct packed_git *p, struct pack_window **w_curs,
 	return data_crc != ntohl(*index_crc);
 }
 
+/*
+ * Small objects are checked in batches, so that the hash implementation
+ * can name several of them at once.
+ */
+#define VERIFY_BATCH_NR 16
+#define VERIFY_BATCH_MAX_SIZE (64 * 1024)
+
+struct verify_batch {
+	struct hash_object_request req[VERIFY_BATCH_NR];
+	struct object_id oid[VERIFY_BATCH_NR];
+	int nr;
+};
+
+static int flush_verify_batch(struct repository *r, struct packed_git *p,
+			      struct verify_batch *batch, verify_fn fn)
+{
+	int err = 0;
+
+	hash_object_file_many(r->hash_algo, batch->req, batch->nr);
+	for (int i = 0; i < batch->nr; i++) {
+		struct hash_object_request *req = &batch->req[i];
+		void *data = (void *)req->buf;
+
+		if (!oideq(&batch->oid[i], &req->oid))
+			err = error("packed %s from %s is corrupt",
+				    oid_to_hex(&batch->oid[i]), p->pack_name);
+		else if (fn) {
+			int eaten = 0;
+			err |= fn(&batch->oid[i], req->type, req->len, data,
+				  &eaten);
+			if (eaten)
+				data = NULL;
+		}
+		free(data);
+	}
+	batch->nr = 0;
+	return err;
+}
+
 static int verify_packfile(struct repository *r,
 			   struct packed_git *p,
 			   struct pack_window **w_curs,
@@ -63,6 +102,7 @@ static int verify_packfile(struct repository *r,
 	uint32_t nr_objects, i;
 	int err = 0;
 	struct idx_entry *entries;
+	struct verify_batch batch = { .nr = 0 };
 
 	if (!is_pack_valid(p))
 		return error("packfile %s cannot be accessed", p->pack_name);
@@ -147,7 +187,17 @@ static int verify_packfile(struct repository *r,
 			err = error("cannot unpack %s from %s at offset %"PRIuMAX"",
 				    oid_to_hex(&oid), p->pack_name,
 				    (uintmax_t)entries[i].offset);
-		else if (data && check_object_signature(r, &oid, data, size,
+		else if (data && size < VERIFY_BATCH_MAX_SIZE) {
+			struct hash_object_request *req = &batch.req[batch.nr];
+
+			oidcpy(&batch.oid[batch.nr], &oid);
+			req->buf = data;
+			req->len = size;
+			req->type = type;
+			data = NULL;
+			if (++batch.nr == VERIFY_BATCH_NR)
+				err |= flush_verify_batch(r, p, &batch, fn);
+		} else if (data && check_object_signature(r, &oid, data, size,
 							type) < 0)
 			err = error("packed %s from %s is corrupt",
 				    oid_to_hex(&oid), p->pack_name);
@@ -165,6 +215,7 @@ static int verify_packfile(struct repository *r,
 		free(data);
 
 	}
+	err |= flush_verify_batch(r, p, &batch, fn);
 	display_progress(progress, base_count + i);
 	free(entries);
 
@@ -91,6 +91,7 @@ const char *write_idx_file(const char *index_name, struct pack_idx_entry **objec
 			fd = xopen(index_name, O_CREAT|O_EXCL|O_WRONLY, 0600);
 		}
 		f = hashfd(fd, index_name);
+		f->want_thread = !!(opts->flags & WRITE_CHECKSUM_THREAD);
 	}
 
 	/* if last object's offset is >= 2^31 we should use index V2 */
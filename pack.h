@@ -47,6 +47,7 @@ struct pack_idx_option {
 #define WRITE_REV 04
 #define WRITE_REV_VERIFY 010
 #define WRITE_MTIMES 020
+#define WRITE_CHECKSUM_THREAD 040 /* hash the pack and idx on a helper thread */
 
 	uint32_t version;
 	uint32_t off32_limit;
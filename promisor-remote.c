@@ -4,53 +4,85 @@
 #include "gettext.h"
 #include "hex.h"
 #include "object-store-ll.h"
+#include "oid-array.h"
+#include "oidset.h"
 #include "promisor-remote.h"
 #include "config.h"
 #include "trace2.h"
+#include "run-command.h"
 #include "transport.h"
 #include "strvec.h"
 #include "packfile.h"
 #include "environment.h"
 
+struct prefetch_batch {
+	struct child_process child;
+	struct oid_array oids;
+};
+
 struct promisor_remote_config {
 	struct promisor_remote *promisors;
 	struct promisor_remote **promisors_tail;
+
+	/*
+	 * Background fetches started by promisor_remote_prefetch(), oldest
+	 * first, and the objects they are fetching.
+	 */
+	struct prefetch_batch **prefetch;
+	size_t prefetch_nr, prefetch_alloc;
+	struct oidset prefetching;
 };
 
-static int fetch_objects(struct repository *repo,
-			 const char *remote_name,
-			 const struct object_id *oids,
-			 int oid_nr)
+/*
+ * Start fetching the given objects from the given promisor remote. The
+ * caller is responsible for calling finish_command() on "child".
+ */
+static int start_fetch_objects(struct repository *repo,
+			       const char *remote_name,
+			       const struct object_id *oids,
+			       int oid_nr,
+			       struct child_process *child,
+			       int background)
 {
-	struct child_process child = CHILD_PROCESS_INIT;
 	int i;
 	FILE *child_in;
 	int quiet;
 
 	if (git_env_bool(NO_LAZY_FETCH_ENVIRONMENT, 0)) {
 		static int warning_shown;
-		if (!warning_shown) {
+		if (!warning_shown && !background) {
 			warning_shown = 1;
 			warning(_("lazy fetching disabled; some objects may not be available"));
 		}
 		return -1;
 	}
 
-	child.git_cmd = 1;
-	child.in = -1;
+	child->git_cmd = 1;
+	child->in = -1;
 	if (repo != the_repository)
-		prepare_other_repo_env(&child.env, repo->gitdir);
-	strvec_pushl(&child.args, "-c", "fetch.negotiationAlgorithm=noop",
+		prepare_other_repo_env(&child->env, repo->gitdir);
+	strvec_pushl(&child->args, "-c", "fetch.negotiationAlgorithm=noop",
 		     "fetch", remote_name, "--no-tags",
 		     "--no-write-fetch-head", "--recurse-submodules=no",
 		     "--filter=blob:none", "--stdin", NULL);
-	if (!git_config_get_bool("promisor.quiet", &quiet) && quiet)
-		strvec_push(&child.args, "--quiet");
-	if (start_command(&child))
+	if (background) {
+		/*
+		 * Do not let the output of background fetches interfere
+		 * with ours, and do not leave them behind when we exit.
+		 */
+		strvec_pushl(&child->args, "--quiet", "--no-auto-maintenance",
+			     NULL);
+		child->clean_on_exit = 1;
+		child->wait_after_clean = 1;
+	} else if (!git_config_get_bool("promisor.quiet", &quiet) && quiet) {
+		strvec_push(&child->args, "--quiet");
+	}
+	if (start_command(child))
 		die(_("promisor-remote: unable to fork off fetch subprocess"));
-	child_in = xfdopen(child.in, "w");
+	child_in = xfdopen(child->in, "w");
 
-	trace2_data_intmax("promisor", repo, "fetch_count", oid_nr);
+	trace2_data_intmax("promisor", repo,
+			   background ? "prefetch_count" : "fetch_count", oid_nr);
 
 	for (i = 0; i < oid_nr; i++) {
 		if (fputs(oid_to_hex(&oids[i]), child_in) < 0)
@@ -61,6 +93,18 @@ static int fetch_objects(struct repository *repo,
 
 	if (fclose(child_in) < 0)
 		die_errno(_("promisor-remote: could not close stdin to fetch subprocess"));
+	return 0;
+}
+
+static int fetch_objects(struct repository *repo,
+			 const char *remote_name,
+			 const struct object_id *oids,
+			 int oid_nr)
+{
+	struct child_process child = CHILD_PROCESS_INIT;
+
+	if (start_fetch_objects(repo, remote_name, oids, oid_nr, &child, 0))
+		return -1;
 	return finish_command(&child) ? -1 : 0;
 }
 
@@ -186,8 +230,32 @@ static void promisor_remote_init(struct repository *r)
 	}
 }
 
+/*
+ * Wait for the oldest background fetch. If it failed, the objects it was
+ * supposed to fetch will be lazily fetched when they are needed.
+ */
+static void finish_prefetch_batch(struct promisor_remote_config *config)
+{
+	struct prefetch_batch *batch = config->prefetch[0];
+
+	finish_command(&batch->child);
+	for (size_t i = 0; i < batch->oids.nr; i++)
+		oidset_remove(&config->prefetching, &batch->oids.oid[i]);
+	oid_array_clear(&batch->oids);
+	free(batch);
+
+	config->prefetch_nr--;
+	MOVE_ARRAY(config->prefetch, config->prefetch + 1, config->prefetch_nr);
+}
+
 void promisor_remote_clear(struct promisor_remote_config *config)
 {
+	while (config->prefetch_nr)
+		finish_prefetch_batch(config);
+	FREE_AND_NULL(config->prefetch);
+	config->prefetch_alloc = 0;
+	oidset_clear(&config->prefetching);
+
 	while (config->promisors) {
 		struct promisor_remote *r = config->promisors;
 		free(r->partial_clone_filter);
@@ -253,6 +321,146 @@ static int remove_fetched_oids(struct repository *repo,
 	return remaining_nr;
 }
 
+/*
+ * Wait for the background fetches of any of the given objects. Returns
+ * whether there were any.
+ */
+static int wait_for_prefetch(struct repository *repo,
+			     const struct object_id *oids,
+			     int oid_nr)
+{
+	struct promisor_remote_config *config = repo->promisor_remote_config;
+	int waited = 0;
+
+	for (int i = 0; i < oid_nr; i++) {
+		while (oidset_contains(&config->prefetching, &oids[i])) {
+			finish_prefetch_batch(config);
+			waited = 1;
+		}
+	}
+	if (waited)
+		reprepare_packed_git(repo);
+	return waited;
+}
+
+void promisor_remote_prefetch(struct repository *repo,
+			      const struct object_id *oids,
+			      int oid_nr)
+{
+	struct promisor_remote_config *config;
+	struct prefetch_batch *batch;
+
+	if (!oid_nr || git_env_bool(NO_LAZY_FETCH_ENVIRONMENT, 0))
+		return;
+
+	promisor_remote_init(repo);
+	config = repo->promisor_remote_config;
+	if (!config->promisors)
+		return;
+
+	CALLOC_ARRAY(batch, 1);
+	child_process_init(&batch->child);
+	for (int i = 0; i < oid_nr; i++) {
+		if (oidset_contains(&config->prefetching, &oids[i]) ||
+		    !oid_object_info_extended(repo, &oids[i], NULL,
+					      OBJECT_INFO_FOR_PREFETCH))
+			continue;
+		oidset_insert(&config->prefetching, &oids[i]);
+		oid_array_append(&batch->oids, &oids[i]);
+	}
+	if (!batch->oids.nr) {
+		free(batch);
+		return;
+	}
+
+	if (config->prefetch_nr >= PROMISOR_PREFETCH_MAX_BATCHES) {
+		finish_prefetch_batch(config);
+		reprepare_packed_git(repo);
+	}
+
+	if (start_fetch_objects(repo, config->promisors->name,
+				batch->oids.oid, batch->oids.nr,
+				&batch->child, 1)) {
+		for (size_t i = 0; i < batch->oids.nr; i++)
+			oidset_remove(&config->prefetching, &batch->oids.oid[i]);
+		oid_array_clear(&batch->oids);
+		free(batch);
+		return;
+	}
+
+	ALLOC_GROW(config->prefetch, config->prefetch_nr + 1,
+		   config->prefetch_alloc);
+	config->prefetch[config->prefetch_nr++] = batch;
+}
+
+int promisor_remote_get_object_info(struct repository *repo,
+				    const struct object_id *oids,
+				    int oid_nr,
+				    struct remote_object_info *infos)
+{
+	struct promisor_remote *r;
+	struct object_id *ask;
+	struct remote_object_info *answers;
+	int *index;
+	int ask_nr = oid_nr, answered = 0;
+
+	if (!oid_nr)
+		return 0;
+	if (repo != the_repository ||
+	    git_env_bool(NO_LAZY_FETCH_ENVIRONMENT, 0))
+		return -1;
+
+	promisor_remote_init(repo);
+
+	for (int i = 0; i < oid_nr; i++)
+		memset(&infos[i], 0, sizeof(infos[i]));
+	ALLOC_ARRAY(ask, oid_nr);
+	ALLOC_ARRAY(answers, oid_nr);
+	ALLOC_ARRAY(index, oid_nr);
+	for (int i = 0; i < oid_nr; i++) {
+		oidcpy(&ask[i], &oids[i]);
+		index[i] = i;
+	}
+
+	/*
+	 * Ask the promisor remotes one after the other about the objects
+	 * that the previous ones did not know.
+	 */
+	for (r = repo->promisor_remote_config->promisors; r && ask_nr; r = r->next) {
+		struct transport *transport;
+		int ret, j = 0;
+
+		if (r->no_object_info)
+			continue;
+
+		trace2_data_intmax("promisor", repo, "object_info_count", ask_nr);
+		transport = transport_get(remote_get(r->name), NULL);
+		ret = transport_get_object_info(transport, ask, ask_nr, answers);
+		transport_disconnect(transport);
+		if (ret < 0) {
+			/* do not bother this remote again */
+			r->no_object_info = 1;
+			continue;
+		}
+		answered = 1;
+
+		for (int i = 0; i < ask_nr; i++) {
+			if (answers[i].found) {
+				infos[index[i]] = answers[i];
+				continue;
+			}
+			oidcpy(&ask[j], &ask[i]);
+			index[j++] = index[i];
+		}
+		ask_nr = j;
+	}
+
+	free(ask);
+	free(answers);
+	free(index);
+	return answered ? 0 : -1;
+}
+
 void promisor_remote_get_direct(struct repository *repo,
 				const struct object_id *oids,
 				int oid_nr)
@@ -268,6 +476,18 @@ void promisor_remote_get_direct(struct repository *repo,
 
 	promisor_remote_init(repo);
 
+	/*
+	 * Objects that are being fetched in the background already only
+	 * need to be waited for.
+	 */
+	if (wait_for_prefetch(repo, oids, oid_nr)) {
+		remaining_nr = remove_fetched_oids(repo, &remaining_oids,
+						 remaining_nr, 0);
+		if (!remaining_nr)
+			return;
+		to_free = 1;
+	}
+
 	for (r = repo->promisor_remote_config->promisors; r; r = r->next) {
 		if (fetch_objects(repo, r->name, remaining_oids, remaining_nr) < 0) {
 			if (remaining_nr == 1)
@@ -14,6 +14,8 @@ struct object_id;
 struct promisor_remote {
 	struct promisor_remote *next;
 	char *partial_clone_filter;
+	/* set if the remote cannot answer object-info requests */
+	unsigned no_object_info : 1;
 	const char name[FLEX_ARRAY];
 };
 
@@ -32,4 +34,42 @@ void promisor_remote_get_direct(struct repository *repo,
 				const struct object_id *oids,
 				int oid_nr);
 
+struct remote_object_info;
+
+/*
+ * Asks the promisor remotes, one at a time, for the type, size and (if
+ * they can tell) disk size of the requested objects, without fetching the
+ * objects themselves. The answer for oids[i] is stored in infos[i]; its
+ * "found" bit is unset if no promisor remote knows the object.
+ *
+ * Returns a negative value if none of the promisor remotes supports such
+ * requests (see the "object-info" command of protocol v2), in which case
+ * the caller has to fetch the objects to learn about them.
+ */
+int promisor_remote_get_object_info(struct repository *repo,
+				    const struct object_id *oids,
+				    int oid_nr,
+				    struct remote_object_info *infos);
+
+/*
+ * The maximum number of background fetches started by
+ * promisor_remote_prefetch() that may run at the same time.
+ */
+#define PROMISOR_PREFETCH_MAX_BATCHES 4
+
+/*
+ * Starts fetching the requested objects from the first promisor remote in
+ * the background, skipping those that are present or already being
+ * fetched, and returns without waiting for the fetch to finish.
+ *
+ * This lets callers that know which objects they will need soon overlap
+ * the network round trip with local work. When one of these objects is
+ * needed before its fetch has finished, promisor_remote_get_direct()
+ * waits for it instead of fetching it again. Objects that a background
+ * fetch fails to provide are lazily fetched as usual.
+ */
+void promisor_remote_prefetch(struct repository *repo,
+			      const struct object_id *oids,
+			      int oid_nr);
+
 #endif /* PROMISOR_REMOTE_H */
@@ -13,6 +13,8 @@
 
 struct requested_info {
 	unsigned size : 1;
+	unsigned type : 1;
+	unsigned disk_size : 1;
 };
 
 /*
@@ -46,12 +48,23 @@ static void send_info(struct repository *r, struct packet_writer *writer,
 		return;
 
 	if (info->size)
-		packet_writer_write(writer, "size");
+		strbuf_addstr(&send_buffer, " size");
+	if (info->type)
+		strbuf_addstr(&send_buffer, " type");
+	if (info->disk_size)
+		strbuf_addstr(&send_buffer, " disk-size");
+	if (send_buffer.len)
+		packet_writer_write(writer, "%s", send_buffer.buf + 1);
+	strbuf_reset(&send_buffer);
 
 	for_each_string_list_item (item, oid_str_list) {
 		const char *oid_str = item->string;
 		struct object_id oid;
 		unsigned long object_size;
+		enum object_type type;
+		off_t disk_size;
+		struct object_info oi = OBJECT_INFO_INIT;
+		int found;
 
 		if (get_oid_hex_algop(oid_str, &oid, r->hash_algo) < 0) {
 			packet_writer_error(
@@ -63,13 +76,36 @@ static void send_info(struct repository *r, struct packet_writer *writer,
 
 		strbuf_addstr(&send_buffer, oid_str);
 
+		/*
+		 * Unknown objects are listed with all requested values
+		 * left empty.
+		 */
+		if (info->size)
+			oi.sizep = &object_size;
+		if (info->type)
+			oi.typep = &type;
+		if (info->disk_size)
+			oi.disk_sizep = &disk_size;
+		found = oid_object_info_extended(r, &oid, &oi, 0) >= 0;
+
 		if (info->size) {
-			if (oid_object_info(r, &oid, &object_size) < 0) {
+			if (!found) {
 				strbuf_addstr(&send_buffer, " ");
 			} else {
 				strbuf_addf(&send_buffer, " %lu", object_size);
 			}
 		}
+		if (info->type) {
+			strbuf_addch(&send_buffer, ' ');
+			if (found)
+				strbuf_addstr(&send_buffer, type_name(type));
+		}
+		if (info->disk_size) {
+			strbuf_addch(&send_buffer, ' ');
+			if (found)
+				strbuf_addf(&send_buffer, "%"PRIuMAX,
+					    (uintmax_t)disk_size);
+		}
 
 		packet_writer_write(writer, "%s", send_buffer.buf);
 		strbuf_reset(&send_buffer);
@@ -90,6 +126,14 @@ int cap_object_info(struct repository *r, struct packet_reader *request)
 			info.size = 1;
 			continue;
 		}
+		if (!strcmp("type", request->line)) {
+			info.type = 1;
+			continue;
+		}
+		if (!strcmp("disk-size", request->line)) {
+			info.disk_size = 1;
+			continue;
+		}
 
 		if (parse_oid(request->line, &oid_str_list))
 			continue;
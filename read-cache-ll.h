@@ -362,6 +362,18 @@ int index_name_pos_sparse(struct index_state *, const char *name, int namelen);
  */
 int index_entry_exists(struct index_state *, const char *name, int namelen);
 
+/*
+ * Looks up the entry for the given name and stage directly in the index
+ * file at "path", using its path lookup table (see index.recordLookupTable)
+ * to decode only the few entries around it instead of reading the whole
+ * index. Returns 1 and fills in "oid" and "mode" if the entry exists, 0 if
+ * it does not, and -1 if the file cannot be searched this way (e.g. it has
+ * no lookup table, or is a split or sparse index), in which case the caller
+ * has to read the index as usual.
+ */
+int lookup_index_path(const char *path, const char *name, int namelen,
+		      int stage, struct object_id *oid, unsigned int *mode);
+
 /*
  * Some functions return the negative complement of an insert position when a
  * precise match was not found but a position was found where the entry would
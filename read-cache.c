@@ -70,6 +70,7 @@
 #define CACHE_EXT_ENDOFINDEXENTRIES 0x454F4945	/* "EOIE" */
 #define CACHE_EXT_INDEXENTRYOFFSETTABLE 0x49454F54 /* "IEOT" */
 #define CACHE_EXT_SPARSE_DIRECTORIES 0x73646972 /* "sdir" */
+#define CACHE_EXT_PATHLOOKUPTABLE 0x49504C54 /* "IPLT" */
 
 /* changes that can be kept in $GIT_DIR/index (basically all extensions) */
 #define EXTMASK (RESOLVE_UNDO_CHANGED | CACHE_TREE_CHANGED | \
@@ -1768,6 +1769,9 @@ static int read_index_extension(struct index_state *istate,
 	case CACHE_EXT_INDEXENTRYOFFSETTABLE:
 		/* already handled in do_read_index() */
 		break;
+	case CACHE_EXT_PATHLOOKUPTABLE:
+		/* only used by lookup_index_path() */
+		break;
 	case CACHE_EXT_SPARSE_DIRECTORIES:
 		/* no content, only an indicator */
 		istate->sparse_index = INDEX_COLLAPSED;
@@ -2002,6 +2006,13 @@ static void write_ieot_extension(struct strbuf *sb, struct index_entry_offset_ta
 static size_t read_eoie_extension(const char *mmap, size_t mmap_size);
 static void write_eoie_extension(struct strbuf *sb, git_hash_ctx *eoie_context, size_t offset);
 
+/*
+ * Every INDEX_PATH_LOOKUP_STRIDE-th entry is recorded in the path lookup
+ * table, so a lookup decodes at most that many entries.
+ */
+#define INDEX_PATH_LOOKUP_STRIDE (32)
+static void write_iplt_header(struct strbuf *sb, uint32_t stride);
+
 struct load_index_extensions
 {
 	pthread_t pthread;
@@ -2807,6 +2818,15 @@ static int record_ieot(void)
 	return !repo_config_get_index_threads(the_repository, &val) && val != 1;
 }
 
+static int record_iplt(void)
+{
+	int val;
+
+	if (!git_config_get_bool("index.recordlookuptable", &val))
+		return val;
+	return 0;
+}
+
 enum write_extensions {
 	WRITE_NO_EXTENSION =              0,
 	WRITE_SPLIT_INDEX_EXTENSION =     1<<0,
@@ -2842,6 +2862,8 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	int csum_fsync_flag;
 	int ieot_entries = 1;
 	struct index_entry_offset_table *ieot = NULL;
+	struct strbuf iplt = STRBUF_INIT;
+	int iplt_stride = 0, nr_written = 0;
 	struct repository *r = istate->repo;
 	struct strbuf sb = STRBUF_INIT;
 	int nr, nr_threads, ret;
@@ -2911,6 +2933,11 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		}
 	}
 
+	if (record_iplt()) {
+		iplt_stride = INDEX_PATH_LOOKUP_STRIDE;
+		write_iplt_header(&iplt, iplt_stride);
+	}
+
 	offset = hashfile_total(f);
 
 	nr = 0;
@@ -2950,12 +2977,26 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 
 			offset = hashfile_total(f);
 		}
+		if (iplt_stride && !(nr_written % iplt_stride)) {
+			uint32_t buffer;
+
+			/*
+			 * Like at IEOT block boundaries, make sure a V4 entry
+			 * recorded in the lookup table can be decoded without
+			 * knowing the previous one.
+			 */
+			if (previous_name && nr_written)
+				previous_name->buf[0] = 0;
+			put_be32(&buffer, hashfile_total(f));
+			strbuf_add(&iplt, &buffer, sizeof(uint32_t));
+		}
 		if (ce_write_entry(f, ce, previous_name, (struct ondisk_cache_entry *)&ondisk) < 0)
 			err = -1;
 
 		if (err)
 			break;
 		nr++;
+		nr_written++;
 	}
 	if (ieot && nr) {
 		ieot->entries[ieot->nr].nr = nr;
@@ -2975,7 +3016,7 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	 * The extension headers must be hashed on their own for the
 	 * EOIE extension. Create a hashfile here to compute that hash.
 	 */
-	if (offset && record_eoie()) {
+	if (offset && (iplt_stride || record_eoie())) {
 		CALLOC_ARRAY(eoie_c, 1);
 		the_hash_algo->init_fn(eoie_c);
 	}
@@ -2999,6 +3040,19 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		}
 	}
 
+	/*
+	 * The path lookup table is found through the EOIE extension, which
+	 * we made sure to write above.
+	 */
+	if (iplt_stride) {
+		err = write_index_ext_header(f, eoie_c, CACHE_EXT_PATHLOOKUPTABLE, iplt.len) < 0;
+		hashwrite(f, iplt.buf, iplt.len);
+		if (err) {
+			ret = -1;
+			goto out;
+		}
+	}
+
 	if (write_extensions & WRITE_SPLIT_INDEX_EXTENSION &&
 	    istate->split_index) {
 		strbuf_reset(&sb);
@@ -3125,6 +3179,7 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	if (f)
 		free_hashfile(f);
 	strbuf_release(&sb);
+	strbuf_release(&iplt);
 	free(eoie_c);
 	free(ieot);
 	return ret;
@@ -3735,6 +3790,227 @@ static void write_ieot_extension(struct strbuf *sb, struct index_entry_offset_ta
 	}
 }
 
+#define IPLT_VERSION	(1)
+
+static void write_iplt_header(struct strbuf *sb, uint32_t stride)
+{
+	uint32_t buffer;
+
+	/* version */
+	put_be32(&buffer, IPLT_VERSION);
+	strbuf_add(sb, &buffer, sizeof(uint32_t));
+
+	/* stride */
+	put_be32(&buffer, stride);
+	strbuf_add(sb, &buffer, sizeof(uint32_t));
+}
+
+/*
+ * Return the name and stage of the on-disk entry at "ondisk". For
+ * version 4, "previous_len" is the length of the name of the entry
+ * before it, or 0 at the start of a block, and only the part of the
+ * name that is stored in the entry itself is returned. Entries recorded
+ * in the path lookup table start a block, so their full name is
+ * returned.
+ *
+ * Return NULL if the entry does not end before "end", or if its name
+ * does not match the length recorded in its flags, so that it is safe
+ * to hand the entry to create_from_disk().
+ */
+static const char *iplt_entry_name(const char *ondisk, const char *end,
+				   unsigned int version, size_t previous_len,
+				   int *stage, size_t *namelen)
+{
+	const char *flagsp = ondisk + offsetof(struct ondisk_cache_entry, data) +
+		the_hash_algo->rawsz;
+	unsigned int flags;
+	size_t copy_len = 0;
+	const char *name, *nul;
+
+	if (end - flagsp < (ptrdiff_t)(2 * sizeof(uint16_t)))
+		return NULL;
+	flags = get_be16(flagsp);
+	*stage = (flags & CE_STAGEMASK) >> CE_STAGESHIFT;
+	if (flags & CE_EXTENDED)
+		name = flagsp + 2 * sizeof(uint16_t);
+	else
+		name = flagsp + sizeof(uint16_t);
+
+	if (version == 4) {
+		const unsigned char *cp = (const unsigned char *)name;
+		size_t strip_len;
+
+		/* make sure the varint ends before "end" */
+		while ((const char *)cp < end && (*cp & 0x80))
+			cp++;
+		if ((const char *)cp >= end)
+			return NULL;
+		cp = (const unsigned char *)name;
+		strip_len = decode_varint(&cp);
+		if (previous_len) {
+			if (previous_len < strip_len)
+				return NULL;
+			copy_len = previous_len - strip_len;
+		}
+		name = (const char *)cp;
+	}
+	nul = memchr(name, '\0', end - name);
+	if (!nul)
+		return NULL;
+	*namelen = nul - name;
+	if ((flags & CE_NAMEMASK) != CE_NAMEMASK &&
+	    (flags & CE_NAMEMASK) != copy_len + *namelen)
+		return NULL;
+	return name;
+}
+
+int lookup_index_path(const char *path, const char *name, int namelen,
+		      int stage, struct object_id *oid, unsigned int *mode)
+{
+	int fd, ret = -1;
+	struct stat st;
+	const struct cache_header *hdr;
+	const char *mmap;
+	size_t mmap_size, offset, limit;
+	const char *table = NULL;
+	uint32_t table_size = 0, version, nr_entries, stride, nr_samples;
+	uint32_t lo, hi, first, end, i, nr_decoded = 0;
+	const struct cache_entry *previous_ce = NULL;
+	struct mem_pool ce_mem_pool;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	mmap_size = xsize_t(st.st_size);
+	if (mmap_size < sizeof(struct cache_header) + the_hash_algo->rawsz) {
+		close(fd);
+		return -1;
+	}
+	mmap = xmmap_gently(NULL, mmap_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mmap == MAP_FAILED)
+		return -1;
+
+	hdr = (const struct cache_header *)mmap;
+	if (verify_hdr(hdr, mmap_size) < 0)
+		goto unmap;
+	version = ntohl(hdr->hdr_version);
+	nr_entries = ntohl(hdr->hdr_entries);
+
+	/*
+	 * Find the lookup table. Split and sparse indexes need the full
+	 * machinery of do_read_index() to be interpreted correctly.
+	 */
+	offset = read_eoie_extension(mmap, mmap_size);
+	if (!offset)
+		goto unmap;
+	while (offset <= mmap_size - the_hash_algo->rawsz - 8) {
+		uint32_t extsize = get_be32(mmap + offset + 4);
+
+		switch (CACHE_EXT((mmap + offset))) {
+		case CACHE_EXT_LINK:
+		case CACHE_EXT_SPARSE_DIRECTORIES:
+			goto unmap;
+		case CACHE_EXT_PATHLOOKUPTABLE:
+			if (extsize > mmap_size - the_hash_algo->rawsz - offset - 8)
+				goto unmap;
+			table = mmap + offset + 8;
+			table_size = extsize;
+			break;
+		}
+		offset += 8;
+		offset += extsize;
+	}
+	if (!table || table_size < 2 * sizeof(uint32_t))
+		goto unmap;
+	if (get_be32(table) != IPLT_VERSION)
+		goto unmap;
+	stride = get_be32(table + sizeof(uint32_t));
+	table += 2 * sizeof(uint32_t);
+	nr_samples = (table_size - 2 * sizeof(uint32_t)) / sizeof(uint32_t);
+	if (!stride || nr_samples != DIV_ROUND_UP(nr_entries, stride))
+		goto unmap;
+
+	limit = mmap_size - the_hash_algo->rawsz;
+
+	/* find the last recorded entry sorting at or before the one we want */
+	lo = 0;
+	hi = nr_samples;
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		const char *sample_name;
+		size_t sample_len;
+		int sample_stage;
+
+		offset = get_be32(table + mi * sizeof(uint32_t));
+		if (offset < sizeof(*hdr) || offset >= limit)
+			goto unmap;
+		sample_name = iplt_entry_name(mmap + offset, mmap + limit, version,
+					      0, &sample_stage, &sample_len);
+		if (!sample_name)
+			goto unmap;
+		if (cache_name_stage_compare(sample_name, sample_len,
+					     sample_stage, name, namelen, stage) <= 0)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	ret = 0;
+	if (!lo)
+		goto unmap;
+
+	/* decode the entries of that block until we reach or pass the name */
+	mem_pool_init(&ce_mem_pool, 0);
+	first = (lo - 1) * stride;
+	end = first + stride;
+	if (end > nr_entries)
+		end = nr_entries;
+	offset = get_be32(table + (lo - 1) * sizeof(uint32_t));
+	for (i = first; i < end && offset < limit; i++) {
+		struct cache_entry *ce;
+		unsigned long consumed;
+		const char *entry_name;
+		size_t entry_len;
+		int entry_stage, cmp;
+
+		/* the index checksum is not verified; check the entry fits */
+		entry_name = iplt_entry_name(mmap + offset, mmap + limit, version,
+					     previous_ce ? previous_ce->ce_namelen : 0,
+					     &entry_stage, &entry_len);
+		if (!entry_name) {
+			ret = -1;
+			break;
+		}
+		ce = create_from_disk(&ce_mem_pool, version, mmap + offset,
+				      &consumed, previous_ce);
+		nr_decoded++;
+		cmp = cache_name_stage_compare(ce->name, ce->ce_namelen,
+					       ce_stage(ce), name, namelen, stage);
+		if (!cmp) {
+			oidcpy(oid, &ce->oid);
+			*mode = ce->ce_mode;
+			ret = 1;
+			break;
+		}
+		if (cmp > 0)
+			break;
+		offset += consumed;
+		previous_ce = ce;
+	}
+	mem_pool_discard(&ce_mem_pool, 0);
+
+	trace2_data_intmax("index", the_repository, "lookup/decoded",
+			   nr_decoded);
+
+unmap:
+	munmap((void *)mmap, mmap_size);
+	return ret;
+}
+
 void prefetch_cache_entries(const struct index_state *istate,
 			    must_prefetch_predicate must_prefetch)
 {
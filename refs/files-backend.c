@@ -13,6 +13,7 @@
 #include "../repo-settings.h"
 #include "refs-internal.h"
 #include "ref-cache.h"
+#include "loose-cache.h"
 #include "packed-backend.h"
 #include "../ident.h"
 #include "../iterator.h"
@@ -83,6 +84,20 @@ struct files_ref_store {
 
 	struct ref_cache *loose;
 
+	/*
+	 * The persistent cache of loose refs, if enabled via
+	 * `core.looseRefsCache`. It is opened lazily.
+	 */
+	int use_loose_cache;
+	struct loose_cache *loose_cache;
+
+	/*
+	 * Set when lockfiles have only been written out to the disk with
+	 * `core.fsyncMethod=batch`. The hardware flush is deferred until
+	 * the first of them gets committed.
+	 */
+	int batch_fsync_pending;
+
 	struct ref_store *packed_ref_store;
 };
 
@@ -114,6 +129,7 @@ static struct ref_store *files_ref_store_init(struct repository *repo,
 		packed_ref_store_init(repo, refs->gitcommondir, flags);
 	refs->log_all_ref_updates = repo_settings_get_log_all_ref_updates(repo);
 	repo_config_get_bool(repo, "core.prefersymlinkrefs", &refs->prefer_symlink_refs);
+	repo_config_get_bool(repo, "core.looserefscache", &refs->use_loose_cache);
 
 	chdir_notify_reparent("files-backend $GIT_DIR", &refs->base.gitdir);
 	chdir_notify_reparent("files-backend $GIT_COMMONDIR",
@@ -164,6 +180,7 @@ static void files_ref_store_release(struct ref_store *ref_store)
 {
 	struct files_ref_store *refs = files_downcast(ref_store, 0, "release");
 	free_ref_cache(refs->loose);
+	loose_cache_free(refs->loose_cache);
 	free(refs->gitcommondir);
 	ref_store_release(refs->packed_ref_store);
 	free(refs->packed_ref_store);
@@ -249,10 +266,11 @@ static void add_per_worktree_entries_to_dir(struct ref_dir *dir, const char *dir
 	}
 }
 
-static void loose_fill_ref_dir_regular_file(struct files_ref_store *refs,
-					    const char *refname,
-					    struct ref_dir *dir)
+static struct ref_entry *loose_fill_ref_dir_regular_file(struct files_ref_store *refs,
+							 const char *refname,
+							 struct ref_dir *dir)
 {
+	struct ref_entry *entry;
 	struct object_id oid;
 	int flag;
 	const char *referent = refs_resolve_ref_unsafe(&refs->base,
@@ -285,7 +303,72 @@ static void loose_fill_ref_dir_regular_file(struct files_ref_store *refs,
 	if (!(flag & REF_ISSYMREF))
 		referent = NULL;
 
-	add_entry_to_dir(dir, create_ref_entry(refname, referent, &oid, flag));
+	entry = create_ref_entry(refname, referent, &oid, flag);
+	add_entry_to_dir(dir, entry);
+	return entry;
+}
+
+struct loose_fill_cached_data {
+	struct files_ref_store *refs;
+	struct ref_dir *dir;
+};
+
+static void loose_fill_cached_entry(const char *name,
+				    const struct object_id *oid,
+				    void *cb_data)
+{
+	struct loose_fill_cached_data *data = cb_data;
+	struct ref_entry *entry;
+
+	if (ends_with(name, "/"))
+		entry = create_dir_entry(data->dir->cache, name, strlen(name));
+	else if (oid)
+		entry = create_ref_entry(name, NULL, oid, 0);
+	else {
+		loose_fill_ref_dir_regular_file(data->refs, name, data->dir);
+		return;
+	}
+
+	add_entry_to_dir(data->dir, entry);
+}
+
+/*
+ * Try to fill the directory from the persistent loose refs cache. If that is
+ * not possible, return the record that the caller shall fill while reading
+ * the directory from disk, if any.
+ */
+static int loose_fill_ref_dir_from_cache(struct files_ref_store *refs,
+					 struct ref_dir *dir,
+					 const char *dirname, const char *path,
+					 struct loose_cache_dir **record)
+{
+	struct loose_fill_cached_data data = {
+		.refs = refs,
+		.dir = dir,
+	};
+	struct stat st;
+
+	*record = NULL;
+
+	if (!refs->use_loose_cache)
+		return 0;
+	if (!refs->loose_cache) {
+		struct strbuf sb = STRBUF_INIT;
+		strbuf_addf(&sb, "%s/loose-refs-cache", refs->base.gitdir);
+		refs->loose_cache = loose_cache_open(sb.buf,
+						     refs->base.repo->hash_algo);
+		strbuf_release(&sb);
+	}
+
+	if (stat(path, &st) < 0 || !S_ISDIR(st.st_mode))
+		return 0;
+
+	if (loose_cache_read_dir(refs->loose_cache, dirname, &st,
+				 loose_fill_cached_entry, &data))
+		return 1;
+
+	*record = loose_cache_record_dir(refs->loose_cache, dirname, &st);
+	return 0;
 }
 
 /*
@@ -298,6 +381,7 @@ static void loose_fill_ref_dir(struct ref_store *ref_store,
 {
 	struct files_ref_store *refs =
 		files_downcast(ref_store, REF_STORE_READ, "fill_ref_dir");
+	struct loose_cache_dir *record;
 	DIR *d;
 	struct dirent *de;
 	int dirnamelen = strlen(dirname);
@@ -306,6 +390,13 @@ static void loose_fill_ref_dir(struct ref_store *ref_store,
 
 	files_ref_path(refs, &path, dirname);
 
+	if (loose_fill_ref_dir_from_cache(refs, dir, dirname, path.buf,
+					  &record)) {
+		strbuf_release(&path);
+		add_per_worktree_entries_to_dir(dir, dirname);
+		return;
+	}
+
 	d = opendir(path.buf);
 	if (!d) {
 		strbuf_release(&path);
@@ -330,8 +421,19 @@ static void loose_fill_ref_dir(struct ref_store *ref_store,
 			add_entry_to_dir(dir,
 					 create_dir_entry(dir->cache, refname.buf,
 							  refname.len));
+			if (record)
+				loose_cache_record_entry(record, refname.buf, NULL);
 		} else if (dtype == DT_REG) {
-			loose_fill_ref_dir_regular_file(refs, refname.buf, dir);
+			struct ref_entry *entry =
+				loose_fill_ref_dir_regular_file(refs, refname.buf, dir);
+
+			/*
+			 * Only plain refs can be served from the cache. All
+			 * others, like symbolic refs, are read from disk.
+			 */
+			if (record)
+				loose_cache_record_entry(record, refname.buf,
+							 entry->flag ? NULL : &entry->u.value.oid);
 		}
 		strbuf_setlen(&refname, dirnamelen);
 	}
@@ -984,6 +1086,8 @@ static struct ref_iterator *files_ref_iterator_begin(
 
 	loose_iter = cache_ref_iterator_begin(get_loose_ref_cache(refs, flags),
 					      prefix, ref_store->repo, 1);
+	if (refs->loose_cache)
+		loose_cache_write(refs->loose_cache);
 
 	/*
 	 * The packed-refs file might contain broken references, for
@@ -1728,11 +1832,65 @@ static int close_ref_gently(struct ref_lock *lock)
 	return 0;
 }
 
-static int commit_ref(struct ref_lock *lock)
+/*
+ * Fsync the lockfile of a loose ref. With `core.fsyncMethod=batch` we
+ * only ask the OS to write out the data here and issue a single hardware
+ * flush via `flush_batch_fsync()` before the first lockfile is renamed
+ * into place, similar to how loose objects are handled by bulk-checkin.
+ */
+static int fsync_ref_lock(struct files_ref_store *refs, struct ref_lock *lock)
 {
-	char *path = get_locked_file_path(&lock->lk);
+	int fd = get_lock_file_fd(&lock->lk);
+
+	if (batch_fsync_enabled(FSYNC_COMPONENT_REFERENCE)) {
+		if (git_fsync(fd, FSYNC_WRITEOUT_ONLY) >= 0) {
+			refs->batch_fsync_pending = 1;
+			return 0;
+		}
+		if (errno == ENOSYS)
+			warning(_("core.fsyncMethod = batch is unsupported on this platform"));
+	}
+
+	return fsync_component(FSYNC_COMPONENT_REFERENCE, fd);
+}
+
+static int flush_batch_fsync(struct files_ref_store *refs)
+{
+	struct strbuf temp_path = STRBUF_INIT;
+	struct tempfile *temp;
+	int ret = 0;
+
+	if (!refs->batch_fsync_pending)
+		return 0;
+	refs->batch_fsync_pending = 0;
+
+	/*
+	 * Issue a full hardware flush against a temporary file to ensure
+	 * that all lockfiles we have written out so far are durable before
+	 * any of them becomes visible under its final name.
+	 */
+	strbuf_addf(&temp_path, "%s/bulk_fsync_XXXXXX", refs->base.gitdir);
+	temp = mks_tempfile(temp_path.buf);
+	if (!temp)
+		ret = error_errno(_("unable to create temporary file '%s'"),
+				  temp_path.buf);
+	else if (fsync_component(FSYNC_COMPONENT_REFERENCE, get_tempfile_fd(temp)) < 0)
+		ret = error_errno(_("fsync error on '%s'"), temp_path.buf);
+
+	delete_tempfile(&temp);
+	strbuf_release(&temp_path);
+	return ret;
+}
+
+static int commit_ref(struct files_ref_store *refs, struct ref_lock *lock)
+{
+	char *path;
 	struct stat st;
 
+	if (flush_batch_fsync(refs) < 0)
+		return -1;
+
+	path = get_locked_file_path(&lock->lk);
 	if (!lstat(path, &st) && S_ISDIR(st.st_mode)) {
 		/*
 		 * There is a directory at the path we want to rename
@@ -1950,7 +2108,7 @@ static int write_ref_to_lockfile(struct files_ref_store *refs,
 	fd = get_lock_file_fd(&lock->lk);
 	if (write_in_full(fd, oid_to_hex(oid), refs->base.repo->hash_algo->hexsz) < 0 ||
 	    write_in_full(fd, &term, 1) < 0 ||
-	    fsync_component(FSYNC_COMPONENT_REFERENCE, get_lock_file_fd(&lock->lk)) < 0 ||
+	    fsync_ref_lock(refs, lock) < 0 ||
 	    close_ref_gently(lock) < 0) {
 		strbuf_addf(err,
 			    "couldn't write '%s'", get_lock_file_path(&lock->lk));
@@ -2016,7 +2174,7 @@ static int commit_ref_update(struct files_ref_store *refs,
 		}
 	}
 
-	if (commit_ref(lock)) {
+	if (commit_ref(refs, lock)) {
 		strbuf_addf(err, "couldn't set '%s'", lock->ref_name);
 		unlock_ref(lock);
 		return -1;
@@ -3152,7 +3310,7 @@ static int files_transaction_finish(struct ref_store *ref_store,
 
 		if (update->flags & REF_NEEDS_COMMIT) {
 			clear_loose_ref_cache(refs);
-			if (commit_ref(lock)) {
+			if (commit_ref(refs, lock)) {
 				strbuf_addf(err, "couldn't set '%s'", lock->ref_name);
 				unlock_ref(lock);
 				update->backend_data = NULL;
@@ -3406,7 +3564,7 @@ static int files_reflog_expire(struct ref_store *ref_store,
 		} else if (commit_lock_file(&reflog_lock)) {
 			status |= error("unable to write reflog '%s' (%s)",
 					log_file, strerror(errno));
-		} else if (update && commit_ref(lock)) {
+		} else if (update && commit_ref(refs, lock)) {
 			status |= error("couldn't set %s", lock->ref_name);
 		}
 	}
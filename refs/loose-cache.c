@@ -0,0 +1,474 @@
+#include "../git-compat-util.h"
+#include "../hash.h"
+#include "../hex.h"
+#include "../lockfile.h"
+#include "../statinfo.h"
+#include "../strbuf.h"
+#include "../string-list.h"
+#include "../strmap.h"
+#include "../wrapper.h"
+#include "loose-cache.h"
+
+struct loose_cache_dir {
+	struct stat_data sd;
+	/* Set when the directory was modified too recently to be trusted. */
+	int racy;
+	/* The entries of the directory; `util` holds the object ID of refs. */
+	struct string_list entries;
+};
+
+struct loose_cache {
+	char *path;
+	const struct git_hash_algo *algop;
+
+	/* The contents of the cache file, if any. */
+	char *buf;
+	size_t size;
+	int mmapped;
+
+	/* The records of the cache file, excluding its header. */
+	const char *start, *eof;
+
+	/* Directories read from disk, keyed by their name. */
+	struct strmap dirs;
+	/* Whether any of `dirs` is worth writing out. */
+	int dirty;
+};
+
+struct cache_line {
+	const char *name;
+	size_t name_len;
+	const char *value;
+	size_t value_len;
+	const char *next;
+};
+
+static void loose_cache_header(struct loose_cache *cache, struct strbuf *out)
+{
+	strbuf_addf(out, "# loose-refs-cache v1 %s\n", cache->algop->name);
+}
+
+static void loose_cache_release_file(struct loose_cache *cache)
+{
+	if (cache->mmapped)
+		munmap(cache->buf, cache->size);
+	else
+		free(cache->buf);
+	cache->buf = NULL;
+	cache->size = 0;
+	cache->mmapped = 0;
+	cache->start = cache->eof = NULL;
+}
+
+static void loose_cache_load(struct loose_cache *cache)
+{
+	struct strbuf header = STRBUF_INIT;
+	struct stat st;
+	int fd;
+
+	fd = open(cache->path, O_RDONLY);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) < 0 || !st.st_size)
+		goto out;
+	cache->size = xsize_t(st.st_size);
+
+#ifdef MMAP_PREVENTS_DELETE
+	cache->buf = xmalloc(cache->size);
+	if (read_in_full(fd, cache->buf, cache->size) != cache->size) {
+		loose_cache_release_file(cache);
+		goto out;
+	}
+#else
+	cache->buf = xmmap_gently(NULL, cache->size, PROT_READ, MAP_PRIVATE,
+				  fd, 0);
+	if (cache->buf == MAP_FAILED) {
+		cache->buf = NULL;
+		cache->size = 0;
+		goto out;
+	}
+	cache->mmapped = 1;
+#endif
+
+	loose_cache_header(cache, &header);
+	if (cache->size < header.len ||
+	    memcmp(cache->buf, header.buf, header.len) ||
+	    cache->buf[cache->size - 1] != '\n') {
+		loose_cache_release_file(cache);
+		goto out;
+	}
+
+	cache->start = cache->buf + header.len;
+	cache->eof = cache->buf + cache->size;
+
+out:
+	strbuf_release(&header);
+	close(fd);
+}
+
+struct loose_cache *loose_cache_open(const char *path,
+				     const struct git_hash_algo *algop)
+{
+	struct loose_cache *cache;
+
+	CALLOC_ARRAY(cache, 1);
+	cache->path = xstrdup(path);
+	cache->algop = algop;
+	strmap_init(&cache->dirs);
+	loose_cache_load(cache);
+
+	return cache;
+}
+
+static void loose_cache_clear_dirs(struct loose_cache *cache)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	strmap_for_each_entry(&cache->dirs, &iter, e) {
+		struct loose_cache_dir *dir = e->value;
+		string_list_clear(&dir->entries, 1);
+		free(dir);
+	}
+	strmap_partial_clear(&cache->dirs, 0);
+}
+
+void loose_cache_free(struct loose_cache *cache)
+{
+	if (!cache)
+		return;
+	loose_cache_release_file(cache);
+	loose_cache_clear_dirs(cache);
+	strmap_clear(&cache->dirs, 0);
+	free(cache->path);
+	free(cache);
+}
+
+static int parse_line(const char *p, const char *eof, struct cache_line *out)
+{
+	const char *eol = memchr(p, '\n', eof - p);
+	const char *sp;
+
+	if (!eol)
+		return -1;
+	sp = memchr(p, ' ', eol - p);
+	if (!sp)
+		return -1;
+
+	out->name = p;
+	out->name_len = sp - p;
+	out->value = sp + 1;
+	out->value_len = eol - sp - 1;
+	out->next = eol + 1;
+	return 0;
+}
+
+/*
+ * Compare the name of the line starting at `line` with `name` the same way
+ * strcmp() would.
+ */
+static int cmp_line_name(const char *line, const char *eof,
+			 const char *name, size_t len)
+{
+	for (size_t i = 0; i < len; i++, line++) {
+		if (line == eof || *line == ' ')
+			return -1;
+		if (*line != name[i])
+			return (unsigned char)*line < (unsigned char)name[i] ? -1 : 1;
+	}
+	return line != eof && *line != ' ';
+}
+
+/*
+ * Find the first line at or after `lo` whose name does not sort before
+ * `name`. Returns the end of the file if there is no such line.
+ */
+static const char *find_line(struct loose_cache *cache, const char *lo,
+			     const char *name, size_t len)
+{
+	const char *hi = cache->eof;
+
+	while (lo < hi) {
+		const char *mid = lo + (hi - lo) / 2, *line = mid;
+
+		while (line > lo && line[-1] != '\n')
+			line--;
+
+		if (cmp_line_name(line, cache->eof, name, len) < 0) {
+			const char *eol = memchr(mid, '\n', cache->eof - mid);
+			lo = eol ? eol + 1 : cache->eof;
+		} else {
+			hi = line;
+		}
+	}
+
+	return lo;
+}
+
+static int parse_stat_data(const char *p, size_t len, struct stat_data *sd)
+{
+	char *copy = xmemdupz(p, len);
+	unsigned int v[9];
+	int n;
+
+	n = sscanf(copy, "%u.%u %u.%u %u %u %u %u %u",
+		   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8]);
+	free(copy);
+	if (n != 9)
+		return -1;
+
+	sd->sd_ctime.sec = v[0];
+	sd->sd_ctime.nsec = v[1];
+	sd->sd_mtime.sec = v[2];
+	sd->sd_mtime.nsec = v[3];
+	sd->sd_dev = v[4];
+	sd->sd_ino = v[5];
+	sd->sd_uid = v[6];
+	sd->sd_gid = v[7];
+	sd->sd_size = v[8];
+	return 0;
+}
+
+static void format_stat_data(struct strbuf *out, const struct stat_data *sd)
+{
+	strbuf_addf(out, "%u.%u %u.%u %u %u %u %u %u",
+		    (unsigned int)sd->sd_ctime.sec, (unsigned int)sd->sd_ctime.nsec,
+		    (unsigned int)sd->sd_mtime.sec, (unsigned int)sd->sd_mtime.nsec,
+		    sd->sd_dev, sd->sd_ino, sd->sd_uid, sd->sd_gid, sd->sd_size);
+}
+
+/*
+ * Find the line of directory `dirname`. Returns NULL when there is none.
+ */
+static const char *find_dir_line(struct loose_cache *cache,
+				 const char *dirname, size_t len,
+				 struct cache_line *line)
+{
+	const char *p;
+
+	if (!cache->start)
+		return NULL;
+
+	p = find_line(cache, cache->start, dirname, len);
+	if (p == cache->eof || parse_line(p, cache->eof, line) < 0 ||
+	    line->name_len != len || memcmp(line->name, dirname, len))
+		return NULL;
+
+	return p;
+}
+
+/*
+ * Call `fn` for each entry directly contained in the directory `dirname`,
+ * whose records start at `p`. `fn` may be NULL to only verify the records.
+ * Returns 0 on success and -1 when the records are corrupt.
+ */
+static int for_each_dir_entry(struct loose_cache *cache, const char *p,
+			      const char *dirname, size_t len,
+			      loose_cache_entry_fn fn, void *cb_data)
+{
+	struct strbuf name = STRBUF_INIT;
+	struct cache_line line;
+	int ret = 0;
+
+	while (p < cache->eof) {
+		struct object_id oid, *oidp = NULL;
+		const char *slash;
+
+		if (parse_line(p, cache->eof, &line) < 0) {
+			ret = -1;
+			break;
+		}
+		if (line.name_len <= len || memcmp(line.name, dirname, len))
+			break;
+
+		strbuf_reset(&name);
+		strbuf_add(&name, line.name, line.name_len);
+
+		slash = strchr(name.buf + len, '/');
+		if (slash) {
+			if (slash[1]) {
+				ret = -1;
+				break;
+			}
+			if (fn)
+				fn(name.buf, NULL, cb_data);
+
+			/* Skip over the contents of the subdirectory. */
+			name.buf[name.len - 1] = '/' + 1;
+			p = find_line(cache, line.next, name.buf, name.len);
+			continue;
+		}
+
+		if (line.value_len == cache->algop->hexsz &&
+		    !get_oid_hex_algop(line.value, &oid, cache->algop)) {
+			oidp = &oid;
+		} else if (line.value_len != 1 || *line.value != '?') {
+			ret = -1;
+			break;
+		}
+		if (fn)
+			fn(name.buf, oidp, cb_data);
+
+		p = line.next;
+	}
+
+	strbuf_release(&name);
+	return ret;
+}
+
+int loose_cache_read_dir(struct loose_cache *cache, const char *dirname,
+			 struct stat *st, loose_cache_entry_fn fn,
+			 void *cb_data)
+{
+	size_t len = strlen(dirname);
+	struct cache_line line;
+	struct stat_data sd;
+
+	if (!find_dir_line(cache, dirname, len, &line) ||
+	    parse_stat_data(line.value, line.value_len, &sd) < 0 ||
+	    match_stat_data(&sd, st))
+		return 0;
+
+	/*
+	 * Verify the records first so that we do not hand out partial
+	 * results when the file is corrupt.
+	 */
+	if (for_each_dir_entry(cache, line.next, dirname, len, NULL, NULL) < 0)
+		return 0;
+	for_each_dir_entry(cache, line.next, dirname, len, fn, cb_data);
+
+	return 1;
+}
+
+struct loose_cache_dir *loose_cache_record_dir(struct loose_cache *cache,
+					       const char *dirname,
+					       struct stat *st)
+{
+	struct loose_cache_dir *dir = strmap_get(&cache->dirs, dirname);
+
+	if (dir) {
+		string_list_clear(&dir->entries, 1);
+	} else {
+		CALLOC_ARRAY(dir, 1);
+		string_list_init_dup(&dir->entries);
+		strmap_put(&cache->dirs, dirname, dir);
+	}
+
+	fill_stat_data(&dir->sd, st);
+
+	/*
+	 * Changes that happen in the same second as the last modification
+	 * of the directory may not be visible in its stat data, depending on
+	 * the timestamp granularity of the filesystem. We thus do not trust
+	 * directories that have been modified too recently.
+	 */
+	dir->racy = st->st_mtime >= time(NULL);
+	if (!dir->racy)
+		cache->dirty = 1;
+
+	return dir;
+}
+
+void loose_cache_record_entry(struct loose_cache_dir *dir, const char *name,
+			      const struct object_id *oid)
+{
+	struct string_list_item *item = string_list_append(&dir->entries, name);
+	item->util = oid ? oiddup(oid) : NULL;
+}
+
+struct write_data {
+	struct loose_cache *cache;
+	struct strbuf *out;
+};
+
+static void write_dir(struct loose_cache *cache, struct strbuf *out,
+		      const char *dirname);
+
+static void write_entry(const char *name, const struct object_id *oid,
+			void *cb_data)
+{
+	struct write_data *data = cb_data;
+
+	if (ends_with(name, "/"))
+		write_dir(data->cache, data->out, name);
+	else
+		strbuf_addf(data->out, "%s %s\n", name,
+			    oid ? hash_to_hex_algop(oid->hash, data->cache->algop) : "?");
+}
+
+static void write_dir(struct loose_cache *cache, struct strbuf *out,
+		      const char *dirname)
+{
+	struct loose_cache_dir *dir = strmap_get(&cache->dirs, dirname);
+	struct write_data data = {
+		.cache = cache,
+		.out = out,
+	};
+	size_t len = strlen(dirname);
+	struct cache_line line;
+	const char *p;
+
+	/* Prefer what we have read from disk over the old cache file. */
+	if (dir) {
+		struct string_list_item *item;
+
+		strbuf_addf(out, "%s ", dirname);
+		if (dir->racy)
+			strbuf_addch(out, '-');
+		else
+			format_stat_data(out, &dir->sd);
+		strbuf_addch(out, '\n');
+
+		string_list_sort(&dir->entries);
+		for_each_string_list_item(item, &dir->entries)
+			write_entry(item->string, item->util, &data);
+		return;
+	}
+
+	/*
+	 * Directories that we did not read keep their old records. These
+	 * still get verified by the next reader.
+	 */
+	p = find_dir_line(cache, dirname, len, &line);
+	if (!p ||
+	    for_each_dir_entry(cache, line.next, dirname, len, NULL, NULL) < 0) {
+		strbuf_addf(out, "%s -\n", dirname);
+		return;
+	}
+
+	strbuf_add(out, p, line.next - p);
+	for_each_dir_entry(cache, line.next, dirname, len, write_entry, &data);
+}
+
+void loose_cache_write(struct loose_cache *cache)
+{
+	struct lock_file lock = LOCK_INIT;
+	struct strbuf out = STRBUF_INIT;
+
+	if (!cache->dirty)
+		return;
+	cache->dirty = 0;
+
+	loose_cache_header(cache, &out);
+	write_dir(cache, &out, "refs/");
+
+	if (hold_lock_file_for_update(&lock, cache->path, 0) < 0)
+		goto out;
+	if (write_in_full(get_lock_file_fd(&lock), out.buf, out.len) < 0) {
+		rollback_lock_file(&lock);
+		goto out;
+	}
+
+	/*
+	 * Release the old file before replacing it, as some platforms do not
+	 * allow renaming over a file that is still mapped. Afterwards, all
+	 * directories we have recorded are part of the new file.
+	 */
+	loose_cache_release_file(cache);
+	if (!commit_lock_file(&lock))
+		loose_cache_clear_dirs(cache);
+	loose_cache_load(cache);
+
+out:
+	strbuf_release(&out);
+}
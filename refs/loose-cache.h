@@ -0,0 +1,80 @@
+#ifndef REFS_LOOSE_CACHE_H
+#define REFS_LOOSE_CACHE_H
+
+struct git_hash_algo;
+struct object_id;
+struct stat;
+
+/*
+ * A persistent cache of the loose refs namespace, used by the files
+ * backend when `core.looseRefsCache` is enabled.
+ *
+ * The cache is a single file with one line per directory and per ref,
+ * sorted by name so that it can be searched with a binary search:
+ *
+ *   # loose-refs-cache v1 <hash algorithm>
+ *   refs/ <stat data>
+ *   refs/heads/ <stat data>
+ *   refs/heads/main <object ID>
+ *   refs/remotes/ -
+ *   refs/remotes/origin/HEAD ?
+ *
+ * Directories have a trailing slash and record the stat data they had when
+ * their contents were read. They are only trusted while their stat data
+ * still matches. As refs are always updated by renaming a lockfile into
+ * place, any change to a ref changes the stat data of its directory. A "-"
+ * means that the contents of the directory must be read from disk. Refs
+ * that are recorded with "?" instead of an object ID, like symbolic refs,
+ * must be read from disk, too.
+ */
+struct loose_cache;
+
+/*
+ * Open the cache stored at `path`. Returns an empty cache in case the file
+ * does not exist or cannot be used.
+ */
+struct loose_cache *loose_cache_open(const char *path,
+				     const struct git_hash_algo *algop);
+
+void loose_cache_free(struct loose_cache *cache);
+
+typedef void loose_cache_entry_fn(const char *name,
+				  const struct object_id *oid,
+				  void *cb_data);
+
+/*
+ * Look up the directory `dirname`, which must end with a slash, whose
+ * current stat data is `st`. If the cache holds up-to-date contents for
+ * it, call `fn` for each entry directly contained in it and return 1.
+ * Subdirectories are passed with a trailing slash and a NULL object ID,
+ * refs that must be read from disk with a NULL object ID. Otherwise,
+ * return 0 without calling `fn`.
+ */
+int loose_cache_read_dir(struct loose_cache *cache, const char *dirname,
+			 struct stat *st, loose_cache_entry_fn fn,
+			 void *cb_data);
+
+struct loose_cache_dir;
+
+/*
+ * Start recording the contents of `dirname` as read from disk. `st` must
+ * be the stat data of the directory as taken before reading it.
+ */
+struct loose_cache_dir *loose_cache_record_dir(struct loose_cache *cache,
+					       const char *dirname,
+					       struct stat *st);
+
+/*
+ * Record an entry of a directory. Subdirectories must have a trailing slash
+ * and a NULL `oid`. Refs that cannot be cached pass a NULL `oid`.
+ */
+void loose_cache_record_entry(struct loose_cache_dir *dir, const char *name,
+			      const struct object_id *oid);
+
+/*
+ * Write the cache back to disk in case directories have been recorded.
+ * Failing to do so is not an error, as the cache is purely an optimization.
+ */
+void loose_cache_write(struct loose_cache *cache);
+
+#endif /* REFS_LOOSE_CACHE_H */
@@ -20,6 +20,7 @@
 #include "../reftable/reftable-error.h"
 #include "../reftable/reftable-iterator.h"
 #include "../repo-settings.h"
+#include "../run-command.h"
 #include "../setup.h"
 #include "../strmap.h"
 #include "../trace2.h"
@@ -237,6 +238,48 @@ static int read_ref_without_reload(struct reftable_ref_store *refs,
 	return ret;
 }
 
+/*
+ * Auto-compaction hook used with `reftable.autoCompaction=background`: hand
+ * compaction of the stack over to the "pack-refs" maintenance task, which
+ * runs detached unless `maintenance.autoDetach` says otherwise. Writers
+ * only pay for spawning it, and concurrent writers can continue to append
+ * tables while it compacts.
+ */
+static int reftable_be_compact_in_background(struct reftable_stack *stack,
+					     void *payload)
+{
+	struct reftable_ref_store *refs = payload;
+	struct child_process cmd = CHILD_PROCESS_INIT;
+	int auto_detach;
+
+	/*
+	 * git-pack-refs(1) only compacts the stack of the worktree it is run
+	 * in, so we compact any other stack right away.
+	 */
+	if (stack != (refs->worktree_stack ? refs->worktree_stack : refs->main_stack))
+		return reftable_stack_auto_compact(stack);
+
+	if (repo_config_get_bool(refs->base.repo, "maintenance.autodetach", &auto_detach) &&
+	    repo_config_get_bool(refs->base.repo, "gc.autodetach", &auto_detach))
+		auto_detach = 1;
+
+	cmd.git_cmd = 1;
+	cmd.no_stdin = 1;
+	prepare_other_repo_env(&cmd.env, refs->base.gitdir);
+	strvec_pushl(&cmd.args, "maintenance", "run", "--auto", "--quiet",
+		     "--task=pack-refs", NULL);
+	strvec_push(&cmd.args, auto_detach ? "--detach" : "--no-detach");
+
+	trace2_region_enter("reftable", "background-compaction", refs->base.repo);
+	if (run_command(&cmd)) {
+		trace2_region_leave("reftable", "background-compaction", refs->base.repo);
+		return reftable_stack_auto_compact(stack);
+	}
+	trace2_region_leave("reftable", "background-compaction", refs->base.repo);
+
+	return 0;
+}
+
 static int reftable_be_config(const char *var, const char *value,
 			      const struct config_context *ctx,
 			      void *_opts)
@@ -267,6 +310,19 @@ static int reftable_be_config(const char *var, const char *value,
 		if (lock_timeout < 0 && lock_timeout != -1)
 			die("reftable lock timeout does not support negative values other than -1");
 		opts->lock_timeout_ms = lock_timeout;
+	} else if (!strcmp(var, "reftable.autocompaction")) {
+		int enabled = git_parse_maybe_bool(value);
+		if (enabled >= 0) {
+			opts->disable_auto_compact = !enabled;
+			opts->auto_compact_hook = NULL;
+		} else if (!strcmp(value, "background")) {
+			opts->auto_compact_hook = reftable_be_compact_in_background;
+		} else {
+			die(_("unknown value for config '%s': %s"), var, value);
+		}
+	} else if (!strcmp(var, "reftable.blockcachesize")) {
+		unsigned long size = git_config_ulong(var, value, ctx->kvi);
+		opts->block_cache_size = size ? size : -1;
 	}
 
 	return 0;
@@ -294,6 +350,7 @@ static struct ref_store *reftable_be_init(struct repository *repo,
 	refs->write_options.disable_auto_compact =
 		!git_env_bool("GIT_TEST_REFTABLE_AUTOCOMPACTION", 1);
 	refs->write_options.lock_timeout_ms = 100;
+	refs->write_options.auto_compact_payload = refs;
 
 	git_config(reftable_be_config, &refs->write_options);
 
@@ -351,6 +408,28 @@ static struct ref_store *reftable_be_init(struct repository *repo,
 	return &refs->base;
 }
 
+/*
+ * The reftable library only counts how its block cache is used. Hand
+ * those counts over to trace2 and reset them so that they are not
+ * reported twice.
+ */
+static void trace2_block_cache_stats(struct reftable_stack *stack)
+{
+	struct reftable_block_cache_stats *stats;
+
+	if (!stack)
+		return;
+	stats = reftable_stack_block_cache_stats(stack);
+	if (!stats)
+		return;
+
+	trace2_counter_add(TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_HITS, stats->hits);
+	trace2_counter_add(TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_MISSES, stats->misses);
+	trace2_counter_add(TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_EVICTIONS, stats->evictions);
+	trace2_counter_add(TRACE2_COUNTER_ID_REFTABLE_READAHEADS, stats->readaheads);
+	stats->hits = stats->misses = stats->evictions = stats->readaheads = 0;
+}
+
 static void reftable_be_release(struct ref_store *ref_store)
 {
 	struct reftable_ref_store *refs = reftable_be_downcast(ref_store, 0, "release");
@@ -358,17 +437,21 @@ static void reftable_be_release(struct ref_store *ref_store)
 	struct hashmap_iter iter;
 
 	if (refs->main_stack) {
+		trace2_block_cache_stats(refs->main_stack);
 		reftable_stack_destroy(refs->main_stack);
 		refs->main_stack = NULL;
 	}
 
 	if (refs->worktree_stack) {
+		trace2_block_cache_stats(refs->worktree_stack);
 		reftable_stack_destroy(refs->worktree_stack);
 		refs->worktree_stack = NULL;
 	}
 
-	strmap_for_each_entry(&refs->worktree_stacks, &iter, entry)
+	strmap_for_each_entry(&refs->worktree_stacks, &iter, entry) {
+		trace2_block_cache_stats(entry->value);
 		reftable_stack_destroy(entry->value);
+	}
 	strmap_clear(&refs->worktree_stacks, 0);
 }
 
@@ -742,7 +825,7 @@ static struct reftable_ref_iterator *ref_iterator_for_stack(struct reftable_ref_
 		goto done;
 
 	reftable_stack_init_ref_iterator(stack, &iter->iter);
-	ret = reftable_iterator_seek_ref(&iter->iter, prefix);
+	ret = reftable_iterator_seek_ref_prefix(&iter->iter, prefix);
 	if (ret)
 		goto done;
 
@@ -1819,6 +1902,7 @@ static int reftable_be_copy_ref(struct ref_store *ref_store,
 struct reftable_reflog_iterator {
 	struct ref_iterator base;
 	struct reftable_ref_store *refs;
+	struct reftable_stack *stack;
 	struct reftable_iterator iter;
 	struct reftable_log_record log;
 	struct strbuf last_name;
@@ -1881,6 +1965,7 @@ static int reftable_reflog_iterator_abort(struct ref_iterator *ref_iterator)
 		(struct reftable_reflog_iterator *)ref_iterator;
 	reftable_log_record_release(&iter->log);
 	reftable_iterator_destroy(&iter->iter);
+	trace2_block_cache_stats(iter->stack);
 	strbuf_release(&iter->last_name);
 	free(iter);
 	return ITER_DONE;
@@ -1902,6 +1987,7 @@ static struct reftable_reflog_iterator *reflog_iterator_for_stack(struct reftabl
 	base_ref_iterator_init(&iter->base, &reftable_reflog_iterator_vtable);
 	strbuf_init(&iter->last_name, 0);
 	iter->refs = refs;
+	iter->stack = stack;
 
 	ret = refs->err;
 	if (ret)
@@ -2003,6 +2089,7 @@ static int reftable_be_for_each_reflog_ent_reverse(struct ref_store *ref_store,
 done:
 	reftable_log_record_release(&log);
 	reftable_iterator_destroy(&it);
+	trace2_block_cache_stats(stack);
 	return ret;
 }
 
@@ -2051,6 +2138,7 @@ static int reftable_be_for_each_reflog_ent(struct ref_store *ref_store,
 
 done:
 	reftable_iterator_destroy(&it);
+	trace2_block_cache_stats(stack);
 	for (i = 0; i < logs_nr; i++)
 		reftable_log_record_release(&logs[i]);
 	free(logs);
@@ -2099,6 +2187,7 @@ static int reftable_be_reflog_exists(struct ref_store *ref_store,
 
 done:
 	reftable_iterator_destroy(&it);
+	trace2_block_cache_stats(stack);
 	reftable_log_record_release(&log);
 	if (ret < 0)
 		ret = 0;
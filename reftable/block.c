@@ -210,6 +210,33 @@ int block_writer_finish(struct block_writer *w)
 	return w->next;
 }
 
+/*
+ * Set up `br` to read the decoded block `block` of `sz` bytes, taking over
+ * ownership of its data.
+ */
+static void block_reader_setup(struct block_reader *br,
+			       struct reftable_block *block, uint32_t sz,
+			       uint32_t header_off, uint32_t full_block_size,
+			       int hash_size)
+{
+	uint16_t restart_count = get_be16(block->data + sz - 2);
+	uint32_t restart_start = sz - 2 - 3 * restart_count;
+
+	/* transfer ownership. */
+	br->block = *block;
+	block->data = NULL;
+	block->len = 0;
+	block->source.ops = NULL;
+	block->source.arg = NULL;
+
+	br->hash_size = hash_size;
+	br->block_len = restart_start;
+	br->full_block_size = full_block_size;
+	br->header_off = header_off;
+	br->restart_count = restart_count;
+	br->restart_bytes = br->block.data + restart_start;
+}
+
 int block_reader_init(struct block_reader *br, struct reftable_block *block,
 		      uint32_t header_off, uint32_t table_block_size,
 		      int hash_size)
@@ -218,9 +245,6 @@ int block_reader_init(struct block_reader *br, struct reftable_block *block,
 	uint8_t typ = block->data[header_off];
 	uint32_t sz = get_be24(block->data + header_off + 1);
 	int err = 0;
-	uint16_t restart_count = 0;
-	uint32_t restart_start = 0;
-	uint8_t *restart_bytes = NULL;
 
 	reftable_block_done(&br->block);
 
@@ -300,26 +324,31 @@ int block_reader_init(struct block_reader *br, struct reftable_block *block,
 		full_block_size = sz;
 	}
 
-	restart_count = get_be16(block->data + sz - 2);
-	restart_start = sz - 2 - 3 * restart_count;
-	restart_bytes = block->data + restart_start;
-
-	/* transfer ownership. */
-	br->block = *block;
-	block->data = NULL;
-	block->len = 0;
-
-	br->hash_size = hash_size;
-	br->block_len = restart_start;
-	br->full_block_size = full_block_size;
-	br->header_off = header_off;
-	br->restart_count = restart_count;
-	br->restart_bytes = restart_bytes;
+	block_reader_setup(br, block, sz, header_off, full_block_size,
+			   hash_size);
 
 done:
 	return err;
 }
 
+int block_reader_init_decoded(struct block_reader *br,
+			      struct reftable_block *block,
+			      uint32_t header_off, uint32_t full_block_size,
+			      int hash_size)
+{
+	uint8_t typ = block->data[header_off];
+	uint32_t sz = get_be24(block->data + header_off + 1);
+
+	reftable_block_done(&br->block);
+
+	if (!reftable_is_block_type(typ) || sz > block->len)
+		return REFTABLE_FORMAT_ERROR;
+
+	block_reader_setup(br, block, sz, header_off, full_block_size,
+			   hash_size);
+	return 0;
+}
+
 void block_reader_release(struct block_reader *br)
 {
 	inflateEnd(br->zstream);
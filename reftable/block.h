@@ -94,6 +94,16 @@ int block_reader_init(struct block_reader *br, struct reftable_block *bl,
 		      uint32_t header_off, uint32_t table_block_size,
 		      int hash_size);
 
+/*
+ * initializes a block reader from a block that has already been decoded, as
+ * handed out by the block cache. `full_block_size` is the size of the
+ * encoded block in the file.
+ */
+int block_reader_init_decoded(struct block_reader *br,
+			      struct reftable_block *block,
+			      uint32_t header_off, uint32_t full_block_size,
+			      int hash_size);
+
 void block_reader_release(struct block_reader *br);
 
 /* Returns the block type (eg. 'r' for refs) */
@@ -0,0 +1,265 @@
+/*
+Use of this source code is governed by a BSD-style
+license that can be found in the LICENSE file or at
+https://developers.google.com/open-source/licenses/bsd
+*/
+
+#include "blockcache.h"
+
+#include "basics.h"
+#include "reftable-error.h"
+
+struct block_cache_entry {
+	struct block_cache_entry *hash_next;
+	/* neighbours in the LRU list, most recently used first. */
+	struct block_cache_entry *lru_prev, *lru_next;
+
+	const struct reftable_reader *r;
+	uint64_t off;
+
+	unsigned char *data;
+	uint32_t len;
+	uint32_t full_block_size;
+
+	/*
+	 * One reference is held by the cache while the entry is linked into
+	 * it, and one by each block that currently borrows the data.
+	 */
+	unsigned refcount;
+};
+
+struct block_cache {
+	uint64_t max_bytes;
+
+	struct block_cache_entry **buckets;
+	size_t buckets_nr; /* always a power of two */
+	size_t nr;
+
+	struct block_cache_entry *lru_head, *lru_tail;
+	struct reftable_block_cache_stats stats;
+	unsigned refcount;
+};
+
+static void entry_decref(struct block_cache_entry *e)
+{
+	if (--e->refcount)
+		return;
+	reftable_free(e->data);
+	reftable_free(e);
+}
+
+static void cache_return_block(void *arg, struct reftable_block *block UNUSED)
+{
+	entry_decref(arg);
+}
+
+static struct reftable_block_source_vtable cache_block_vtable = {
+	.return_block = &cache_return_block,
+};
+
+static size_t entry_hash(const struct reftable_reader *r, uint64_t off)
+{
+	uint64_t h = (uintptr_t)r ^ (off * 0x9e3779b97f4a7c15ULL);
+	return h ^ (h >> 29);
+}
+
+static struct block_cache_entry **find_entry(struct block_cache *c,
+					     const struct reftable_reader *r,
+					     uint64_t off)
+{
+	struct block_cache_entry **e;
+
+	if (!c->buckets_nr)
+		return NULL;
+
+	e = &c->buckets[entry_hash(r, off) & (c->buckets_nr - 1)];
+	while (*e && ((*e)->r != r || (*e)->off != off))
+		e = &(*e)->hash_next;
+	return e;
+}
+
+static void lru_unlink(struct block_cache *c, struct block_cache_entry *e)
+{
+	if (e->lru_prev)
+		e->lru_prev->lru_next = e->lru_next;
+	else
+		c->lru_head = e->lru_next;
+	if (e->lru_next)
+		e->lru_next->lru_prev = e->lru_prev;
+	else
+		c->lru_tail = e->lru_prev;
+	e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_push(struct block_cache *c, struct block_cache_entry *e)
+{
+	e->lru_prev = NULL;
+	e->lru_next = c->lru_head;
+	if (c->lru_head)
+		c->lru_head->lru_prev = e;
+	else
+		c->lru_tail = e;
+	c->lru_head = e;
+}
+
+static void evict_entry(struct block_cache *c, struct block_cache_entry *e)
+{
+	struct block_cache_entry **p = find_entry(c, e->r, e->off);
+
+	*p = e->hash_next;
+	lru_unlink(c, e);
+	c->nr--;
+	c->stats.bytes -= e->len;
+	entry_decref(e);
+}
+
+static void grow_buckets(struct block_cache *c)
+{
+	size_t new_nr = c->buckets_nr ? 2 * c->buckets_nr : 64;
+	struct block_cache_entry **new_buckets;
+
+	REFTABLE_CALLOC_ARRAY(new_buckets, new_nr);
+	if (!new_buckets)
+		return; /* keep going with longer chains */
+
+	for (size_t i = 0; i < c->buckets_nr; i++) {
+		struct block_cache_entry *e = c->buckets[i], *next;
+		for (; e; e = next) {
+			size_t b = entry_hash(e->r, e->off) & (new_nr - 1);
+			next = e->hash_next;
+			e->hash_next = new_buckets[b];
+			new_buckets[b] = e;
+		}
+	}
+
+	reftable_free(c->buckets);
+	c->buckets = new_buckets;
+	c->buckets_nr = new_nr;
+}
+
+int block_cache_new(struct block_cache **dest, uint64_t max_bytes)
+{
+	struct block_cache *c;
+
+	REFTABLE_CALLOC_ARRAY(c, 1);
+	if (!c)
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+	c->max_bytes = max_bytes;
+	c->refcount = 1;
+
+	*dest = c;
+	return 0;
+}
+
+void block_cache_incref(struct block_cache *c)
+{
+	c->refcount++;
+}
+
+void block_cache_decref(struct block_cache *c)
+{
+	if (!c || --c->refcount)
+		return;
+	while (c->lru_head)
+		evict_entry(c, c->lru_head);
+	reftable_free(c->buckets);
+	reftable_free(c);
+}
+
+int block_cache_get(struct block_cache *c, const struct reftable_reader *r,
+		    uint64_t off, struct reftable_block *dest,
+		    uint32_t *full_block_size)
+{
+	struct block_cache_entry **p = find_entry(c, r, off);
+	struct block_cache_entry *e = p ? *p : NULL;
+
+	if (!e)
+		return 0;
+
+	lru_unlink(c, e);
+	lru_push(c, e);
+	e->refcount++;
+
+	dest->data = e->data;
+	dest->len = e->len;
+	dest->source.ops = &cache_block_vtable;
+	dest->source.arg = e;
+	*full_block_size = e->full_block_size;
+
+	c->stats.hits++;
+	return 1;
+}
+
+int block_cache_adopt(struct block_cache *c, const struct reftable_reader *r,
+		      uint64_t off, struct block_reader *br)
+{
+	struct block_cache_entry **p, *e;
+
+	/* Only blocks that have been inflated into `br` can be adopted. */
+	if (!br->uncompressed_data || br->block.data != br->uncompressed_data ||
+	    br->block.source.ops)
+		return 0;
+
+	REFTABLE_CALLOC_ARRAY(e, 1);
+	if (!e)
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+	e->r = r;
+	e->off = off;
+	e->data = br->uncompressed_data;
+	e->len = br->block.len;
+	e->full_block_size = br->full_block_size;
+	e->refcount = 2;
+
+	br->uncompressed_data = NULL;
+	br->uncompressed_cap = 0;
+	br->block.source.ops = &cache_block_vtable;
+	br->block.source.arg = e;
+
+	p = find_entry(c, r, off);
+	if (p && *p)
+		evict_entry(c, *p);
+	if (c->nr >= c->buckets_nr)
+		grow_buckets(c);
+
+	p = find_entry(c, r, off);
+	if (!p) {
+		/* No buckets at all; the caller still owns its block. */
+		e->refcount--;
+		return 0;
+	}
+	*p = e;
+	lru_push(c, e);
+	c->nr++;
+	c->stats.bytes += e->len;
+
+	c->stats.misses++;
+
+	while (c->stats.bytes > c->max_bytes && c->lru_tail) {
+		evict_entry(c, c->lru_tail);
+		c->stats.evictions++;
+	}
+
+	return 0;
+}
+
+void block_cache_drop_reader(struct block_cache *c,
+			     const struct reftable_reader *r)
+{
+	struct block_cache_entry *e = c->lru_head, *next;
+
+	for (; e; e = next) {
+		next = e->lru_next;
+		if (e->r == r)
+			evict_entry(c, e);
+	}
+}
+
+void block_cache_note_readahead(struct block_cache *c)
+{
+	c->stats.readaheads++;
+}
+
+struct reftable_block_cache_stats *block_cache_stats(struct block_cache *c)
+{
+	return &c->stats;
+}
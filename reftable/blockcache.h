@@ -0,0 +1,62 @@
+/*
+Use of this source code is governed by a BSD-style
+license that can be found in the LICENSE file or at
+https://developers.google.com/open-source/licenses/bsd
+*/
+
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include "system.h"
+
+#include "block.h"
+#include "reftable-stack.h"
+
+/*
+ * A bounded LRU cache of decoded blocks, shared by all readers of a stack.
+ * Only log blocks are cached: they have to be inflated before they can be
+ * read, whereas other blocks are used straight from the block source.
+ *
+ * Blocks are keyed by their reader and offset. Blocks handed out by the
+ * cache stay valid until they are returned via `reftable_block_done()`,
+ * even when they get evicted in the meantime.
+ */
+struct block_cache;
+struct reftable_reader;
+
+/*
+ * Create a new cache that holds at most `max_bytes` of decoded blocks. The
+ * cache starts out with a refcount of one.
+ */
+int block_cache_new(struct block_cache **dest, uint64_t max_bytes);
+
+void block_cache_incref(struct block_cache *c);
+void block_cache_decref(struct block_cache *c);
+
+/*
+ * Look up the block of reader `r` at offset `off`. On a hit, `dest` borrows
+ * the decoded block, `full_block_size` is set to the size of the block in
+ * the file and 1 is returned. Returns 0 on a miss.
+ */
+int block_cache_get(struct block_cache *c, const struct reftable_reader *r,
+		    uint64_t off, struct reftable_block *dest,
+		    uint32_t *full_block_size);
+
+/*
+ * Move the decoded log block that `br` has just inflated for offset `off`
+ * of reader `r` into the cache. `br` keeps using the block, but borrows it
+ * from the cache from now on.
+ */
+int block_cache_adopt(struct block_cache *c, const struct reftable_reader *r,
+		      uint64_t off, struct block_reader *br);
+
+/* Evict all blocks of reader `r`, which is about to go away. */
+void block_cache_drop_reader(struct block_cache *c,
+			     const struct reftable_reader *r);
+
+/* Account for a readahead issued on behalf of a reader using the cache. */
+void block_cache_note_readahead(struct block_cache *c);
+
+struct reftable_block_cache_stats *block_cache_stats(struct block_cache *c);
+
+#endif
@@ -88,10 +88,24 @@ static int file_read_block(void *v, struct reftable_block *dest, uint64_t off,
 	return size;
 }
 
+static void file_readahead(void *v, uint64_t off, uint32_t size)
+{
+#ifdef POSIX_MADV_WILLNEED
+	struct file_block_source *b = v;
+	uintptr_t page_mask = getpagesize() - 1;
+	uintptr_t start = (uintptr_t)(b->data + off) & ~page_mask;
+
+	assert(off + size <= b->size);
+	posix_madvise((void *)start, (uintptr_t)(b->data + off) + size - start,
+		      POSIX_MADV_WILLNEED);
+#endif
+}
+
 static struct reftable_block_source_vtable file_vtable = {
 	.size = &file_size,
 	.read_block = &file_read_block,
 	.return_block = &file_return_block,
+	.readahead = &file_readahead,
 	.close = &file_close,
 };
 
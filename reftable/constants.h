@@ -18,5 +18,8 @@ license that can be found in the LICENSE file or at
 #define MAX_RESTARTS ((1 << 16) - 1)
 #define DEFAULT_BLOCK_SIZE 4096
 #define DEFAULT_GEOMETRIC_FACTOR 2
+#define DEFAULT_BLOCK_CACHE_SIZE (1024 * 1024)
+#define READAHEAD_BLOCKS 16
+#define READAHEAD_MIN_SEQUENTIAL_BLOCKS 2
 
 #endif
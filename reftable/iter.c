@@ -20,6 +20,14 @@ int iterator_seek(struct reftable_iterator *it, struct reftable_record *want)
 	return it->ops->seek(it->iter_arg, want);
 }
 
+int iterator_seek_prefix(struct reftable_iterator *it,
+			 struct reftable_record *want)
+{
+	if (it->ops->seek_prefix)
+		return it->ops->seek_prefix(it->iter_arg, want);
+	return it->ops->seek(it->iter_arg, want);
+}
+
 int iterator_next(struct reftable_iterator *it, struct reftable_record *rec)
 {
 	return it->ops->next(it->iter_arg, rec);
@@ -255,6 +263,18 @@ int reftable_iterator_seek_ref(struct reftable_iterator *it,
 	return it->ops->seek(it->iter_arg, &want);
 }
 
+int reftable_iterator_seek_ref_prefix(struct reftable_iterator *it,
+				      const char *prefix)
+{
+	struct reftable_record want = {
+		.type = BLOCK_TYPE_REF,
+		.u.ref = {
+			.refname = (char *)prefix,
+		},
+	};
+	return iterator_seek_prefix(it, &want);
+}
+
 int reftable_iterator_next_ref(struct reftable_iterator *it,
 			       struct reftable_ref_record *ref)
 {
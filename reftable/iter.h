@@ -20,6 +20,12 @@ license that can be found in the LICENSE file or at
  */
 struct reftable_iterator_vtable {
 	int (*seek)(void *iter_arg, struct reftable_record *want);
+	/*
+	 * Optional. Like `seek()`, but the caller is only interested in
+	 * records whose key starts with the key of `want`. Implementations may
+	 * use this to skip over data that cannot contain any such record.
+	 */
+	int (*seek_prefix)(void *iter_arg, struct reftable_record *want);
 	int (*next)(void *iter_arg, struct reftable_record *rec);
 	void (*close)(void *iter_arg);
 };
@@ -30,6 +36,14 @@ struct reftable_iterator_vtable {
  */
 int iterator_seek(struct reftable_iterator *it, struct reftable_record *want);
 
+/*
+ * Position the iterator like `iterator_seek()`, but allow it to omit records
+ * whose key does not start with the key of `want`. Returns 1 in case the
+ * iterator knows that there are no such records.
+ */
+int iterator_seek_prefix(struct reftable_iterator *it,
+			 struct reftable_record *want);
+
 /*
  * Yield the next record and advance the iterator. Returns <0 on error, 0 when
  * a record was yielded, and >0 when the iterator hit an error.
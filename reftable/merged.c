@@ -61,14 +61,33 @@ static int merged_iter_advance_subiter(struct merged_iter *mi, size_t idx)
 	return 0;
 }
 
-static int merged_iter_seek(struct merged_iter *mi, struct reftable_record *want)
+static int merged_iter_seek(struct merged_iter *mi, struct reftable_record *want,
+			    int prefix)
 {
 	int err;
 
 	mi->advance_index = -1;
 
+	/*
+	 * Subiterators may now be skipped, so we must not keep entries from
+	 * a previous seek around.
+	 */
+	while (!merged_iter_pqueue_is_empty(mi->pq))
+		merged_iter_pqueue_remove(&mi->pq);
+
+	/*
+	 * Only bother to let subiterators skip themselves when there are
+	 * multiple of them. For a single table the check would only cost us
+	 * time.
+	 */
+	if (mi->subiters_len < 2)
+		prefix = 0;
+
 	for (size_t i = 0; i < mi->subiters_len; i++) {
-		err = iterator_seek(&mi->subiters[i].iter, want);
+		if (prefix)
+			err = iterator_seek_prefix(&mi->subiters[i].iter, want);
+		else
+			err = iterator_seek(&mi->subiters[i].iter, want);
 		if (err < 0)
 			return err;
 		if (err > 0)
@@ -149,7 +168,12 @@ static int merged_iter_next_entry(struct merged_iter *mi,
 
 static int merged_iter_seek_void(void *it, struct reftable_record *want)
 {
-	return merged_iter_seek(it, want);
+	return merged_iter_seek(it, want, 0);
+}
+
+static int merged_iter_seek_prefix_void(void *it, struct reftable_record *want)
+{
+	return merged_iter_seek(it, want, 1);
 }
 
 static int merged_iter_next_void(void *p, struct reftable_record *rec)
@@ -167,6 +191,7 @@ static int merged_iter_next_void(void *p, struct reftable_record *rec)
 
 static struct reftable_iterator_vtable merged_iter_vtable = {
 	.seek = merged_iter_seek_void,
+	.seek_prefix = merged_iter_seek_prefix_void,
 	.next = &merged_iter_next_void,
 	.close = &merged_iter_close,
 };
@@ -10,6 +10,7 @@ license that can be found in the LICENSE file or at
 
 #include "system.h"
 #include "block.h"
+#include "blockcache.h"
 #include "constants.h"
 #include "iter.h"
 #include "record.h"
@@ -29,6 +30,15 @@ int block_source_read_block(struct reftable_block_source *source,
 	return result;
 }
 
+int block_source_readahead(struct reftable_block_source *source,
+			   uint64_t off, uint32_t size)
+{
+	if (!source->ops->readahead)
+		return 0;
+	source->ops->readahead(source->arg, off, size);
+	return 1;
+}
+
 void block_source_close(struct reftable_block_source *source)
 {
 	if (!source->ops) {
@@ -77,6 +87,18 @@ const char *reader_name(struct reftable_reader *r)
 	return r->name;
 }
 
+void reader_set_block_cache(struct reftable_reader *r,
+			    struct block_cache *cache)
+{
+	if (r->block_cache) {
+		block_cache_drop_reader(r->block_cache, r);
+		block_cache_decref(r->block_cache);
+	}
+	r->block_cache = cache;
+	if (cache)
+		block_cache_incref(cache);
+}
+
 static int parse_footer(struct reftable_reader *r, uint8_t *footer,
 			uint8_t *header)
 {
@@ -169,6 +191,10 @@ struct table_iter {
 	struct block_reader br;
 	struct block_iter bi;
 	int is_finished;
+	/* number of blocks read sequentially since the last seek. */
+	unsigned sequential_blocks;
+	/* end of the segment we have asked the block source to read ahead. */
+	uint64_t readahead_end;
 };
 
 static int table_iter_init(struct table_iter *ti, struct reftable_reader *r)
@@ -214,6 +240,34 @@ static int32_t extract_block_size(uint8_t *data, uint8_t *typ, uint64_t off,
 	return result;
 }
 
+/*
+ * Initialize `br` from the block cache. Returns 0 on success, a positive
+ * value if the cached block is not of type `want_typ` and -1 if the block is
+ * not cached.
+ */
+static int reader_init_cached_block_reader(struct reftable_reader *r,
+					   struct block_reader *br,
+					   uint64_t off, uint8_t want_typ)
+{
+	struct reftable_block block = { NULL };
+	uint32_t header_off = off ? 0 : header_size(r->version);
+	uint32_t full_block_size;
+	int err;
+
+	if (!block_cache_get(r->block_cache, r, off, &block, &full_block_size))
+		return -1;
+
+	if (want_typ != BLOCK_TYPE_ANY && block.data[header_off] != want_typ)
+		err = 1;
+	else
+		err = block_reader_init_decoded(br, &block, header_off,
+						full_block_size,
+						hash_size(r->hash_id));
+
+	reftable_block_done(&block);
+	return err;
+}
+
 int reader_init_block_reader(struct reftable_reader *r, struct block_reader *br,
 			     uint64_t next_off, uint8_t want_typ)
 {
@@ -228,6 +282,12 @@ int reader_init_block_reader(struct reftable_reader *r, struct block_reader *br,
 	if (next_off >= r->size)
 		return 1;
 
+	if (r->block_cache) {
+		err = reader_init_cached_block_reader(r, br, next_off, want_typ);
+		if (err >= 0)
+			return err;
+	}
+
 	err = reader_get_block(r, &block, next_off, guess_block_size);
 	if (err < 0)
 		goto done;
@@ -253,6 +313,8 @@ int reader_init_block_reader(struct reftable_reader *r, struct block_reader *br,
 
 	err = block_reader_init(br, &block, header_off, r->block_size,
 				hash_size(r->hash_id));
+	if (!err && r->block_cache && block_typ == BLOCK_TYPE_LOG)
+		err = block_cache_adopt(r->block_cache, r, next_off, br);
 done:
 	reftable_block_done(&block);
 
@@ -266,11 +328,39 @@ static void table_iter_close(struct table_iter *ti)
 	reftable_reader_decref(ti->r);
 }
 
+/*
+ * Ask the block source to read ahead once an iterator scans sequentially
+ * through the table and gets close to the end of what it has been asked to
+ * read ahead so far.
+ */
+static void table_iter_readahead(struct table_iter *ti, uint64_t off)
+{
+	struct reftable_reader *r = ti->r;
+	uint64_t len;
+
+	if (++ti->sequential_blocks < READAHEAD_MIN_SEQUENTIAL_BLOCKS ||
+	    !r->block_size || off >= r->size ||
+	    off + r->block_size <= ti->readahead_end)
+		return;
+
+	len = (uint64_t)r->block_size * READAHEAD_BLOCKS;
+	if (len > r->size - off)
+		len = r->size - off;
+	if (!block_source_readahead(&r->source, off, len))
+		return;
+
+	ti->readahead_end = off + len;
+	if (r->block_cache)
+		block_cache_note_readahead(r->block_cache);
+}
+
 static int table_iter_next_block(struct table_iter *ti)
 {
 	uint64_t next_block_off = ti->block_off + ti->br.full_block_size;
 	int err;
 
+	table_iter_readahead(ti, next_block_off);
+
 	err = reader_init_block_reader(ti->r, &ti->br, next_block_off, ti->typ);
 	if (err > 0)
 		ti->is_finished = 1;
@@ -327,6 +417,8 @@ static int table_iter_seek_to(struct table_iter *ti, uint64_t off, uint8_t typ)
 
 	ti->typ = block_reader_type(&ti->br);
 	ti->block_off = off;
+	ti->sequential_blocks = 0;
+	ti->readahead_end = 0;
 	block_iter_seek_start(&ti->bi, &ti->br);
 	ti->is_finished = 0;
 	return 0;
@@ -529,11 +621,140 @@ static int table_iter_seek(struct table_iter *ti,
 	return err;
 }
 
+static int reader_load_ref_range(struct reftable_reader *r)
+{
+	struct reftable_record rec;
+	struct table_iter ti;
+	int err;
+
+	reftable_record_init(&rec, BLOCK_TYPE_REF);
+	table_iter_init(&ti, r);
+
+	err = table_iter_seek_start(&ti, BLOCK_TYPE_REF, 0);
+	if (!err)
+		err = table_iter_next(&ti, &rec);
+	if (err > 0) {
+		/* no refs at all; remember that as an empty range */
+		r->ref_range_loaded = 1;
+		err = 0;
+		goto done;
+	}
+	if (err < 0)
+		goto done;
+	err = reftable_record_key(&rec, &r->first_ref_key);
+	if (err < 0)
+		goto done;
+
+	/*
+	 * Without an index the ref section consists of a handful of blocks
+	 * only, so we can afford to scan it for its last key. Otherwise, the
+	 * last record of the highest index level refers to the last ref block
+	 * and thus carries the last key of the section.
+	 */
+	if (r->ref_offsets.index_offset) {
+		table_iter_close(&ti);
+		table_iter_init(&ti, r);
+		reftable_record_release(&rec);
+		reftable_record_init(&rec, BLOCK_TYPE_INDEX);
+
+		err = table_iter_seek_start(&ti, BLOCK_TYPE_REF, 1);
+		if (err)
+			goto done;
+	} else {
+		err = reftable_record_key(&rec, &r->last_ref_key);
+		if (err < 0)
+			goto done;
+	}
+
+	while (!(err = table_iter_next(&ti, &rec))) {
+		err = reftable_record_key(&rec, &r->last_ref_key);
+		if (err < 0)
+			goto done;
+	}
+	if (err < 0)
+		goto done;
+
+	if (!r->last_ref_key.len) {
+		err = REFTABLE_FORMAT_ERROR;
+		goto done;
+	}
+
+	r->ref_range_loaded = 1;
+	err = 0;
+
+done:
+	reftable_record_release(&rec);
+	table_iter_close(&ti);
+	return err;
+}
+
+static int key_cmp_prefix(const struct reftable_buf *key, const char *prefix,
+			  size_t prefix_len)
+{
+	int cmp = memcmp(key->buf, prefix,
+			 key->len < prefix_len ? key->len : prefix_len);
+	if (!cmp && key->len < prefix_len)
+		return -1;
+	return cmp;
+}
+
+/*
+ * Check whether the ref section of the reader may contain refs starting with
+ * the given prefix. Returns 0 when it doesn't, 1 when it may and a negative
+ * error code otherwise.
+ */
+static int reader_may_contain_ref_prefix(struct reftable_reader *r,
+					 const char *prefix)
+{
+	size_t prefix_len = strlen(prefix);
+	int err;
+
+	if (!r->ref_range_loaded) {
+		err = reader_load_ref_range(r);
+		if (err < 0)
+			return err;
+	}
+	if (!r->first_ref_key.len)
+		return 0;
+
+	/*
+	 * All refs with the prefix sort in the range starting at the prefix
+	 * and ending right before the first key that sorts after the prefix,
+	 * but which does not start with it.
+	 */
+	if (key_cmp_prefix(&r->last_ref_key, prefix, prefix_len) < 0 ||
+	    key_cmp_prefix(&r->first_ref_key, prefix, prefix_len) > 0)
+		return 0;
+
+	return 1;
+}
+
 static int table_iter_seek_void(void *ti, struct reftable_record *want)
 {
 	return table_iter_seek(ti, want);
 }
 
+static int table_iter_seek_prefix_void(void *p, struct reftable_record *want)
+{
+	struct table_iter *ti = p;
+
+	if (reftable_record_type(want) == BLOCK_TYPE_REF &&
+	    want->u.ref.refname && *want->u.ref.refname) {
+		int err = reader_may_contain_ref_prefix(ti->r,
+							want->u.ref.refname);
+		if (err < 0)
+			return err;
+		if (!err) {
+			table_iter_block_done(ti);
+			ti->typ = BLOCK_TYPE_REF;
+			ti->is_finished = 1;
+			return 1;
+		}
+	}
+
+	return table_iter_seek(ti, want);
+}
+
 static int table_iter_next_void(void *ti, struct reftable_record *rec)
 {
 	return table_iter_next(ti, rec);
@@ -546,6 +767,7 @@ static void table_iter_close_void(void *ti)
 
 static struct reftable_iterator_vtable table_iter_vtable = {
 	.seek = &table_iter_seek_void,
+	.seek_prefix = &table_iter_seek_prefix_void,
 	.next = &table_iter_next_void,
 	.close = &table_iter_close_void,
 };
@@ -681,6 +903,9 @@ void reftable_reader_decref(struct reftable_reader *r)
 		BUG("cannot decrement ref counter of dead reader");
 	if (--r->refcount)
 		return;
+	reader_set_block_cache(r, NULL);
+	reftable_buf_release(&r->first_ref_key);
+	reftable_buf_release(&r->last_ref_key);
 	block_source_close(&r->source);
 	REFTABLE_FREE_AND_NULL(r->name);
 	reftable_free(r);
@@ -14,6 +14,8 @@ license that can be found in the LICENSE file or at
 #include "reftable-iterator.h"
 #include "reftable-reader.h"
 
+struct block_cache;
+
 uint64_t block_source_size(struct reftable_block_source *source);
 
 int block_source_read_block(struct reftable_block_source *source,
@@ -21,6 +23,13 @@ int block_source_read_block(struct reftable_block_source *source,
 			    uint32_t size);
 void block_source_close(struct reftable_block_source *source);
 
+/*
+ * Hint the source that the given segment is about to be read. Returns 1 if
+ * the source supports readahead, 0 otherwise.
+ */
+int block_source_readahead(struct reftable_block_source *source,
+			   uint64_t off, uint32_t size);
+
 /* metadata for a block type */
 struct reftable_reader_offsets {
 	int is_present;
@@ -52,10 +61,27 @@ struct reftable_reader {
 	struct reftable_reader_offsets log_offsets;
 
 	uint64_t refcount;
+
+	/* cache of decoded blocks shared with the other tables of a stack. */
+	struct block_cache *block_cache;
+
+	/*
+	 * Keys of the first and last record in the ref section. They are
+	 * loaded on the first prefix seek and let us skip tables that cannot
+	 * contain any ref with the sought-after prefix. Both are empty for a
+	 * table without refs.
+	 */
+	int ref_range_loaded;
+	struct reftable_buf first_ref_key;
+	struct reftable_buf last_ref_key;
 };
 
 const char *reader_name(struct reftable_reader *r);
 
+/* Make `r` keep its decoded blocks in `cache`. */
+void reader_set_block_cache(struct reftable_reader *r,
+			    struct block_cache *cache);
+
 int reader_init_iter(struct reftable_reader *r,
 		     struct reftable_iterator *it,
 		     uint8_t typ);
@@ -38,6 +38,9 @@ struct reftable_block_source_vtable {
 	/* mark the block as read; may return the data back to malloc */
 	void (*return_block)(void *source, struct reftable_block *blockp);
 
+	/* optional: hint that a segment is about to be read sequentially */
+	void (*readahead)(void *source, uint64_t off, uint32_t size);
+
 	/* release all resources associated with the block source */
 	void (*close)(void *source);
 };
@@ -28,6 +28,16 @@ struct reftable_iterator {
 int reftable_iterator_seek_ref(struct reftable_iterator *it,
 			       const char *name);
 
+/*
+ * Position the iterator at the first ref record whose name starts with
+ * `prefix`. Other than `reftable_iterator_seek_ref()`, this allows the
+ * iterator to skip tables that do not contain any such record. The iterator
+ * may thus omit records sorting after the last matching one, and callers are
+ * expected to stop iterating at the first record that does not match.
+ */
+int reftable_iterator_seek_ref_prefix(struct reftable_iterator *it,
+				      const char *prefix);
+
 /* reads the next reftable_ref_record. Returns < 0 for error, 0 for OK and > 0:
  * end of iteration.
  */
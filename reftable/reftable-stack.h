@@ -136,6 +136,13 @@ int reftable_stack_read_ref(struct reftable_stack *st, const char *refname,
 int reftable_stack_read_log(struct reftable_stack *st, const char *refname,
 			    struct reftable_log_record *log);
 
+/*
+ * Check whether `reftable_stack_auto_compact()` would compact any tables that
+ * are not locked by a concurrent compaction already. Returns 1 if so, 0 if
+ * not, and a negative error code otherwise.
+ */
+int reftable_stack_auto_compact_needed(struct reftable_stack *st);
+
 /* statistics on past compactions. */
 struct reftable_compaction_stats {
 	uint64_t bytes; /* total number of bytes written */
@@ -149,4 +156,20 @@ struct reftable_compaction_stats {
 struct reftable_compaction_stats *
 reftable_stack_compaction_stats(struct reftable_stack *st);
 
+/* statistics for the cache of decoded blocks of a stack. */
+struct reftable_block_cache_stats {
+	uint64_t hits; /* blocks served from the cache */
+	uint64_t misses; /* blocks decoded and added to the cache */
+	uint64_t evictions; /* blocks evicted to stay within the size limit */
+	uint64_t readaheads; /* readahead hints issued to the block source */
+	uint64_t bytes; /* bytes currently cached */
+};
+
+/*
+ * return statistics for the block cache up till now, or NULL if the stack
+ * does not cache blocks.
+ */
+struct reftable_block_cache_stats *
+reftable_stack_block_cache_stats(struct reftable_stack *st);
+
 #endif
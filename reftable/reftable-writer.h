@@ -16,6 +16,8 @@ license that can be found in the LICENSE file or at
 
 /* Writing single reftables */
 
+struct reftable_stack;
+
 /* reftable_write_options sets options for writing a single reftable. */
 struct reftable_write_options {
 	/* boolean: do not pad out blocks to block size. */
@@ -46,6 +48,16 @@ struct reftable_write_options {
 	/* boolean: Prevent auto-compaction of tables. */
 	unsigned disable_auto_compact : 1;
 
+	/*
+	 * Optional callback that is invoked instead of compacting the stack
+	 * after an addition has been committed, when auto-compaction has work
+	 * to do that no concurrent compaction is taking care of already. This
+	 * allows the caller to compact the stack out of band, e.g. in a
+	 * detached process. It is not invoked if auto-compaction is disabled.
+	 */
+	int (*auto_compact_hook)(struct reftable_stack *st, void *payload);
+	void *auto_compact_payload;
+
 	/*
 	 * Geometric sequence factor used by auto-compaction to decide which
 	 * tables to compact. Defaults to 2 if unset.
@@ -62,6 +74,13 @@ struct reftable_write_options {
 	 * negative value will cause us to block indefinitely.
 	 */
 	long lock_timeout_ms;
+
+	/*
+	 * The maximum number of bytes of decoded blocks that a stack keeps
+	 * cached for its tables. Defaults to 1MB if unset; a negative value
+	 * disables the cache.
+	 */
+	int64_t block_cache_size;
 };
 
 /* reftable_block_stats holds statistics for a single block type */
@@ -10,6 +10,7 @@ license that can be found in the LICENSE file or at
 
 #include "../write-or-die.h"
 #include "system.h"
+#include "blockcache.h"
 #include "constants.h"
 #include "merged.h"
 #include "reader.h"
@@ -91,6 +92,14 @@ int reftable_new_stack(struct reftable_stack **dest, const char *dir,
 		goto out;
 	}
 
+	if (opts.block_cache_size >= 0) {
+		err = block_cache_new(&p->block_cache, opts.block_cache_size ?
+				      opts.block_cache_size :
+				      DEFAULT_BLOCK_CACHE_SIZE);
+		if (err < 0)
+			goto out;
+	}
+
 	err = reftable_stack_reload_maybe_reuse(p, 1);
 	if (err < 0)
 		goto out;
@@ -239,6 +248,7 @@ void reftable_stack_destroy(struct reftable_stack *st)
 		st->list_fd = -1;
 	}
 
+	block_cache_decref(st->block_cache);
 	REFTABLE_FREE_AND_NULL(st->list_file);
 	REFTABLE_FREE_AND_NULL(st->reftable_dir);
 	reftable_free(st);
@@ -330,6 +340,9 @@ static int reftable_stack_reload_once(struct reftable_stack *st,
 			err = reftable_reader_new(&rd, &src, name);
 			if (err < 0)
 				goto done;
+
+			if (st->block_cache)
+				reader_set_block_cache(rd, st->block_cache);
 		}
 
 		new_readers[new_readers_len] = rd;
@@ -796,8 +809,18 @@ int reftable_addition_commit(struct reftable_addition *add)
 		 * trying to compact parts of the stack, which would lead to a
 		 * `REFTABLE_LOCK_ERROR` because parts of the stack are locked
 		 * already. This is a benign error though, so we ignore it.
+		 *
+		 * If the caller wants to compact the stack by itself, we only
+		 * tell it that there is work to do.
 		 */
-		err = reftable_stack_auto_compact(add->stack);
+		if (add->stack->opts.auto_compact_hook) {
+			err = reftable_stack_auto_compact_needed(add->stack);
+			if (err > 0)
+				err = add->stack->opts.auto_compact_hook(add->stack,
+						add->stack->opts.auto_compact_payload);
+		} else {
+			err = reftable_stack_auto_compact(add->stack);
+		}
 		if (err < 0 && err != REFTABLE_LOCK_ERROR)
 			goto done;
 		err = 0;
@@ -1637,12 +1660,61 @@ int reftable_stack_auto_compact(struct reftable_stack *st)
 	return 0;
 }
 
+int reftable_stack_auto_compact_needed(struct reftable_stack *st)
+{
+	struct reftable_buf lock_path = REFTABLE_BUF_INIT;
+	struct segment seg;
+	uint64_t *sizes;
+	int err = 0;
+
+	sizes = stack_table_sizes_for_compaction(st);
+	if (!sizes)
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+
+	seg = suggest_compaction_segment(sizes, st->merged->readers_len,
+					 st->opts.auto_compaction_factor);
+	reftable_free(sizes);
+
+	if (!segment_size(&seg))
+		goto done;
+
+	/*
+	 * A concurrent compaction locks the tables it compacts, from the last
+	 * to the first one. If any of the tables we would compact is locked,
+	 * somebody else is already taking care of compacting them.
+	 */
+	for (size_t i = seg.start; i < seg.end; i++) {
+		struct stat st_lock;
+
+		if ((err = stack_filename(&lock_path, st,
+					  reader_name(st->readers[i]))) < 0 ||
+		    (err = reftable_buf_addstr(&lock_path, ".lock")) < 0)
+			goto done;
+		if (!stat(lock_path.buf, &st_lock))
+			goto done;
+	}
+
+	err = 1;
+
+done:
+	reftable_buf_release(&lock_path);
+	return err;
+}
+
 struct reftable_compaction_stats *
 reftable_stack_compaction_stats(struct reftable_stack *st)
 {
 	return &st->stats;
 }
 
+struct reftable_block_cache_stats *
+reftable_stack_block_cache_stats(struct reftable_stack *st)
+{
+	if (!st->block_cache)
+		return NULL;
+	return block_cache_stats(st->block_cache);
+}
+
 int reftable_stack_read_ref(struct reftable_stack *st, const char *refname,
 			    struct reftable_ref_record *ref)
 {
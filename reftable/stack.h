@@ -13,6 +13,8 @@ license that can be found in the LICENSE file or at
 #include "reftable-writer.h"
 #include "reftable-stack.h"
 
+struct block_cache;
+
 struct reftable_stack {
 	struct stat list_st;
 	char *list_file;
@@ -26,6 +28,7 @@ struct reftable_stack {
 	size_t readers_len;
 	struct reftable_merged_table *merged;
 	struct reftable_compaction_stats stats;
+	struct block_cache *block_cache;
 };
 
 int read_lines(const char *filename, char ***lines);
@@ -3,6 +3,7 @@
 
 #include "hash.h"
 #include "hashmap.h"
+#include "object.h"
 #include "refspec.h"
 #include "string-list.h"
 #include "strvec.h"
@@ -240,6 +241,29 @@ struct bundle_list;
 int get_remote_bundle_uri(int fd_out, struct packet_reader *reader,
 			  struct bundle_list *bundles, int stateless_rpc);
 
+/*
+ * What the remote told us about an object using the protocol v2
+ * "object-info" command.
+ */
+struct remote_object_info {
+	enum object_type type;
+	unsigned long size;
+	/* The size the object takes on the remote side, or -1 if unknown. */
+	off_t disk_size;
+	/* Whether the remote has the object at all. */
+	unsigned found : 1;
+};
+
+/*
+ * Used for protocol v2 in order to retrieve the type, size and (if the
+ * server supports it) disk size of objects from a remote without fetching
+ * them. The information about oids[i] is stored in infos[i].
+ */
+int get_remote_object_info(int fd_out, struct packet_reader *reader,
+			   const struct object_id *oids, int oid_nr,
+			   struct remote_object_info *infos,
+			   int stateless_rpc);
+
 int resolve_remote_symref(struct ref *ref, struct ref *list);
 
 /*
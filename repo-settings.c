@@ -3,6 +3,7 @@
 #include "repo-settings.h"
 #include "repository.h"
 #include "midx.h"
+#include "csum-file.h"
 
 static void repo_cfg_bool(struct repository *r, const char *key, int *dest,
 			  int def)
@@ -83,6 +84,11 @@ void prepare_repo_settings(struct repository *r)
 	if (git_env_bool(GIT_TEST_MULTI_PACK_INDEX, 0))
 		r->settings.core_multi_pack_index = 1;
 
+	repo_cfg_bool(r, "core.checksumthread", &r->settings.core_checksum_thread, 0);
+	r->settings.core_checksum_thread =
+		git_env_bool(GIT_TEST_CHECKSUM_THREAD,
+			     r->settings.core_checksum_thread);
+
 	/*
 	 * Non-boolean config
 	 */
@@ -5,6 +5,7 @@
 #include "config.h"
 #include "hash.h"
 #include "pkt-line.h"
+#include "protocol.h"
 #include "version.h"
 #include "ls-refs.h"
 #include "protocol-caps.h"
@@ -70,7 +71,7 @@ static void session_id_receive(struct repository *r UNUSED,
 	trace2_data_string("transfer", NULL, "client-sid", client_sid);
 }
 
-static int object_info_advertise(struct repository *r, struct strbuf *value UNUSED)
+static int object_info_advertise(struct repository *r, struct strbuf *value)
 {
 	if (advertise_object_info == -1 &&
 	    repo_config_get_bool(r, "transfer.advertiseobjectinfo",
@@ -78,6 +79,8 @@ static int object_info_advertise(struct repository *r, struct strbuf *value UNUS
 		/* disabled by default */
 		advertise_object_info = 0;
 	}
+	if (advertise_object_info && value)
+		strbuf_addstr(value, "size type disk-size");
 	return advertise_object_info;
 }
 
@@ -349,3 +352,29 @@ void protocol_v2_serve_loop(int stateless_rpc)
 				break;
 	}
 }
+
+void serve_upload_pack(int advertise_refs, int stateless_rpc, int timeout)
+{
+	switch (determine_protocol_version_server()) {
+	case protocol_v2:
+		if (advertise_refs)
+			protocol_v2_advertise_capabilities();
+		else
+			protocol_v2_serve_loop(stateless_rpc);
+		break;
+	case protocol_v1:
+		/*
+		 * v1 is just the original protocol with a version string,
+		 * so just fall through after writing the version string.
+		 */
+		if (advertise_refs || !stateless_rpc)
+			packet_write_fmt(1, "version 1\n");
+
+		/* fallthrough */
+	case protocol_v0:
+		upload_pack(advertise_refs, stateless_rpc, timeout);
+		break;
+	case protocol_unknown_version:
+		BUG("unknown protocol version");
+	}
+}
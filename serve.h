@@ -4,4 +4,10 @@
 void protocol_v2_advertise_capabilities(void);
 void protocol_v2_serve_loop(int stateless_rpc);
 
+/*
+ * Serve upload-pack over stdin and stdout, using the protocol version
+ * requested by the client.
+ */
+void serve_upload_pack(int advertise_refs, int stateless_rpc, int timeout);
+
 #endif /* SERVE_H */
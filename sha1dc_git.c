@@ -1,6 +1,174 @@
 #include "git-compat-util.h"
 #include "sha1dc_git.h"
 #include "hex.h"
+#include "parse.h"
+
+/*
+ * On x86-64 CPUs with the SHA extensions, blocks that cannot be part of
+ * a collision attack are compressed in hardware.  sha1dc itself decides
+ * which blocks need a closer look with ubc_check(): unless one of the
+ * unavoidable bit conditions of a disturbance vector holds for the
+ * expanded message, it does nothing but the plain SHA-1 compression.
+ * We run the same check up front and hand only the blocks it flags to
+ * sha1dc, so the result, including collision detection, is identical.
+ */
+#if !defined(DC_SHA1_EXTERNAL) && !defined(NO_DC_SHA1_HW) && \
+	defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA1DC_HW
+
+#ifdef DC_SHA1_SUBMODULE
+#include "sha1collisiondetection/lib/ubc_check.h"
+#else
+#include "sha1dc/ubc_check.h"
+#endif
+#include <cpuid.h>
+#include <immintrin.h>
+
+static int sha1dc_hw_supported(void)
+{
+	static int supported = -1;
+	unsigned int eax, ebx, ecx, edx;
+
+	if (supported >= 0)
+		return supported;
+
+	supported = 0;
+	if (!git_env_bool("GIT_TEST_SHA1DC_HW", 1))
+		return supported;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+	    !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+		return supported;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) ||
+	    !(ebx & bit_SHA))
+		return supported;
+	supported = 1;
+	return supported;
+}
+
+/*
+ * The message words for rounds 4k..4k+3 are in m0, highest lane first;
+ * keep them in W[] for ubc_check().
+ */
+#define SHA1DC_HW_STORE_W(k, m) \
+	_mm_storeu_si128((__m128i *)(W + 4 * (k)), _mm_shuffle_epi32(m, 0x1b))
+
+#define SHA1DC_HW_ROUNDS(k, e, e_next, m0, m1, m2, m3) \
+	do { \
+		SHA1DC_HW_STORE_W(k, m0); \
+		e = _mm_sha1nexte_epu32(e, m0); \
+		e_next = abcd; \
+		m1 = _mm_sha1msg2_epu32(m1, m0); \
+		abcd = _mm_sha1rnds4_epu32(abcd, e, (k) / 5); \
+		m3 = _mm_sha1msg1_epu32(m3, m0); \
+		m2 = _mm_xor_si128(m2, m0); \
+	} while (0)
+
+/*
+ * Compress one block into ihv, leaving the expanded message (as
+ * sha1_compression_states() would compute it) in W.
+ */
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha1dc_hw_compress(uint32_t ihv[5], uint32_t W[80],
+			       const unsigned char *block)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+					    0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_save, e0, e0_save, e1;
+	__m128i msg0, msg1, msg2, msg3;
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)ihv), 0x1b);
+	e0 = _mm_set_epi32(ihv[4], 0, 0, 0);
+	abcd_save = abcd;
+	e0_save = e0;
+
+	/* rounds 0-3 */
+	msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)block), mask);
+	SHA1DC_HW_STORE_W(0, msg0);
+	e0 = _mm_add_epi32(e0, msg0);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+	/* rounds 4-7 */
+	msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 16)), mask);
+	SHA1DC_HW_STORE_W(1, msg1);
+	e1 = _mm_sha1nexte_epu32(e1, msg1);
+	e0 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+	msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+	/* rounds 8-11 */
+	msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 32)), mask);
+	SHA1DC_HW_STORE_W(2, msg2);
+	e0 = _mm_sha1nexte_epu32(e0, msg2);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+	msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+	msg0 = _mm_xor_si128(msg0, msg2);
+
+	/* rounds 12-79, four at a time */
+	msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 48)), mask);
+	SHA1DC_HW_ROUNDS(3, e1, e0, msg3, msg0, msg1, msg2);
+	SHA1DC_HW_ROUNDS(4, e0, e1, msg0, msg1, msg2, msg3);
+	SHA1DC_HW_ROUNDS(5, e1, e0, msg1, msg2, msg3, msg0);
+	SHA1DC_HW_ROUNDS(6, e0, e1, msg2, msg3, msg0, msg1);
+	SHA1DC_HW_ROUNDS(7, e1, e0, msg3, msg0, msg1, msg2);
+	SHA1DC_HW_ROUNDS(8, e0, e1, msg0, msg1, msg2, msg3);
+	SHA1DC_HW_ROUNDS(9, e1, e0, msg1, msg2, msg3, msg0);
+	SHA1DC_HW_ROUNDS(10, e0, e1, msg2, msg3, msg0, msg1);
+	SHA1DC_HW_ROUNDS(11, e1, e0, msg3, msg0, msg1, msg2);
+	SHA1DC_HW_ROUNDS(12, e0, e1, msg0, msg1, msg2, msg3);
+	SHA1DC_HW_ROUNDS(13, e1, e0, msg1, msg2, msg3, msg0);
+	SHA1DC_HW_ROUNDS(14, e0, e1, msg2, msg3, msg0, msg1);
+	SHA1DC_HW_ROUNDS(15, e1, e0, msg3, msg0, msg1, msg2);
+	SHA1DC_HW_ROUNDS(16, e0, e1, msg0, msg1, msg2, msg3);
+	SHA1DC_HW_ROUNDS(17, e1, e0, msg1, msg2, msg3, msg0);
+	SHA1DC_HW_ROUNDS(18, e0, e1, msg2, msg3, msg0, msg1);
+	SHA1DC_HW_ROUNDS(19, e1, e0, msg3, msg0, msg1, msg2);
+
+	e0 = _mm_sha1nexte_epu32(e0, e0_save);
+	abcd = _mm_add_epi32(abcd, abcd_save);
+
+	_mm_storeu_si128((__m128i *)ihv, _mm_shuffle_epi32(abcd, 0x1b));
+	ihv[4] = _mm_extract_epi32(e0, 3);
+}
+
+static void sha1dc_hw_update(SHA1_CTX *ctx, const char *data, size_t len)
+{
+	size_t left = ctx->total & 63;
+
+	if (left) {
+		size_t fill = 64 - left;
+
+		if (len < fill) {
+			SHA1DCUpdate(ctx, data, len);
+			return;
+		}
+		SHA1DCUpdate(ctx, data, fill);
+		data += fill;
+		len -= fill;
+	}
+
+	for (; len >= 64; data += 64, len -= 64) {
+		uint32_t ihv[5], W[80], dvmask[DVMASKSIZE];
+
+		memcpy(ihv, ctx->ihv, sizeof(ihv));
+		sha1dc_hw_compress(ctx->ihv, W, (const unsigned char *)data);
+		if (ctx->detect_coll) {
+			ubc_check(W, dvmask);
+			if (CHECK_DVMASK(dvmask)) {
+				/* let sha1dc redo this block the careful way */
+				memcpy(ctx->ihv, ihv, sizeof(ihv));
+				SHA1DCUpdate(ctx, data, 64);
+				continue;
+			}
+		}
+		ctx->total += 64;
+	}
+
+	if (len)
+		SHA1DCUpdate(ctx, data, len);
+}
+#endif
 
 #ifdef DC_SHA1_EXTERNAL
 /*
@@ -24,12 +192,29 @@ void git_SHA1DCFinal(unsigned char hash[20], SHA1_CTX *ctx)
 	    hash_to_hex_algop(hash, &hash_algos[GIT_HASH_SHA1]));
 }
 
+int git_SHA1DC_hw_supported(void)
+{
+#ifdef SHA1DC_HW
+	return sha1dc_hw_supported();
+#else
+	return 0;
+#endif
+}
+
 /*
  * Same as SHA1DCUpdate, but adjust types to match git's usual interface.
  */
 void git_SHA1DCUpdate(SHA1_CTX *ctx, const void *vdata, unsigned long len)
 {
 	const char *data = vdata;
+
+#ifdef SHA1DC_HW
+	if (sha1dc_hw_supported() && (ctx->ubc_check || !ctx->detect_coll)) {
+		sha1dc_hw_update(ctx, data, len);
+		return;
+	}
+#endif
+
 	/* We expect an unsigned long, but sha1dc only takes an int */
 	while (len > INT_MAX) {
 		SHA1DCUpdate(ctx, data, INT_MAX);
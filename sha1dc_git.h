@@ -17,6 +17,9 @@ void git_SHA1DCInit(SHA1_CTX *);
 void git_SHA1DCFinal(unsigned char [20], SHA1_CTX *);
 void git_SHA1DCUpdate(SHA1_CTX *ctx, const void *data, unsigned long len);
 
+/* Whether safe blocks are compressed with the CPU's SHA instructions. */
+int git_SHA1DC_hw_supported(void);
+
 #define platform_SHA_IS_SHA1DC /* used by "test-tool sha1-is-sha1dc" */
 
 #ifndef platform_SHA_CTX
@@ -1,5 +1,6 @@
 #include "git-compat-util.h"
 #include "./sha256.h"
+#include "parse.h"
 
 #undef RND
 #undef BLKSIZE
@@ -176,6 +177,315 @@ void blk_SHA256_Update(blk_SHA256_CTX *ctx, const void *data, size_t len)
 		memcpy(ctx->buf, data, len);
 }
 
+/*
+ * Multi-buffer hashing: independent messages are compressed side by
+ * side, one message per 32-bit SIMD lane, so that a batch of small
+ * objects costs about as much as a couple of them hashed one by one.
+ * When a message runs out of blocks, its lane is refilled with the
+ * next message of the batch.
+ */
+#define SHA256_MB_LANES 8
+
+/*
+ * With fewer messages than this left, the vector code does not pay for
+ * itself and the remaining blocks are compressed one at a time.
+ */
+#define SHA256_MB_MIN_LANES 3
+
+struct sha256_mb_lane {
+	blk_SHA256_CTX *ctx;
+	/* the completed ctx->buf, if any, to be compressed before "data" */
+	const unsigned char *first;
+	const unsigned char *data;
+	size_t nr_blocks;
+};
+
+static const unsigned char *sha256_mb_next_block(struct sha256_mb_lane *lane)
+{
+	const unsigned char *block;
+
+	if (lane->first) {
+		block = lane->first;
+		lane->first = NULL;
+	} else {
+		block = lane->data;
+		lane->data += blk_SHA256_BLKSIZE;
+	}
+	lane->nr_blocks--;
+	return block;
+}
+
+#if !defined(NO_SHA256_MULTI_BUFFER) && \
+	defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA256_MB_AVX2
+
+#include <immintrin.h>
+
+static int sha256_mb_supported(void)
+{
+	static int supported = -1;
+
+	if (supported < 0)
+		supported = git_env_bool("GIT_TEST_SHA256_MULTI_BUFFER", 1) &&
+			    __builtin_cpu_supports("avx2");
+	return supported;
+}
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define MB_ADD(a, b) _mm256_add_epi32(a, b)
+#define MB_XOR(a, b) _mm256_xor_si256(a, b)
+#define MB_ROR(x, n) \
+	_mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+/*
+ * Transpose eight rows of eight 32-bit words, so that row i of the
+ * result holds word i of every input row.
+ */
+__attribute__((target("avx2")))
+static inline void sha256_mb_transpose(__m256i r[8])
+{
+	__m256i t0, t1, t2, t3, t4, t5, t6, t7;
+	__m256i u0, u1, u2, u3, u4, u5, u6, u7;
+
+	t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+	t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+	t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+	t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+	t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+	t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+	t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+	t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+	u0 = _mm256_unpacklo_epi64(t0, t2);
+	u1 = _mm256_unpackhi_epi64(t0, t2);
+	u2 = _mm256_unpacklo_epi64(t1, t3);
+	u3 = _mm256_unpackhi_epi64(t1, t3);
+	u4 = _mm256_unpacklo_epi64(t4, t6);
+	u5 = _mm256_unpackhi_epi64(t4, t6);
+	u6 = _mm256_unpacklo_epi64(t5, t7);
+	u7 = _mm256_unpackhi_epi64(t5, t7);
+
+	r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+	r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+	r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+	r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+	r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+	r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+	r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+	r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+/*
+ * Compress one block in each of the eight lanes; state[i] and block[i]
+ * are the chaining value and the next 64 input bytes of lane i.
+ */
+__attribute__((target("avx2")))
+static void sha256_mb_transform(uint32_t *state[SHA256_MB_LANES],
+				const unsigned char *block[SHA256_MB_LANES])
+{
+	const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+					      4, 5, 6, 7, 0, 1, 2, 3,
+					      12, 13, 14, 15, 8, 9, 10, 11,
+					      4, 5, 6, 7, 0, 1, 2, 3);
+	__m256i S[8], H[8], W[64];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		S[i] = _mm256_loadu_si256((const __m256i *)state[i]);
+	sha256_mb_transpose(S);
+
+	for (i = 0; i < 8; i++)
+		W[i] = _mm256_loadu_si256((const __m256i *)block[i]);
+	sha256_mb_transpose(W);
+	for (i = 0; i < 8; i++)
+		W[i + 8] = _mm256_loadu_si256((const __m256i *)(block[i] + 32));
+	sha256_mb_transpose(W + 8);
+	for (i = 0; i < 16; i++)
+		W[i] = _mm256_shuffle_epi8(W[i], bswap);
+
+	for (i = 16; i < 64; i++) {
+		__m256i w2 = W[i - 2], w15 = W[i - 15];
+		__m256i g1 = MB_XOR(MB_XOR(MB_ROR(w2, 17), MB_ROR(w2, 19)),
+				    _mm256_srli_epi32(w2, 10));
+		__m256i g0 = MB_XOR(MB_XOR(MB_ROR(w15, 7), MB_ROR(w15, 18)),
+				    _mm256_srli_epi32(w15, 3));
+		W[i] = MB_ADD(MB_ADD(g1, W[i - 7]), MB_ADD(g0, W[i - 16]));
+	}
+
+	for (i = 0; i < 8; i++)
+		H[i] = S[i];
+
+	for (i = 0; i < 64; i++) {
+		__m256i a = H[0], b = H[1], c = H[2], e = H[4];
+		__m256i f = H[5], g = H[6];
+		__m256i s1 = MB_XOR(MB_XOR(MB_ROR(e, 6), MB_ROR(e, 11)),
+				    MB_ROR(e, 25));
+		__m256i ch = MB_XOR(g, _mm256_and_si256(e, MB_XOR(f, g)));
+		__m256i s0 = MB_XOR(MB_XOR(MB_ROR(a, 2), MB_ROR(a, 13)),
+				    MB_ROR(a, 22));
+		__m256i maj = _mm256_or_si256(
+			_mm256_and_si256(_mm256_or_si256(a, b), c),
+			_mm256_and_si256(a, b));
+		__m256i t0 = MB_ADD(MB_ADD(H[7], s1),
+				    MB_ADD(MB_ADD(ch, W[i]),
+					   _mm256_set1_epi32(sha256_k[i])));
+		__m256i t1 = MB_ADD(s0, maj);
+
+		H[7] = g;
+		H[6] = f;
+		H[5] = e;
+		H[4] = MB_ADD(H[3], t0);
+		H[3] = c;
+		H[2] = b;
+		H[1] = a;
+		H[0] = MB_ADD(t0, t1);
+	}
+
+	for (i = 0; i < 8; i++)
+		S[i] = MB_ADD(S[i], H[i]);
+	sha256_mb_transpose(S);
+	for (i = 0; i < 8; i++)
+		_mm256_storeu_si256((__m256i *)state[i], S[i]);
+}
+
+#undef MB_ADD
+#undef MB_XOR
+#undef MB_ROR
+
+/*
+ * Compress the blocks of all lanes, keeping as many SIMD lanes busy as
+ * there are messages with blocks left.
+ */
+static void sha256_mb_blocks(struct sha256_mb_lane *lanes, size_t nr)
+{
+	static const unsigned char scratch_block[blk_SHA256_BLKSIZE];
+	uint32_t scratch_state[SHA256_MB_LANES][8];
+	struct sha256_mb_lane *active[SHA256_MB_LANES] = { NULL };
+	uint32_t *state[SHA256_MB_LANES];
+	const unsigned char *block[SHA256_MB_LANES];
+	size_t next = 0;
+	int i;
+
+	for (;;) {
+		int nr_active = 0;
+
+		for (i = 0; i < SHA256_MB_LANES; i++) {
+			while (!active[i] && next < nr) {
+				if (lanes[next].nr_blocks)
+					active[i] = &lanes[next];
+				next++;
+			}
+			if (active[i])
+				nr_active++;
+		}
+		if (nr_active < SHA256_MB_MIN_LANES)
+			break;
+
+		for (i = 0; i < SHA256_MB_LANES; i++) {
+			if (active[i]) {
+				state[i] = active[i]->ctx->state;
+				block[i] = sha256_mb_next_block(active[i]);
+				if (!active[i]->nr_blocks)
+					active[i] = NULL;
+			} else {
+				state[i] = scratch_state[i];
+				block[i] = scratch_block;
+			}
+		}
+		sha256_mb_transform(state, block);
+	}
+}
+#endif /* SHA256_MB_AVX2 */
+
+void blk_SHA256_Update_Many(blk_SHA256_CTX **ctx, const void **data,
+			    const size_t *len, size_t nr)
+{
+	struct sha256_mb_lane lanes_stack[32], *lanes = lanes_stack;
+	size_t i;
+
+#ifdef SHA256_MB_AVX2
+	if (nr < SHA256_MB_MIN_LANES || !sha256_mb_supported())
+#endif
+	{
+		for (i = 0; i < nr; i++)
+			blk_SHA256_Update(ctx[i], data[i], len[i]);
+		return;
+	}
+
+	if (nr > ARRAY_SIZE(lanes_stack))
+		ALLOC_ARRAY(lanes, nr);
+
+	/*
+	 * A partially filled ctx->buf is topped up first; if that completes
+	 * it, it is the first block of the lane.  The remaining full blocks
+	 * are taken straight from the input.
+	 */
+	for (i = 0; i < nr; i++) {
+		struct sha256_mb_lane *lane = &lanes[i];
+		unsigned int len_buf = ctx[i]->size & 63;
+		size_t n = len[i];
+
+		ctx[i]->size += n;
+		lane->ctx = ctx[i];
+		lane->first = NULL;
+		lane->data = data[i];
+		lane->nr_blocks = 0;
+
+		if (len_buf) {
+			unsigned int left = 64 - len_buf;
+			if (n < left)
+				left = n;
+			memcpy(ctx[i]->buf + len_buf, lane->data, left);
+			lane->data += left;
+			n -= left;
+			if ((len_buf + left) & 63)
+				continue;
+			lane->first = ctx[i]->buf;
+			lane->nr_blocks++;
+		}
+		lane->nr_blocks += n / blk_SHA256_BLKSIZE;
+	}
+
+#ifdef SHA256_MB_AVX2
+	sha256_mb_blocks(lanes, nr);
+#endif
+
+	/*
+	 * Finish whatever the vector code left over, and only then buffer
+	 * the tails: ctx->buf may have been a lane's first block.
+	 */
+	for (i = 0; i < nr; i++) {
+		struct sha256_mb_lane *lane = &lanes[i];
+		const unsigned char *end = (const unsigned char *)data[i] + len[i];
+
+		while (lane->nr_blocks)
+			blk_SHA256_Transform(lane->ctx, sha256_mb_next_block(lane));
+		if (lane->data < end)
+			memcpy(ctx[i]->buf, lane->data, end - lane->data);
+	}
+
+	if (lanes != lanes_stack)
+		free(lanes);
+}
+
 void blk_SHA256_Final(unsigned char *digest, blk_SHA256_CTX *ctx)
 {
 	static const unsigned char pad[64] = { 0x80 };
@@ -16,9 +16,19 @@ void blk_SHA256_Init(blk_SHA256_CTX *ctx);
 void blk_SHA256_Update(blk_SHA256_CTX *ctx, const void *data, size_t len);
 void blk_SHA256_Final(unsigned char *digest, blk_SHA256_CTX *ctx);
 
+/*
+ * Feed len[i] bytes from data[i] into ctx[i], for each of the nr
+ * independent contexts; equivalent to calling blk_SHA256_Update() on
+ * each, but uses SIMD lanes to hash several messages at once where the
+ * CPU allows.
+ */
+void blk_SHA256_Update_Many(blk_SHA256_CTX **ctx, const void **data,
+			    const size_t *len, size_t nr);
+
 #define platform_SHA256_CTX blk_SHA256_CTX
 #define platform_SHA256_Init blk_SHA256_Init
 #define platform_SHA256_Update blk_SHA256_Update
 #define platform_SHA256_Final blk_SHA256_Final
+#define platform_SHA256_Update_Many blk_SHA256_Update_Many
 
 #endif
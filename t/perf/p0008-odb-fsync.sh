@@ -61,16 +61,22 @@ test_perf_fsync_cfgs "stash $total_files files" \
 	"setup_repo" \
 	"stash push -u -- files"
 
-test_perf_fsync_cfgs "unpack $total_files files" \
-	"
+setup_unpack="
 	setup_repo &&
 	git -c core.fsync=none add -- files &&
 	git -c core.fsync=none commit -q -m second &&
 	echo HEAD | git pack-objects -q --stdout --revs >test_pack.pack &&
 	setup_repo
-	" \
+	"
+
+test_perf_fsync_cfgs "unpack $total_files files" \
+	"$setup_unpack" \
 	"unpack-objects -q <test_pack.pack"
 
+test_perf_fsync_cfgs "unpack $total_files files with one thread" \
+	"$setup_unpack" \
+	"unpack-objects -q --threads=1 <test_pack.pack"
+
 test_perf_fsync_cfgs "commit $total_files files" \
 	"
 	setup_repo &&
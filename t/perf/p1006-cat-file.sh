@@ -9,4 +9,8 @@ test_perf 'cat-file --batch-check' '
 	git cat-file --batch-all-objects --batch-check
 '
 
+test_perf 'cat-file --batch' '
+	git cat-file --batch-all-objects --batch >/dev/null
+'
+
 test_done
@@ -14,7 +14,12 @@ test_expect_success "setup" '
 		printf "start\ncreate refs/heads/%d PRE\ncommit\n" $i &&
 		printf "start\nupdate refs/heads/%d POST PRE\ncommit\n" $i &&
 		printf "start\ndelete refs/heads/%d POST\ncommit\n" $i || return 1
-	done >instructions
+	done >instructions &&
+	for i in $(test_seq 1000)
+	do
+		echo "create refs/heads/many/$i PRE" >>create &&
+		echo "delete refs/heads/many/$i PRE" >>delete || return 1
+	done
 '
 
 test_perf "update-ref" '
@@ -30,4 +35,13 @@ test_perf "update-ref --stdin" '
 	git update-ref --stdin <instructions >/dev/null
 '
 
+for method in fsync batch
+do
+	test_perf "update-ref --stdin with many refs (core.fsyncMethod=$method)" "
+		GIT_TEST_FSYNC=true git -c core.fsync=reference \
+			-c core.fsyncMethod=$method update-ref --stdin <create &&
+		git update-ref --stdin <delete
+	"
+done
+
 test_done
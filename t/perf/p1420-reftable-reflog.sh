@@ -0,0 +1,41 @@
+#!/bin/sh
+
+test_description="Tests performance of reading reflogs from reftables"
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success "setup" '
+	git init --ref-format=reftable reftable &&
+	test_commit -C reftable PRE &&
+	test_commit -C reftable POST &&
+	git -C reftable update-ref refs/heads/branch PRE &&
+	for i in $(test_seq 2500)
+	do
+		printf "start\nupdate refs/heads/branch POST PRE\ncommit\n" &&
+		printf "start\nupdate refs/heads/branch PRE POST\ncommit\n" ||
+		return 1
+	done >instructions &&
+	git -C reftable update-ref --stdin <instructions >/dev/null &&
+	git -C reftable pack-refs &&
+
+	for i in $(test_seq 0 500)
+	do
+		echo "branch@{$i}" || return 1
+	done >revs
+'
+
+test_perf "reflog show" '
+	git -C reftable reflog show refs/heads/branch >/dev/null
+'
+
+for size in 0 1m
+do
+	test_perf "rev-parse many reflog entries (blockCacheSize=$size)" "
+		git -C reftable -c reftable.blockCacheSize=$size \
+			rev-parse \$(cat revs) >/dev/null
+	"
+done
+
+test_done
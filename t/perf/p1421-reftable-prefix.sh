@@ -0,0 +1,45 @@
+#!/bin/sh
+
+test_description="Tests performance of prefix iteration over reftable stacks"
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success "setup" '
+	git init --ref-format=reftable reftable &&
+	test_commit -C reftable A &&
+	for i in $(test_seq 50000)
+	do
+		echo "create refs/heads/branch-$i HEAD" || return 1
+	done >instructions &&
+	git -C reftable update-ref --stdin <instructions &&
+	git -C reftable pack-refs &&
+
+	for i in $(test_seq 29)
+	do
+		for j in $(test_seq 10)
+		do
+			echo "create refs/heads/feature/table-$i/$j HEAD" || return 1
+		done >instructions &&
+		git -C reftable -c reftable.autoCompaction=false \
+			update-ref --stdin <instructions || return 1
+	done &&
+	test_line_count = 30 reftable/.git/reftable/tables.list &&
+
+	for i in $(test_seq 29)
+	do
+		echo "refs/heads/feature/table-$i/" &&
+		echo "refs/tags/missing-$i/" || return 1
+	done >prefixes
+'
+
+test_perf "for-each-ref with a single prefix" "
+	git -C reftable for-each-ref refs/heads/feature/table-1/
+"
+
+test_perf "for-each-ref with many prefixes" "
+	git -C reftable for-each-ref \$(cat prefixes) >/dev/null
+"
+
+test_done
@@ -0,0 +1,44 @@
+#!/bin/sh
+
+test_description="Test matching against large .gitignore files"
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success 'setup large .gitignore and untracked files' '
+	for i in $(test_seq 1 2000)
+	do
+		echo "generated-$i.out" &&
+		echo "*.ext$i" &&
+		echo "/out/dir$i/" &&
+		echo "src/mod$i/*.tmp" || return $?
+	done >.gitignore &&
+	echo "!generated-7.out" >>.gitignore &&
+	git add .gitignore &&
+	git commit -q -m ignore &&
+	mkdir -p out src &&
+	for i in $(test_seq 1 100)
+	do
+		mkdir -p src/mod$i out/dir$i &&
+		>src/mod$i/a.tmp &&
+		>src/mod$i/b.c &&
+		>generated-$i.out &&
+		>file.ext$i || return $?
+	done
+'
+
+test_perf 'status --ignored' '
+	git status --porcelain --ignored >/dev/null
+'
+
+test_perf 'ls-files -o --exclude-standard' '
+	git ls-files -o --exclude-standard >/dev/null
+'
+
+test_perf 'check-ignore --stdin' '
+	git ls-files -o >paths &&
+	git check-ignore --stdin <paths >/dev/null
+'
+
+test_done
@@ -26,4 +26,24 @@ test_perf 'log -p -3000 --patience' '
 	git log -p -3000 --patience >/dev/null
 '
 
+test_expect_success 'setup large generated files' '
+	test_seq 1 200000 |
+	sed "s/.*/    \"package-&\": \"^1.&.0\",/" >generated.old &&
+	sed -e "s/1\.1234[0-9]\.0/2.0.0/" generated.old >generated.new
+'
+
+test_perf 'diff --no-index large generated file' '
+	test_expect_code 1 git diff --no-index generated.old generated.new >/dev/null
+'
+
+test_perf 'diff --no-index --ignore-cr-at-eol large generated file' '
+	test_expect_code 1 git diff --no-index --ignore-cr-at-eol \
+		generated.old generated.new >/dev/null
+'
+
+test_perf 'diff --no-index -w large generated file' '
+	test_expect_code 1 git diff --no-index -w \
+		generated.old generated.new >/dev/null
+'
+
 test_done
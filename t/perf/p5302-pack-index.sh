@@ -1,6 +1,11 @@
 #!/bin/sh
 
-test_description="Tests index-pack performance"
+test_description="Tests index-pack performance
+
+If GIT_PERF_5302_THREADS is set to a list of threads (e.g. '1 20 64 128'
+etc.) we will index the pack with those numbers of threads instead of
+the ones counting up to the number of CPUs.
+"
 
 . ./perf-lib.sh
 
@@ -17,13 +22,18 @@ test_expect_success 'repack' '
 # halving each time. That ensures that our final test uses as many threads as
 # CPUs, even if it isn't a power of 2.
 test_expect_success 'set up thread-counting tests' '
-	t=$(test-tool online-cpus) &&
-	threads= &&
-	while test $t -gt 0
-	do
-		threads="$t $threads" &&
-		t=$((t / 2)) || return 1
-	done
+	if test -n "$GIT_PERF_5302_THREADS"
+	then
+		threads=$GIT_PERF_5302_THREADS
+	else
+		t=$(test-tool online-cpus) &&
+		threads= &&
+		while test $t -gt 0
+		do
+			threads="$t $threads" &&
+			t=$((t / 2)) || return 1
+		done
+	fi
 '
 
 test_perf 'index-pack 0 threads' --prereq PERF_EXTRA \
@@ -0,0 +1,73 @@
+#!/bin/sh
+
+test_description="Tests performance of cloning from a list of bundles
+
+The history of HEAD is split into incremental bundles that are served
+from a local directory through file:// URIs, standing in for a bundle
+server, and advertised by a bundle list using the creationToken
+heuristic.
+
+If GIT_PERF_5558_BUNDLES is set, the history is split into that many
+bundles instead of 20. If GIT_PERF_5558_JOBS is set to a list of job
+counts (e.g. '1 4 8'), we clone with those values of fetch.bundleJobs
+instead of 1 and the number of CPUs.
+"
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+test_expect_success 'create bundles' '
+	nr=${GIT_PERF_5558_BUNDLES:-20} &&
+	mkdir server &&
+	git rev-list --first-parent --reverse HEAD >commits &&
+	total=$(wc -l <commits) &&
+	step=$(( (total + nr - 1) / nr )) &&
+
+	cat >server/bundle-list <<-EOF &&
+	[bundle]
+		version = 1
+		mode = all
+		heuristic = creationToken
+	EOF
+
+	i=0 &&
+	prev= &&
+	while test $(( i * step )) -lt $total
+	do
+		i=$((i + 1)) &&
+		n=$(( i * step )) &&
+		if test $n -gt $total
+		then
+			n=$total
+		fi &&
+		tip=$(sed -n "${n}p" commits) &&
+		git update-ref refs/heads/perf-bundle-tip $tip &&
+		git bundle create server/bundle-$i.bundle \
+			perf-bundle-tip ${prev:+^$prev} &&
+		cat >>server/bundle-list <<-EOF &&
+		[bundle "bundle-$i"]
+			uri = file://$(pwd)/server/bundle-$i.bundle
+			creationToken = $i
+		EOF
+		prev=$tip || return 1
+	done &&
+	git update-ref -d refs/heads/perf-bundle-tip
+'
+
+jobs=${GIT_PERF_5558_JOBS:-"1 $(test-tool online-cpus)"}
+
+for j in $jobs
+do
+	JOBS=$j
+	export JOBS
+	test_perf "clone from bundle list (fetch.bundleJobs=$j)" \
+		--setup 'rm -rf dst.git' '
+		git -c fetch.bundleJobs=$JOBS clone --bare --no-local \
+			--single-branch --no-tags \
+			--bundle-uri="file://$(pwd)/server/bundle-list" \
+			. dst.git
+	'
+done
+
+test_done
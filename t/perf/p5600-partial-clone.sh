@@ -23,6 +23,27 @@ test_perf 'checkout of result' '
 	git -C worktree checkout -f
 '
 
+test_expect_success 'pick a file to blame' '
+	git log -1 --format= --name-only --diff-filter=M --no-merges >files &&
+	head -n 1 files >blame-path
+'
+
+test_perf 'log -p with lazy fetches' \
+	--setup '
+		rm -rf log.git &&
+		git clone --bare --filter=blob:none "file://$(pwd)" log.git
+	' '
+	git -C log.git log -p -500 >/dev/null
+'
+
+test_perf 'blame with lazy fetches' \
+	--setup '
+		rm -rf blame.git &&
+		git clone --bare --filter=blob:none "file://$(pwd)" blame.git
+	' '
+	git -C blame.git blame -- "$(cat blame-path)" >/dev/null
+'
+
 test_perf 'fsck' '
 	git -C bare.git fsck
 '
@@ -664,4 +664,77 @@ test_expect_success 'user defined builtin_objectmode values are ignored' '
 	test_cmp expect err
 '
 
+test_expect_success 'paths sharing a basename get their own attributes' '
+	test_when_finished "rm -rf attr-cache" &&
+	git init attr-cache &&
+	(
+		cd attr-cache &&
+		cat >.gitattributes <<-\EOF &&
+		*.c test=c
+		/docs/*.c test=docs
+		Makefile test=make
+		EOF
+		mkdir -p a b docs sub/deep &&
+		echo "*.c -test" >sub/.gitattributes &&
+		cat >paths <<-\EOF &&
+		a/x.c
+		b/x.c
+		docs/x.c
+		sub/x.c
+		sub/deep/x.c
+		a/x.c
+		a/Makefile
+		b/Makefile
+		sub/deep/Makefile
+		x.c
+		EOF
+		cat >expect <<-\EOF &&
+		a/x.c: test: c
+		b/x.c: test: c
+		docs/x.c: test: docs
+		sub/x.c: test: unset
+		sub/deep/x.c: test: unset
+		a/x.c: test: c
+		a/Makefile: test: make
+		b/Makefile: test: make
+		sub/deep/Makefile: test: make
+		x.c: test: c
+		EOF
+		GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+			git check-attr --stdin test <paths >actual &&
+		test_cmp expect actual &&
+		# entering or leaving "sub" empties the cache
+		grep "\"category\":\"attr\",\"name\":\"cache-hits\",\"count\":3" trace.event &&
+		grep "\"category\":\"attr\",\"name\":\"cache-misses\",\"count\":7" trace.event
+	)
+'
+
+test_expect_success 'patterns that can match anywhere disable the cache' '
+	test_when_finished "rm -rf attr-cache" &&
+	git init attr-cache &&
+	(
+		cd attr-cache &&
+		cat >.gitattributes <<-\EOF &&
+		*.c test=c
+		**/gen/*.c test=gen
+		EOF
+		cat >paths <<-\EOF &&
+		a/x.c
+		b/x.c
+		a/gen/x.c
+		b/gen/x.c
+		EOF
+		cat >expect <<-\EOF &&
+		a/x.c: test: c
+		b/x.c: test: c
+		a/gen/x.c: test: gen
+		b/gen/x.c: test: gen
+		EOF
+		GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+			git check-attr --stdin test <paths >actual &&
+		test_cmp expect actual &&
+		test_grep ! "\"category\":\"attr\",\"name\":\"cache-hits\"" trace.event
+	)
+'
+
 test_done
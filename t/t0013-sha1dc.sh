@@ -6,6 +6,7 @@ test_description='test sha1 collision detection'
 TEST_DATA="$TEST_DIRECTORY/t0013"
 
 test_lazy_prereq SHA1_IS_SHA1DC 'test-tool sha1-is-sha1dc'
+test_lazy_prereq SHA1DC_HW 'test-tool sha1-dc-hw'
 
 if ! test_have_prereq SHA1_IS_SHA1DC
 then
@@ -19,4 +20,21 @@ test_expect_success 'test-sha1 detects shattered pdf' '
 	grep 38762cf7f55934b34d179ae6a4c80cadccbb7f0a err
 '
 
+test_expect_success 'test-sha1 detects shattered pdf without hardware SHA-1' '
+	test_must_fail env GIT_TEST_SHA1DC_HW=0 \
+		test-tool sha1 <"$TEST_DATA/shattered-1.pdf" 2>err &&
+	test_grep collision err &&
+	grep 38762cf7f55934b34d179ae6a4c80cadccbb7f0a err
+'
+
+test_expect_success SHA1DC_HW 'hardware and portable SHA-1 agree' '
+	for size in 0 1 55 56 63 64 65 127 128 1000 65536 1048577
+	do
+		test-tool genrandom "$size" "$size" >data &&
+		test-tool sha1 <data >hw &&
+		GIT_TEST_SHA1DC_HW=0 test-tool sha1 <data >portable &&
+		test_cmp portable hw || return 1
+	done
+'
+
 test_done
@@ -707,6 +707,98 @@ test_expect_success 'push should not fetch new commit objects' '
 	grep "^[?]$COMMIT" objects
 '
 
+test_expect_success 'blame fetches older versions of the file in batches' '
+	rm -rf server partial.git trace &&
+	test_create_repo server &&
+	test_config -C server uploadpack.allowfilter 1 &&
+	test_config -C server uploadpack.allowanysha1inwant 1 &&
+	for i in $(test_seq 1 40)
+	do
+		echo "line $i" >>server/file.txt &&
+		git -C server add file.txt &&
+		git -C server commit -q -m "commit $i" || return 1
+	done &&
+
+	git clone --filter=blob:none --bare "file://$(pwd)/server" partial.git &&
+
+	# One negotiation for the blamed version, then one for the
+	# versions of the next 32 commits, and one for the rest.
+	GIT_TRACE_PACKET="$(pwd)/trace" git -C partial.git blame file.txt >actual &&
+	grep "fetch> done" trace >done_lines &&
+	test_line_count = 3 done_lines &&
+	git -C server blame file.txt >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'setup for object-info tests' '
+	rm -rf server &&
+	test_create_repo server &&
+	for i in $(test_seq 1 5)
+	do
+		echo "content $i" >server/file$i.txt || return 1
+	done &&
+	git -C server add . &&
+	git -C server commit -q -m files &&
+	git -C server config uploadpack.allowfilter 1 &&
+	git -C server config uploadpack.allowanysha1inwant 1 &&
+	git -C server ls-tree --format="%(objectname)" HEAD >blobs &&
+	git -C server cat-file --batch-check="%(objectname) %(objecttype) %(objectsize) %(objectsize:disk)" \
+		<blobs >expect
+'
+
+test_expect_success 'cat-file --batch-check asks the promisor remote instead of fetching' '
+	test_config -C server transfer.advertiseObjectInfo true &&
+	rm -rf repo trace &&
+	git clone --no-checkout --filter=blob:none "file://$(pwd)/server" repo &&
+
+	GIT_TRACE_PACKET="$(pwd)/trace" git -C repo cat-file --buffer \
+		--batch-check="%(objectname) %(objecttype) %(objectsize) %(objectsize:disk)" \
+		<blobs >actual &&
+	test_cmp expect actual &&
+
+	# All objects were asked about in a single request ...
+	grep "git> command=object-info" trace >requests &&
+	test_line_count = 1 requests &&
+	! grep "fetch> done" trace &&
+
+	# ... and are still missing.
+	git -C repo rev-list --objects --missing=print HEAD >objects &&
+	grep "^?" objects >missing &&
+	test_line_count = 5 missing
+'
+
+test_expect_success 'cat-file --batch-command asks the promisor remote on flush' '
+	test_config -C server transfer.advertiseObjectInfo true &&
+	rm -rf repo trace &&
+	git clone --no-checkout --filter=blob:none "file://$(pwd)/server" repo &&
+
+	{
+		sed "s/^/info /" blobs &&
+		echo flush
+	} >cmds &&
+	GIT_TRACE_PACKET="$(pwd)/trace" git -C repo cat-file --buffer \
+		--batch-command="%(objectname) %(objecttype) %(objectsize) %(objectsize:disk)" \
+		<cmds >actual &&
+	test_cmp expect actual &&
+	grep "git> command=object-info" trace >requests &&
+	test_line_count = 1 requests &&
+	! grep "fetch> done" trace
+'
+
+test_expect_success 'cat-file --batch-check fetches without object-info' '
+	test_config -C server transfer.advertiseObjectInfo false &&
+	rm -rf repo trace &&
+	git clone --no-checkout --filter=blob:none "file://$(pwd)/server" repo &&
+
+	GIT_TRACE_PACKET="$(pwd)/trace" git -C repo cat-file --buffer \
+		--batch-check="%(objectname) %(objecttype) %(objectsize)" \
+		<blobs >actual &&
+	cut -d" " -f1-3 expect >expect.fetched &&
+	test_cmp expect.fetched actual &&
+	! grep "command=object-info" trace &&
+	grep "fetch> done" trace
+'
+
 test_expect_success 'setup for promisor.quiet tests' '
 	rm -rf server &&
 	test_create_repo server &&
@@ -499,4 +499,66 @@ test_expect_success 'symref transaction supports false symlink config' '
 	test_cmp expect actual
 '
 
+check_fsync_events () {
+	local trace="$1" &&
+	shift &&
+
+	cat >expect &&
+	sed -n \
+		-e '/^{"event":"counter",.*"category":"fsync",/ {
+			s/.*"category":"fsync",//;
+			s/}$//;
+			p;
+		}' \
+		<"$trace" >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'ref transaction: writes are synced' '
+	test_when_finished "rm -rf repo trace2.txt" &&
+	git init repo &&
+	test_commit -C repo initial &&
+	cat >input <<-EOF &&
+	create refs/heads/a HEAD
+	create refs/heads/b HEAD
+	create refs/heads/c HEAD
+	EOF
+
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" \
+	GIT_TEST_FSYNC=true \
+		git -C repo -c core.fsync=reference \
+		-c core.fsyncMethod=fsync update-ref --stdin <input &&
+	check_fsync_events trace2.txt <<-EOF
+	"name":"hardware-flush","count":3
+	EOF
+'
+
+test_expect_success 'ref transaction: writes are batched with core.fsyncMethod=batch' '
+	test_when_finished "rm -rf repo trace2.txt" &&
+	git init repo &&
+	test_commit -C repo initial &&
+	cat >input <<-EOF &&
+	create refs/heads/a HEAD
+	create refs/heads/b HEAD
+	create refs/heads/c HEAD
+	EOF
+
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" \
+	GIT_TEST_FSYNC=true \
+		git -C repo -c core.fsync=reference \
+		-c core.fsyncMethod=batch update-ref --stdin <input &&
+	check_fsync_events trace2.txt <<-EOF &&
+	"name":"writeout-only","count":3
+	"name":"hardware-flush","count":1
+	EOF
+	git -C repo rev-parse HEAD >expect &&
+	for ref in a b c
+	do
+		git -C repo rev-parse refs/heads/$ref >actual &&
+		test_cmp expect actual || return 1
+	done &&
+	find repo/.git -name "bulk_fsync_*" >leftover &&
+	test_must_be_empty leftover
+'
+
 test_done
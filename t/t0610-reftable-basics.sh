@@ -361,6 +361,91 @@ test_expect_success 'ref transaction: alternating table sizes are compacted' '
 	test_line_count = 2 repo/.git/reftable/tables.list
 '
 
+test_expect_success 'ref transaction: config disables compaction' '
+	test_when_finished "rm -rf repo" &&
+
+	git init repo &&
+	test_commit -C repo A &&
+	git -C repo config reftable.autoCompaction false &&
+
+	start=$(wc -l <repo/.git/reftable/tables.list) &&
+	for i in $(test_seq 5)
+	do
+		git -C repo update-ref branch-$i HEAD || return 1
+	done &&
+	test_line_count = $((start + 5)) repo/.git/reftable/tables.list
+'
+
+test_expect_success 'ref transaction: config re-enables compaction' '
+	test_when_finished "rm -rf repo" &&
+
+	git init repo &&
+	test_commit -C repo A &&
+	git -C repo config reftable.autoCompaction false &&
+
+	start=$(wc -l <repo/.git/reftable/tables.list) &&
+	for i in $(test_seq 5)
+	do
+		git -C repo -c reftable.autoCompaction=true \
+			update-ref branch-$i HEAD || return 1
+	done &&
+	test_line_count -lt $((start + 5)) repo/.git/reftable/tables.list
+'
+
+test_expect_success 'ref transaction: background compaction' '
+	test_when_finished "rm -rf repo trace2.txt" &&
+
+	git init repo &&
+	test_commit -C repo A &&
+	git -C repo config reftable.autoCompaction background &&
+	git -C repo config maintenance.autoDetach false &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" \
+		git -C repo update-ref refs/heads/branch HEAD &&
+	test_subcommand git maintenance run --auto --quiet --task=pack-refs \
+		--no-detach <trace2.txt &&
+	test_line_count = 1 repo/.git/reftable/tables.list &&
+
+	for i in $(test_seq 5)
+	do
+		git -C repo update-ref branch-$i HEAD || return 1
+	done &&
+	test_line_count = 1 repo/.git/reftable/tables.list
+'
+
+test_expect_success 'ref transaction: background compaction skips locked tables' '
+	test_when_finished "rm -rf repo trace2.txt" &&
+
+	git init repo &&
+	test_commit -C repo A &&
+	git -C repo config reftable.autoCompaction background &&
+	git -C repo config maintenance.autoDetach false &&
+
+	start=$(wc -l <repo/.git/reftable/tables.list) &&
+	GIT_TEST_REFTABLE_AUTOCOMPACTION=false \
+		git -C repo update-ref refs/heads/first HEAD &&
+	test_line_count = $((start + 1)) repo/.git/reftable/tables.list &&
+
+	# Pretend that a concurrent process is compacting the stack.
+	first=$(head -n 1 repo/.git/reftable/tables.list) &&
+	>repo/.git/reftable/$first.lock &&
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" \
+		git -C repo update-ref refs/heads/second HEAD &&
+	test_subcommand ! git maintenance run --auto --quiet --task=pack-refs \
+		--no-detach <trace2.txt &&
+	test_line_count = $((start + 2)) repo/.git/reftable/tables.list
+'
+
+test_expect_success 'ref transaction: invalid auto-compaction mode' '
+	test_when_finished "rm -rf repo" &&
+
+	git init repo &&
+	test_commit -C repo A &&
+	test_must_fail git -C repo -c reftable.autoCompaction=bogus \
+		update-ref refs/heads/branch HEAD 2>err &&
+	test_grep "unknown value for config ${SQ}reftable.autocompaction${SQ}: bogus" err
+'
+
 check_fsync_events () {
 	local trace="$1" &&
 	shift &&
@@ -0,0 +1,105 @@
+#!/bin/sh
+
+test_description='persistent cache of loose refs'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+if test_have_prereq !REFFILES
+then
+	skip_all='skipping files-backend specific loose refs cache tests'
+	test_done
+fi
+
+# Move the modification time of all ref directories into the past so that
+# they are not considered to be racily clean. Callers must pass decreasing
+# offsets so that directories never end up with a modification time they
+# have already had before.
+backdate_ref_dirs () {
+	find .git/refs -type d >dirs &&
+	test-tool chmtime =-$1 $(cat dirs)
+}
+
+test_expect_success 'setup' '
+	test_commit A &&
+	test_commit B &&
+	git config core.looseRefsCache true &&
+	git branch nested/branch A &&
+	git update-ref refs/tags/target A &&
+	git symbolic-ref refs/heads/sym refs/tags/target &&
+	backdate_ref_dirs 100
+'
+
+test_expect_success 'iterating refs writes the cache' '
+	git for-each-ref >expect &&
+	test_path_is_file .git/loose-refs-cache &&
+	head -n 1 .git/loose-refs-cache >header &&
+	echo "# loose-refs-cache v1 $(test_oid algo)" >expect-header &&
+	test_cmp expect-header header &&
+	grep "^refs/heads/nested/branch $(git rev-parse A)\$" .git/loose-refs-cache &&
+	grep "^refs/heads/sym ?\$" .git/loose-refs-cache &&
+	git for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'cache is trusted while directories are unchanged' '
+	test_when_finished "rm -f .git/loose-refs-cache" &&
+	sed "s,^refs/heads/nested/branch .*,refs/heads/nested/branch $(git rev-parse B)," \
+		.git/loose-refs-cache >cache &&
+	mv cache .git/loose-refs-cache &&
+	git for-each-ref --format="%(objectname)" refs/heads/nested/ >actual &&
+	git rev-parse B >expect &&
+	test_cmp expect actual &&
+
+	git -c core.looseRefsCache=false for-each-ref \
+		--format="%(objectname)" refs/heads/nested/ >actual &&
+	git rev-parse A >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'updated refs are picked up' '
+	git for-each-ref >/dev/null &&
+	git update-ref refs/heads/nested/branch B &&
+	git for-each-ref --format="%(objectname)" refs/heads/nested/ >actual &&
+	git rev-parse B >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'created and deleted refs are picked up' '
+	backdate_ref_dirs 90 &&
+	git for-each-ref >/dev/null &&
+	git branch new/branch A &&
+	git branch -D nested/branch &&
+	git for-each-ref --format="%(refname)" refs/heads/ >actual &&
+	cat >expect <<-EOF &&
+	refs/heads/main
+	refs/heads/new/branch
+	refs/heads/sym
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'symbolic refs are resolved on every read' '
+	backdate_ref_dirs 80 &&
+	git for-each-ref >/dev/null &&
+	git update-ref refs/tags/target B &&
+	git for-each-ref --format="%(objectname)" refs/heads/sym >actual &&
+	git rev-parse B >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'corrupt cache is ignored' '
+	git for-each-ref >expect &&
+	sed "s/ [0-9a-f]*\$/ garbage/" .git/loose-refs-cache >cache &&
+	mv cache .git/loose-refs-cache &&
+	git for-each-ref >actual &&
+	test_cmp expect actual &&
+
+	echo "# unknown header" >.git/loose-refs-cache &&
+	git for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_done
@@ -133,4 +133,108 @@ test_expect_success 'index version config precedence' '
 	test_index_version 0 true 2 2
 '
 
+test_expect_success 'setup repository with index lookup table' '
+	git init lookup &&
+	(
+		cd lookup &&
+		mkdir dir &&
+		for i in $(test_seq 1 100)
+		do
+			echo $i >dir/file$i || return 1
+		done &&
+		echo new >intent &&
+		git add dir &&
+		git add -N intent &&
+		git config index.recordLookupTable true
+	)
+'
+
+for version in 2 3 4
+do
+	test_expect_success "rev-parse :path uses the lookup table (v$version)" '
+		(
+			cd lookup &&
+			git update-index --index-version $version &&
+			for path in dir/file1 dir/file50 dir/file99 intent
+			do
+				git ls-files -s $path >entry &&
+				cut -d" " -f2 entry >expect &&
+				rm -f trace.txt &&
+				GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+					git rev-parse :$path >actual &&
+				test_cmp expect actual &&
+				grep "\"key\":\"lookup/decoded\"" trace.txt &&
+				test_region ! index do_read_index trace.txt ||
+				return 1
+			done
+		)
+	'
+done
+
+test_expect_success 'missing path falls back to reading the index' '
+	(
+		cd lookup &&
+		rm -f trace.txt &&
+		test_must_fail env GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+			git rev-parse :dir/file0 2>err &&
+		test_grep "neither on disk nor in the index" err &&
+		test_region index do_read_index trace.txt
+	)
+'
+
+test_expect_success 'lookup table respects stages' '
+	(
+		cd lookup &&
+		blob1=$(echo one | git hash-object -w --stdin) &&
+		blob2=$(echo two | git hash-object -w --stdin) &&
+		git update-index --index-info <<-EOF &&
+		0 $ZERO_OID	dir/file2
+		100644 $blob1 1	dir/file2
+		100644 $blob2 2	dir/file2
+		EOF
+		echo $blob2 >expect &&
+		git rev-parse :2:dir/file2 >actual &&
+		test_cmp expect actual &&
+		test_must_fail git rev-parse :dir/file2
+	)
+'
+
+# Rewrite the lookup table in .git/index with the Perl code in $1, which
+# sees the extension size in $size and the table in $table. The index is
+# written without a checksum, so that reading it in full still works.
+corrupt_lookup_table () {
+	perl -e '
+		my $rawsz = shift;
+		local $/;
+		open(my $fh, "+<", ".git/index") or die;
+		binmode $fh;
+		my $index = <$fh>;
+		my $pos = index($index, "IPLT") or die;
+		my $size = unpack("N", substr($index, $pos + 4, 4));
+		my $table = substr($index, $pos + 8, $size);
+		my $limit = length($index) - $rawsz;
+		eval shift; die $@ if $@;
+		substr($index, $pos + 4, 4) = pack("N", $size);
+		substr($index, $pos + 8, length($table)) = $table;
+		seek($fh, 0, 0);
+		print $fh $index;
+	' "$(test_oid rawsz)" "$1"
+}
+
+for corruption in \
+	'$size = 0x7fffffff' \
+	'substr($table, 8) = pack("N", $limit - 1) x ((length($table) - 8) / 4)'
+do
+	test_expect_success "corrupt lookup table is ignored: $corruption" '
+		(
+			cd lookup &&
+			git -c index.skipHash=true update-index --index-version 2 &&
+			corrupt_lookup_table "$corruption" &&
+			git rev-parse :dir/file50 >actual &&
+			git hash-object dir/file50 >expect &&
+			test_cmp expect actual
+		)
+	'
+done
+
 test_done
@@ -0,0 +1,92 @@
+#!/bin/sh
+
+test_description='unpack_trees() with tree prefetching worker threads'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	for d in $(test_seq 1 8)
+	do
+		for s in $(test_seq 1 4)
+		do
+			mkdir -p dir$d/sub$s &&
+			echo base >dir$d/sub$s/file || return 1
+		done
+	done &&
+	echo base >top &&
+	git add . &&
+	git commit -m base &&
+	git tag base &&
+
+	git checkout -b one &&
+	for d in 1 3 5 7
+	do
+		echo one >dir$d/sub2/file &&
+		mkdir dir$d/sub2/new &&
+		echo one >dir$d/sub2/new/file || return 1
+	done &&
+	git add . &&
+	git commit -m one &&
+
+	git checkout -b two base &&
+	for d in 2 3 6
+	do
+		echo two >dir$d/sub4/file || return 1
+	done &&
+	git rm -r -q dir8 &&
+	git commit -a -m two
+'
+
+test_expect_success 'branch switch with tree workers' '
+	git checkout -f two &&
+	rm -f trace.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" GIT_TEST_CHECKOUT_TREE_WORKERS=4 \
+		git checkout one &&
+	git ls-files -s >actual &&
+	git ls-tree -r --format="%(objectmode) %(objectname) 0	%(path)" one >expect &&
+	test_cmp expect actual &&
+	git diff --exit-code one &&
+	grep "\"key\":\"prefetch/trees_read\"" trace.txt &&
+	grep "\"key\":\"prefetch/trees_used\"" trace.txt
+'
+
+test_expect_success 'three-way merge with tree workers' '
+	git checkout -f one &&
+	git read-tree -m base one two &&
+	git ls-files -s >expect &&
+	git reset -q --hard one &&
+	GIT_TEST_CHECKOUT_TREE_WORKERS=4 git read-tree -m base one two &&
+	git ls-files -s >actual &&
+	test_cmp expect actual &&
+	git reset -q --hard one
+'
+
+test_expect_success 'one-way merge only reads trees that differ from the cache-tree' '
+	git checkout -f one &&
+	git write-tree &&
+	rm -f trace.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" GIT_TEST_CHECKOUT_TREE_WORKERS=4 \
+		git reset -q --hard one &&
+	test_grep ! "\"key\":\"prefetch/trees_read\"" trace.txt &&
+
+	rm -f trace.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" GIT_TEST_CHECKOUT_TREE_WORKERS=4 \
+		git reset -q --hard two &&
+	test_grep "\"key\":\"prefetch/trees_read\"" trace.txt &&
+	git diff --exit-code two &&
+	git reset -q --hard one
+'
+
+test_expect_success 'sparse index with tree workers' '
+	git clone --no-checkout . sparse &&
+	git -C sparse sparse-checkout set --sparse-index dir1 dir3 &&
+	git -C sparse checkout -q origin/two &&
+	GIT_TEST_CHECKOUT_TREE_WORKERS=4 git -C sparse checkout -q origin/one &&
+	git -C sparse ls-files --sparse -s >actual &&
+	git -C sparse checkout -q origin/two &&
+	GIT_TEST_CHECKOUT_TREE_WORKERS=1 git -C sparse checkout -q origin/one &&
+	git -C sparse ls-files --sparse -s >expect &&
+	test_cmp expect actual
+'
+
+test_done
@@ -303,4 +303,40 @@ test_expect_success 'ls-files with "**" patterns and no slashes' '
 	test_must_be_empty actual
 '
 
+test_expect_success 'long exclude lists match like short ones' '
+	git init long-list &&
+	(
+		cd long-list &&
+		test_seq 1 40 | sed "s/^/filler-/" >.gitignore &&
+		cat >>.gitignore <<-\EOF &&
+		*.log
+		!keep.log
+		build/
+		/docs/*.html
+		!docs/api/index.html
+		Makefile.*
+		EOF
+		mkdir -p sub &&
+		test_seq 1 40 | sed "s/^/sub-filler-/" >sub/.gitignore &&
+		echo "/local/" >>sub/.gitignore &&
+		mkdir -p build docs/api sub/local sub/x/local &&
+		cat >expect <<-\EOF &&
+		.gitignore:41:*.log	a.log
+		.gitignore:42:!keep.log	keep.log
+		.gitignore:41:*.log	sub/deep/b.log
+		.gitignore:43:build/	build
+		.gitignore:44:/docs/*.html	docs/x.html
+		.gitignore:45:!docs/api/index.html	docs/api/index.html
+		.gitignore:46:Makefile.*	Makefile.in
+		.gitignore:20:filler-20	sub/filler-20
+		sub/.gitignore:41:/local/	sub/local
+		EOF
+		git check-ignore -v a.log keep.log sub/deep/b.log build \
+			docs/x.html docs/api/index.html docs/api/y.html \
+			Makefile.in Makefile sub/filler-20 sub/local \
+			sub/x/local >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_done
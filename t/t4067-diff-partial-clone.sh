@@ -180,4 +180,41 @@ test_expect_success 'diff --break-rewrites fetches only if necessary, and batche
 	test_line_count = 1 done_lines
 '
 
+test_expect_success 'log -p fetches blobs of upcoming commits in batches' '
+	test_when_finished "rm -rf server client trace" &&
+
+	test_create_repo server &&
+	test_commit_bulk -C server 40 &&
+
+	test_config -C server uploadpack.allowfilter 1 &&
+	test_config -C server uploadpack.allowanysha1inwant 1 &&
+	git clone --bare --filter=blob:none "file://$(pwd)/server" client &&
+
+	# Instead of one negotiation per commit, expect one for the first
+	# 32 commits and one for the rest.
+	GIT_TRACE_PACKET="$(pwd)/trace" git -C client log -p >actual &&
+	grep "fetch> done" trace >done_lines &&
+	test_line_count = 2 done_lines &&
+	git -C server log -p >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'log -p does not fetch beyond --max-count' '
+	test_when_finished "rm -rf server client trace" &&
+
+	test_create_repo server &&
+	test_commit_bulk -C server 40 &&
+
+	test_config -C server uploadpack.allowfilter 1 &&
+	test_config -C server uploadpack.allowanysha1inwant 1 &&
+	git clone --bare --filter=blob:none "file://$(pwd)/server" client &&
+
+	git -C client log -p -3 >actual &&
+	git -C server log -p -3 >expect &&
+	test_cmp expect actual &&
+	git -C client rev-list --objects --missing=print HEAD >objects &&
+	grep "^?" objects >missing &&
+	test_line_count = 37 missing
+'
+
 test_done
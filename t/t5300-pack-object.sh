@@ -160,6 +160,19 @@ test_expect_success 'negative window clamps to 0' '
 	check_deltas stderr = 0
 '
 
+test_expect_success 'checksum thread writes the same pack and index' '
+	inline=$(GIT_TEST_CHECKSUM_THREAD=0 \
+		 git pack-objects --window=0 inline <obj-list) &&
+	thread=$(GIT_TEST_CHECKSUM_THREAD=1 \
+		 git pack-objects --window=0 thread <obj-list) &&
+	test "$inline" = "$thread" &&
+	test_cmp_bin inline-$inline.pack thread-$thread.pack &&
+	test_cmp_bin inline-$inline.idx thread-$thread.idx &&
+	GIT_TEST_CHECKSUM_THREAD=1 \
+		git index-pack -o thread-reindexed.idx thread-$thread.pack &&
+	test_cmp_bin inline-$inline.idx thread-reindexed.idx
+'
+
 test_expect_success 'pack-objects with bogus arguments' '
 	test_must_fail git pack-objects --window=0 test-1 blah blah <obj-list
 '
@@ -215,6 +228,30 @@ test_expect_success 'unpack with OFS_DELTA (core.fsyncmethod=batch)' '
 	check_unpack test-3-${packname_3} obj-list "$BATCH_CONFIGURATION"
 '
 
+for threads in 1 4
+do
+	test_expect_success "unpack with OFS_DELTA (pack.threads=$threads)" '
+		check_unpack test-3-${packname_3} obj-list "-c pack.threads=$threads"
+	'
+
+	test_expect_success "unpack with REF_DELTA (pack.threads=$threads)" '
+		check_unpack test-2-${packname_2} obj-list "-c pack.threads=$threads"
+	'
+
+	test_expect_success "unpack with OFS_DELTA (pack.threads=$threads, core.fsyncmethod=batch)" '
+		check_unpack test-3-${packname_3} obj-list \
+			"$BATCH_CONFIGURATION -c pack.threads=$threads"
+	'
+done
+
+test_expect_success 'unpack with --strict and threads' '
+	test_when_finished "rm -rf git2" &&
+	git init --bare git2 &&
+	git -C git2 unpack-objects --strict --threads=4 <test-3-${packname_3}.pack &&
+	git -C git2 cat-file --batch-check="%(objectname)" <obj-list >current &&
+	test_cmp obj-list current
+'
+
 test_expect_success 'compare delta flavors' '
 	perl -e '\''
 		defined($_ = -s $_) or die for @ARGV;
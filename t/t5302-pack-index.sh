@@ -285,6 +285,16 @@ test_expect_success 'index-pack -v --stdin produces progress for both phases' '
 	test_grep "Resolving deltas" err
 '
 
+test_expect_success 'index-pack --stdin can resolve deltas while receiving' '
+	pack=$(git pack-objects --delta-base-offset test-3 <obj-list) &&
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" \
+	GIT_TEST_INDEX_PACK_EARLY_DELTAS=1 \
+		git index-pack --stdin early.pack <test-3-$pack.pack &&
+	grep "\"key\":\"early-deltas\",\"value\":\"[1-9]" trace2.txt &&
+	cmp test-3-$pack.idx early.idx &&
+	git verify-pack early.pack
+'
+
 test_expect_success 'too-large packs report the breach' '
 	pack=$(git pack-objects --all pack </dev/null) &&
 	sz="$(test_file_size pack-$pack.pack)" &&
@@ -0,0 +1,83 @@
+#!/bin/sh
+
+test_description='connectivity checks using reachability bitmaps'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+# Print the result of the bitmap connectivity check recorded in the
+# trace2 event log "$1", if any.
+bitmap_check_result () {
+	sed -n -e 's/.*"key":"bitmap-check\/result","value":"\([a-z]*\)".*/\1/p' "$1"
+}
+
+test_expect_success 'setup' '
+	test_commit_bulk --id=base 20 &&
+	git clone --bare . server.git &&
+	git -C server.git repack -adb
+'
+
+test_expect_success 'push is checked with bitmaps' '
+	test_commit one &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git push server.git main &&
+	echo connected >expect &&
+	bitmap_check_result trace.txt >actual &&
+	test_cmp expect actual &&
+	grep "\"key\":\"bitmap-check/commits\",\"value\":\"1\"" trace.txt &&
+	git -C server.git rev-parse main >actual &&
+	git rev-parse main >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'push is checked with multi-pack bitmaps' '
+	git -C server.git repack -adb --write-midx &&
+	test_commit two &&
+	rm -f trace.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git push server.git main &&
+	echo connected >expect &&
+	bitmap_check_result trace.txt >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'bitmap check can be disabled' '
+	test_config -C server.git transfer.bitmapConnectivityCheck false &&
+	test_commit three &&
+	rm -f trace.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git push server.git main &&
+	bitmap_check_result trace.txt >actual &&
+	test_must_be_empty actual &&
+	test_grep ! "bitmap-check" trace.txt
+'
+
+test_expect_success 'missing objects fall back to rev-list' '
+	git clone --bare server.git client.git &&
+	git -C client.git repack -adb &&
+
+	echo content >file &&
+	blob=$(git -C server.git hash-object -w --stdin <file) &&
+	tree=$(printf "100644 blob $blob\tfile\n" | git -C server.git mktree) &&
+	commit=$(git -C server.git commit-tree -p main -m missing $tree) &&
+	git -C server.git update-ref refs/heads/missing $commit &&
+
+	# Copy over the commit and its tree, but not the blob.
+	for oid in $commit $tree
+	do
+		type=$(git -C server.git cat-file -t $oid) &&
+		git -C server.git cat-file $type $oid >object &&
+		git -C client.git hash-object -w -t $type --stdin <object ||
+		return 1
+	done &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git -C client.git fetch ../server.git missing:refs/heads/missing &&
+	bitmap_check_result trace.txt >actual &&
+	grep fallback actual &&
+	git -C client.git cat-file -e $blob
+'
+
+test_done
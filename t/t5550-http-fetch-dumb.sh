@@ -530,4 +530,27 @@ test_expect_success 'dumb http can fetch index v1' '
 	git -C idx-v1 fsck
 '
 
+test_expect_success 'dumb http fetches loose commits, trees and blobs' '
+	git init loose &&
+	mkdir loose/dir0 loose/dir1 loose/dir2 &&
+	for i in $(test_seq 10)
+	do
+		test_commit -C loose file$i dir$((i % 3))/file$i || return 1
+	done &&
+	git clone --bare loose "$HTTPD_DOCUMENT_ROOT_PATH/loose.git" &&
+	git -C "$HTTPD_DOCUMENT_ROOT_PATH/loose.git" update-server-info &&
+	git -C loose rev-list --objects --all >expect &&
+
+	git clone --bare "$HTTPD_URL/dumb/loose.git" loose-clone.git &&
+	git -C loose-clone.git fsck --full &&
+	git -C loose-clone.git rev-list --objects --all >actual &&
+	test_cmp expect actual &&
+
+	git -c http.maxRequests=1 clone --bare \
+		"$HTTPD_URL/dumb/loose.git" loose-serial.git &&
+	git -C loose-serial.git fsck --full &&
+	git -C loose-serial.git rev-list --objects --all >actual &&
+	test_cmp expect actual
+'
+
 test_done
@@ -438,6 +438,166 @@ test_expect_success 'negotiation: bundle list with all wanted commits' '
 	test_grep ! "clone> want " trace-packet.txt
 '
 
+test_expect_success 'clone bundle list (file, no heuristic, parallel)' '
+	test_when_finished "rm -f trace*.txt" &&
+	cat >bundle-list <<-EOF &&
+	[bundle]
+		version = 1
+		mode = all
+
+	[bundle "bundle-1"]
+		uri = file://$(pwd)/clone-from/bundle-1.bundle
+
+	[bundle "bundle-2"]
+		uri = file://$(pwd)/clone-from/bundle-2.bundle
+
+	[bundle "bundle-3"]
+		uri = file://$(pwd)/clone-from/bundle-3.bundle
+
+	[bundle "bundle-4"]
+		uri = file://$(pwd)/clone-from/bundle-4.bundle
+	EOF
+
+	GIT_TRACE2_EVENT="$(pwd)/trace-clone.txt" \
+	git -c fetch.bundleJobs=4 clone --bundle-uri="file://$(pwd)/bundle-list" \
+		clone-from clone-list-parallel 2>err &&
+	! grep "Repository lacks these prerequisite commits" err &&
+	test_region bundle-uri unbundle trace-clone.txt &&
+
+	git -C clone-from for-each-ref --format="%(objectname)" >oids &&
+	git -C clone-list-parallel cat-file --batch-check <oids &&
+
+	git -C clone-list-parallel for-each-ref --format="%(refname)" >refs &&
+	grep "refs/bundles/" refs >actual &&
+	cat >expect <<-\EOF &&
+	refs/bundles/base
+	refs/bundles/left
+	refs/bundles/merge
+	refs/bundles/right
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'clone bundle list (file, creationToken, parallel)' '
+	test_when_finished "rm -f trace*.txt" &&
+	cat >bundle-list <<-EOF &&
+	[bundle]
+		version = 1
+		mode = all
+		heuristic = creationToken
+
+	[bundle "bundle-1"]
+		uri = file://$(pwd)/clone-from/bundle-1.bundle
+		creationToken = 1
+
+	[bundle "bundle-2"]
+		uri = file://$(pwd)/clone-from/bundle-2.bundle
+		creationToken = 2
+
+	[bundle "bundle-3"]
+		uri = file://$(pwd)/clone-from/bundle-3.bundle
+		creationToken = 3
+
+	[bundle "bundle-4"]
+		uri = file://$(pwd)/clone-from/bundle-4.bundle
+		creationToken = 4
+	EOF
+
+	GIT_TRACE2_EVENT="$(pwd)/trace-clone.txt" \
+	git -c fetch.bundleJobs=4 clone --bundle-uri="file://$(pwd)/bundle-list" \
+		clone-from clone-token-parallel 2>err &&
+	! grep "warning" err &&
+	test_region bundle-uri unbundle trace-clone.txt &&
+	grep "\"event\":\"child_start\".*\"index-pack\"" trace-clone.txt >index-packs &&
+	test_line_count = 4 index-packs &&
+
+	git -C clone-token-parallel for-each-ref --format="%(refname) %(objectname)" \
+		"refs/bundles/*" >actual &&
+	git -C clone-from for-each-ref --format="%(refname) %(objectname)" \
+		refs/heads/base refs/heads/left refs/heads/merge refs/heads/right |
+		sed "s,refs/heads/,refs/bundles/," >expect &&
+	test_cmp expect actual &&
+	echo 4 >expect &&
+	git -C clone-token-parallel config fetch.bundleCreationToken >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'clone incomplete bundle list (file, creationToken, parallel)' '
+	cat >bundle-list <<-EOF &&
+	[bundle]
+		version = 1
+		mode = all
+		heuristic = creationToken
+
+	[bundle "bundle-1"]
+		uri = file://$(pwd)/clone-from/bundle-1.bundle
+		creationToken = 1
+
+	[bundle "bundle-2"]
+		uri = file://$(pwd)/clone-from/bundle-2.bundle
+		creationToken = 2
+
+	# No bundle-3 means bundle-4 will not apply.
+	[bundle "bundle-3"]
+		uri = file://$(pwd)/clone-from/bundle-0.bundle
+		creationToken = 3
+
+	[bundle "bundle-4"]
+		uri = file://$(pwd)/clone-from/bundle-4.bundle
+		creationToken = 4
+	EOF
+
+	git -c fetch.bundleJobs=4 clone --bundle-uri="file://$(pwd)/bundle-list" \
+		clone-from clone-token-parallel-fail 2>err &&
+	grep "warning: failed to download bundle from URI .*bundle-0.bundle" err &&
+
+	git -C clone-token-parallel-fail for-each-ref --format="%(refname)" \
+		"refs/bundles/*" >actual &&
+	cat >expect <<-\EOF &&
+	refs/bundles/base
+	refs/bundles/left
+	EOF
+	test_cmp expect actual &&
+	test_must_fail git -C clone-token-parallel-fail \
+		config fetch.bundleCreationToken
+'
+
+test_expect_success 'clone bundle list with a non-bundle (file, creationToken)' '
+	echo bogus >not-a-bundle &&
+	cat >bundle-list <<-EOF &&
+	[bundle]
+		version = 1
+		mode = all
+		heuristic = creationToken
+
+	[bundle "bundle-1"]
+		uri = file://$(pwd)/clone-from/bundle-1.bundle
+		creationToken = 1
+
+	[bundle "bundle-2"]
+		uri = file://$(pwd)/clone-from/bundle-2.bundle
+		creationToken = 2
+
+	[bundle "bundle-3"]
+		uri = file://$(pwd)/clone-from/bundle-3.bundle
+		creationToken = 3
+
+	[bundle "bundle-4"]
+		uri = file://$(pwd)/not-a-bundle
+		creationToken = 4
+	EOF
+
+	for jobs in 1 4
+	do
+		git -c fetch.bundleJobs=$jobs clone \
+			--bundle-uri="file://$(pwd)/bundle-list" \
+			clone-from clone-token-not-a-bundle-$jobs 2>err &&
+		test_grep "not a bundle or bundle list" err &&
+		test_cmp_config -C clone-token-not-a-bundle-$jobs 3 \
+			fetch.bundleCreationToken || return 1
+	done
+'
+
 #########################################################################
 # HTTP tests begin here
 
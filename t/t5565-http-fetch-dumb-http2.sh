@@ -0,0 +1,64 @@
+#!/bin/sh
+
+test_description='test dumb fetching over http/2'
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+if test_have_prereq !REFFILES
+then
+	skip_all='skipping test; dumb HTTP protocol not supported with reftable.'
+	test_done
+fi
+
+LIB_HTTPD_SSL=1
+. "$TEST_DIRECTORY"/lib-httpd.sh
+enable_http2
+start_httpd
+
+test_expect_success 'setup repository with loose objects' '
+	git config --global http.version HTTP/2 &&
+	mkdir dir0 dir1 dir2 dir3 &&
+	for i in $(test_seq 20)
+	do
+		test_commit file$i dir$((i % 4))/file$i || return 1
+	done &&
+	git clone --bare . "$HTTPD_DOCUMENT_ROOT_PATH/repo.git" &&
+	git -C "$HTTPD_DOCUMENT_ROOT_PATH/repo.git" update-server-info &&
+	git rev-list --objects --all >objects
+'
+
+test_expect_success 'clone fetches loose objects over http/2' '
+	git clone --bare "$HTTPD_URL/dumb/repo.git" clone.git &&
+	git -C clone.git fsck --full &&
+	git -C clone.git rev-list --objects --all >actual &&
+	test_cmp objects actual &&
+
+	strip_access_log >log &&
+	grep "^GET  /dumb/repo.git/objects/[0-9a-f][0-9a-f]/" log >object-requests &&
+	test_line_count = $(wc -l <objects) object-requests &&
+	! grep -v " HTTP/2.0 200\$" object-requests
+'
+
+test_expect_success 'clone multiplexes requests over a single connection' '
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git -c http.maxRequests=2 clone --bare \
+		"$HTTPD_URL/dumb/repo.git" multiplexed.git &&
+	git -C multiplexed.git fsck --full &&
+	test_trace2_data http connections 1 <trace.txt &&
+	sed -n "s/.*\"key\":\"peak-active-requests\",\"value\":\"\([0-9]*\)\".*/\1/p" \
+		trace.txt >peak &&
+	test_line_count = 1 peak &&
+	test $(cat peak) -gt 2
+'
+
+test_expect_success 'clone with a single request at a time' '
+	git -c http.maxMultiplexedRequests=1 -c http.maxRequests=1 \
+		clone --bare "$HTTPD_URL/dumb/repo.git" serial.git &&
+	git -C serial.git fsck --full &&
+	git -C serial.git rev-list --objects --all >actual &&
+	test_cmp objects actual
+'
+
+test_done
@@ -32,6 +32,13 @@ test_expect_success 'daemon rejects invalid --max-connections values' '
 	test_grep "fatal: invalid max-connections ${SQ}$arg${SQ}, expecting an integer" err
 '
 
+test_expect_success 'daemon rejects invalid --prefork values' '
+	test_must_fail git daemon --prefork=-1 2>err &&
+	test_grep "fatal: invalid prefork ${SQ}-1${SQ}, expecting a non-negative integer" err &&
+	test_must_fail git daemon --prefork=3 --max-connections=2 2>err &&
+	test_grep "fatal: --prefork=3 exceeds --max-connections=2" err
+'
+
 start_git_daemon
 
 check_verbose_connect () {
@@ -232,4 +239,57 @@ test_expect_success FAKENC 'hostname interpolation works after LF-stripping' '
 	test_cmp expect actual
 '
 
+stop_git_daemon
+GIT_TRACE="$PWD/daemon-trace"
+export GIT_TRACE
+start_git_daemon --prefork=1
+sane_unset GIT_TRACE
+
+# Count how many times the daemon has spawned "git upload-pack".
+upload_pack_spawned () {
+	grep -c "run_command:.*upload-pack --strict" daemon-trace
+}
+
+test_expect_success 'prefork: first connection spawns upload-pack' '
+	git init --bare "$GIT_DAEMON_DOCUMENT_ROOT_PATH/prefork.git" &&
+	>"$GIT_DAEMON_DOCUMENT_ROOT_PATH/prefork.git/git-daemon-export-ok" &&
+	git push "$GIT_DAEMON_DOCUMENT_ROOT_PATH/prefork.git" main &&
+	git ls-remote "$GIT_DAEMON_URL/prefork.git" >actual &&
+	git ls-remote "$GIT_DAEMON_DOCUMENT_ROOT_PATH/prefork.git" >expect &&
+	test_cmp expect actual &&
+	echo 1 >expect &&
+	upload_pack_spawned >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'prefork: worker serves later connections itself' '
+	git clone "$GIT_DAEMON_URL/prefork.git" prefork-clone &&
+	test_cmp file prefork-clone/file &&
+	git -c protocol.version=0 ls-remote "$GIT_DAEMON_URL/prefork.git" &&
+	echo 1 >expect &&
+	upload_pack_spawned >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'prefork: new refs are seen by the worker' '
+	echo content >>file &&
+	git commit -a -m prefork &&
+	git push "$GIT_DAEMON_DOCUMENT_ROOT_PATH/prefork.git" main &&
+	git -C prefork-clone pull &&
+	test_cmp file prefork-clone/file &&
+	echo 1 >expect &&
+	upload_pack_spawned >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'prefork: worker is replaced once packs change' '
+	git -C "$GIT_DAEMON_DOCUMENT_ROOT_PATH/prefork.git" repack -ad &&
+	git ls-remote "$GIT_DAEMON_URL/prefork.git" &&
+	git ls-remote "$GIT_DAEMON_URL/prefork.git" &&
+	git ls-remote "$GIT_DAEMON_URL/prefork.git" &&
+	echo 3 >expect &&
+	upload_pack_spawned >actual &&
+	test_cmp expect actual
+'
+
 test_done
@@ -345,6 +345,42 @@ test_expect_success 'basics of object-info' '
 	test_cmp expect actual
 '
 
+test_expect_success 'object-info with type and disk-size' '
+	test_config transfer.advertiseObjectInfo true &&
+
+	GIT_TEST_SIDEBAND_ALL=0 test-tool serve-v2 \
+		--advertise-capabilities >out &&
+	test-tool pkt-line unpack <out >actual &&
+	grep "^object-info=size type disk-size\$" actual &&
+
+	oid=$(git rev-parse two:two.t) &&
+	missing=$(test_oid deadbeef) &&
+	test-tool pkt-line pack >in <<-EOF &&
+	command=object-info
+	object-format=$(test_oid algo)
+	0001
+	disk-size
+	type
+	size
+	oid $oid
+	oid $missing
+	0000
+	EOF
+
+	disk_size=$(echo $oid | git cat-file --batch-check="%(objectsize:disk)") &&
+	{
+		echo "size type disk-size" &&
+		echo "$oid $(wc -c <two.t | xargs) blob $disk_size" &&
+		# unknown objects have all values empty
+		echo "$missing   " &&
+		echo 0000
+	} >expect &&
+
+	test-tool serve-v2 --stateless-rpc <in >out &&
+	test-tool pkt-line unpack <out >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success 'test capability advertisement with uploadpack.advertiseBundleURIs' '
 	test_config uploadpack.advertiseBundleURIs true &&
 
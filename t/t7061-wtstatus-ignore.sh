@@ -313,4 +313,51 @@ test_expect_success 'status ignores submodule in excluded directory' '
 	test_cmp expected actual
 '
 
+test_expect_success 'status with readdir threads matches sequential status' '
+	mkdir -p tracked/deep/er untracked-dir/sub &&
+	echo tracked >tracked/deep/er/file &&
+	git add -f tracked/deep/er/file &&
+	echo untracked >tracked/deep/er/untracked &&
+	echo untracked >untracked-dir/sub/file &&
+	for flags in "-uno" "-unormal" "-uall" "-uall --ignored" "--ignored=matching"
+	do
+		git status --porcelain $flags >expect &&
+		GIT_TEST_READDIR_THREADS=4 git status --porcelain $flags >actual &&
+		test_cmp expect actual || return 1
+	done &&
+	git status --porcelain -uall >expect &&
+	GIT_TRACE2_EVENT="$(pwd)/.git/trace.txt" GIT_TEST_READDIR_THREADS=4 \
+		git status --porcelain -uall >actual &&
+	test_cmp expect actual &&
+	grep "\"key\":\"prefetch/listings-read\"" .git/trace.txt
+'
+
+test_expect_success 'readdir threads hand over listings that are being read' '
+	git init many &&
+	for i in $(test_seq 40)
+	do
+		mkdir -p many/$i/sub &&
+		echo tracked >many/$i/sub/file &&
+		echo untracked >many/$i/untracked &&
+		git -C many add $i/sub/file || return 1
+	done &&
+	test_seq 40 | sort >dirs &&
+	sed "s|.*|A  &/sub/file|" dirs >expect &&
+	sed "s|.*|?? &/untracked|" dirs >>expect &&
+	for i in 1 2 3
+	do
+		rm -f trace.txt &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		GIT_TEST_READDIR_THREADS=16 GIT_TEST_READDIR_PREFETCH_ENTRIES=1 \
+			git -C many status --porcelain -uall >actual &&
+		test_cmp expect actual &&
+		sed -n "s/.*\"key\":\"prefetch\/listings-read\",\"value\":\"\([0-9]*\)\".*/\1/p" \
+			trace.txt >read &&
+		sed -n "s/.*\"key\":\"prefetch\/listings-used\",\"value\":\"\([0-9]*\)\".*/\1/p" \
+			trace.txt >used &&
+		test_line_count = 1 read &&
+		test_cmp read used || return 1
+	done
+'
+
 test_done
@@ -446,6 +446,150 @@ test_expect_success 'pack-refs task' '
 	test_subcommand git pack-refs --all --prune <pack-refs.txt
 '
 
+# The bundle list names the newest bundle last.
+newest_bundle () {
+	uri=$(git config -f "$1/bundle-list" --get-regexp "bundle\..*\.uri" |
+	      tail -n 1 | cut -d " " -f 2) &&
+	echo "$(pwd)/$1/$uri"
+}
+
+test_expect_success 'bundles task' '
+	test_when_finished "rm -rf bundles.git" &&
+	git init --bare bundles.git &&
+	test_commit_bulk -C bundles.git --ref=refs/heads/main 50 &&
+	dir=bundles.git/objects/info/bundles &&
+
+	git -C bundles.git maintenance run --task=bundles &&
+	ls $dir/bundle-*.bundle >bundles &&
+	test_line_count = 1 bundles &&
+	git -C bundles.git bundle verify "$(pwd)/$(cat bundles)" &&
+	git config -f $dir/bundle-list bundle.heuristic >actual &&
+	echo creationToken >expect &&
+	test_cmp expect actual &&
+
+	# Nothing to do when everything is bundled already.
+	git -C bundles.git branch old main~10 &&
+	cp $dir/bundle-list list-before &&
+	git -C bundles.git maintenance run --task=bundles &&
+	ls $dir/bundle-*.bundle >actual &&
+	test_cmp bundles actual &&
+	test_cmp list-before $dir/bundle-list &&
+
+	# A small update gets a bundle of its own...
+	test_commit_bulk -C bundles.git --ref=refs/heads/main --id=new 1 &&
+	git -C bundles.git tag v1.0 main &&
+	git -C bundles.git maintenance run --task=bundles &&
+	ls $dir/bundle-*.bundle >bundles &&
+	test_line_count = 2 bundles &&
+	git config -f $dir/bundle-list --get-regexp "bundle\..*\.uri" >uris &&
+	test_line_count = 2 uris &&
+	git -C bundles.git bundle list-heads "$(newest_bundle $dir)" >heads &&
+	test_grep refs/tags/v1.0 heads &&
+
+	# ...until it becomes too large compared to the older bundles.
+	test_commit_bulk -C bundles.git --ref=refs/heads/main --id=more 1 &&
+	git -C bundles.git -c maintenance.bundles.geometricFactor=100000 \
+		maintenance run --task=bundles &&
+	ls $dir/bundle-*.bundle >bundles &&
+	test_line_count = 1 bundles &&
+	git -C bundles.git bundle verify "$(pwd)/$(cat bundles)" &&
+	test_must_fail git -C bundles.git \
+		-c maintenance.bundles.geometricFactor=1 \
+		maintenance run --task=bundles 2>err &&
+	test_grep "geometricFactor must be at least 2" err
+'
+
+test_expect_success 'bundles task after a forced update and prune' '
+	test_when_finished "rm -rf bundles.git" &&
+	git init --bare bundles.git &&
+	test_commit_bulk -C bundles.git --ref=refs/heads/main 10 &&
+	dir=bundles.git/objects/info/bundles &&
+	git -C bundles.git maintenance run --task=bundles &&
+
+	# Rewrite the bundled tip and prune it from the repository.
+	old=$(git -C bundles.git rev-parse main) &&
+	new=$(git -C bundles.git commit-tree -p main~3 -m rewritten main^{tree}) &&
+	git -C bundles.git update-ref refs/heads/main $new &&
+	git -C bundles.git reflog expire --expire=now --all &&
+	git -C bundles.git gc --prune=now --quiet &&
+	test_must_fail git -C bundles.git cat-file -e $old &&
+
+	git -C bundles.git maintenance run --task=bundles &&
+	git -C bundles.git maintenance run --task=bundles &&
+	ls $dir/bundle-*.bundle >bundles &&
+	git -C bundles.git bundle list-heads "$(newest_bundle $dir)" >heads &&
+	test_grep $new heads
+'
+
+test_expect_success 'bundles task leaves out hidden refs' '
+	test_when_finished "rm -rf bundles.git unbundled" &&
+	git init --bare bundles.git &&
+	test_commit_bulk -C bundles.git --ref=refs/heads/main 5 &&
+	test_commit_bulk -C bundles.git --ref=refs/heads/secret --id=secret 1 &&
+	secret=$(git -C bundles.git rev-parse secret) &&
+	dir=bundles.git/objects/info/bundles &&
+
+	git -C bundles.git config uploadpack.hideRefs refs/heads/secret &&
+	git -C bundles.git maintenance run --task=bundles &&
+	git -C bundles.git bundle list-heads "$(newest_bundle $dir)" >heads &&
+	test_grep refs/heads/main heads &&
+	test_grep ! refs/heads/secret heads &&
+	git init --bare unbundled &&
+	git -C unbundled bundle unbundle "$(newest_bundle $dir)" &&
+	test_must_fail git -C unbundled cat-file -e $secret &&
+
+	# Hiding all refs leaves nothing to bundle.
+	git -C bundles.git -c transfer.hideRefs=refs/heads/main \
+		maintenance run --task=bundles &&
+	test_path_is_missing $dir/bundle-list &&
+	ls $dir >actual &&
+	test_must_be_empty actual
+'
+
+test_expect_success 'bundles are not advertised once refs in them are hidden' '
+	test_when_finished "rm -rf bundles.git clone-*" &&
+	git init --bare bundles.git &&
+	test_commit_bulk -C bundles.git --ref=refs/heads/main 5 &&
+	test_commit_bulk -C bundles.git --ref=refs/heads/secret --id=secret 1 &&
+	dir=bundles.git/objects/info/bundles &&
+	git -C bundles.git maintenance run --task=bundles &&
+	old=$(newest_bundle $dir) &&
+
+	git -C bundles.git config transfer.hideRefs refs/heads/secret &&
+	git -c transfer.bundleURI=true clone --no-local \
+		"file://$(pwd)/bundles.git" clone-hidden &&
+	test_must_fail git -C clone-hidden rev-parse --verify refs/bundles/main &&
+	test_must_fail git -C clone-hidden rev-parse --verify refs/bundles/secret &&
+
+	# The next run replaces the bundles.
+	git -C bundles.git maintenance run --task=bundles &&
+	test_path_is_missing "$old" &&
+	git -C bundles.git bundle list-heads "$(newest_bundle $dir)" >heads &&
+	test_grep ! refs/heads/secret heads &&
+	git -c transfer.bundleURI=true clone --no-local \
+		"file://$(pwd)/bundles.git" clone-rebundled &&
+	git -C clone-rebundled rev-parse --verify refs/bundles/main &&
+	test_must_fail git -C clone-rebundled rev-parse --verify refs/bundles/secret
+'
+
+test_expect_success 'upload-pack advertises bundles written by maintenance' '
+	test_when_finished "rm -rf bundles.git clone-*" &&
+	git init --bare bundles.git &&
+	test_commit_bulk -C bundles.git --ref=refs/heads/main 10 &&
+	git -C bundles.git maintenance run --task=bundles &&
+
+	git -c transfer.bundleURI=true clone --no-local \
+		"file://$(pwd)/bundles.git" clone-bundles &&
+	git -C bundles.git rev-parse main >expect &&
+	git -C clone-bundles rev-parse refs/bundles/main >actual &&
+	test_cmp expect actual &&
+
+	git -C bundles.git config uploadpack.advertiseBundleURIs false &&
+	git -c transfer.bundleURI=true clone --no-local \
+		"file://$(pwd)/bundles.git" clone-no-bundles &&
+	test_must_fail git -C clone-no-bundles rev-parse --verify refs/bundles/main
+'
+
 test_expect_success '--auto and --schedule incompatible' '
 	test_must_fail git maintenance run --auto --schedule=daily 2>err &&
 	test_grep "at most one" err
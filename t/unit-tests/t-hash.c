@@ -24,6 +24,59 @@ static void check_hash_data(const void *data, size_t data_length,
 	}
 }
 
+static void check_hash_many(void)
+{
+	struct strbuf data = STRBUF_INIT;
+	const void *in[40];
+	size_t len[ARRAY_SIZE(in)];
+	static const char prefix[64] = "a partial block";
+	uint32_t seed = 1;
+
+	/*
+	 * Messages of assorted lengths, including none at all and exact
+	 * multiples of the block size, so that lanes run dry at different
+	 * times.
+	 */
+	for (size_t i = 0; i < ARRAY_SIZE(in); i++) {
+		len[i] = i % 5 ? (i * 97) % 1100 : i * 64;
+		for (size_t j = 0; j < len[i]; j++) {
+			seed = seed * 1103515245 + 12345;
+			strbuf_addch(&data, seed >> 16);
+		}
+	}
+
+	for (size_t i = 1; i < ARRAY_SIZE(hash_algos); i++) {
+		const struct git_hash_algo *algop = &hash_algos[i];
+		git_hash_ctx one, many[ARRAY_SIZE(in)], *ctx[ARRAY_SIZE(in)];
+		unsigned char expect[GIT_MAX_RAWSZ], actual[GIT_MAX_RAWSZ];
+		const char *p = data.buf;
+
+		for (size_t j = 0; j < ARRAY_SIZE(in); j++) {
+			in[j] = p;
+			p += len[j];
+			ctx[j] = &many[j];
+			algop->init_fn(ctx[j]);
+			/* leave some contexts with a partial block buffered */
+			algop->update_fn(ctx[j], prefix, j % 3 ? 6 * (j % 11) : 0);
+		}
+		algop->update_many_fn(ctx, in, len, ARRAY_SIZE(in));
+
+		for (size_t j = 0; j < ARRAY_SIZE(in); j++) {
+			algop->init_fn(&one);
+			algop->update_fn(&one, prefix, j % 3 ? 6 * (j % 11) : 0);
+			algop->update_fn(&one, in[j], len[j]);
+			algop->final_fn(expect, &one);
+			algop->final_fn(actual, ctx[j]);
+			if (!check_str(hash_to_hex_algop(actual, algop),
+				       hash_to_hex_algop(expect, algop)))
+				test_msg("message %"PRIuMAX" (%s)",
+					 (uintmax_t)j, algop->name);
+		}
+	}
+
+	strbuf_release(&data);
+}
+
 /* Works with a NUL terminated string. Doesn't work if it should contain a NUL character. */
 #define TEST_HASH_STR(data, expected_sha1, expected_sha256) do { \
 		const char *expected_hashes[] = { expected_sha1, expected_sha256 }; \
@@ -77,6 +130,9 @@ int cmd_main(int argc UNUSED, const char **argv UNUSED)
 		"4b825dc642cb6eb9a060e54bf8d69288fbee4904",
 		"6ef19b41225c5369f1c104d45d8d85efa9b057b53b14b4b9b939dd74decc5321");
 
+	TEST(check_hash_many(),
+	     "update_many_fn agrees with update_fn for each message");
+
 	strbuf_release(&aaaaaaaaaa_100000);
 	strbuf_release(&alphabet_100000);
 
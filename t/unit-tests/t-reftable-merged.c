@@ -273,6 +273,107 @@ static void t_merged_seek_multiple_times(void)
 	reftable_free(sources);
 }
 
+static void t_merged_seek_prefix(void)
+{
+	struct reftable_ref_record r1[] = {
+		{
+			.refname = (char *) "refs/heads/feature/a",
+			.update_index = 1,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { 1 },
+		},
+		{
+			.refname = (char *) "refs/heads/main",
+			.update_index = 1,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { 1 },
+		},
+		{
+			.refname = (char *) "refs/tags/v1",
+			.update_index = 1,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { 1 },
+		},
+	};
+	struct reftable_ref_record r2[] = {
+		{
+			.refname = (char *) "refs/heads/feature/a",
+			.update_index = 2,
+			.value_type = REFTABLE_REF_DELETION,
+		},
+		{
+			.refname = (char *) "refs/heads/feature/b",
+			.update_index = 2,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { 2 },
+		},
+	};
+	struct reftable_ref_record r3[] = {
+		{
+			.refname = (char *) "refs/remotes/origin/main",
+			.update_index = 3,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { 3 },
+		},
+	};
+	struct reftable_ref_record *refs[] = { r1, r2, r3 };
+	size_t sizes[] = { ARRAY_SIZE(r1), ARRAY_SIZE(r2), ARRAY_SIZE(r3) };
+	struct reftable_buf bufs[] = {
+		REFTABLE_BUF_INIT, REFTABLE_BUF_INIT, REFTABLE_BUF_INIT,
+	};
+	struct reftable_block_source *sources = NULL;
+	struct reftable_reader **readers = NULL;
+	struct reftable_ref_record rec = { 0 };
+	struct reftable_iterator it = { 0 };
+	struct reftable_merged_table *mt;
+	int err;
+
+	mt = merged_table_from_records(refs, &sources, &readers, sizes, bufs, 3);
+	mt->suppress_deletions = 1;
+	merged_table_init_iter(mt, &it, BLOCK_TYPE_REF);
+
+	for (size_t i = 0; i < 2; i++) {
+		err = reftable_iterator_seek_ref_prefix(&it, "refs/heads/feature/");
+		check(!err);
+		err = reftable_iterator_next_ref(&it, &rec);
+		check(!err);
+		check(reftable_ref_record_equal(&rec, &r2[1], GIT_SHA1_RAWSZ));
+		err = reftable_iterator_next_ref(&it, &rec);
+		check(!err);
+		check(reftable_ref_record_equal(&rec, &r1[1], GIT_SHA1_RAWSZ));
+
+		err = reftable_iterator_seek_ref_prefix(&it, "refs/remotes/");
+		check(!err);
+		err = reftable_iterator_next_ref(&it, &rec);
+		check(!err);
+		check(reftable_ref_record_equal(&rec, &r3[0], GIT_SHA1_RAWSZ));
+		err = reftable_iterator_next_ref(&it, &rec);
+		check(!err);
+		check(reftable_ref_record_equal(&rec, &r1[2], GIT_SHA1_RAWSZ));
+		err = reftable_iterator_next_ref(&it, &rec);
+		check_int(err, >, 0);
+
+		/*
+		 * The last table does not contain the prefix and thus gets
+		 * skipped, so its records that sort after the prefix are
+		 * missing, too.
+		 */
+		err = reftable_iterator_seek_ref_prefix(&it, "refs/notes/");
+		check(!err);
+		err = reftable_iterator_next_ref(&it, &rec);
+		check(!err);
+		check(reftable_ref_record_equal(&rec, &r1[2], GIT_SHA1_RAWSZ));
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(bufs); i++)
+		reftable_buf_release(&bufs[i]);
+	readers_destroy(readers, ARRAY_SIZE(refs));
+	reftable_ref_record_release(&rec);
+	reftable_iterator_destroy(&it);
+	reftable_merged_table_free(mt);
+	reftable_free(sources);
+}
+
 static struct reftable_merged_table *
 merged_table_from_log_records(struct reftable_log_record **logs,
 			      struct reftable_block_source **source,
@@ -467,6 +568,7 @@ int cmd_main(int argc UNUSED, const char *argv[] UNUSED)
 	TEST(t_merged_logs(), "merged table with multiple log updates for same ref");
 	TEST(t_merged_refs(), "merged table with multiple updates to same ref");
 	TEST(t_merged_seek_multiple_times(), "merged table can seek multiple times");
+	TEST(t_merged_seek_prefix(), "merged table skips tables when seeking a prefix");
 	TEST(t_merged_single_record(), "ref occurring in only one record can be fetched");
 
 	return test_done();
@@ -88,9 +88,79 @@ static int t_reader_reseek(void)
 	return 0;
 }
 
+static void check_seek_prefix(struct reftable_reader *reader,
+			      const char *prefix, const char *want)
+{
+	struct reftable_ref_record ref = { 0 };
+	struct reftable_iterator it = { 0 };
+	int ret;
+
+	reftable_reader_init_ref_iterator(reader, &it);
+	ret = reftable_iterator_seek_ref_prefix(&it, prefix);
+	check_int(ret, ==, !want);
+
+	ret = reftable_iterator_next_ref(&it, &ref);
+	if (want) {
+		check_int(ret, ==, 0);
+		check_str(ref.refname, want);
+	} else {
+		check_int(ret, ==, 1);
+	}
+
+	reftable_ref_record_release(&ref);
+	reftable_iterator_destroy(&it);
+}
+
+static int t_reader_seek_prefix(int indexed)
+{
+	struct reftable_write_options opts = {
+		.block_size = 256,
+	};
+	size_t nrecords = indexed ? 100 : 3;
+	struct reftable_ref_record *records;
+	struct reftable_block_source source = { 0 };
+	struct reftable_reader *reader;
+	struct reftable_buf buf = REFTABLE_BUF_INIT;
+	int ret;
+
+	REFTABLE_CALLOC_ARRAY(records, nrecords);
+	for (size_t i = 0; i < nrecords; i++) {
+		records[i].refname = xstrfmt("refs/heads/branch-%03"PRIuMAX,
+					     (uintmax_t)i);
+		records[i].update_index = 1;
+		records[i].value_type = REFTABLE_REF_VAL1;
+		t_reftable_set_hash(records[i].value.val1, i, GIT_SHA1_FORMAT_ID);
+	}
+
+	t_reftable_write_to_buf(&buf, records, nrecords, NULL, 0, &opts);
+	block_source_from_buf(&source, &buf);
+
+	ret = reftable_reader_new(&reader, &source, "name");
+	check(!ret);
+	check_int(!!reader->ref_offsets.index_offset, ==, indexed);
+
+	check_seek_prefix(reader, "refs/heads/", "refs/heads/branch-000");
+	check_seek_prefix(reader, "refs/heads/branch-002", "refs/heads/branch-002");
+	check_seek_prefix(reader, "refs/heads/branch-00", "refs/heads/branch-000");
+	check_seek_prefix(reader, "refs/heads/branch-1", NULL);
+	check_seek_prefix(reader, "refs/heads/a", NULL);
+	check_seek_prefix(reader, "refs/heads/feature/", NULL);
+	check_seek_prefix(reader, "refs/tags/", NULL);
+	check_seek_prefix(reader, "", "refs/heads/branch-000");
+
+	for (size_t i = 0; i < nrecords; i++)
+		reftable_free(records[i].refname);
+	reftable_free(records);
+	reftable_reader_decref(reader);
+	reftable_buf_release(&buf);
+	return 0;
+}
+
 int cmd_main(int argc UNUSED, const char *argv[] UNUSED)
 {
 	TEST(t_reader_seek_once(), "reader can seek once");
 	TEST(t_reader_reseek(), "reader can reseek multiple times");
+	TEST(t_reader_seek_prefix(0), "reader skips seeks for prefixes outside of the table");
+	TEST(t_reader_seek_prefix(1), "reader with index skips seeks for prefixes outside of the table");
 	return test_done();
 }
@@ -1100,6 +1100,72 @@ static void t_reftable_stack_auto_compaction_with_locked_tables(void)
 	clear_dir(dir);
 }
 
+static int count_auto_compact_hook(struct reftable_stack *st UNUSED,
+				   void *payload)
+{
+	int *calls = payload;
+	(*calls)++;
+	return 0;
+}
+
+static void add_ref_table(struct reftable_stack *st, const char *refname)
+{
+	struct reftable_ref_record ref = {
+		.refname = (char *) refname,
+		.update_index = reftable_stack_next_update_index(st),
+		.value_type = REFTABLE_REF_VAL1,
+	};
+
+	t_reftable_set_hash(ref.value.val1, 1, GIT_SHA1_FORMAT_ID);
+	check(!reftable_stack_add(st, write_test_ref, &ref));
+}
+
+static void t_reftable_stack_auto_compaction_hook(void)
+{
+	struct reftable_write_options opts = {
+		.auto_compact_hook = count_auto_compact_hook,
+	};
+	struct reftable_stack *st = NULL;
+	struct reftable_buf buf = REFTABLE_BUF_INIT;
+	char *dir = get_tmp_dir(__LINE__);
+	int calls = 0;
+	int err;
+
+	opts.auto_compact_payload = &calls;
+	err = reftable_new_stack(&st, dir, &opts);
+	check(!err);
+
+	/*
+	 * The hook is called instead of compacting the stack whenever there
+	 * are tables that auto-compaction would want to compact.
+	 */
+	add_ref_table(st, "refs/heads/a");
+	check_int(calls, ==, 0);
+	add_ref_table(st, "refs/heads/b");
+	check_int(calls, ==, 1);
+	check_int(st->merged->readers_len, ==, 2);
+	check_int(reftable_stack_auto_compact_needed(st), ==, 1);
+
+	/*
+	 * It is not called when a concurrent compaction has locked the tables
+	 * already.
+	 */
+	check(!reftable_buf_addstr(&buf, dir));
+	check(!reftable_buf_addstr(&buf, "/"));
+	check(!reftable_buf_addstr(&buf, st->readers[0]->name));
+	check(!reftable_buf_addstr(&buf, ".lock"));
+	write_file_buf(buf.buf, "", 0);
+
+	check_int(reftable_stack_auto_compact_needed(st), ==, 0);
+	add_ref_table(st, "refs/heads/c");
+	check_int(calls, ==, 1);
+	check_int(st->merged->readers_len, ==, 3);
+
+	reftable_stack_destroy(st);
+	reftable_buf_release(&buf);
+	clear_dir(dir);
+}
+
 static void t_reftable_stack_add_performs_auto_compaction(void)
 {
 	struct reftable_write_options opts = { 0 };
@@ -1300,6 +1366,207 @@ static void t_reftable_stack_read_across_reload(void)
 	clear_dir(dir);
 }
 
+struct write_logs_arg {
+	struct reftable_log_record *logs;
+	size_t n;
+	uint64_t update_index;
+};
+
+static int write_test_logs(struct reftable_writer *wr, void *arg)
+{
+	struct write_logs_arg *wla = arg;
+
+	reftable_writer_set_limits(wr, wla->update_index, wla->update_index);
+	return reftable_writer_add_logs(wr, wla->logs, wla->n);
+}
+
+static void write_log_table(struct reftable_stack *st, size_t n)
+{
+	struct write_logs_arg arg = {
+		.update_index = reftable_stack_next_update_index(st),
+		.n = n,
+	};
+	int err;
+
+	REFTABLE_CALLOC_ARRAY(arg.logs, n);
+	check(arg.logs != NULL);
+	for (size_t i = 0; i < n; i++) {
+		struct reftable_log_record *log = &arg.logs[i];
+
+		log->refname = xstrfmt("refs/heads/branch-%04"PRIuMAX, (uintmax_t)i);
+		log->update_index = arg.update_index;
+		log->value_type = REFTABLE_LOG_UPDATE;
+		log->value.update.email = xstrdup("johndoe@invalid");
+		log->value.update.message = xstrfmt("update number %"PRIuMAX"\n",
+						    (uintmax_t)i);
+		t_reftable_set_hash(log->value.update.new_hash, i, GIT_SHA1_FORMAT_ID);
+	}
+
+	err = reftable_stack_add(st, write_test_logs, &arg);
+	check(!err);
+
+	for (size_t i = 0; i < n; i++)
+		reftable_log_record_release(&arg.logs[i]);
+	reftable_free(arg.logs);
+}
+
+static size_t count_logs(struct reftable_stack *st)
+{
+	struct reftable_log_record log = { 0 };
+	struct reftable_iterator it = { 0 };
+	size_t n = 0;
+	int err;
+
+	err = reftable_stack_init_log_iterator(st, &it);
+	check(!err);
+	err = reftable_iterator_seek_log(&it, "");
+	check(!err);
+	while (!(err = reftable_iterator_next_log(&it, &log)))
+		n++;
+	check_int(err, >, 0);
+
+	reftable_log_record_release(&log);
+	reftable_iterator_destroy(&it);
+	return n;
+}
+
+static void t_reftable_stack_block_cache(void)
+{
+	struct reftable_write_options opts = {
+		.block_size = 256,
+	};
+	struct reftable_block_cache_stats *stats;
+	struct reftable_stack *st = NULL;
+	char *dir = get_tmp_dir(__LINE__);
+	uint64_t misses;
+	int err;
+
+	err = reftable_new_stack(&st, dir, &opts);
+	check(!err);
+	write_log_table(st, 200);
+
+	stats = reftable_stack_block_cache_stats(st);
+	check(stats != NULL);
+
+	/* The first scan has to inflate all log blocks... */
+	check_int(count_logs(st), ==, 200);
+	misses = stats->misses;
+	check_uint(misses, >, 1);
+	check_uint(stats->bytes, >, 0);
+	check_uint(stats->evictions, ==, 0);
+	check_uint(stats->readaheads, >, 0);
+
+	/* ... whereas the second one is served from the cache. */
+	check_int(count_logs(st), ==, 200);
+	check_uint(stats->misses, ==, misses);
+	check_uint(stats->hits, >=, misses);
+
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
+static void t_reftable_stack_block_cache_eviction(void)
+{
+	struct reftable_write_options opts = {
+		.block_size = 256,
+		.block_cache_size = 1024,
+	};
+	struct reftable_block_cache_stats *stats;
+	struct reftable_stack *st = NULL;
+	char *dir = get_tmp_dir(__LINE__);
+	int err;
+
+	err = reftable_new_stack(&st, dir, &opts);
+	check(!err);
+	write_log_table(st, 200);
+
+	stats = reftable_stack_block_cache_stats(st);
+	check_int(count_logs(st), ==, 200);
+	check_uint(stats->evictions, >, 0);
+	check_uint(stats->bytes, <=, 1024);
+
+	/* Evicted blocks are inflated anew. */
+	check_int(count_logs(st), ==, 200);
+	check_uint(stats->bytes, <=, 1024);
+
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
+static void t_reftable_stack_block_cache_disabled(void)
+{
+	struct reftable_write_options opts = {
+		.block_size = 256,
+		.block_cache_size = -1,
+	};
+	struct reftable_stack *st = NULL;
+	char *dir = get_tmp_dir(__LINE__);
+	int err;
+
+	err = reftable_new_stack(&st, dir, &opts);
+	check(!err);
+	write_log_table(st, 200);
+
+	check(reftable_stack_block_cache_stats(st) == NULL);
+	check_int(count_logs(st), ==, 200);
+
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
+static void t_reftable_stack_block_cache_across_reload(void)
+{
+	struct reftable_write_options opts = {
+		.block_size = 256,
+		.disable_auto_compact = 1,
+	};
+	struct reftable_block_cache_stats *stats;
+	struct reftable_log_record log = { 0 };
+	struct reftable_iterator it = { 0 };
+	struct reftable_stack *st = NULL;
+	char *dir = get_tmp_dir(__LINE__);
+	size_t n = 0;
+	int err;
+
+	err = reftable_new_stack(&st, dir, &opts);
+	check(!err);
+	write_log_table(st, 100);
+	write_log_table(st, 100);
+	stats = reftable_stack_block_cache_stats(st);
+
+	/* Start iterating so that the iterator keeps a cached block. */
+	err = reftable_stack_init_log_iterator(st, &it);
+	check(!err);
+	err = reftable_iterator_seek_log(&it, "");
+	check(!err);
+	err = reftable_iterator_next_log(&it, &log);
+	check(!err);
+	n++;
+
+	/*
+	 * Compacting the stack replaces its tables, which must drop their
+	 * blocks from the cache. The iterator has to continue to work with
+	 * the blocks it still holds.
+	 */
+	err = reftable_stack_compact_all(st, NULL);
+	check(!err);
+	check_int(st->merged->readers_len, ==, 1);
+
+	while (!(err = reftable_iterator_next_log(&it, &log)))
+		n++;
+	check_int(err, >, 0);
+	check_int(n, ==, 200);
+	reftable_iterator_destroy(&it);
+	check_uint(stats->bytes, ==, 0);
+
+	check_int(count_logs(st), ==, 200);
+	check_uint(stats->bytes, >, 0);
+
+	reftable_log_record_release(&log);
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
 static void t_reftable_stack_reload_with_missing_table(void)
 {
 	struct reftable_write_options opts = { 0 };
@@ -1367,10 +1634,15 @@ int cmd_main(int argc UNUSED, const char *argv[] UNUSED)
 	TEST(t_reflog_expire(), "expire reflog entries");
 	TEST(t_reftable_stack_add(), "add multiple refs and logs to stack");
 	TEST(t_reftable_stack_add_one(), "add a single ref record to stack");
+	TEST(t_reftable_stack_block_cache(), "block cache serves repeated log scans");
+	TEST(t_reftable_stack_block_cache_across_reload(), "block cache drops blocks of replaced tables");
+	TEST(t_reftable_stack_block_cache_disabled(), "block cache can be disabled");
+	TEST(t_reftable_stack_block_cache_eviction(), "block cache stays within its size limit");
 	TEST(t_reftable_stack_add_performs_auto_compaction(), "addition to stack triggers auto-compaction");
 	TEST(t_reftable_stack_auto_compaction(), "stack must form geometric sequence after compaction");
 	TEST(t_reftable_stack_auto_compaction_factor(), "auto-compaction with non-default geometric factor");
 	TEST(t_reftable_stack_auto_compaction_fails_gracefully(), "failure on auto-compaction");
+	TEST(t_reftable_stack_auto_compaction_hook(), "auto-compaction hook replaces inline compaction");
 	TEST(t_reftable_stack_auto_compaction_with_locked_tables(), "auto compaction with locked tables");
 	TEST(t_reftable_stack_compaction_concurrent(), "compaction with concurrent stack");
 	TEST(t_reftable_stack_compaction_concurrent_clean(), "compaction with unclean stack shutdown");
@@ -555,11 +555,19 @@ enum trace2_counter_id {
 
 	TRACE2_COUNTER_ID_PACKED_REFS_JUMPS, /* counts number of jumps */
 	TRACE2_COUNTER_ID_REFTABLE_RESEEKS, /* counts number of re-seeks */
+	TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_HITS,
+	TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_MISSES,
+	TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_EVICTIONS,
+	TRACE2_COUNTER_ID_REFTABLE_READAHEADS,
 
 	/* counts number of fsyncs */
 	TRACE2_COUNTER_ID_FSYNC_WRITEOUT_ONLY,
 	TRACE2_COUNTER_ID_FSYNC_HARDWARE_FLUSH,
 
+	/* counts lookups in the attribute result cache */
+	TRACE2_COUNTER_ID_ATTR_CACHE_HITS,
+	TRACE2_COUNTER_ID_ATTR_CACHE_MISSES,
+
 	/* Add additional counter definitions before here. */
 	TRACE2_NUMBER_OF_COUNTERS
 };
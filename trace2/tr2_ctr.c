@@ -36,6 +36,26 @@ static struct tr2_counter_metadata tr2_counter_metadata[TRACE2_NUMBER_OF_COUNTER
 		.name = "reseeks_made",
 		.want_per_thread_events = 0,
 	},
+	[TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_HITS] = {
+		.category = "reftable",
+		.name = "block_cache_hits",
+		.want_per_thread_events = 0,
+	},
+	[TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_MISSES] = {
+		.category = "reftable",
+		.name = "block_cache_misses",
+		.want_per_thread_events = 0,
+	},
+	[TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_EVICTIONS] = {
+		.category = "reftable",
+		.name = "block_cache_evictions",
+		.want_per_thread_events = 0,
+	},
+	[TRACE2_COUNTER_ID_REFTABLE_READAHEADS] = {
+		.category = "reftable",
+		.name = "readaheads",
+		.want_per_thread_events = 0,
+	},
 	[TRACE2_COUNTER_ID_FSYNC_WRITEOUT_ONLY] = {
 		.category = "fsync",
 		.name = "writeout-only",
@@ -46,6 +66,16 @@ static struct tr2_counter_metadata tr2_counter_metadata[TRACE2_NUMBER_OF_COUNTER
 		.name = "hardware-flush",
 		.want_per_thread_events = 0,
 	},
+	[TRACE2_COUNTER_ID_ATTR_CACHE_HITS] = {
+		.category = "attr",
+		.name = "cache-hits",
+		.want_per_thread_events = 0,
+	},
+	[TRACE2_COUNTER_ID_ATTR_CACHE_MISSES] = {
+		.category = "attr",
+		.name = "cache-misses",
+		.want_per_thread_events = 0,
+	},
 
 	/* Add additional metadata before here. */
 };
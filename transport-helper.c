@@ -1307,10 +1307,24 @@ static int get_bundle_uri(struct transport *transport)
 	return -1;
 }
 
+static int get_object_info(struct transport *transport,
+			   const struct object_id *oids, int oid_nr,
+			   struct remote_object_info *infos)
+{
+	get_helper(transport);
+
+	if (process_connect(transport, 0))
+		return transport->vtable->get_object_info(transport, oids,
+							  oid_nr, infos);
+
+	return -1;
+}
+
 static struct transport_vtable vtable = {
 	.set_option	= set_helper_option,
 	.get_refs_list	= get_refs_list,
 	.get_bundle_uri = get_bundle_uri,
+	.get_object_info = get_object_info,
 	.fetch_refs	= fetch_refs,
 	.push_refs	= push_refs,
 	.connect	= connect_helper,
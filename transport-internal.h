@@ -1,8 +1,10 @@
 #ifndef TRANSPORT_INTERNAL_H
 #define TRANSPORT_INTERNAL_H
 
+struct object_id;
 struct ref;
 struct transport;
+struct remote_object_info;
 struct strvec;
 struct transport_ls_refs_options;
 
@@ -33,6 +35,16 @@ struct transport_vtable {
 	 */
 	int (*get_bundle_uri)(struct transport *transport);
 
+	/**
+	 * Asks the remote side for information about the given objects
+	 * under protocol v2, if the "object-info" capability was
+	 * advertised with support for object types. Returns 0 if OK,
+	 * negative values if not supported or on error.
+	 */
+	int (*get_object_info)(struct transport *transport,
+			       const struct object_id *oids, int oid_nr,
+			       struct remote_object_info *infos);
+
 	/**
 	 * Fetch the objects for the given refs. Note that this gets
 	 * an array, and should ignore the list structure.
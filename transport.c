@@ -410,6 +410,36 @@ static int get_bundle_uri(struct transport *transport)
 				     transport->bundles, stateless_rpc);
 }
 
+static int get_object_info(struct transport *transport,
+			   const struct object_id *oids, int oid_nr,
+			   struct remote_object_info *infos)
+{
+	struct git_transport_data *data = transport->data;
+	struct packet_reader reader;
+
+	if (!data->finished_handshake) {
+		struct ref *refs = handshake(transport, 0, NULL, 0);
+
+		if (refs)
+			free_refs(refs);
+	}
+
+	/*
+	 * Protocol v0 and servers that cannot tell the type of objects
+	 * are not supported.
+	 */
+	if (!server_supports_v2("object-info") ||
+	    !server_supports_feature("object-info", "type", 0))
+		return -1;
+
+	packet_reader_init(&reader, data->fd[0], NULL, 0,
+			   PACKET_READ_CHOMP_NEWLINE |
+			   PACKET_READ_GENTLE_ON_EOF);
+
+	return get_remote_object_info(data->fd[1], &reader, oids, oid_nr,
+				      infos, transport->stateless_rpc);
+}
+
 static int fetch_refs_via_pack(struct transport *transport,
 			       int nr_heads, struct ref **to_fetch)
 {
@@ -973,6 +1003,7 @@ static int disconnect_git(struct transport *transport)
 static struct transport_vtable taken_over_vtable = {
 	.get_refs_list	= get_refs_via_connect,
 	.get_bundle_uri = get_bundle_uri,
+	.get_object_info = get_object_info,
 	.fetch_refs	= fetch_refs_via_pack,
 	.push_refs	= git_transport_push,
 	.disconnect	= disconnect_git
@@ -1138,6 +1169,7 @@ static struct transport_vtable bundle_vtable = {
 static struct transport_vtable builtin_smart_vtable = {
 	.get_refs_list	= get_refs_via_connect,
 	.get_bundle_uri = get_bundle_uri,
+	.get_object_info = get_object_info,
 	.fetch_refs	= fetch_refs_via_pack,
 	.push_refs	= git_transport_push,
 	.connect	= connect_git,
@@ -1598,6 +1630,17 @@ int transport_get_remote_bundle_uri(struct transport *transport)
 	return 0;
 }
 
+int transport_get_object_info(struct transport *transport,
+			      const struct object_id *oids, int oid_nr,
+			      struct remote_object_info *infos)
+{
+	const struct transport_vtable *vtable = transport->vtable;
+
+	if (!vtable->get_object_info)
+		return -1;
+	return vtable->get_object_info(transport, oids, oid_nr, infos);
+}
+
 void transport_unlock_pack(struct transport *transport, unsigned int flags)
 {
 	int in_signal_handler = !!(flags & TRANSPORT_UNLOCK_PACK_IN_SIGNAL_HANDLER);
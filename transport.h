@@ -299,6 +299,16 @@ const struct ref *transport_get_remote_refs(struct transport *transport,
  */
 int transport_get_remote_bundle_uri(struct transport *transport);
 
+/*
+ * Retrieve the type, size and (if supported) disk size of the given objects
+ * from a remote without fetching them, storing the information about
+ * oids[i] in infos[i]. Returns a negative value if the remote does not
+ * support this, or on error.
+ */
+int transport_get_object_info(struct transport *transport,
+			      const struct object_id *oids, int oid_nr,
+			      struct remote_object_info *infos);
+
 /*
  * Fetch the hash algorithm used by a remote.
  *
@@ -30,6 +30,10 @@
 #include "entry.h"
 #include "parallel-checkout.h"
 #include "setup.h"
+#include "oidmap.h"
+#include "oidset.h"
+#include "strmap.h"
+#include "thread-utils.h"
 
 /*
  * Error messages expected by scripts out of plumbing commands such as
@@ -861,6 +865,441 @@ static int traverse_by_cache_tree(int pos, int nr_entries, int nr_names,
 	return 0;
 }
 
+/*
+ * Tree prefetching: while unpack_callback() merges entries on the main
+ * thread, a pool of worker threads walks ahead over the subtrees that
+ * differ between the trees being unpacked, reading and inflating them
+ * so that traverse_trees_recursive() finds them ready in memory.
+ *
+ * The traversal itself (and therefore the order in which entries are
+ * added to o->internal.result) is unchanged; a tree that has not been
+ * prefetched yet is simply read by the main thread as before.
+ */
+#define TREE_PREFETCH_MEMORY_LIMIT (64 * 1024 * 1024)
+
+struct prefetched_tree {
+	struct oidmap_entry entry;
+	void *buf;
+	unsigned long size;
+};
+
+struct tree_prefetch_job {
+	struct object_id oid[MAX_UNPACK_TREES];
+	char *path; /* with trailing slash, or "" for the root */
+};
+
+struct tree_prefetch {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int n, stop, active;
+	struct tree_prefetch_job **jobs;
+	size_t jobs_nr, jobs_alloc;
+
+	struct oidset seen;
+	struct oidmap trees;
+	size_t cached_bytes;
+
+	/* sparse directories of the source index, which are not descended into */
+	struct strset sparse_dirs;
+
+	/*
+	 * For one-way merges, the tree IDs of the valid cache-tree entries
+	 * of the source index, which the traversal skips if they match.
+	 */
+	struct strmap cache_tree_dirs;
+
+	int nr_threads;
+	pthread_t *threads;
+
+	intmax_t nr_read, nr_hit;
+};
+
+static void get_tree_prefetch_workers(int *num_workers)
+{
+	char *env_workers = getenv("GIT_TEST_CHECKOUT_TREE_WORKERS");
+
+	if (env_workers && *env_workers) {
+		if (strtol_i(env_workers, 10, num_workers))
+			die(_("invalid value for '%s': '%s'"),
+			    "GIT_TEST_CHECKOUT_TREE_WORKERS", env_workers);
+	} else if (git_config_get_int("checkout.treeworkers", num_workers)) {
+		*num_workers = 1;
+		return;
+	}
+	if (*num_workers < 1)
+		*num_workers = online_cpus();
+}
+
+static void push_prefetch_job(struct tree_prefetch *tp,
+			      struct tree_prefetch_job *job)
+{
+	ALLOC_GROW(tp->jobs, tp->jobs_nr + 1, tp->jobs_alloc);
+	tp->jobs[tp->jobs_nr++] = job;
+}
+
+static void free_prefetch_job(struct tree_prefetch_job *job)
+{
+	free(job->path);
+	free(job);
+}
+
+struct prefetch_subtree {
+	const char *path;
+	struct tree_prefetch_job *job;
+};
+
+static int prefetch_subtree_cmp(const void *a_, const void *b_)
+{
+	const struct prefetch_subtree *a = a_, *b = b_;
+	return strcmp(a->path, b->path);
+}
+
+/*
+ * Queue the subdirectories found in "bufs" that are not identical in all
+ * trees; unchanged directories are either skipped by the traversal using
+ * the cache-tree, or read only once anyway. With a single tree, skip the
+ * directories that match the cache-tree instead.
+ */
+static void queue_prefetch_subtrees(struct tree_prefetch *tp,
+				    const char *parent_path,
+				    void **bufs, unsigned long *sizes)
+{
+	struct strmap subtrees = STRMAP_INIT;
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+	struct prefetch_subtree *sorted;
+	size_t nr = 0, alloc = 0;
+	struct strbuf path = STRBUF_INIT;
+	int i, j;
+
+	for (i = 0; i < tp->n; i++) {
+		struct tree_desc desc;
+		struct name_entry entry;
+
+		/*
+		 * A corrupt tree is not our problem; the traversal will
+		 * report it when it gets there.
+		 */
+		if (!bufs[i] ||
+		    init_tree_desc_gently(&desc, NULL, bufs[i], sizes[i], 0))
+			continue;
+		while (tree_entry_gently(&desc, &entry)) {
+			struct tree_prefetch_job *job;
+
+			if (!S_ISDIR(entry.mode))
+				continue;
+
+			strbuf_reset(&path);
+			strbuf_addstr(&path, parent_path);
+			strbuf_add(&path, entry.path, entry.pathlen);
+			strbuf_addch(&path, '/');
+
+			job = strmap_get(&subtrees, path.buf);
+			if (!job) {
+				CALLOC_ARRAY(job, 1);
+				job->path = xstrdup(path.buf);
+				strmap_put(&subtrees, path.buf, job);
+			}
+			oidcpy(&job->oid[i], &entry.oid);
+		}
+	}
+	strbuf_release(&path);
+
+	ALLOC_ARRAY(sorted, strmap_get_size(&subtrees));
+	strmap_for_each_entry(&subtrees, &iter, e) {
+		struct tree_prefetch_job *job = e->value;
+		int same = tp->n > 1;
+
+		for (j = 1; same && j < tp->n; j++)
+			if (is_null_oid(&job->oid[0]) ||
+			    !oideq(&job->oid[0], &job->oid[j]))
+				same = 0;
+		if (tp->n == 1) {
+			const struct object_id *oid =
+				strmap_get(&tp->cache_tree_dirs, job->path);
+			same = oid && oideq(oid, &job->oid[0]);
+		}
+		if (same || strset_contains(&tp->sparse_dirs, job->path)) {
+			free_prefetch_job(job);
+			continue;
+		}
+		ALLOC_GROW(sorted, nr + 1, alloc);
+		sorted[nr].path = job->path;
+		sorted[nr].job = job;
+		nr++;
+	}
+	strmap_clear(&subtrees, 0);
+
+	/*
+	 * Push in reverse order, so that the jobs are popped roughly in the
+	 * order in which the traversal is going to need them.
+	 */
+	QSORT(sorted, nr, prefetch_subtree_cmp);
+	pthread_mutex_lock(&tp->mutex);
+	while (nr)
+		push_prefetch_job(tp, sorted[--nr].job);
+	pthread_cond_broadcast(&tp->cond);
+	pthread_mutex_unlock(&tp->mutex);
+	free(sorted);
+}
+
+static void run_prefetch_job(struct tree_prefetch *tp,
+			     struct tree_prefetch_job *job)
+{
+	void *bufs[MAX_UNPACK_TREES] = { NULL };
+	unsigned long sizes[MAX_UNPACK_TREES] = { 0 };
+	int publish[MAX_UNPACK_TREES] = { 0 };
+	int i, j;
+
+	for (i = 0; i < tp->n; i++) {
+		const struct object_id *oid = &job->oid[i];
+		enum object_type type;
+		int seen;
+
+		if (is_null_oid(oid))
+			continue;
+		for (j = 0; j < i; j++)
+			if (oideq(oid, &job->oid[j]))
+				break;
+		if (j < i)
+			continue;
+
+		pthread_mutex_lock(&tp->mutex);
+		seen = oidset_insert(&tp->seen, oid);
+		pthread_mutex_unlock(&tp->mutex);
+
+		bufs[i] = repo_read_object_file(the_repository, oid, &type, &sizes[i]);
+		if (bufs[i] && type != OBJ_TREE)
+			FREE_AND_NULL(bufs[i]);
+		publish[i] = bufs[i] && !seen;
+	}
+
+	queue_prefetch_subtrees(tp, job->path, bufs, sizes);
+
+	pthread_mutex_lock(&tp->mutex);
+	for (i = 0; i < tp->n; i++) {
+		struct prefetched_tree *tree;
+
+		if (!publish[i]) {
+			free(bufs[i]);
+			continue;
+		}
+		CALLOC_ARRAY(tree, 1);
+		oidcpy(&tree->entry.oid, &job->oid[i]);
+		tree->buf = bufs[i];
+		tree->size = sizes[i];
+		oidmap_put(&tp->trees, tree);
+		tp->cached_bytes += sizes[i];
+		tp->nr_read++;
+	}
+	pthread_mutex_unlock(&tp->mutex);
+
+	free_prefetch_job(job);
+}
+
+static void *tree_prefetch_thread(void *data)
+{
+	struct tree_prefetch *tp = data;
+
+	pthread_mutex_lock(&tp->mutex);
+	while (1) {
+		struct tree_prefetch_job *job;
+
+		while (!tp->stop &&
+		       (!tp->jobs_nr ||
+			tp->cached_bytes > TREE_PREFETCH_MEMORY_LIMIT) &&
+		       (tp->jobs_nr || tp->active))
+			pthread_cond_wait(&tp->cond, &tp->mutex);
+		if (tp->stop || (!tp->jobs_nr && !tp->active))
+			break;
+
+		job = tp->jobs[--tp->jobs_nr];
+		tp->active++;
+		pthread_mutex_unlock(&tp->mutex);
+
+		run_prefetch_job(tp, job);
+
+		pthread_mutex_lock(&tp->mutex);
+		tp->active--;
+		if (!tp->active && !tp->jobs_nr)
+			pthread_cond_broadcast(&tp->cond);
+	}
+	pthread_mutex_unlock(&tp->mutex);
+	return NULL;
+}
+
+static void add_cache_tree_dirs(struct strmap *dirs, struct cache_tree *it,
+				struct strbuf *path)
+{
+	int i;
+
+	for (i = 0; i < it->subtree_nr; i++) {
+		struct cache_tree_sub *sub = it->down[i];
+		size_t len = path->len;
+
+		if (!sub->cache_tree)
+			continue;
+		strbuf_add(path, sub->name, sub->namelen);
+		strbuf_addch(path, '/');
+		/* the cache-tree is not changed until the traversal is done */
+		if (sub->cache_tree->entry_count >= 0)
+			strmap_put(dirs, path->buf, &sub->cache_tree->oid);
+		add_cache_tree_dirs(dirs, sub->cache_tree, path);
+		strbuf_setlen(path, len);
+	}
+}
+
+static void start_tree_prefetch(struct unpack_trees_options *o,
+				unsigned n, struct tree_desc *t)
+{
+	struct tree_prefetch *tp;
+	void *bufs[MAX_UNPACK_TREES];
+	unsigned long sizes[MAX_UNPACK_TREES];
+	int nr_threads, i, err;
+
+	if (!HAVE_THREADS || !n)
+		return;
+	get_tree_prefetch_workers(&nr_threads);
+	if (nr_threads < 2)
+		return;
+	/* lazy fetches from worker threads are not supported */
+	if (repo_has_promisor_remote(the_repository))
+		return;
+	/* we would only read trees that the traversal never asks for */
+	if (o->pathspec && o->pathspec->nr)
+		return;
+
+	CALLOC_ARRAY(tp, 1);
+	tp->n = n;
+	tp->nr_threads = nr_threads;
+	pthread_mutex_init(&tp->mutex, NULL);
+	pthread_cond_init(&tp->cond, NULL);
+	oidset_init(&tp->seen, 0);
+	oidmap_init(&tp->trees, 0);
+	strset_init(&tp->sparse_dirs);
+	if (o->src_index->sparse_index) {
+		for (i = 0; i < o->src_index->cache_nr; i++) {
+			struct cache_entry *ce = o->src_index->cache[i];
+			if (S_ISSPARSEDIR(ce->ce_mode))
+				strset_add(&tp->sparse_dirs, ce->name);
+		}
+	}
+	strmap_init(&tp->cache_tree_dirs);
+	if (n == 1 && o->merge && o->src_index->cache_tree) {
+		struct strbuf path = STRBUF_INIT;
+
+		add_cache_tree_dirs(&tp->cache_tree_dirs,
+				    o->src_index->cache_tree, &path);
+		strbuf_release(&path);
+	}
+
+	/*
+	 * The root trees have already been read by our caller, so seed the
+	 * queue with their subdirectories.
+	 */
+	for (i = 0; i < n; i++) {
+		bufs[i] = (void *)t[i].buffer;
+		sizes[i] = t[i].size;
+	}
+	queue_prefetch_subtrees(tp, o->prefix ? o->prefix : "", bufs, sizes);
+
+	if (!tp->jobs_nr) {
+		oidset_clear(&tp->seen);
+		oidmap_free(&tp->trees, 1);
+		strset_clear(&tp->sparse_dirs);
+		strmap_clear(&tp->cache_tree_dirs, 0);
+		pthread_mutex_destroy(&tp->mutex);
+		pthread_cond_destroy(&tp->cond);
+		free(tp);
+		return;
+	}
+
+	enable_obj_read_lock();
+	CALLOC_ARRAY(tp->threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		err = pthread_create(&tp->threads[i], NULL,
+				     tree_prefetch_thread, tp);
+		if (err)
+			die(_("unable to create tree prefetch thread: %s"),
+			    strerror(err));
+	}
+	o->internal.tree_prefetch = tp;
+}
+
+static void stop_tree_prefetch(struct unpack_trees_options *o)
+{
+	struct tree_prefetch *tp = o->internal.tree_prefetch;
+	struct oidmap_iter iter;
+	struct prefetched_tree *tree;
+	int i;
+
+	if (!tp)
+		return;
+
+	pthread_mutex_lock(&tp->mutex);
+	tp->stop = 1;
+	pthread_cond_broadcast(&tp->cond);
+	pthread_mutex_unlock(&tp->mutex);
+	for (i = 0; i < tp->nr_threads; i++)
+		if (pthread_join(tp->threads[i], NULL))
+			die(_("unable to join tree prefetch thread"));
+	disable_obj_read_lock();
+
+	trace2_data_intmax("unpack_trees", the_repository,
+			   "prefetch/trees_read", tp->nr_read);
+	trace2_data_intmax("unpack_trees", the_repository,
+			   "prefetch/trees_used", tp->nr_hit);
+
+	while (tp->jobs_nr)
+		free_prefetch_job(tp->jobs[--tp->jobs_nr]);
+	free(tp->jobs);
+	for (tree = oidmap_iter_first(&tp->trees, &iter); tree;
+	     tree = oidmap_iter_next(&iter))
+		free(tree->buf);
+	oidmap_free(&tp->trees, 1);
+	oidset_clear(&tp->seen);
+	strset_clear(&tp->sparse_dirs);
+	strmap_clear(&tp->cache_tree_dirs, 0);
+	pthread_mutex_destroy(&tp->mutex);
+	pthread_cond_destroy(&tp->cond);
+	free(tp->threads);
+	free(tp);
+	o->internal.tree_prefetch = NULL;
+}
+
+/*
+ * Like fill_tree_descriptor(), but take the tree from the prefetched ones
+ * if it is there. The returned buffer is owned by the caller either way.
+ */
+static void *fill_tree_descriptor_prefetched(struct unpack_trees_options *o,
+					     struct tree_desc *desc,
+					     const struct object_id *oid)
+{
+	struct tree_prefetch *tp = o->internal.tree_prefetch;
+
+	if (tp && oid) {
+		struct prefetched_tree *tree;
+
+		pthread_mutex_lock(&tp->mutex);
+		tree = oidmap_remove(&tp->trees, oid);
+		if (tree) {
+			tp->cached_bytes -= tree->size;
+			tp->nr_hit++;
+			pthread_cond_broadcast(&tp->cond);
+		}
+		pthread_mutex_unlock(&tp->mutex);
+
+		if (tree) {
+			void *buf = tree->buf;
+
+			init_tree_desc(desc, oid, buf, tree->size);
+			free(tree);
+			return buf;
+		}
+	}
+	return fill_tree_descriptor(the_repository, desc, oid);
+}
+
 static int traverse_trees_recursive(int n, unsigned long dirmask,
 				    unsigned long df_conflicts,
 				    struct name_entry *names,
@@ -935,7 +1374,7 @@ static int traverse_trees_recursive(int n, unsigned long dirmask,
 			const struct object_id *oid = NULL;
 			if (dirmask & 1)
 				oid = &names[i].oid;
-			buf[nr_buf++] = fill_tree_descriptor(the_repository, t + i, oid);
+			buf[nr_buf++] = fill_tree_descriptor_prefetched(o, t + i, oid);
 		}
 	}
 
@@ -2004,7 +2443,9 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 
 		trace_performance_enter();
 		trace2_region_enter("unpack_trees", "traverse_trees", the_repository);
+		start_tree_prefetch(o, len, t);
 		ret = traverse_trees(o->src_index, len, t, &info);
+		stop_tree_prefetch(o);
 		trace2_region_leave("unpack_trees", "traverse_trees", the_repository);
 		trace_performance_leave("traverse_trees");
 		if (ret < 0)
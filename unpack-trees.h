@@ -11,6 +11,7 @@
 
 struct cache_entry;
 struct unpack_trees_options;
+struct tree_prefetch;
 struct pattern_list;
 
 typedef int (*merge_fn_t)(const struct cache_entry * const *src,
@@ -107,6 +108,7 @@ struct unpack_trees_options {
 
 		struct pattern_list *pl;
 		struct dir_struct *dir;
+		struct tree_prefetch *tree_prefetch;
 	} internal;
 };
 
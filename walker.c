@@ -116,8 +116,92 @@ static int process_tag(struct walker *walker, struct tag *tag)
 	return process(walker, tag->tagged);
 }
 
-static struct object_list *process_queue = NULL;
-static struct object_list **process_queue_end = &process_queue;
+/*
+ * Objects are queued by what they may lead to: commits (and tags) name
+ * trees and more commits, trees name blobs, and blobs name nothing.
+ * Scanning the objects in that order keeps a walker that fetches many
+ * objects at once busy with requests for objects we know we need.
+ */
+enum process_queue_id {
+	QUEUE_COMMITS,
+	QUEUE_TREES,
+	QUEUE_BLOBS,
+	NR_QUEUES
+};
+
+static struct process_queue {
+	struct object_list *head;
+	struct object_list **tail;
+} process_queues[NR_QUEUES];
+
+static enum process_queue_id queue_for(struct object *obj)
+{
+	switch (obj->type) {
+	case OBJ_TREE:
+		return QUEUE_TREES;
+	case OBJ_BLOB:
+		return QUEUE_BLOBS;
+	default:
+		return QUEUE_COMMITS;
+	}
+}
+
+static void queue_object(struct object *obj)
+{
+	struct process_queue *queue = &process_queues[queue_for(obj)];
+
+	if (!queue->tail)
+		queue->tail = &queue->head;
+	object_list_insert(obj, queue->tail);
+	queue->tail = &(*queue->tail)->next;
+}
+
+static struct object *dequeue_object(struct process_queue *queue)
+{
+	struct object_list *elem = queue->head;
+	struct object *obj = elem->item;
+
+	queue->head = elem->next;
+	if (!queue->head)
+		queue->tail = &queue->head;
+	free(elem);
+	return obj;
+}
+
+static int object_ready(struct walker *walker, struct object *obj)
+{
+	return (obj->flags & TO_SCAN) ||
+		(walker->fetch_ready && walker->fetch_ready(walker, &obj->oid));
+}
+
+/*
+ * Pick the next object to scan: the first one (by queue priority)
+ * that we have or that the walker has already fetched, waiting for
+ * the walker as long as it has requests in flight. Returns NULL when
+ * all queues are empty.
+ */
+static struct object *next_object(struct walker *walker)
+{
+	for (;;) {
+		struct process_queue *first = NULL;
+		int i;
+
+		for (i = 0; i < NR_QUEUES; i++) {
+			struct process_queue *queue = &process_queues[i];
+
+			if (!queue->head)
+				continue;
+			if (!first)
+				first = queue;
+			if (object_ready(walker, queue->head->item))
+				return dequeue_object(queue);
+		}
+		if (!first)
+			return NULL;
+		if (!walker->wait || walker->wait(walker) < 0)
+			return dequeue_object(first);
+	}
+}
 
 static int process_object(struct walker *walker, struct object *obj)
 {
@@ -157,31 +241,23 @@ static int process(struct walker *walker, struct object *obj)
 	else {
 		if (obj->flags & COMPLETE)
 			return 0;
-		walker->prefetch(walker, &obj->oid);
+		walker->prefetch(walker, &obj->oid, obj->type);
 	}
 
-	object_list_insert(obj, process_queue_end);
-	process_queue_end = &(*process_queue_end)->next;
+	queue_object(obj);
 	return 0;
 }
 
 static int loop(struct walker *walker)
 {
-	struct object_list *elem;
+	struct object *obj;
 	struct progress *progress = NULL;
 	uint64_t nr = 0;
 
 	if (walker->get_progress)
 		progress = start_delayed_progress(_("Fetching objects"), 0);
 
-	while (process_queue) {
-		struct object *obj = process_queue->item;
-		elem = process_queue;
-		process_queue = elem->next;
-		free(elem);
-		if (!process_queue)
-			process_queue_end = &process_queue;
-
+	while ((obj = next_object(walker))) {
 		/* If we are not scanning this object, we placed it in
 		 * the queue because we needed to fetch it first.
 		 */
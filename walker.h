@@ -6,8 +6,17 @@
 struct walker {
 	void *data;
 	int (*fetch_ref)(struct walker *, struct ref *ref);
-	void (*prefetch)(struct walker *, const struct object_id *oid);
+	void (*prefetch)(struct walker *, const struct object_id *oid,
+			 enum object_type type);
 	int (*fetch)(struct walker *, const struct object_id *oid);
+	/*
+	 * Optional: a walker that fetches several objects at once can
+	 * tell whether fetch() would return without waiting for "oid",
+	 * and wait until any of its requests finishes. wait() returns -1
+	 * if there is nothing to wait for.
+	 */
+	int (*fetch_ready)(struct walker *, const struct object_id *oid);
+	int (*wait)(struct walker *);
 	void (*cleanup)(struct walker *);
 	int get_verbosely;
 	int get_progress;
@@ -34,6 +34,11 @@
 #define XDL_ADDBITS(v,b)	((v) + ((v) >> (b)))
 #define XDL_MASKBITS(b)		((1UL << (b)) - 1)
 #define XDL_HASHLONG(v,b)	(XDL_ADDBITS((unsigned long)(v), b) & XDL_MASKBITS(b))
+#if defined(__GNUC__)
+#define XDL_PREFETCH(p)		__builtin_prefetch(p)
+#else
+#define XDL_PREFETCH(p)		((void)(p))
+#endif
 #define XDL_LE32_PUT(p, v) \
 do { \
 	unsigned char *__p = (unsigned char *) (p); \
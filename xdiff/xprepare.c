@@ -28,23 +28,27 @@
 #define XDL_SIMSCAN_WINDOW 100
 #define XDL_GUESS_NLINES1 256
 #define XDL_GUESS_NLINES2 20
+#define XDL_CLASSIFY_AHEAD 8
 
 
 typedef struct s_xdlclass {
-	struct s_xdlclass *next;
 	unsigned long ha;
 	char const *line;
 	long size;
-	long idx;
 	long len1, len2;
 } xdlclass_t;
 
+/*
+ * Classes live in one contiguous array, indexed by class number.  The
+ * hash table is open-addressed with linear probing and stores class
+ * number + 1, so that zero marks an empty slot; it is kept at most half
+ * full.
+ */
 typedef struct s_xdlclassifier {
 	unsigned int hbits;
 	long hsize;
-	xdlclass_t **rchash;
-	chastore_t ncha;
-	xdlclass_t **rcrecs;
+	long *rchash;
+	xdlclass_t *rcrecs;
 	long alloc;
 	long count;
 	long flags;
@@ -74,13 +78,8 @@ static int xdl_init_classifier(xdlclassifier_t *cf, long size, long flags) {
 	cf->hbits = xdl_hashbits((unsigned int) size);
 	cf->hsize = 1 << cf->hbits;
 
-	if (xdl_cha_init(&cf->ncha, sizeof(xdlclass_t), size / 4 + 1) < 0) {
-
-		return -1;
-	}
 	if (!XDL_CALLOC_ARRAY(cf->rchash, cf->hsize)) {
 
-		xdl_cha_free(&cf->ncha);
 		return -1;
 	}
 
@@ -88,7 +87,6 @@ static int xdl_init_classifier(xdlclassifier_t *cf, long size, long flags) {
 	if (!XDL_ALLOC_ARRAY(cf->rcrecs, cf->alloc)) {
 
 		xdl_free(cf->rchash);
-		xdl_cha_free(&cf->ncha);
 		return -1;
 	}
 
@@ -102,44 +100,62 @@ static void xdl_free_classifier(xdlclassifier_t *cf) {
 
 	xdl_free(cf->rcrecs);
 	xdl_free(cf->rchash);
-	xdl_cha_free(&cf->ncha);
+}
+
+
+static int xdl_grow_classifier(xdlclassifier_t *cf) {
+	long i, hi, *rchash;
+	unsigned int hbits = cf->hbits + 1;
+	long hsize = 1L << hbits;
+
+	if (!XDL_CALLOC_ARRAY(rchash, hsize))
+		return -1;
+	for (i = 0; i < cf->count; i++) {
+		hi = (long) XDL_HASHLONG(cf->rcrecs[i].ha, hbits);
+		while (rchash[hi])
+			hi = (hi + 1) & (hsize - 1);
+		rchash[hi] = i + 1;
+	}
+	xdl_free(cf->rchash);
+	cf->rchash = rchash;
+	cf->hbits = hbits;
+	cf->hsize = hsize;
+
+	return 0;
 }
 
 
 static int xdl_classify_record(unsigned int pass, xdlclassifier_t *cf, xrecord_t **rhash,
 			       unsigned int hbits, xrecord_t *rec) {
-	long hi;
-	char const *line;
+	long hi, idx;
 	xdlclass_t *rcrec;
 
-	line = rec->ptr;
 	hi = (long) XDL_HASHLONG(rec->ha, cf->hbits);
-	for (rcrec = cf->rchash[hi]; rcrec; rcrec = rcrec->next)
+	for (; (idx = cf->rchash[hi]); hi = (hi + 1) & (cf->hsize - 1)) {
+		rcrec = &cf->rcrecs[idx - 1];
 		if (rcrec->ha == rec->ha &&
 				xdl_recmatch(rcrec->line, rcrec->size,
 					rec->ptr, rec->size, cf->flags))
 			break;
+	}
 
-	if (!rcrec) {
-		if (!(rcrec = xdl_cha_alloc(&cf->ncha))) {
-
-			return -1;
-		}
-		rcrec->idx = cf->count++;
+	if (!idx) {
+		idx = ++cf->count;
 		if (XDL_ALLOC_GROW(cf->rcrecs, cf->count, cf->alloc))
 				return -1;
-		cf->rcrecs[rcrec->idx] = rcrec;
-		rcrec->line = line;
+		rcrec = &cf->rcrecs[idx - 1];
+		rcrec->line = rec->ptr;
 		rcrec->size = rec->size;
 		rcrec->ha = rec->ha;
 		rcrec->len1 = rcrec->len2 = 0;
-		rcrec->next = cf->rchash[hi];
-		cf->rchash[hi] = rcrec;
+		cf->rchash[hi] = idx;
+		if (cf->count * 2 > cf->hsize && xdl_grow_classifier(cf) < 0)
+			return -1;
 	}
 
 	(pass == 1) ? rcrec->len1++ : rcrec->len2++;
 
-	rec->ha = (unsigned long) rcrec->idx;
+	rec->ha = (unsigned long) (idx - 1);
 
 	hi = (long) XDL_HASHLONG(rec->ha, hbits);
 	rec->next = rhash[hi];
@@ -152,7 +168,7 @@ static int xdl_classify_record(unsigned int pass, xdlclassifier_t *cf, xrecord_t
 static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_t const *xpp,
 			   xdlclassifier_t *cf, xdfile_t *xdf) {
 	unsigned int hbits;
-	long nrec, hsize, bsize;
+	long i, nrec, hsize, bsize;
 	unsigned long hav;
 	char const *blk, *cur, *top, *prev;
 	xrecord_t *crec;
@@ -191,11 +207,23 @@ static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_
 			crec->size = (long) (cur - prev);
 			crec->ha = hav;
 			recs[nrec++] = crec;
-			if (xdl_classify_record(pass, cf, rhash, hbits, crec) < 0)
-				goto abort;
 		}
 	}
 
+	/*
+	 * Classify in a second pass, so that the classifier slot of a
+	 * record a few lines ahead can be prefetched; on large inputs the
+	 * table is much bigger than the cache and each lookup would
+	 * otherwise stall on memory.
+	 */
+	for (i = 0; i < nrec; i++) {
+		if (i + XDL_CLASSIFY_AHEAD < nrec)
+			XDL_PREFETCH(&cf->rchash[XDL_HASHLONG(recs[i + XDL_CLASSIFY_AHEAD]->ha,
+							      cf->hbits)]);
+		if (xdl_classify_record(pass, cf, rhash, hbits, recs[i]) < 0)
+			goto abort;
+	}
+
 	if (!XDL_CALLOC_ARRAY(rchg, nrec + 2))
 		goto abort;
 
@@ -377,16 +405,16 @@ static int xdl_cleanup_records(xdlclassifier_t *cf, xdfile_t *xdf1, xdfile_t *xd
 	if ((mlim = xdl_bogosqrt(xdf1->nrec)) > XDL_MAX_EQLIMIT)
 		mlim = XDL_MAX_EQLIMIT;
 	for (i = xdf1->dstart, recs = &xdf1->recs[xdf1->dstart]; i <= xdf1->dend; i++, recs++) {
-		rcrec = cf->rcrecs[(*recs)->ha];
-		nm = rcrec ? rcrec->len2 : 0;
+		rcrec = &cf->rcrecs[(*recs)->ha];
+		nm = rcrec->len2;
 		dis1[i] = (nm == 0) ? 0: (nm >= mlim) ? 2: 1;
 	}
 
 	if ((mlim = xdl_bogosqrt(xdf2->nrec)) > XDL_MAX_EQLIMIT)
 		mlim = XDL_MAX_EQLIMIT;
 	for (i = xdf2->dstart, recs = &xdf2->recs[xdf2->dstart]; i <= xdf2->dend; i++, recs++) {
-		rcrec = cf->rcrecs[(*recs)->ha];
-		nm = rcrec ? rcrec->len1 : 0;
+		rcrec = &cf->rcrecs[(*recs)->ha];
+		nm = rcrec->len1;
 		dis2[i] = (nm == 0) ? 0: (nm >= mlim) ? 2: 1;
 	}
 
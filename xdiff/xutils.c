@@ -253,16 +253,9 @@ static unsigned long xdl_hash_record_with_whitespace(char const **data,
 		char const *top, long flags) {
 	unsigned long ha = 5381;
 	char const *ptr = *data;
-	int cr_at_eol_only = (flags & XDF_WHITESPACE_FLAGS) == XDF_IGNORE_CR_AT_EOL;
 
 	for (; ptr < top && *ptr != '\n'; ptr++) {
-		if (cr_at_eol_only) {
-			/* do not ignore CR at the end of an incomplete line */
-			if (*ptr == '\r' &&
-			    (ptr + 1 < top && ptr[1] == '\n'))
-				continue;
-		}
-		else if (XDL_ISSPACE(*ptr)) {
+		if (XDL_ISSPACE(*ptr)) {
 			const char *ptr2 = ptr;
 			int at_eol;
 			while (ptr + 1 < top && XDL_ISSPACE(ptr[1])
@@ -294,20 +287,53 @@ static unsigned long xdl_hash_record_with_whitespace(char const **data,
 	return ha;
 }
 
+/*
+ * Hash a line eight bytes at a time.  The value is only ever compared
+ * against other values computed by this function, so the result does
+ * not need to be stable across platforms, only within one process.
+ */
+static unsigned long xdl_hash_bytes(char const *ptr, size_t len) {
+	const uint64_t k = 0x9e3779b97f4a7c15ULL;
+	uint64_t ha = 5381 ^ (len * k);
+	uint64_t w;
+
+	for (; len >= sizeof(w); ptr += sizeof(w), len -= sizeof(w)) {
+		memcpy(&w, ptr, sizeof(w));
+		ha = (ha ^ w) * k;
+		ha ^= ha >> 32;
+	}
+	if (len) {
+		w = 0;
+		memcpy(&w, ptr, len);
+		ha = (ha ^ w) * k;
+	}
+	ha ^= ha >> 29;
+
+	return (unsigned long) ha;
+}
+
 unsigned long xdl_hash_record(char const **data, char const *top, long flags) {
-	unsigned long ha = 5381;
 	char const *ptr = *data;
+	char const *eol;
+	size_t len;
 
-	if (flags & XDF_WHITESPACE_FLAGS)
+	if ((flags & XDF_WHITESPACE_FLAGS) &&
+	    (flags & XDF_WHITESPACE_FLAGS) != XDF_IGNORE_CR_AT_EOL)
 		return xdl_hash_record_with_whitespace(data, top, flags);
 
-	for (; ptr < top && *ptr != '\n'; ptr++) {
-		ha += (ha << 5);
-		ha ^= (unsigned long) *ptr;
+	/* memchr() is vectorized in every libc we care about */
+	eol = memchr(ptr, '\n', top - ptr);
+	if (!eol) {
+		*data = top;
+		return xdl_hash_bytes(ptr, top - ptr);
 	}
-	*data = ptr < top ? ptr + 1: ptr;
+	*data = eol + 1;
+	len = eol - ptr;
+	/* do not ignore CR at the end of an incomplete line */
+	if ((flags & XDF_IGNORE_CR_AT_EOL) && len && ptr[len - 1] == '\r')
+		len--;
 
-	return ha;
+	return xdl_hash_bytes(ptr, len);
 }
 
 unsigned int xdl_hashbits(unsigned int size) {